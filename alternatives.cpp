@@ -0,0 +1,59 @@
+#include "alternatives.h"
+#include "cpu.h"
+#include "klog.h"
+
+// Bounds of the kernel_alternatives section, defined by the linker
+extern const Alternative __start_kernel_alternatives[];
+extern const Alternative __stop_kernel_alternatives[];
+
+static u32 g_features = 0;
+
+static const char* const feature_names[CPU_FEATURE_COUNT] = { "erms", "sse4.2" };
+
+void cpu_features_detect() {
+    u32 max_leaf, ebx, ecx, edx;
+    cpuid(0, &max_leaf, &ebx, &ecx, &edx);
+
+    u32 eax;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (ecx & CPUID_ECX_SSE42) g_features |= 1u << CPU_FEATURE_SSE42;
+
+    if (max_leaf >= 7) {
+        cpuid(7, &eax, &ebx, &ecx, &edx);
+        if (ebx & CPUID_7_EBX_ERMS) g_features |= 1u << CPU_FEATURE_ERMS;
+    }
+}
+
+bool cpu_has_feature(u8 feature) {
+    return feature < CPU_FEATURE_COUNT && (g_features & (1u << feature));
+}
+
+const char* cpu_feature_name(u8 feature) {
+    return feature < CPU_FEATURE_COUNT ? feature_names[feature] : "?";
+}
+
+// jmp rel32 over the first five bytes of the function
+static void patch_jump(void* target, void* replacement) {
+    u8* site = (u8*)target;
+    u32 rel = (u32)replacement - ((u32)site + 5);
+    site[0] = 0xE9;
+    site[1] = (u8)rel;
+    site[2] = (u8)(rel >> 8);
+    site[3] = (u8)(rel >> 16);
+    site[4] = (u8)(rel >> 24);
+}
+
+u32 alternatives_apply() {
+    u32 patched = 0;
+    for (const Alternative* alt = __start_kernel_alternatives; alt < __stop_kernel_alternatives; alt++) {
+        if (!cpu_has_feature(alt->feature)) continue;
+        patch_jump(alt->target, alt->replacement);
+        klogf(KLOG_INFO, "alternatives: %s", alt->name);
+        patched++;
+    }
+
+    // Serialize so this CPU doesn't run stale prefetched bytes
+    u32 eax, ebx, ecx, edx;
+    cpuid(0, &eax, &ebx, &ecx, &edx);
+    return patched;
+}
@@ -0,0 +1,48 @@
+#ifndef ALTERNATIVES_H
+#define ALTERNATIVES_H
+
+#include "memory.h"
+
+// Boot-time code patching. A hot function with a faster variant for some
+// CPUs registers it with ALTERNATIVE(); the entry lands in the
+// kernel_alternatives section. After CPUID detection, alternatives_apply()
+// overwrites the start of every function whose feature is present with a
+// direct jmp to the variant. Callers keep their plain direct calls, the
+// compiler-emitted memcpy/memset ones included, and pay one predicted
+// jump instead of loading a function pointer on every call.
+//
+// Patching runs on the boot CPU before the APs start, so no other CPU can
+// be executing the bytes being rewritten.
+
+enum CpuFeature : u8 {
+    CPU_FEATURE_ERMS,   // fast rep movsb/stosb (leaf 7 EBX bit 9)
+    CPU_FEATURE_SSE42,  // crc32 instruction (leaf 1 ECX bit 20)
+    CPU_FEATURE_COUNT
+};
+
+struct Alternative {
+    const char* name;   // "target -> replacement", for dmesg
+    void* target;       // entry is overwritten with jmp replacement
+    void* replacement;
+    u8 feature;
+    u8 reserved[3];
+};
+
+// A patched function must keep its own out-of-line body: inlined or
+// cloned copies would never see the jump
+#define ALTERNATIVE_TARGET __attribute__((noinline, noclone))
+
+#define ALTERNATIVE(target, replacement, feature)                                   \
+    static const Alternative alternative_##replacement                              \
+        __attribute__((used, section("kernel_alternatives"), aligned(4))) =        \
+        { #target " -> " #replacement, (void*)target, (void*)replacement, feature, { 0, 0, 0 } }
+
+void cpu_features_detect();
+bool cpu_has_feature(u8 feature);
+const char* cpu_feature_name(u8 feature);
+
+// Patch every registered function whose feature is present; returns
+// how many were patched. Call once, after cpu_features_detect().
+u32 alternatives_apply();
+
+#endif
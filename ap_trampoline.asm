@@ -0,0 +1,60 @@
+; Application processor startup trampoline.
+; smp.cpp copies this blob to AP_TRAMPOLINE_ADDR and points the SIPI at it;
+; the AP wakes in real mode at <page>:0000, switches to protected mode with
+; a temporary GDT and calls ap_main(cpu_index) on the stack the BSP left in
+; the parameter block below.
+section .text
+[bits 16]
+
+AP_TRAMPOLINE_ADDR equ 0x8000
+%define TRAMP(label) (AP_TRAMPOLINE_ADDR + ((label) - ap_trampoline_start))
+
+global ap_trampoline_start
+global ap_trampoline_end
+global ap_trampoline_stack
+global ap_trampoline_cpu
+global ap_trampoline_entry
+
+ap_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [TRAMP(tramp_gdt_descriptor)]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:TRAMP(tramp_protected_mode)
+
+[bits 32]
+tramp_protected_mode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov esp, [TRAMP(ap_trampoline_stack)]
+    push dword [TRAMP(ap_trampoline_cpu)]
+    mov eax, [TRAMP(ap_trampoline_entry)]
+    call eax
+.hang:
+    hlt
+    jmp .hang
+
+align 8
+tramp_gdt:
+    dq 0x0000000000000000
+    dq 0x00CF9A000000FFFF   ; flat code
+    dq 0x00CF92000000FFFF   ; flat data
+tramp_gdt_descriptor:
+    dw tramp_gdt_descriptor - tramp_gdt - 1
+    dd TRAMP(tramp_gdt)
+
+; Parameter block, written by the BSP before each SIPI
+align 4
+ap_trampoline_stack: dd 0
+ap_trampoline_cpu:   dd 0
+ap_trampoline_entry: dd 0
+ap_trampoline_end:
@@ -0,0 +1,130 @@
+#include "apic.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "smp.h"
+#include "process.h"
+#include "timer.h"
+
+static volatile u32* lapic = (volatile u32*)LAPIC_DEFAULT_BASE;
+static u32 timer_initial_count = 0;  // calibrated once on the BSP
+
+static inline u32 lapic_read(u32 reg) {
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(u32 reg, u32 value) {
+    lapic[reg / 4] = value;
+    (void)lapic[LAPIC_ID / 4];  // serialize the posted write
+}
+
+static void apic_timer_interrupt(InterruptFrame* frame) {
+    (void)frame;
+    this_cpu()->ticks++;
+    process_tick();
+}
+
+static void apic_wakeup_interrupt(InterruptFrame* frame) {
+    // Nothing to do: the interrupt itself ends the target's hlt
+    (void)frame;
+    this_cpu()->ipis_received++;
+}
+
+bool apic_available() {
+    u32 eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (edx & CPUID_EDX_APIC) && (edx & CPUID_EDX_MSR);
+}
+
+void apic_set_base(u32 phys) {
+    lapic = (volatile u32*)phys;
+}
+
+void apic_initialize(bool bsp) {
+    // Globally enable via the APIC base MSR, keeping the BSP flag
+    u64 base = rdmsr(MSR_APIC_BASE);
+    wrmsr(MSR_APIC_BASE, base | (1 << 11));
+
+    lapic_write(LAPIC_TPR, 0);
+    lapic_write(LAPIC_LVT_ERROR, 0x10000);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+
+    // Legacy PIC interrupts arrive on the BSP's LINT0 (virtual wire mode)
+    lapic_write(LAPIC_LVT_LINT0, bsp ? 0x700 : 0x10000);
+    lapic_write(LAPIC_LVT_LINT1, bsp ? 0x400 : 0x10000);
+
+    // Software enable + spurious vector
+    lapic_write(LAPIC_SVR, 0x100 | VECTOR_APIC_SPURIOUS);
+    lapic_write(LAPIC_EOI, 0);
+
+    if (bsp) {
+        register_interrupt_handler(VECTOR_APIC_TIMER, apic_timer_interrupt);
+        register_interrupt_handler(VECTOR_IPI_WAKEUP, apic_wakeup_interrupt);
+    }
+}
+
+void apic_timer_start() {
+    lapic_write(LAPIC_TIMER_DIV, 0x3);  // divide by 16
+
+    if (timer_initial_count == 0) {
+        // Count down from the maximum for 10ms against the PIT
+        lapic_write(LAPIC_LVT_TIMER, 0x10000);
+        lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+        pit_wait_us(10000);
+        u32 elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_COUNT);
+        lapic_write(LAPIC_TIMER_INIT, 0);
+        timer_initial_count = elapsed * 100 / TIMER_HZ;
+        if (timer_initial_count == 0) timer_initial_count = 1;
+    }
+
+    lapic_write(LAPIC_LVT_TIMER, VECTOR_APIC_TIMER | 0x20000);  // periodic
+    lapic_write(LAPIC_TIMER_INIT, timer_initial_count);
+}
+
+u32 apic_id() {
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void apic_eoi() {
+    lapic[LAPIC_EOI / 4] = 0;
+}
+
+static void apic_wait_icr() {
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) cpu_pause();
+}
+
+void apic_send_ipi(u32 target_apic_id, u8 vector) {
+    u32 flags = irq_save();
+    apic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, target_apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, ICR_ASSERT | vector);
+    apic_wait_icr();
+    irq_restore(flags);
+}
+
+void apic_send_ipi_all_but_self(u8 vector) {
+    u32 flags = irq_save();
+    apic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, 0);
+    lapic_write(LAPIC_ICR_LOW, ICR_ALL_BUT_SELF | ICR_ASSERT | vector);
+    apic_wait_icr();
+    irq_restore(flags);
+}
+
+void apic_send_init(u32 target_apic_id) {
+    apic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, target_apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    apic_wait_icr();
+    udelay(200);
+    lapic_write(LAPIC_ICR_HIGH, target_apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, ICR_INIT | ICR_LEVEL);  // de-assert
+    apic_wait_icr();
+}
+
+void apic_send_startup(u32 target_apic_id, u8 page) {
+    apic_wait_icr();
+    lapic_write(LAPIC_ICR_HIGH, target_apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, ICR_STARTUP | page);
+    apic_wait_icr();
+}
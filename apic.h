@@ -0,0 +1,45 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "memory.h"
+
+#define LAPIC_DEFAULT_BASE 0xFEE00000
+
+// Local APIC register offsets
+#define LAPIC_ID          0x020
+#define LAPIC_VERSION     0x030
+#define LAPIC_TPR         0x080
+#define LAPIC_EOI         0x0B0
+#define LAPIC_SVR         0x0F0
+#define LAPIC_ESR         0x280
+#define LAPIC_ICR_LOW     0x300
+#define LAPIC_ICR_HIGH    0x310
+#define LAPIC_LVT_TIMER   0x320
+#define LAPIC_LVT_LINT0   0x350
+#define LAPIC_LVT_LINT1   0x360
+#define LAPIC_LVT_ERROR   0x370
+#define LAPIC_TIMER_INIT  0x380
+#define LAPIC_TIMER_COUNT 0x390
+#define LAPIC_TIMER_DIV   0x3E0
+
+// ICR delivery modes / flags
+#define ICR_INIT          0x00000500
+#define ICR_STARTUP       0x00000600
+#define ICR_PENDING       0x00001000
+#define ICR_ASSERT        0x00004000
+#define ICR_LEVEL         0x00008000
+#define ICR_ALL_BUT_SELF  0x000C0000
+
+bool apic_available();
+void apic_set_base(u32 phys);
+void apic_initialize(bool bsp);     // enable local APIC on the calling CPU
+void apic_timer_start();            // periodic tick at TIMER_HZ
+u32 apic_id();
+void apic_eoi();
+
+void apic_send_ipi(u32 target_apic_id, u8 vector);
+void apic_send_ipi_all_but_self(u8 vector);
+void apic_send_init(u32 target_apic_id);
+void apic_send_startup(u32 target_apic_id, u8 page);
+
+#endif
@@ -0,0 +1,260 @@
+#include "bench.h"
+#include "cpu.h"
+#include "timer.h"
+#include "rcu.h"
+#include "fs_ramdisk.h"
+#include "socket.h"
+
+static u32 g_overhead = 0;  // median cycles of timing an empty call
+static bool g_calibrated = false;
+
+static void bench_nothing(void*) {}
+
+static u32 time_once(const BenchCase* bc) {
+    if (bc->setup) bc->setup(bc->arg);
+    u32 flags = irq_save();
+    u64 start = rdtsc();
+    bc->run(bc->arg);
+    u64 end = rdtsc();
+    irq_restore(flags);
+    return (u32)(end - start);
+}
+
+// Insertion sort: a few hundred samples, already close to sorted
+static void sort_samples(u32* samples, u32 count) {
+    for (u32 i = 1; i < count; i++) {
+        u32 v = samples[i];
+        u32 j = i;
+        while (j > 0 && samples[j - 1] > v) {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = v;
+    }
+}
+
+static bool measure_raw(const BenchCase* bc, u32 warmup, u32 iterations, BenchResult* out) {
+    if (iterations == 0) return false;
+    u32* samples = (u32*)kmalloc(iterations * sizeof(u32));
+    if (!samples) return false;
+
+    for (u32 i = 0; i < warmup; i++) time_once(bc);
+    for (u32 i = 0; i < iterations; i++) samples[i] = time_once(bc);
+    sort_samples(samples, iterations);
+
+    u32 p99 = iterations * 99 / 100;
+    if (p99 >= iterations) p99 = iterations - 1;
+    out->min = samples[0];
+    out->median = samples[iterations / 2];
+    out->p99 = samples[p99];
+    kfree(samples);
+    return true;
+}
+
+static u32 minus_overhead(u32 cycles) {
+    return cycles > g_overhead ? cycles - g_overhead : 0;
+}
+
+bool bench_measure(const BenchCase* bc, u32 warmup, u32 iterations, BenchResult* out) {
+    if (!g_calibrated) {
+        BenchCase empty = { "", "", nullptr, bench_nothing, nullptr };
+        BenchResult base;
+        if (!measure_raw(&empty, BENCH_WARMUP, BENCH_ITERATIONS, &base)) return false;
+        g_overhead = base.median;
+        g_calibrated = true;
+    }
+
+    if (!measure_raw(bc, warmup, iterations, out)) return false;
+    out->min = minus_overhead(out->min);
+    out->median = minus_overhead(out->median);
+    out->p99 = minus_overhead(out->p99);
+    out->median_ns = (u32)tsc_to_ns(out->median);
+    out->p99_ns = (u32)tsc_to_ns(out->p99);
+    return true;
+}
+
+// ---- report lines ----
+
+struct LineBuilder {
+    char* out;
+    u32 size;
+    u32 len;
+};
+
+static void append(LineBuilder* lb, const char* text) {
+    while (*text && lb->len + 1 < lb->size) lb->out[lb->len++] = *text++;
+    lb->out[lb->len] = 0;
+}
+
+static void append_num(LineBuilder* lb, u32 value, const char* unit) {
+    char num[12];
+    itoa(num, (int)value, 10);
+    append(lb, num);
+    append(lb, unit);
+}
+
+u32 bench_format(const BenchCase* bc, const BenchResult* result, char* out, u32 size) {
+    LineBuilder lb = { out, size, 0 };
+    if (size) out[0] = 0;
+    append(&lb, bc->name);
+    append(&lb, ": ");
+    append_num(&lb, result->median, "c ");
+    append_num(&lb, result->median_ns, "ns p99 ");
+    append_num(&lb, result->p99, "c ");
+    append_num(&lb, result->p99_ns, "ns");
+    return lb.len;
+}
+
+// ---- kernel cases ----
+
+#define BENCH_MEM_SIZE 4096
+#define BENCH_FS_MAX (64 * 1024)
+#define BENCH_FS_NAME "bench.tmp"
+
+static u8* g_mem_buffer = nullptr;  // 2 * BENCH_MEM_SIZE: source, destination
+static u8* g_fs_buffer = nullptr;   // file contents, written and read back
+
+// Loopback pairs: a UDP sender and receiver, a connected TCP client and
+// server (the listener closes once it has accepted)
+#define BENCH_NET_PORT 9000
+#define BENCH_NET_MAX 1024
+static bool g_net_ready = false;
+static s32 g_udp_tx, g_udp_rx, g_tcp_client, g_tcp_server;
+
+static u8* mem_buffer() {
+    if (!g_mem_buffer) g_mem_buffer = (u8*)kmalloc(2 * BENCH_MEM_SIZE);
+    return g_mem_buffer;
+}
+
+static u8* fs_buffer() {
+    if (!g_fs_buffer) g_fs_buffer = (u8*)kmalloc(BENCH_FS_MAX);
+    return g_fs_buffer;
+}
+
+static bool net_pairs() {
+    if (g_net_ready) return true;
+    g_udp_tx = sock_open(SOCKET_UDP);
+    g_udp_rx = sock_open(SOCKET_UDP);
+    s32 listener = sock_open(SOCKET_TCP);
+    g_tcp_client = sock_open(SOCKET_TCP);
+    g_net_ready = g_udp_tx >= 0 && g_udp_rx >= 0 && listener >= 0 && g_tcp_client >= 0 &&
+                  sock_bind(g_udp_rx, BENCH_NET_PORT) == 0 && sock_bind(listener, BENCH_NET_PORT) == 0 &&
+                  sock_listen(listener, 1) == 0 &&
+                  sock_connect(g_tcp_client, NET_LOOPBACK_IP, BENCH_NET_PORT, 0) == 0 &&
+                  (g_tcp_server = sock_accept(listener, SOCKET_NONBLOCK)) >= 0;
+    sock_close(listener);
+    if (!g_net_ready) {
+        sock_close(g_udp_tx);
+        sock_close(g_udp_rx);
+        sock_close(g_tcp_client);
+    }
+    return g_net_ready;
+}
+
+void bench_release() {
+    kfree(g_mem_buffer);
+    kfree(g_fs_buffer);
+    g_mem_buffer = nullptr;
+    g_fs_buffer = nullptr;
+    fs_delete_file(BENCH_FS_NAME);
+    if (g_net_ready) {
+        sock_close(g_udp_tx);
+        sock_close(g_udp_rx);
+        sock_close(g_tcp_client);
+        sock_close(g_tcp_server);
+        g_net_ready = false;
+    }
+}
+
+static void bench_kmalloc(void* arg) {
+    kfree(kmalloc((u32)arg));
+}
+
+static void bench_memcpy(void*) {
+    u8* buf = mem_buffer();
+    memcpy(buf + BENCH_MEM_SIZE, buf, BENCH_MEM_SIZE);
+}
+
+static void bench_memmove(void*) {
+    u8* buf = mem_buffer();
+    memmove(buf + 1, buf, BENCH_MEM_SIZE);  // overlapping: the backward path
+}
+
+static void bench_memset(void*) {
+    memset(mem_buffer(), 0xA5, BENCH_MEM_SIZE);
+}
+
+static void bench_memcmp(void*) {
+    u8* buf = mem_buffer();
+    memcmp(buf, buf, BENCH_MEM_SIZE);  // equal: compares every byte
+}
+
+static void fs_setup_absent(void*) {
+    fs_delete_file(BENCH_FS_NAME);
+    synchronize_rcu();  // its blocks come back now rather than inside a timed create
+}
+
+static void fs_setup_present(void* arg) {
+    if (!fs_file_exists(BENCH_FS_NAME)) fs_create_file(BENCH_FS_NAME, fs_buffer(), (u32)arg);
+}
+
+static void fs_setup_fresh(void* arg) {
+    fs_setup_absent(arg);
+    fs_create_file(BENCH_FS_NAME, fs_buffer(), (u32)arg);
+}
+
+static void bench_fs_create(void* arg) {
+    fs_create_file(BENCH_FS_NAME, fs_buffer(), (u32)arg);
+}
+
+static void bench_fs_read(void* arg) {
+    fs_read_file(BENCH_FS_NAME, fs_buffer(), (u32)arg);
+}
+
+static void bench_fs_delete(void*) {
+    fs_delete_file(BENCH_FS_NAME);
+}
+
+// One packet down the stack and back up: send, loopback, receive
+static void bench_udp_roundtrip(void* arg) {
+    if (!net_pairs()) return;
+    sock_sendto(g_udp_tx, mem_buffer(), (u32)arg, NET_LOOPBACK_IP, BENCH_NET_PORT);
+    sock_recv(g_udp_rx, mem_buffer() + BENCH_MEM_SIZE, BENCH_NET_MAX, SOCKET_NONBLOCK);
+}
+
+// Data segment, receive and the ACK that follows it
+static void bench_tcp_roundtrip(void* arg) {
+    if (!net_pairs()) return;
+    sock_send(g_tcp_client, mem_buffer(), (u32)arg, SOCKET_NONBLOCK);
+    sock_recv(g_tcp_server, mem_buffer() + BENCH_MEM_SIZE, BENCH_NET_MAX, SOCKET_NONBLOCK);
+}
+
+// Each read case follows the create case of the same size, which leaves
+// the file behind.
+static const BenchCase kernel_cases[] = {
+    { "alloc", "kmalloc+kfree 32", nullptr, bench_kmalloc, (void*)32 },
+    { "alloc", "kmalloc+kfree 1K", nullptr, bench_kmalloc, (void*)1024 },
+    { "alloc", "kmalloc+kfree 8K", nullptr, bench_kmalloc, (void*)8192 },
+    { "mem", "memcpy 4K", nullptr, bench_memcpy, nullptr },
+    { "mem", "memmove 4K", nullptr, bench_memmove, nullptr },
+    { "mem", "memset 4K", nullptr, bench_memset, nullptr },
+    { "mem", "memcmp 4K", nullptr, bench_memcmp, nullptr },
+    { "fs", "fs create 64", fs_setup_absent, bench_fs_create, (void*)64 },
+    { "fs", "fs read 64", fs_setup_present, bench_fs_read, (void*)64 },
+    { "fs", "fs delete 64", fs_setup_fresh, bench_fs_delete, (void*)64 },
+    { "fs", "fs create 4K", fs_setup_absent, bench_fs_create, (void*)4096 },
+    { "fs", "fs read 4K", fs_setup_present, bench_fs_read, (void*)4096 },
+    { "fs", "fs delete 4K", fs_setup_fresh, bench_fs_delete, (void*)4096 },
+    { "fs", "fs create 64K", fs_setup_absent, bench_fs_create, (void*)BENCH_FS_MAX },
+    { "fs", "fs read 64K", fs_setup_present, bench_fs_read, (void*)BENCH_FS_MAX },
+    { "fs", "fs delete 64K", fs_setup_fresh, bench_fs_delete, (void*)BENCH_FS_MAX },
+    { "net", "udp send+recv 64", nullptr, bench_udp_roundtrip, (void*)64 },
+    { "net", "udp send+recv 1K", nullptr, bench_udp_roundtrip, (void*)BENCH_NET_MAX },
+    { "net", "tcp send+recv 64", nullptr, bench_tcp_roundtrip, (void*)64 },
+    { "net", "tcp send+recv 1K", nullptr, bench_tcp_roundtrip, (void*)BENCH_NET_MAX },
+};
+
+const BenchCase* bench_kernel_cases(u32* count) {
+    *count = sizeof(kernel_cases) / sizeof(kernel_cases[0]);
+    return kernel_cases;
+}
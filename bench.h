@@ -0,0 +1,40 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "memory.h"
+
+// TSC-timed microbenchmarks. Every case runs a warmup, then N timed
+// iterations with interrupts off; the report is the median and p99 in
+// cycles and ns, minus the cost of timing an empty call.
+
+#define BENCH_WARMUP 16
+#define BENCH_ITERATIONS 256
+#define BENCH_FILE "bench.log"
+
+typedef void (*BenchFn)(void* arg);
+
+struct BenchCase {
+    const char* group;  // selects cases: bench <group>
+    const char* name;
+    BenchFn setup;      // untimed, before every iteration; may be nullptr
+    BenchFn run;        // timed
+    void* arg;
+};
+
+struct BenchResult {
+    u32 min, median, p99;  // cycles
+    u32 median_ns, p99_ns;
+};
+
+bool bench_measure(const BenchCase* bc, u32 warmup, u32 iterations, BenchResult* out);
+
+// "name: 84c 41ns p99 130c 63ns" (no newline); returns the length
+u32 bench_format(const BenchCase* bc, const BenchResult* result, char* out, u32 size);
+
+// Cases for the allocator, mem* routines, RAM disk and loopback sockets
+// ("alloc", "mem", "fs", "net"). bench_release frees the buffers and
+// sockets they set up on first use.
+const BenchCase* bench_kernel_cases(u32* count);
+void bench_release();
+
+#endif
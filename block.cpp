@@ -0,0 +1,131 @@
+#include "block.h"
+#include "cpu.h"
+
+static BlockDevice* g_devices[BLOCK_MAX_DEVICES];
+static u32 g_device_count = 0;
+
+bool block_register(BlockDevice* dev) {
+    if (g_device_count == BLOCK_MAX_DEVICES || !dev->ops || !dev->queue_depth || !dev->max_segments) {
+        return false;
+    }
+    g_devices[g_device_count++] = dev;
+    return true;
+}
+
+u32 block_count() {
+    return g_device_count;
+}
+
+BlockDevice* block_get(u32 index) {
+    return index < g_device_count ? g_devices[index] : nullptr;
+}
+
+// Checked with interrupts off, so a completion interrupt can't slip in
+// between the test and the hlt
+static void wait_for(BlockDevice* dev, BlockRequest* req) {
+    u32 flags = irq_save();
+    while (__atomic_load_n(&req->status, __ATOMIC_ACQUIRE) == BLOCK_PENDING) {
+        dev->ops->poll(dev);
+        if (req->status != BLOCK_PENDING) break;
+        if (flags & EFLAGS_IF) {
+            irq_enable_and_halt();
+            irq_disable();
+        } else {
+            cpu_pause();
+        }
+    }
+    irq_restore(flags);
+}
+
+bool block_run(BlockDevice* dev, BlockRequest** requests, u32 count) {
+    for (u32 i = 0; i < count; i++) requests[i]->status = BLOCK_PENDING;
+
+    // Keep the queue topped up: whatever didn't fit goes in as the
+    // oldest requests finish
+    u32 submitted = 0;
+    bool ok = true;
+    for (u32 done = 0; done < count; done++) {
+        while (submitted < count) {
+            u32 taken = dev->ops->submit(dev, requests + submitted, count - submitted);
+            submitted += taken;
+            if (taken) dev->batches++;
+            if (taken || submitted > done) break;
+            dev->ops->poll(dev);  // full of other callers' requests
+            cpu_pause();
+        }
+        BlockRequest* req = requests[done];
+        wait_for(dev, req);
+
+        dev->requests++;
+        if (req->status != BLOCK_OK) {
+            dev->errors++;
+            ok = false;
+            continue;
+        }
+        for (u32 s = 0; s < req->segment_count; s++) {
+            if (req->op == BLOCK_READ) dev->bytes_read += req->segments[s].length;
+            if (req->op == BLOCK_WRITE) dev->bytes_written += req->segments[s].length;
+        }
+    }
+    return ok;
+}
+
+static bool transfer(BlockDevice* dev, BlockOp op, u64 sector, u8* buffer, u32 bytes) {
+    if (bytes % BLOCK_SECTOR_SIZE || sector + bytes / BLOCK_SECTOR_SIZE > dev->sectors) return false;
+    if (op == BLOCK_WRITE && dev->read_only) return false;
+
+    // As much as the device's segments can carry, in whole sectors
+    u64 limit = (u64)dev->max_segments * dev->max_segment_size;
+    u32 request_bytes = limit < BLOCK_REQUEST_BYTES ? (u32)limit : BLOCK_REQUEST_BYTES;
+    request_bytes &= ~(BLOCK_SECTOR_SIZE - 1);
+    if (!request_bytes) return false;
+
+    u32 batch = dev->queue_depth < BLOCK_BATCH_MAX ? dev->queue_depth : BLOCK_BATCH_MAX;
+    BlockRequest* requests = (BlockRequest*)kmalloc(batch * sizeof(BlockRequest));
+    if (!requests) return false;
+    BlockRequest* pointers[BLOCK_BATCH_MAX];
+
+    bool ok = true;
+    while (bytes && ok) {
+        u32 count = 0;
+        for (; count < batch && bytes; count++) {
+            BlockRequest* req = &requests[count];
+            u32 length = bytes < request_bytes ? bytes : request_bytes;
+            req->op = op;
+            req->sector = sector;
+            req->segment_count = 0;
+            for (u32 left = length; left; ) {
+                u32 piece = left < dev->max_segment_size ? left : dev->max_segment_size;
+                req->segments[req->segment_count].buffer = buffer;
+                req->segments[req->segment_count].length = piece;
+                req->segment_count++;
+                buffer += piece;
+                left -= piece;
+            }
+            pointers[count] = req;
+            sector += length / BLOCK_SECTOR_SIZE;
+            bytes -= length;
+        }
+        ok = block_run(dev, pointers, count);
+    }
+
+    kfree(requests);
+    return ok;
+}
+
+bool block_read(BlockDevice* dev, u64 sector, void* buffer, u32 bytes) {
+    return transfer(dev, BLOCK_READ, sector, (u8*)buffer, bytes);
+}
+
+bool block_write(BlockDevice* dev, u64 sector, const void* buffer, u32 bytes) {
+    return transfer(dev, BLOCK_WRITE, sector, (u8*)buffer, bytes);
+}
+
+bool block_flush(BlockDevice* dev) {
+    BlockRequest req;
+    req.op = BLOCK_FLUSH;
+    req.sector = 0;
+    req.segment_count = 0;
+    BlockRequest* pointer = &req;
+    return block_run(dev, &pointer, 1);
+}
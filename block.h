@@ -0,0 +1,87 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "memory.h"
+
+// Block device layer. A driver registers a BlockDevice with a submit
+// hook that queues a whole batch of requests at once and a poll hook
+// that reaps finished ones. Requests complete asynchronously: the driver
+// sets status from its interrupt handler or from poll. block_run waits
+// for a batch; it halts between interrupts when they are enabled and
+// spins on poll when they are not. block_read/block_write split a
+// transfer into scatter-gather requests of up to BLOCK_REQUEST_BYTES
+// and keep up to queue_depth of them in flight.
+//
+// Buffers are kernel memory, which is identity mapped, so a segment's
+// address is also its DMA address.
+
+#define BLOCK_SECTOR_SIZE   512
+#define BLOCK_MAX_DEVICES   4
+#define BLOCK_NAME_LEN      8
+#define BLOCK_MAX_SEGMENTS  16
+#define BLOCK_REQUEST_BYTES (64 * 1024)
+#define BLOCK_BATCH_MAX     16          // requests per block_run from block_read/write
+
+enum BlockOp : u8 {
+    BLOCK_READ,
+    BLOCK_WRITE,
+    BLOCK_FLUSH      // no segments: make completed writes durable
+};
+
+enum BlockStatus : u8 {
+    BLOCK_PENDING,
+    BLOCK_OK,
+    BLOCK_ERROR,
+    BLOCK_UNSUPPORTED
+};
+
+struct BlockSegment {
+    void* buffer;
+    u32 length;
+};
+
+struct BlockRequest {
+    BlockOp op;
+    volatile u8 status;       // BlockStatus; BLOCK_PENDING until the driver finishes it
+    u8 segment_count;
+    u64 sector;
+    BlockSegment segments[BLOCK_MAX_SEGMENTS];
+};
+
+struct BlockDevice;
+
+struct BlockOps {
+    // Queue up to count requests with one doorbell; returns how many were
+    // taken. A request the device can't run is finished with BLOCK_ERROR.
+    u32 (*submit)(BlockDevice* dev, BlockRequest** requests, u32 count);
+    void (*poll)(BlockDevice* dev);
+};
+
+struct BlockDevice {
+    char name[BLOCK_NAME_LEN];
+    u64 sectors;
+    u32 max_segments;         // per request, <= BLOCK_MAX_SEGMENTS
+    u32 max_segment_size;
+    u32 queue_depth;          // requests in flight at once
+    bool read_only;
+    const BlockOps* ops;
+    void* driver_data;
+
+    // Counted by block_run
+    u64 bytes_read, bytes_written;
+    u32 requests, batches, errors;
+};
+
+bool block_register(BlockDevice* dev);
+u32 block_count();
+BlockDevice* block_get(u32 index);
+
+// Submit a batch and wait for all of it; true if every request succeeded
+bool block_run(BlockDevice* dev, BlockRequest** requests, u32 count);
+
+// bytes is a multiple of BLOCK_SECTOR_SIZE
+bool block_read(BlockDevice* dev, u64 sector, void* buffer, u32 bytes);
+bool block_write(BlockDevice* dev, u64 sector, const void* buffer, u32 bytes);
+bool block_flush(BlockDevice* dev);
+
+#endif
@@ -1,90 +1,134 @@
-[org 0x7c00]                        
-KERNEL_LOCATION equ 0x1000
-                                    
-
-mov [BOOT_DISK], dl                 
-
-                                    
-xor ax, ax                          
-mov es, ax
-mov ds, ax
-mov bp, 0x8000
-mov sp, bp
-
-mov bx, KERNEL_LOCATION
-mov dh, 54
-
-mov ah, 0x02
-mov al, dh 
-mov ch, 0x00
-mov dh, 0x00
-mov cl, 0x02
-mov dl, [BOOT_DISK]
-int 0x13                
-
-                                    
-mov ah, 0x0
-mov al, 0x3
-int 0x10                ; text mode
-
-
-CODE_SEG equ GDT_code - GDT_start
-DATA_SEG equ GDT_data - GDT_start
-
-cli
-lgdt [GDT_descriptor]
-mov eax, cr0
-or eax, 1
-mov cr0, eax
-jmp CODE_SEG:start_protected_mode
-
-jmp $
-                                    
-BOOT_DISK: db 0
-
-GDT_start:
-    GDT_null:
-        dd 0x0
-        dd 0x0
-
-    GDT_code:
-        dw 0xffff
-        dw 0x0
-        db 0x0
-        db 0b10011010
-        db 0b11001111
-        db 0x0
-
-    GDT_data:
-        dw 0xffff
-        dw 0x0
-        db 0x0
-        db 0b10010010
-        db 0b11001111
-        db 0x0
-
-GDT_end:
-
-GDT_descriptor:
-    dw GDT_end - GDT_start - 1
-    dd GDT_start
-
-
-[bits 32]
-start_protected_mode:
-    mov ax, DATA_SEG
-	mov ds, ax
-	mov ss, ax
-	mov es, ax
-	mov fs, ax
-	mov gs, ax
-	
-	mov ebp, 0x90000		; 32 bit stack base pointer
-	mov esp, ebp
-
-    jmp KERNEL_LOCATION
-
-                                     
- 
-times 510-($-$$) db 0              
+[org 0x7c00]                        
+KERNEL_LOCATION equ 0x10000
+KERNEL_SEGMENT equ 0x1000
+KERNEL_SECTORS equ 512              ; 256KB, must match the size check in the Makefile
+                                    
+
+mov [BOOT_DISK], dl                 
+
+                                    
+xor ax, ax                          
+mov es, ax
+mov ds, ax
+mov bp, 0x8000
+mov sp, bp
+
+; Ask the BIOS for the drive geometry (keeps the floppy defaults on failure)
+mov ah, 0x08
+mov dl, [BOOT_DISK]
+int 0x13
+jc load_kernel
+and cl, 0x3F
+mov [SECTORS_PER_TRACK], cl
+inc dh
+mov [HEADS], dh
+
+; The kernel no longer fits below the boot sector, so it is loaded at
+; 0x10000 one sector at a time (CHS, crossing tracks and heads)
+load_kernel:
+mov ax, KERNEL_SEGMENT
+mov es, ax
+
+read_sector:
+xor bx, bx
+mov ah, 0x02
+mov al, 1
+mov ch, [CYLINDER]
+mov cl, [SECTOR]
+mov dh, [HEAD]
+mov dl, [BOOT_DISK]
+int 0x13
+jc $
+
+mov ax, es
+add ax, 0x20                        ; next 512 bytes
+mov es, ax
+
+inc byte [SECTOR]
+mov al, [SECTOR]
+cmp al, [SECTORS_PER_TRACK]
+jbe next_sector
+mov byte [SECTOR], 1
+inc byte [HEAD]
+mov al, [HEAD]
+cmp al, [HEADS]
+jb next_sector
+mov byte [HEAD], 0
+inc byte [CYLINDER]
+
+next_sector:
+dec word [SECTORS_LEFT]
+jnz read_sector
+
+                                    
+mov ah, 0x0
+mov al, 0x3
+int 0x10                ; text mode
+
+
+CODE_SEG equ GDT_code - GDT_start
+DATA_SEG equ GDT_data - GDT_start
+
+cli
+lgdt [GDT_descriptor]
+mov eax, cr0
+or eax, 1
+mov cr0, eax
+jmp CODE_SEG:start_protected_mode
+
+jmp $
+                                    
+BOOT_DISK: db 0
+SECTORS_PER_TRACK: db 18
+HEADS: db 2
+CYLINDER: db 0
+HEAD: db 0
+SECTOR: db 2
+SECTORS_LEFT: dw KERNEL_SECTORS
+
+GDT_start:
+    GDT_null:
+        dd 0x0
+        dd 0x0
+
+    GDT_code:
+        dw 0xffff
+        dw 0x0
+        db 0x0
+        db 0b10011010
+        db 0b11001111
+        db 0x0
+
+    GDT_data:
+        dw 0xffff
+        dw 0x0
+        db 0x0
+        db 0b10010010
+        db 0b11001111
+        db 0x0
+
+GDT_end:
+
+GDT_descriptor:
+    dw GDT_end - GDT_start - 1
+    dd GDT_start
+
+
+[bits 32]
+start_protected_mode:
+    mov ax, DATA_SEG
+	mov ds, ax
+	mov ss, ax
+	mov es, ax
+	mov fs, ax
+	mov gs, ax
+	
+	mov ebp, 0x90000		; 32 bit stack base pointer
+	mov esp, ebp
+
+    jmp KERNEL_LOCATION
+
+                                     
+ 
+times 510-($-$$) db 0              
 dw 0xaa55
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "console.h"
+#include "serial.h"
+
+#define SCAN_SHIFT   0x2A
+#define SCAN_CTRL    0x1D
+#define SCAN_RELEASE 0x80
+#define SCAN_ESC     0x01
+#define SCAN_ENTER   0x1C
+#define SCAN_BACKSPACE 0x0E
+#define SCAN_F1      0x3B
+#define SCAN_UP      0x48
+#define SCAN_DOWN    0x50
+#define SCAN_LEFT    0x4B
+#define SCAN_RIGHT   0x4D
+
+#define KEY_SHIFTED 0x80  // in ascii_keys: press shift around the key
+
+static u32 g_routes = 0;
+
+// ASCII -> scan code (| KEY_SHIFTED), 0 for bytes with no key
+static u8 ascii_keys[128];
+
+// Filled by the serial interrupt, drained by the UI loop; one of each
+static u8 g_queue[CONSOLE_INPUT_QUEUE];
+static volatile u32 g_queue_head = 0;
+static volatile u32 g_queue_tail = 0;
+
+// Escape sequences can span bytes: ESC, ESC [ ..., ESC O ...
+enum EscapeState { ESC_NONE, ESC_SEEN, ESC_CSI, ESC_SS3 };
+static EscapeState g_escape = ESC_NONE;
+
+static void build_key_table() {
+    // US layout rows, unshifted and shifted, from their first scan code
+    static const char* const rows[] = { "1234567890-=", "qwertyuiop[]", "asdfghjkl;'`", "\\zxcvbnm,./" };
+    static const char* const shifted[] = { "!@#$%^&*()_+", "QWERTYUIOP{}", "ASDFGHJKL:\"~", "|ZXCVBNM<>?" };
+    static const u8 first[] = { 0x02, 0x10, 0x1E, 0x2B };
+
+    for (u32 r = 0; r < 4; r++) {
+        for (u32 i = 0; rows[r][i]; i++) {
+            ascii_keys[(u8)rows[r][i]] = first[r] + i;
+            ascii_keys[(u8)shifted[r][i]] = (first[r] + i) | KEY_SHIFTED;
+        }
+    }
+    ascii_keys[(u8)' '] = 0x39;
+    ascii_keys[(u8)'*'] = 0x37;
+    ascii_keys['\r'] = SCAN_ENTER;
+    ascii_keys['\n'] = SCAN_ENTER;
+    ascii_keys[0x08] = SCAN_BACKSPACE;
+    ascii_keys[0x7F] = SCAN_BACKSPACE;
+}
+
+static void queue_push(u8 scan_code) {
+    u32 head = g_queue_head;
+    if (head - __atomic_load_n(&g_queue_tail, __ATOMIC_ACQUIRE) == CONSOLE_INPUT_QUEUE) return;  // full: drop
+    g_queue[head & (CONSOLE_INPUT_QUEUE - 1)] = scan_code;
+    __atomic_store_n(&g_queue_head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void press(u8 scan_code, u8 modifier = 0) {
+    if (modifier) queue_push(modifier);
+    queue_push(scan_code);
+    queue_push(scan_code | SCAN_RELEASE);
+    if (modifier) queue_push(modifier | SCAN_RELEASE);
+}
+
+static void receive_byte(u8 c) {
+    switch (g_escape) {
+    case ESC_SEEN:
+        if (c == '[') { g_escape = ESC_CSI; return; }
+        if (c == 'O') { g_escape = ESC_SS3; return; }
+        press(SCAN_ESC);  // a plain ESC followed by some other key
+        g_escape = ESC_NONE;
+        break;
+    case ESC_CSI:
+        if (c >= 0x40 && c <= 0x7E) {  // final byte; parameters are ignored
+            if (c == 'A') press(SCAN_UP);
+            else if (c == 'B') press(SCAN_DOWN);
+            else if (c == 'C') press(SCAN_RIGHT);
+            else if (c == 'D') press(SCAN_LEFT);
+            g_escape = ESC_NONE;
+        }
+        return;
+    case ESC_SS3:
+        if (c == 'P') press(SCAN_F1);
+        g_escape = ESC_NONE;
+        return;
+    case ESC_NONE:
+        break;
+    }
+
+    if (c == 0x1B) {
+        g_escape = ESC_SEEN;
+        return;
+    }
+    if (c >= 0x80) return;
+    u8 key = ascii_keys[c];
+    if (key) {
+        press(key & ~KEY_SHIFTED, (key & KEY_SHIFTED) ? SCAN_SHIFT : 0);
+    } else if (c >= 0x01 && c <= 0x1A) {  // Ctrl+letter
+        press(ascii_keys[(u8)('a' + c - 1)], SCAN_CTRL);
+    }
+}
+
+// Serial interrupt: a burst is whatever the RX FIFO held
+static void receive(const u8* data, u32 len) {
+    for (u32 i = 0; i < len; i++) receive_byte(data[i]);
+    // Terminals send a whole escape sequence at once, so an ESC that
+    // ends a burst was the Esc key itself
+    if (g_escape == ESC_SEEN) {
+        press(SCAN_ESC);
+        g_escape = ESC_NONE;
+    }
+}
+
+void console_initialize() {
+    build_key_table();
+    if (!serial_present()) return;
+    g_routes = CONSOLE_MIRROR | CONSOLE_REPORTS;
+    serial_set_receiver(receive);
+}
+
+u32 console_routes() {
+    return g_routes;
+}
+
+void console_set_routes(u32 routes) {
+    g_routes = serial_present() ? routes : 0;
+}
+
+// COM1 wants CR LF line ends
+static void serial_text(const char* data, u32 len) {
+    u32 start = 0;
+    for (u32 i = 0; i < len; i++) {
+        if (data[i] != '\n') continue;
+        serial_write(data + start, i - start);
+        serial_write("\r\n", 2);
+        start = i + 1;
+    }
+    serial_write(data + start, len - start);
+}
+
+void console_output(const char* text) {
+    if (!(g_routes & CONSOLE_MIRROR)) return;
+    serial_text(text, strlen(text));
+    serial_write("\r\n", 2);
+}
+
+void console_report(const char* title, const char* data, u32 len) {
+    if (!(g_routes & CONSOLE_REPORTS)) return;
+    serial_print("--- ");
+    serial_print(title);
+    serial_print(" ---\r\n");
+    serial_text(data, len);
+    if (len && data[len - 1] != '\n') serial_write("\r\n", 2);
+}
+
+void console_log(const char* line, u32 len) {
+    if (!(g_routes & CONSOLE_LOG)) return;
+    serial_text(line, len);
+}
+
+bool console_read_scan_code(u8* scan_code) {
+    u32 tail = g_queue_tail;
+    if (tail == __atomic_load_n(&g_queue_head, __ATOMIC_ACQUIRE)) return false;
+    *scan_code = g_queue[tail & (CONSOLE_INPUT_QUEUE - 1)];
+    __atomic_store_n(&g_queue_tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
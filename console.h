@@ -0,0 +1,27 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "memory.h"
+
+// Console mux. The VGA shell is always shown; COM1 is an extra sink that
+// each output stream can be routed to, so a headless run (-nographic)
+// sees results. COM1 is also an extra input: bytes typed on the serial
+// line are turned into set 1 scan codes in the queue that
+// read_scan_code() drains before the keyboard.
+#define CONSOLE_MIRROR  0x01  // output-area lines, as shown on screen
+#define CONSOLE_REPORTS 0x02  // full bench/prof reports
+#define CONSOLE_LOG     0x04  // kernel log (klog.h) as it is written; off by default
+
+#define CONSOLE_INPUT_QUEUE 256  // scan codes, power of two
+
+void console_initialize();  // after serial_initialize
+u32 console_routes();       // CONSOLE_* streams that go to COM1
+void console_set_routes(u32 routes);
+
+void console_output(const char* text);  // one output-area message
+void console_report(const char* title, const char* data, u32 len);
+void console_log(const char* line, u32 len);  // one formatted klog line
+
+bool console_read_scan_code(u8* scan_code);  // next key typed on COM1
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "memory.h"
+
+// EFLAGS
+#define EFLAGS_IF 0x200
+
+// Control register bits
+#define CR0_MP 0x00000002
+#define CR0_EM 0x00000004
+#define CR0_TS 0x00000008
+#define CR0_NE 0x00000020
+#define CR0_WP 0x00010000
+#define CR0_PG 0x80000000
+#define CR4_PSE 0x00000010
+#define CR4_PGE 0x00000080
+#define CR4_OSFXSR 0x00000200
+#define CR4_OSXMMEXCPT 0x00000400
+
+// Model specific registers
+#define MSR_APIC_BASE 0x1B
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+// CPUID feature bits (leaf 1, EDX)
+#define CPUID_EDX_PSE  (1 << 3)
+#define CPUID_EDX_TSC  (1 << 4)
+#define CPUID_EDX_MSR  (1 << 5)
+#define CPUID_EDX_APIC (1 << 9)
+#define CPUID_EDX_SEP  (1 << 11)
+#define CPUID_EDX_PGE  (1 << 13)
+#define CPUID_EDX_FXSR (1 << 24)
+#define CPUID_EDX_SSE  (1 << 25)
+
+// CPUID feature bits (leaf 1, ECX)
+#define CPUID_ECX_SSE42 (1 << 20)
+
+// CPUID feature bits (leaf 7, EBX)
+#define CPUID_7_EBX_ERMS (1 << 9)
+
+static inline void cpuid(u32 leaf, u32* eax, u32* ebx, u32* ecx, u32* edx) {
+    asm volatile ("cpuid"
+                  : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                  : "a"(leaf), "c"(0));
+}
+
+static inline u64 rdtsc() {
+    u32 lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64)hi << 32) | lo;
+}
+
+static inline u64 rdmsr(u32 msr) {
+    u32 lo, hi;
+    asm volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((u64)hi << 32) | lo;
+}
+
+static inline void wrmsr(u32 msr, u64 value) {
+    asm volatile ("wrmsr" : : "c"(msr), "a"((u32)value), "d"((u32)(value >> 32)));
+}
+
+static inline u32 read_cr0() {
+    u32 value;
+    asm volatile ("mov %%cr0, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr0(u32 value) {
+    asm volatile ("mov %0, %%cr0" : : "r"(value) : "memory");
+}
+
+static inline u32 read_cr2() {
+    u32 value;
+    asm volatile ("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static inline u32 read_cr3() {
+    u32 value;
+    asm volatile ("mov %%cr3, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr3(u32 value) {
+    asm volatile ("mov %0, %%cr3" : : "r"(value) : "memory");
+}
+
+static inline u32 read_cr4() {
+    u32 value;
+    asm volatile ("mov %%cr4, %0" : "=r"(value));
+    return value;
+}
+
+static inline void write_cr4(u32 value) {
+    asm volatile ("mov %0, %%cr4" : : "r"(value) : "memory");
+}
+
+static inline void invlpg(u32 addr) {
+    asm volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+static inline void cpu_pause() {
+    asm volatile ("pause" ::: "memory");
+}
+
+#ifdef HOST_BUILD
+// Host-native build (make host-test): a single thread in user mode, no
+// interrupts to mask; irq_save reports them as already off
+static inline void cpu_halt() { cpu_pause(); }
+static inline void irq_disable() {}
+static inline void irq_enable() {}
+static inline void irq_enable_and_halt() { cpu_pause(); }
+static inline u32 irq_save() { return 0; }
+static inline void irq_restore(u32) {}
+#else
+static inline void cpu_halt() {
+    asm volatile ("hlt" ::: "memory");
+}
+
+static inline void irq_disable() {
+    asm volatile ("cli" ::: "memory");
+}
+
+static inline void irq_enable() {
+    asm volatile ("sti" ::: "memory");
+}
+
+// Atomically enable interrupts and halt until the next one arrives
+static inline void irq_enable_and_halt() {
+    asm volatile ("sti; hlt" ::: "memory");
+}
+
+static inline u32 irq_save() {
+    u32 flags;
+    asm volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(u32 flags) {
+    if (flags & EFLAGS_IF) irq_enable();
+}
+#endif
+
+// 64-by-32 bit division without pulling in libgcc's __udivdi3
+static inline u64 udiv64(u64 dividend, u32 divisor) {
+    u32 hi = (u32)(dividend >> 32);
+    u32 lo = (u32)dividend;
+    u32 q_hi = hi / divisor;
+    u32 r_hi = hi % divisor;
+    u32 q_lo, rem;
+    asm ("divl %4" : "=a"(q_lo), "=d"(rem) : "a"(lo), "d"(r_hi), "rm"(divisor));
+    return ((u64)q_hi << 32) | q_lo;
+}
+
+#endif
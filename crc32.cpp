@@ -0,0 +1,44 @@
+#include "crc32.h"
+#include "alternatives.h"
+
+#define CRC32C_POLY_REVERSED 0x82F63B78
+
+static u32 crc_table[256];
+
+void crc32_initialize() {
+    for (u32 i = 0; i < 256; i++) {
+        u32 c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY_REVERSED : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+}
+
+// Pass 0 to start a new checksum; pass the previous result to continue one
+ALTERNATIVE_TARGET u32 crc32c(u32 crc, const void* data, u32 length) {
+    const u8* p = (const u8*)data;
+    crc = ~crc;
+    for (u32 i = 0; i < length; i++) {
+        crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// crc32 works on general registers, so it needs no FPU/SSE state
+u32 crc32c_sse42(u32 crc, const void* data, u32 length) {
+    const u8* p = (const u8*)data;
+    crc = ~crc;
+    for (; length && ((u32)p & 3); length--, p++) {
+        asm ("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+    }
+    for (; length >= 4; length -= 4, p += 4) {
+        asm ("crc32l %1, %0" : "+r"(crc) : "rm"(*(const u32*)p));
+    }
+    for (; length; length--, p++) {
+        asm ("crc32b %1, %0" : "+r"(crc) : "rm"(*p));
+    }
+    return ~crc;
+}
+
+ALTERNATIVE(crc32c, crc32c_sse42, CPU_FEATURE_SSE42);
@@ -0,0 +1,14 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include "memory.h"
+
+// CRC-32C (Castagnoli), the polynomial implemented by the SSE4.2 crc32 instruction
+void crc32_initialize();
+u32 crc32c(u32 crc, const void* data, u32 length);
+
+// Same result with the crc32 instruction; patched over crc32c on SSE4.2
+// CPUs (alternatives.h)
+u32 crc32c_sse42(u32 crc, const void* data, u32 length);
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include "memory.h"
+
+// ELF32 structures (System V ABI, Intel386 supplement)
+
+#define ELF_MAGIC 0x464C457F  // "\x7FELF" read as a little-endian u32
+
+#define ELFCLASS32  1
+#define ELFDATA2LSB 1
+
+#define ET_REL  1
+#define ET_EXEC 2
+#define EM_386  3
+
+struct Elf32_Ehdr {
+    u32 e_magic;
+    u8 e_class;
+    u8 e_data;
+    u8 e_version_ident;
+    u8 e_pad[9];
+    u16 e_type;
+    u16 e_machine;
+    u32 e_version;
+    u32 e_entry;
+    u32 e_phoff;
+    u32 e_shoff;
+    u32 e_flags;
+    u16 e_ehsize;
+    u16 e_phentsize;
+    u16 e_phnum;
+    u16 e_shentsize;
+    u16 e_shnum;
+    u16 e_shstrndx;
+} __attribute__((packed));
+
+// Program headers
+#define PT_LOAD 1
+
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
+struct Elf32_Phdr {
+    u32 p_type;
+    u32 p_offset;
+    u32 p_vaddr;
+    u32 p_paddr;
+    u32 p_filesz;
+    u32 p_memsz;
+    u32 p_flags;
+    u32 p_align;
+} __attribute__((packed));
+
+// Section headers
+#define SHT_PROGBITS 1
+#define SHT_SYMTAB   2
+#define SHT_STRTAB   3
+#define SHT_NOBITS   8
+#define SHT_REL      9
+
+#define SHF_WRITE 0x1
+#define SHF_ALLOC 0x2
+
+#define SHN_UNDEF  0
+#define SHN_ABS    0xFFF1
+#define SHN_COMMON 0xFFF2
+
+struct Elf32_Shdr {
+    u32 sh_name;
+    u32 sh_type;
+    u32 sh_flags;
+    u32 sh_addr;
+    u32 sh_offset;
+    u32 sh_size;
+    u32 sh_link;
+    u32 sh_info;
+    u32 sh_addralign;
+    u32 sh_entsize;
+} __attribute__((packed));
+
+struct Elf32_Sym {
+    u32 st_name;
+    u32 st_value;
+    u32 st_size;
+    u8 st_info;
+    u8 st_other;
+    u16 st_shndx;
+} __attribute__((packed));
+
+#define ELF32_ST_BIND(info) ((info) >> 4)
+#define STB_LOCAL  0
+#define STB_GLOBAL 1
+#define STB_WEAK   2
+
+// Relocations
+#define R_386_32   1
+#define R_386_PC32 2
+
+struct Elf32_Rel {
+    u32 r_offset;
+    u32 r_info;
+} __attribute__((packed));
+
+#define ELF32_R_SYM(info)  ((info) >> 8)
+#define ELF32_R_TYPE(info) ((u8)(info))
+
+// Header checks shared by the program and module loaders
+static inline bool elf_header_ok(const Elf32_Ehdr* eh, u32 size, u16 type) {
+    return size >= sizeof(Elf32_Ehdr) && eh->e_magic == ELF_MAGIC &&
+           eh->e_class == ELFCLASS32 && eh->e_data == ELFDATA2LSB &&
+           eh->e_type == type && eh->e_machine == EM_386;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "exec.h"
+#include "elf.h"
+#include "paging.h"
+#include "fs_ramdisk.h"
+
+// Table in user_images.asm, terminated by a null name
+struct InitrdFile {
+    const char* name;
+    const u8* data;
+    u32 size;
+};
+extern "C" const InitrdFile initrd_files[];
+
+static u32 page_align_up(u32 addr) {
+    return (addr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+// Turn each PT_LOAD segment into a region of proc
+static const char* add_segments(Process* proc, const u8* data, u32 size) {
+    const Elf32_Ehdr* eh = (const Elf32_Ehdr*)data;
+    if (eh->e_phentsize != sizeof(Elf32_Phdr) || eh->e_phoff > size ||
+        eh->e_phnum > (size - eh->e_phoff) / sizeof(Elf32_Phdr)) {
+        return "BAD PROGRAM HEADERS";
+    }
+
+    const Elf32_Phdr* ph = (const Elf32_Phdr*)(data + eh->e_phoff);
+    bool entry_ok = false;
+    for (u32 i = 0; i < eh->e_phnum; i++) {
+        if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0) continue;
+
+        u32 vaddr = ph[i].p_vaddr;
+        u32 page_offset = vaddr & (PAGE_SIZE - 1);
+        if (ph[i].p_filesz > ph[i].p_memsz || ph[i].p_offset > size ||
+            ph[i].p_filesz > size - ph[i].p_offset ||
+            (ph[i].p_offset & (PAGE_SIZE - 1)) != page_offset) {
+            return "BAD SEGMENT";
+        }
+
+        // Leave the stack and the vsyscall page alone
+        u32 stack_bottom = USER_STACK_TOP - USER_STACK_SIZE;
+        if (vaddr < USER_BASE || vaddr >= stack_bottom || ph[i].p_memsz > stack_bottom - vaddr) {
+            return "SEGMENT OUTSIDE USER SPACE";
+        }
+
+        u32 start = vaddr - page_offset;
+        u32 end = page_align_up(vaddr + ph[i].p_memsz);
+        u32 flags = (ph[i].p_flags & PF_W) ? VM_WRITE : 0;
+        if (!process_add_region(proc, start, end, flags, data + ph[i].p_offset - page_offset,
+                                ph[i].p_filesz + page_offset)) {
+            return "OVERLAPPING SEGMENTS";
+        }
+        if (eh->e_entry >= vaddr && eh->e_entry < vaddr + ph[i].p_memsz) entry_ok = true;
+    }
+    return entry_ok ? nullptr : "BAD ENTRY POINT";
+}
+
+Process* exec_spawn(const char* filename, const char** error) {
+    if (!paging_available()) {
+        *error = "NO PAGING SUPPORT";
+        return nullptr;
+    }
+
+    u32 size, handle;
+    const u8* data = fs_map_file(filename, &size, &handle);
+    if (!data) {
+        *error = "FILE NOT FOUND";
+        return nullptr;
+    }
+    if (!elf_header_ok((const Elf32_Ehdr*)data, size, ET_EXEC)) {
+        fs_unmap_file(handle);
+        *error = "NOT AN EXECUTABLE";
+        return nullptr;
+    }
+
+    Process* proc = process_create(filename);
+    if (!proc) {
+        fs_unmap_file(handle);
+        *error = "COULD NOT CREATE PROCESS";
+        return nullptr;
+    }
+    proc->file_handle = handle;  // released with the address space
+
+    *error = add_segments(proc, data, size);
+    if (!*error && !process_start(proc, ((const Elf32_Ehdr*)data)->e_entry)) {
+        *error = "COULD NOT CREATE PROCESS";
+    }
+    if (*error) {
+        process_destroy(proc);
+        return nullptr;
+    }
+    return proc;
+}
+
+void exec_install_initrd() {
+    for (const InitrdFile* f = initrd_files; f->name; f++) {
+        fs_create_file(f->name, f->data, f->size);
+    }
+}
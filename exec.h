@@ -0,0 +1,19 @@
+#ifndef EXEC_H
+#define EXEC_H
+
+#include "process.h"
+
+// ELF32 executables run straight from the RAM disk. The file is pinned
+// for the process's lifetime and its PT_LOAD segments become demand-paged
+// regions: text and rodata map the RAM disk pages in place, data and bss
+// get private frames on first touch. Programs are linked at USER_BASE
+// (see user/user.ld) with file offsets congruent to addresses mod 4KB.
+
+// Start filename as a new process; on failure returns nullptr and sets
+// *error to a message for the shell
+Process* exec_spawn(const char* filename, const char** error);
+
+// Copy the programs and modules built into the kernel image onto the RAM disk
+void exec_install_initrd();
+
+#endif
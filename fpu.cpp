@@ -0,0 +1,118 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "smp.h"
+#include "interrupts.h"
+#include "process.h"
+#include "klog.h"
+
+#define MXCSR_DEFAULT 0x1F80  // all SIMD exceptions masked, round to nearest
+
+static bool g_fpu_available = false;
+static FpuState g_fpu_initial;  // after fninit: what a process starts with
+
+static inline void clts() {
+    asm volatile ("clts" ::: "memory");
+}
+
+static inline void stts() {
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static inline void fxsave(FpuState* state) {
+    asm volatile ("fxsave %0" : "=m"(*state));
+}
+
+static inline void fxrstor(const FpuState* state) {
+    asm volatile ("fxrstor %0" : : "m"(*state));
+}
+
+static inline void fpu_reset() {
+    u32 mxcsr = MXCSR_DEFAULT;
+    asm volatile ("fninit; ldmxcsr %0" : : "m"(mxcsr));
+}
+
+// #NM: a user process touched the FPU while CR0.TS was set. Move the
+// registers over to it, saving whoever had them.
+static void fpu_not_available(InterruptFrame* frame) {
+    if (!frame_from_user(frame)) unhandled_exception(frame);  // kernel FPU use outside a section
+    Process* proc = process_current();
+    if (!g_fpu_available || !proc) {
+        process_fault(frame, 0);
+        return;
+    }
+
+    Cpu* cpu = this_cpu();
+    clts();
+    if (cpu->fpu_owner == proc) return;
+    if (cpu->fpu_owner) fxsave(&cpu->fpu_owner->fpu);
+    fxrstor(proc->fpu_used ? &proc->fpu : &g_fpu_initial);
+    proc->fpu_used = true;
+    cpu->fpu_owner = proc;
+}
+
+void fpu_initialize() {
+    Cpu* cpu = this_cpu();
+    cpu->fpu_owner = nullptr;
+
+    if (cpu->index == 0) {
+        u32 eax, ebx, ecx, edx;
+        cpuid(1, &eax, &ebx, &ecx, &edx);
+        g_fpu_available = (edx & CPUID_EDX_FXSR) && (edx & CPUID_EDX_SSE);
+        register_interrupt_handler(7, fpu_not_available);
+        if (!g_fpu_available) klog(KLOG_WARN, "fpu: no FXSR/SSE, FPU disabled");
+    }
+
+    if (!g_fpu_available) {
+        // x87 instructions trap with #NM and SSE ones with #UD
+        write_cr0(read_cr0() | CR0_EM);
+        return;
+    }
+
+    write_cr0((read_cr0() & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE);
+    write_cr4(read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT);
+    fpu_reset();
+    if (cpu->index == 0) {
+        fxsave(&g_fpu_initial);
+        klog(KLOG_INFO, "fpu: x87/SSE on, lazy switching");
+    }
+    stts();
+}
+
+bool fpu_available() {
+    return g_fpu_available;
+}
+
+// Only the owner may find its registers intact; anyone else traps
+void fpu_switch(Process* next) {
+    if (!g_fpu_available) return;
+    if (this_cpu()->fpu_owner == next) {
+        clts();
+    } else {
+        stts();
+    }
+}
+
+void fpu_release(Process* proc) {
+    Cpu* cpu = this_cpu();
+    if (cpu->fpu_owner == proc) cpu->fpu_owner = nullptr;
+}
+
+void kernel_fpu_begin() {
+    if (!g_fpu_available) return;
+    u32 flags = irq_save();
+    clts();
+    Cpu* cpu = this_cpu();
+    if (cpu->fpu_owner) {
+        fxsave(&cpu->fpu_owner->fpu);
+        cpu->fpu_owner = nullptr;
+    }
+    fpu_reset();
+    irq_restore(flags);
+}
+
+// The registers now hold nobody's state: the next user FPU instruction
+// traps and reloads its own
+void kernel_fpu_end() {
+    if (!g_fpu_available) return;
+    stts();
+}
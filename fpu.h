@@ -0,0 +1,39 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include "memory.h"
+
+// x87/SSE state. fpu_initialize() turns on the FPU and SSE on each CPU
+// (CR0.MP/NE, CR4.OSFXSR/OSXMMEXCPT) and leaves CR0.TS set, so the
+// first FPU or SSE instruction traps with #NM.
+//
+// User processes switch FPU state lazily. A CPU's registers hold the
+// state of at most one process, its fpu_owner. schedule() only sets
+// CR0.TS when it switches away from the owner. The #NM trap saves the
+// owner's state with FXSAVE and loads the trapping process's with
+// FXRSTOR. A process that never touches the FPU never pays for a save.
+//
+// Kernel code doesn't use the FPU outside kernel_fpu_begin/end, and
+// only when fpu_available(). A section starts from a clean FPU state. It
+// must not block or schedule and must not run in an interrupt handler.
+// Sections can't nest.
+
+struct Process;
+
+// FXSAVE image: 512 bytes, 16-byte aligned
+struct FpuState {
+    u8 data[512];
+} __attribute__((aligned(16)));
+
+void fpu_initialize();     // every CPU; on the BSP after interrupts_initialize
+bool fpu_available();      // FXSR and SSE present, FPU enabled
+
+// Hooks for the scheduler (process.cpp)
+void fpu_switch(Process* next);    // before switching to next
+void fpu_release(Process* proc);   // its state is garbage: exiting
+
+// Kernel SIMD sections
+void kernel_fpu_begin();
+void kernel_fpu_end();
+
+#endif
@@ -1,89 +1,149 @@
-#ifndef FS_RAMDISK_H
-#define FS_RAMDISK_H
-
-#include "memory.h"
-
-// RAM Disk Constants
-#define RAMDISK_MAGIC "ATOMICFS"
-#define RAMDISK_VERSION 1
-#define RAMDISK_DEFAULT_SIZE (1024 * 1024)  // 1MB
-#define RAMDISK_BLOCK_SIZE 1024             // 1KB blocks
-#define RAMDISK_MAX_FILES 64
-#define RAMDISK_FILENAME_LEN 32
-
-// RAM Disk Structures
-struct RAMDiskSuperblock {
-    char magic[8];
-    u32 version;
-    u32 total_blocks;
-    u32 free_blocks;  
-    u32 file_count;
-    u32 block_size;
-    u32 fat_blocks;
-    u32 file_table_blocks;
-    u32 data_blocks;
-    u8 reserved[476];
-};
-
-struct RAMDiskFileEntry {
-    char filename[RAMDISK_FILENAME_LEN];
-    u32 start_block;
-    u32 size;
-    u32 timestamp;
-    u8 type;
-    u8 reserved[15];
-};
-
-class RAMDiskFS {
-private:
-    u8* disk_memory;
-    u32 total_size;
-    RAMDiskSuperblock* superblock;
-    u8* fat;
-    RAMDiskFileEntry* file_table;
-    u8* data_blocks;
-    
-    // Helper methods
-    u32 find_free_block();
-    u32 calculate_blocks_needed(u32 file_size);
-    RAMDiskFileEntry* find_file_entry(const char* filename);
-    RAMDiskFileEntry* find_free_file_entry();
-
-public:
-    // Core operations
-    bool initialize(u32 memory_address, u32 size = RAMDISK_DEFAULT_SIZE);
-    bool format();
-    
-    // File operations
-    bool create_file(const char* filename, const u8* data, u32 size);
-    bool read_file(const char* filename, u8* buffer, u32 buffer_size);
-    bool delete_file(const char* filename);
-    bool file_exists(const char* filename);  // <-- ADD THIS LINE
-    
-    // Directory operations  
-    void list_files();
-    u32 get_file_count();
-    u32 get_free_space();
-    u32 get_total_space();
-    int get_file_list(RAMDiskFileEntry* list, int max_entries);  // <-- MOVE THIS HERE
-    
-    // Utility
-    bool is_initialized();
-    void get_file_info(const char* filename, u32* size, u32* timestamp);
-    void debug_status();
-};
-
-extern RAMDiskFS g_ramdisk;
-
-// Public interface functions
-void fs_initialize();
-bool fs_create_file(const char* filename, const u8* data, u32 size);
-bool fs_read_file(const char* filename, u8* buffer, u32 buffer_size);
-bool fs_delete_file(const char* filename);
-bool fs_file_exists(const char* filename);  // <-- ADD THIS LINE
-void fs_list_files();
-u32 fs_get_free_space();
-void fs_debug_status();
-int fs_get_file_list(RAMDiskFileEntry* list, int max_entries);
-
+#ifndef FS_RAMDISK_H
+#define FS_RAMDISK_H
+
+#include "memory.h"
+#include "rcu.h"
+#include "block.h"
+
+// RAM Disk Constants
+#define RAMDISK_MAGIC "ATOMICFS"
+#define RAMDISK_VERSION 1
+#define RAMDISK_DEFAULT_SIZE (1024 * 1024)  // 1MB
+#define RAMDISK_BLOCK_SIZE 1024             // 1KB blocks
+#define RAMDISK_MAX_FILES 64
+#define RAMDISK_FILENAME_LEN 32
+#define RAMDISK_CHECKSUM_CHUNK (16 * 1024)  // unit of work for parallel checksums
+#define RAMDISK_INDEX_BUCKETS 128           // power of two, > RAMDISK_MAX_FILES
+#define RAMDISK_INDEX_EMPTY 0xFF
+#define RAMDISK_BLOCKS_PER_PAGE (PAGE_SIZE / RAMDISK_BLOCK_SIZE)  // files start page aligned
+#define RAMDISK_PIN_REPLACING 0xFF          // pins value: contents being replaced, hidden from readers
+
+// RAM Disk Structures
+struct RAMDiskSuperblock {
+    char magic[8];
+    u32 version;
+    u32 total_blocks;
+    u32 free_blocks;  
+    u32 file_count;
+    u32 block_size;
+    u32 fat_blocks;
+    u32 file_table_blocks;
+    u32 data_blocks;
+    u8 reserved[476];
+};
+
+struct RAMDiskFileEntry {
+    char filename[RAMDISK_FILENAME_LEN];
+    u32 start_block;
+    u32 size;
+    u32 timestamp;
+    u8 type;
+    u8 reserved[15];
+};
+
+// Immutable snapshot of the file table for lock-free readers. Writers
+// build a new one, publish it and free the old one after an RCU grace period.
+struct RAMDiskFileIndex {
+    RcuHead rcu;
+    u32 count;
+    u8 buckets[RAMDISK_INDEX_BUCKETS];  // open addressing on the name hash
+    RAMDiskFileEntry entries[RAMDISK_MAX_FILES];
+};
+
+struct DeferredBlockFree;
+
+// An overwrite whose new contents only fit in the old contents' blocks:
+// the file is hidden and its blocks reserved until readers are done with them
+struct RAMDiskReplace {
+    RAMDiskFileIndex* next;  // published when the replace finishes
+    u32 slot;
+    u32 start_block, block_count;
+    u32 old_start_block, old_block_count;
+};
+
+class RAMDiskFS {
+private:
+    u8* disk_memory;
+    u32 total_size;
+    RAMDiskSuperblock* superblock;
+    u8* fat;
+    RAMDiskFileEntry* file_table;
+    u8* data_blocks;
+    RAMDiskFileIndex* index;  // RCU protected
+    u8 pins[RAMDISK_MAX_FILES];  // mappings of each file-table slot; pinned files can't change
+    u32 pending_free_blocks;     // freed blocks still waiting out a grace period
+    u32 generation;              // bumped when format or load replaces the image
+    
+    // Helper methods
+    u32 find_free_block();
+    u32 find_free_run(u32 blocks_needed);
+    u32 calculate_blocks_needed(u32 file_size);
+    RAMDiskFileEntry* find_file_entry(const char* filename);
+    RAMDiskFileEntry* find_free_file_entry();
+    void remove_entry(RAMDiskFileEntry* entry, DeferredBlockFree* deferred);
+    void defer_block_free(DeferredBlockFree* deferred, u32 start_block, u32 block_count);
+    void set_blocks(u32 start_block, u32 block_count, u8 value);
+    void publish_index(RAMDiskFileIndex* next);
+    const RAMDiskFileEntry* lookup(const RAMDiskFileIndex* idx, const char* filename);
+    static void deferred_block_free(RcuHead* head);
+
+public:
+    // Core operations
+    bool initialize(u32 memory_address, u32 size = RAMDISK_DEFAULT_SIZE);
+    bool format();
+    
+    // File operations
+    bool create_file(const char* filename, const u8* data, u32 size);
+    bool read_file(const char* filename, u8* buffer, u32 buffer_size);
+    bool delete_file(const char* filename);
+    bool has_pending_frees();
+    bool begin_replace(const char* filename, u32 size, RAMDiskReplace* replace);
+    void finish_replace(RAMDiskReplace* replace, const u8* data, u32 size);
+    bool file_exists(const char* filename);  // <-- ADD THIS LINE
+    const u8* map_file(const char* filename, u32* size, u32* handle);
+    void unmap_file(u32 handle);
+    
+    // Directory operations  
+    void list_files();
+    u32 get_file_count();
+    u32 get_free_space();
+    u32 get_total_space();
+    int get_file_list(RAMDiskFileEntry* list, int max_entries);  // <-- MOVE THIS HERE
+    
+    // Utility
+    bool is_initialized();
+    void get_file_info(const char* filename, u32* size, u32* timestamp);
+    void debug_status();
+    u32 checksum(bool parallel);
+
+    // Persistence: the whole image, superblock first, from sector 0
+    bool save(BlockDevice* dev);
+    bool load(BlockDevice* dev);
+};
+
+extern RAMDiskFS g_ramdisk;
+
+// Public interface functions
+void fs_initialize();
+bool fs_create_file(const char* filename, const u8* data, u32 size);
+bool fs_read_file(const char* filename, u8* buffer, u32 buffer_size);
+bool fs_delete_file(const char* filename);
+bool fs_file_exists(const char* filename);  // <-- ADD THIS LINE
+
+// Direct, page-aligned view of a file's contents in the RAM disk. The
+// file can't be deleted or overwritten until every handle is unmapped.
+const u8* fs_map_file(const char* filename, u32* size, u32* handle);
+void fs_unmap_file(u32 handle);
+void fs_list_files();
+u32 fs_get_free_space();
+void fs_debug_status();
+int fs_get_file_list(RAMDiskFileEntry* list, int max_entries);
+u32 fs_checksum(bool parallel);
+
+// Write the RAM disk image to dev, or replace the RAM disk with the image
+// on dev. fs_load fails, leaving the RAM disk alone, if dev holds no
+// image of the same layout or a file is mapped.
+bool fs_save(BlockDevice* dev);
+bool fs_load(BlockDevice* dev);
+
 #endif
\ No newline at end of file
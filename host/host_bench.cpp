@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "host/host_platform.h"
+#include "bench.h"
+#include "timer.h"
+
+// The kernel's alloc/mem/fs benchmarks (bench.cpp) on the host arena:
+//     host_bench [group] [-n iterations]
+// Lines match bench.log, so a host run can be diffed against a boot.
+
+static int strcmp(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return (u8)*a - (u8)*b;
+}
+
+int main(int argc, char** argv) {
+    const char* group = nullptr;
+    u32 iterations = BENCH_ITERATIONS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            iterations = (u32)strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-v") == 0) {
+            host_set_verbose(true);
+        } else {
+            group = argv[i];
+        }
+    }
+    if (!host_platform_initialize()) return 2;
+
+    printf("# %u MHz TSC, %u iterations\n", tsc_khz() / 1000, iterations);
+    u32 count = 0;
+    const BenchCase* cases = bench_kernel_cases(&count);
+    u32 ran = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (group && strcmp(group, cases[i].group) != 0) continue;
+        BenchResult result;
+        if (!bench_measure(&cases[i], BENCH_WARMUP, iterations, &result)) {
+            fprintf(stderr, "%s: failed\n", cases[i].name);
+            continue;
+        }
+        char line[96];
+        bench_format(&cases[i], &result, line, sizeof(line));
+        printf("%s\n", line);
+        ran++;
+    }
+    bench_release();
+
+    if (ran == 0) {
+        fprintf(stderr, "usage: host_bench [alloc|mem|fs] [-n iterations] [-v]\n");
+        return 1;
+    }
+    return 0;
+}
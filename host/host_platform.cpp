@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "host/host_platform.h"
+#include "cpu.h"
+#include "smp.h"
+#include "timer.h"
+#include "console.h"
+#include "trace.h"
+#include "crc32.h"
+#include "alternatives.h"
+#include "klog.h"
+#include "fs_ramdisk.h"
+#include "process.h"
+#include "net.h"
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// ---- CPUs: the process is CPU 0 of a uniprocessor ----
+
+Cpu g_host_cpu;
+
+bool cpu_percpu_ready() {
+    return true;
+}
+
+u32 cpu_count() {
+    return 1;
+}
+
+u32 cpu_online_count() {
+    return 1;
+}
+
+Cpu* get_cpu(u32 index) {
+    return index == 0 ? &g_host_cpu : nullptr;
+}
+
+void smp_wakeup_cpu(u32) {}
+
+// ---- TSC, calibrated against CLOCK_MONOTONIC ----
+
+static u32 g_tsc_khz = 0;
+
+static u64 monotonic_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void calibrate_tsc() {
+    u64 ns_start = monotonic_ns();
+    u64 tsc_start = rdtsc();
+    while (monotonic_ns() - ns_start < 20000000ull) cpu_pause();  // 20ms
+    u64 cycles = rdtsc() - tsc_start;
+    u64 ns = monotonic_ns() - ns_start;
+    g_tsc_khz = (u32)udiv64(cycles * 1000000ull, (u32)ns);
+    if (g_tsc_khz == 0) g_tsc_khz = 1;
+}
+
+u32 tsc_khz() {
+    return g_tsc_khz;
+}
+
+u64 tsc_to_ns(u64 cycles) {
+    return udiv64(cycles * 1000000ull, g_tsc_khz);
+}
+
+void udelay(u32 us) {
+    u64 end = monotonic_ns() + (u64)us * 1000;
+    while (monotonic_ns() < end) cpu_pause();
+}
+
+void mdelay(u32 ms) {
+    udelay(ms * 1000);
+}
+
+// ---- console and trace: klog lines go to stderr, tracing stays off ----
+
+static bool g_verbose = false;
+
+void host_set_verbose(bool verbose) {
+    g_verbose = verbose;
+}
+
+u32 console_routes() {
+    return g_verbose ? CONSOLE_LOG : 0;
+}
+
+void console_log(const char* line, u32 len) {
+    fwrite(line, 1, len, stderr);
+}
+
+volatile bool g_trace_enabled = false;
+
+void trace_record(u8, u8, u32) {}
+
+// ---- processes: no threads, so sockets never block ----
+
+Process* process_current() {
+    return nullptr;
+}
+
+void process_block() {}
+
+void process_wake(Process*) {}
+
+// ---- arena ----
+
+bool host_platform_initialize() {
+    u32 size = HOST_ARENA_END - HOST_ARENA_START;
+    void* arena = mmap((void*)HOST_ARENA_START, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (arena == MAP_FAILED || arena != (void*)HOST_ARENA_START) {
+        fprintf(stderr, "host: can't map the arena at 0x%x-0x%x\n",
+                HOST_ARENA_START, HOST_ARENA_END);
+        if (arena != MAP_FAILED) munmap(arena, size);
+        return false;
+    }
+
+    g_host_cpu.self = &g_host_cpu;
+    g_host_cpu.index = 0;
+    g_host_cpu.online = 1;
+    calibrate_tsc();
+
+    // Same order as the kernel's main()
+    klog_initialize();
+    cpu_features_detect();  // host text is read-only: variants are called directly, never patched in
+    initialize_memory();
+    kmalloc_enable_cpu_caches();
+    crc32_initialize();
+    fs_initialize();
+    net_initialize();
+    return true;
+}
@@ -0,0 +1,22 @@
+#ifndef HOST_PLATFORM_H
+#define HOST_PLATFORM_H
+
+#include "memory.h"
+
+// Host-native build of the allocator and RAM disk (make host-test,
+// make host-bench). The kernel runs identity mapped, so kmalloc and the
+// RAM disk hand out physical addresses; an anonymous mapping at the same
+// addresses lets memory.cpp and fs_ramdisk.cpp run unmodified in a
+// 32-bit Linux process. The rest of the kernel they call into (CPUs,
+// timer, console, trace) is stubbed in host_platform.cpp.
+#define HOST_ARENA_START KERNEL_HEAP_START
+#define HOST_ARENA_END   FRAME_POOL_END
+
+// Map the arena, calibrate the TSC and bring up memory and the RAM disk
+// in boot order; false (with a message on stderr) if the arena is taken
+bool host_platform_initialize();
+
+// klog lines on stderr (off by default, kmalloc OOM warnings are noisy)
+void host_set_verbose(bool verbose);
+
+#endif
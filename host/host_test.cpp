@@ -0,0 +1,722 @@
+#include <stdio.h>
+
+#include "host/host_platform.h"
+#include "memory.h"
+#include "fs_ramdisk.h"
+#include "rcu.h"
+#include "crc32.h"
+#include "alternatives.h"
+#include "block.h"
+#include "net.h"
+#include "socket.h"
+
+// Allocator and RAM disk invariants, run against the host arena. Tests
+// share one heap and one disk in table order, so each one frees what it
+// allocates; the exhaustion test runs last.
+
+static const char* g_current = "";
+static u32 g_failures = 0;
+
+static void fail(const char* file, int line, const char* expr) {
+    fprintf(stderr, "  FAIL %s: %s:%d: %s\n", g_current, file, line, expr);
+    g_failures++;
+}
+
+#define CHECK(cond) do { if (!(cond)) { fail(__FILE__, __LINE__, #cond); return; } } while (0)
+
+static bool in_heap(void* p, u32 size) {
+    u32 addr = (u32)p;
+    return addr >= KERNEL_HEAP_START && addr + size <= KERNEL_HEAP_START + KERNEL_HEAP_SIZE;
+}
+
+static void fill(u8* p, u32 size, u32 seed) {
+    for (u32 i = 0; i < size; i++) p[i] = (u8)(seed * 31 + i);
+}
+
+static bool check_fill(const u8* p, u32 size, u32 seed) {
+    for (u32 i = 0; i < size; i++) {
+        if (p[i] != (u8)(seed * 31 + i)) return false;
+    }
+    return true;
+}
+
+// Freed RAM disk blocks and old file indexes wait for a grace period
+static void settle() {
+    synchronize_rcu();
+}
+
+// ---- kmalloc ----
+
+#define SMALL_BLOCKS 512
+
+static void test_kmalloc_small_distinct() {
+    static u8* blocks[SMALL_BLOCKS];
+    static u32 sizes[SMALL_BLOCKS];
+    for (u32 i = 0; i < SMALL_BLOCKS; i++) {
+        sizes[i] = 1 + (i * 37) % KMALLOC_MAX_CLASS_SIZE;
+        blocks[i] = (u8*)kmalloc(sizes[i]);
+        CHECK(blocks[i] != nullptr);
+        CHECK(((u32)blocks[i] & 7) == 0);
+        CHECK(in_heap(blocks[i], sizes[i]));
+        fill(blocks[i], sizes[i], i);
+    }
+    // Any overlap would have clobbered an earlier pattern
+    for (u32 i = 0; i < SMALL_BLOCKS; i++) CHECK(check_fill(blocks[i], sizes[i], i));
+    for (u32 i = 0; i < SMALL_BLOCKS; i++) kfree(blocks[i]);
+}
+
+static void test_kmalloc_reuses_freed_block() {
+    KmallocStats before, after;
+    void* p = kmalloc(64);
+    CHECK(p != nullptr);
+    kfree(p);
+    kmalloc_get_stats(&before);
+    void* q = kmalloc(64);
+    kmalloc_get_stats(&after);
+    CHECK(q == p);  // the magazine is LIFO
+    CHECK(after.cache_hits == before.cache_hits + 1);
+    kfree(q);
+}
+
+static void test_kmalloc_bytes_in_use() {
+    KmallocStats before, during, after;
+    kmalloc_get_stats(&before);
+    void* small = kmalloc(100);                         // 128-byte class with its header
+    void* large = kmalloc(KMALLOC_MAX_CLASS_SIZE * 2);
+    CHECK(small && large);
+    kmalloc_get_stats(&during);
+    CHECK(during.bytes_in_use >= before.bytes_in_use + 128 + KMALLOC_MAX_CLASS_SIZE * 2);
+    kfree(small);
+    kfree(large);
+    kmalloc_get_stats(&after);
+    CHECK(after.bytes_in_use == before.bytes_in_use);
+}
+
+static void test_kmalloc_magazine_overflow() {
+    // More than a magazine's worth of one class forces refills and drains
+    static void* blocks[KMALLOC_MAGAZINE_SIZE * 4];
+    KmallocStats before, after;
+    kmalloc_get_stats(&before);
+    for (u32 i = 0; i < KMALLOC_MAGAZINE_SIZE * 4; i++) {
+        blocks[i] = kmalloc(100);
+        CHECK(blocks[i] != nullptr);
+        fill((u8*)blocks[i], 100, i);
+    }
+    for (u32 i = 0; i < KMALLOC_MAGAZINE_SIZE * 4; i++) {
+        CHECK(check_fill((u8*)blocks[i], 100, i));
+        kfree(blocks[i]);
+    }
+    kmalloc_get_stats(&after);
+    CHECK(after.refills > before.refills);
+    CHECK(after.drains > before.drains);
+}
+
+static void test_kmalloc_large() {
+    const u32 size = 64 * 1024;
+    u8* a = (u8*)kmalloc(size);
+    u8* b = (u8*)kmalloc(size);
+    CHECK(a && b && a != b);
+    CHECK(in_heap(a, size) && in_heap(b, size));
+    CHECK(a + size <= b || b + size <= a);
+    fill(a, size, 1);
+    fill(b, size, 2);
+    CHECK(check_fill(a, size, 1) && check_fill(b, size, 2));
+    kfree(a);
+    u8* c = (u8*)kmalloc(size);
+    CHECK(c == a);  // first fit finds the freed block
+    kfree(b);
+    kfree(c);
+}
+
+static void test_kfree_ignores_foreign_pointers() {
+    static u32 not_from_kmalloc[4];
+    kfree(nullptr);
+    kfree(&not_from_kmalloc[2]);  // header words are zero: no magic
+    void* p = kmalloc(32);
+    CHECK(p != nullptr);
+    kfree(p);
+}
+
+// ---- frames ----
+
+static void test_frames_zeroed_and_aligned() {
+    u32 free_before = frame_free_count();
+    u32 frames[3];
+    for (u32 i = 0; i < 3; i++) {
+        frames[i] = frame_alloc();
+        CHECK(frames[i] != 0);
+        CHECK((frames[i] & (PAGE_SIZE - 1)) == 0);
+        CHECK(frames[i] >= FRAME_POOL_START && frames[i] + PAGE_SIZE <= FRAME_POOL_END);
+        const u8* page = (const u8*)frames[i];
+        for (u32 j = 0; j < PAGE_SIZE; j++) CHECK(page[j] == 0);
+        memset((void*)frames[i], 0xCC, PAGE_SIZE);
+    }
+    CHECK(frame_free_count() == free_before - 3);
+    for (u32 i = 0; i < 3; i++) frame_free(frames[i]);
+    CHECK(frame_free_count() == free_before);
+
+    // Reallocated frames come back zeroed, not with the old fill
+    u32 again = frame_alloc();
+    CHECK(again != 0);
+    for (u32 j = 0; j < PAGE_SIZE; j++) CHECK(((const u8*)again)[j] == 0);
+    frame_free(again);
+}
+
+// ---- mem* ----
+
+static void test_memcpy_lengths_and_offsets() {
+    static u8 src[160], dst[160];
+    fill(src, sizeof(src), 7);
+    for (u32 offset = 0; offset < 8; offset++) {
+        for (u32 n = 0; n <= 67; n++) {
+            memset(dst, 0xEE, sizeof(dst));
+            memcpy(dst + offset, src + (7 - offset), n);
+            for (u32 i = 0; i < n; i++) CHECK(dst[offset + i] == src[7 - offset + i]);
+            CHECK(dst[offset + n] == 0xEE);
+            if (offset) CHECK(dst[offset - 1] == 0xEE);
+        }
+    }
+}
+
+static void test_memmove_overlap() {
+    static u8 buf[256], ref[256];
+    for (u32 shift = 1; shift < 20; shift++) {
+        fill(buf, sizeof(buf), shift);
+        fill(ref, sizeof(ref), shift);
+        memmove(buf + shift, buf, 200);  // backward copy
+        for (u32 i = 0; i < 200; i++) CHECK(buf[shift + i] == ref[i]);
+
+        fill(buf, sizeof(buf), shift);
+        memmove(buf, buf + shift, 200);  // forward copy
+        for (u32 i = 0; i < 200; i++) CHECK(buf[i] == ref[shift + i]);
+    }
+}
+
+static void test_memset_and_memcmp() {
+    static u8 a[100], b[100];
+    memset(a, 0x5A, sizeof(a));
+    for (u32 i = 0; i < sizeof(a); i++) CHECK(a[i] == 0x5A);
+    memset(b, 0x5A, sizeof(b));
+    CHECK(memcmp(a, b, sizeof(a)) == 0);
+    b[40] = 0x5B;
+    CHECK(memcmp(a, b, sizeof(a)) < 0);
+    CHECK(memcmp(b, a, sizeof(a)) > 0);
+    CHECK(memcmp(a, b, 40) == 0);
+    CHECK(memcmp(a, b, 0) == 0);
+}
+
+// ---- alternatives: each variant must match the routine it replaces ----
+
+static void test_erms_variants_match() {
+    static u8 src[160], a[160], b[160];
+    fill(src, sizeof(src), 3);
+    for (u32 offset = 0; offset < 8; offset++) {
+        for (u32 n = 0; n <= 67; n++) {
+            memset(a, 0xEE, sizeof(a));
+            memset_erms(b, 0xEE, sizeof(b));
+            CHECK(memcmp(a, b, sizeof(a)) == 0);
+            CHECK(memcpy(a + offset, src + 1, n) == a + offset);
+            CHECK(memcpy_erms(b + offset, src + 1, n) == b + offset);
+            CHECK(memcmp(a, b, sizeof(a)) == 0);
+            CHECK(memset_erms(b + offset, 0x100 + n, n) == b + offset);
+            memset(a + offset, 0x100 + n, n);
+            CHECK(memcmp(a, b, sizeof(a)) == 0);
+        }
+    }
+}
+
+static void test_crc32c_sse42_matches() {
+    static u8 data[300];
+    fill(data, sizeof(data), 5);
+    CHECK(crc32c(0, "123456789", 9) == 0xE3069283);
+    if (!cpu_has_feature(CPU_FEATURE_SSE42)) return;
+    CHECK(crc32c_sse42(0, "123456789", 9) == 0xE3069283);
+    for (u32 offset = 0; offset < 4; offset++) {
+        for (u32 n = 0; n < 40; n++) {
+            CHECK(crc32c_sse42(n, data + offset, n) == crc32c(n, data + offset, n));
+        }
+    }
+    CHECK(crc32c_sse42(0, data, sizeof(data)) == crc32c(0, data, sizeof(data)));
+}
+
+// ---- RAM disk ----
+
+static void test_fs_create_read_delete() {
+    static u8 data[5000], out[5000];
+    fill(data, sizeof(data), 3);
+    u32 files = g_ramdisk.get_file_count();
+    u32 free_before = fs_get_free_space();
+
+    CHECK(fs_create_file("a.txt", data, sizeof(data)));
+    CHECK(fs_file_exists("a.txt"));
+    CHECK(g_ramdisk.get_file_count() == files + 1);
+    CHECK(fs_get_free_space() <= free_before - sizeof(data));
+
+    CHECK(fs_read_file("a.txt", out, sizeof(out)));
+    CHECK(check_fill(out, sizeof(out), 3));
+    CHECK(!fs_read_file("a.txt", out, sizeof(out) - 1));  // buffer too small
+
+    CHECK(fs_delete_file("a.txt"));
+    CHECK(!fs_file_exists("a.txt"));
+    CHECK(!fs_delete_file("a.txt"));
+    CHECK(g_ramdisk.get_file_count() == files);
+    settle();
+    CHECK(fs_get_free_space() == free_before);
+}
+
+static void test_fs_rejects_bad_arguments() {
+    u8 byte = 1;
+    CHECK(!fs_create_file(nullptr, &byte, 1));
+    CHECK(!fs_create_file("empty", &byte, 0));
+    CHECK(!fs_create_file("nodata", nullptr, 1));
+    CHECK(!fs_read_file("missing", &byte, 1));
+}
+
+static void test_fs_overwrite_replaces_contents() {
+    static u8 first[3000], second[700], out[3000];
+    fill(first, sizeof(first), 4);
+    fill(second, sizeof(second), 5);
+    u32 free_before = fs_get_free_space();
+    CHECK(fs_create_file("b.txt", first, sizeof(first)));
+    u32 files = g_ramdisk.get_file_count();
+    CHECK(fs_create_file("b.txt", second, sizeof(second)));
+    CHECK(g_ramdisk.get_file_count() == files);
+
+    u32 size = 0;
+    g_ramdisk.get_file_info("b.txt", &size, nullptr);
+    CHECK(size == sizeof(second));
+    CHECK(fs_read_file("b.txt", out, sizeof(out)));
+    CHECK(check_fill(out, sizeof(second), 5));
+
+    CHECK(fs_delete_file("b.txt"));
+    settle();
+    CHECK(fs_get_free_space() == free_before);
+}
+
+// Bigger than half the disk: the new copy only fits in the old one's blocks
+static void test_fs_overwrite_reuses_its_own_blocks() {
+    settle();
+    u32 free_before = fs_get_free_space();
+    u32 size = free_before / 3 * 2;
+    u8* data = (u8*)kmalloc(size);
+    u8* out = (u8*)kmalloc(size);
+    CHECK(data && out);
+    fill(data, size, 9);
+    CHECK(fs_create_file("big.bin", data, size));
+
+    fill(data, size, 10);
+    CHECK(fs_create_file("big.bin", data, size));
+    CHECK(fs_read_file("big.bin", out, size));
+    CHECK(check_fill(out, size, 10));
+
+    // Too big even with the old blocks back: the old file stays
+    CHECK(!fs_create_file("big.bin", data, free_before + RAMDISK_BLOCK_SIZE));
+    CHECK(fs_read_file("big.bin", out, size));
+    CHECK(check_fill(out, size, 10));
+
+    CHECK(fs_delete_file("big.bin"));
+    kfree(data);
+    kfree(out);
+    settle();
+    CHECK(fs_get_free_space() == free_before);
+}
+
+static void test_fs_mapped_file_is_pinned() {
+    static u8 data[100];
+    fill(data, sizeof(data), 6);
+    CHECK(fs_create_file("m.bin", data, sizeof(data)));
+
+    u32 size = 0, handle = 0;
+    const u8* view = fs_map_file("m.bin", &size, &handle);
+    CHECK(view != nullptr);
+    CHECK(((u32)view & (PAGE_SIZE - 1)) == 0);
+    CHECK(size == sizeof(data) && check_fill(view, size, 6));
+    CHECK(!fs_delete_file("m.bin"));
+    CHECK(!fs_create_file("m.bin", data, 10));
+
+    fs_unmap_file(handle);
+    CHECK(fs_delete_file("m.bin"));
+    settle();
+}
+
+static void test_fs_fills_up_and_recovers() {
+    const u32 size = 64 * 1024;
+    u8* data = (u8*)kmalloc(size);
+    CHECK(data != nullptr);
+    fill(data, size, 8);
+    u32 free_before = fs_get_free_space();
+    char name[] = "fill00";
+    u32 created = 0;
+    while (created < 100) {
+        name[4] = '0' + created / 10;
+        name[5] = '0' + created % 10;
+        if (!fs_create_file(name, data, size)) break;
+        created++;
+    }
+    CHECK(created > 0 && created < 100);
+    CHECK(fs_get_free_space() < size);
+
+    for (u32 i = 0; i < created; i++) {
+        name[4] = '0' + i / 10;
+        name[5] = '0' + i % 10;
+        CHECK(fs_delete_file(name));
+    }
+    kfree(data);
+    settle();
+    CHECK(fs_get_free_space() == free_before);
+}
+
+static void test_fs_file_table_limit() {
+    u8 byte = 0x42;
+    char name[] = "t00";
+    u32 base = g_ramdisk.get_file_count();
+    u32 created = 0;
+    for (u32 i = 0; i < RAMDISK_MAX_FILES + 1; i++) {
+        name[1] = '0' + i / 10;
+        name[2] = '0' + i % 10;
+        if (fs_create_file(name, &byte, 1)) created++;
+    }
+    CHECK(base + created == RAMDISK_MAX_FILES);
+
+    RAMDiskFileEntry list[RAMDISK_MAX_FILES];
+    CHECK(fs_get_file_list(list, RAMDISK_MAX_FILES) == RAMDISK_MAX_FILES);
+
+    for (u32 i = 0; i < created; i++) {
+        name[1] = '0' + i / 10;
+        name[2] = '0' + i % 10;
+        CHECK(fs_delete_file(name));
+    }
+    settle();
+    CHECK(g_ramdisk.get_file_count() == base);
+}
+
+static void test_fs_checksum_serial_matches_parallel() {
+    static u8 data[20000];
+    fill(data, sizeof(data), 9);
+    CHECK(fs_create_file("crc.bin", data, sizeof(data)));
+    u32 serial = fs_checksum(false);
+    CHECK(serial == fs_checksum(true));
+    CHECK(fs_delete_file("crc.bin"));
+    settle();
+    CHECK(fs_checksum(false) != serial);
+}
+
+// ---- block layer and RAM disk persistence ----
+
+// A RAM-backed device that finishes requests inside submit, at most two
+// per call, so block_run has to top the queue up
+static u32 memdisk_submit(BlockDevice* dev, BlockRequest** requests, u32 count) {
+    u8* data = (u8*)dev->driver_data;
+    u32 taken = count < 2 ? count : 2;
+    for (u32 i = 0; i < taken; i++) {
+        BlockRequest* req = requests[i];
+        if (req->segment_count > dev->max_segments) {  // as virtio-blk would
+            req->status = BLOCK_ERROR;
+            continue;
+        }
+        u8* at = data + (u32)req->sector * BLOCK_SECTOR_SIZE;
+        for (u32 s = 0; s < req->segment_count; s++) {
+            const BlockSegment& seg = req->segments[s];
+            if (req->op == BLOCK_READ) memcpy(seg.buffer, at, seg.length);
+            if (req->op == BLOCK_WRITE) memcpy(at, seg.buffer, seg.length);
+            at += seg.length;
+        }
+        req->status = BLOCK_OK;
+    }
+    return taken;
+}
+
+static void memdisk_poll(BlockDevice*) {}
+
+static const BlockOps memdisk_ops = { memdisk_submit, memdisk_poll };
+
+static void memdisk_init(BlockDevice* dev, u8* data, u32 bytes) {
+    memset(dev, 0, sizeof(BlockDevice));
+    dev->sectors = bytes / BLOCK_SECTOR_SIZE;
+    dev->max_segments = 3;
+    dev->max_segment_size = 1536;
+    dev->queue_depth = 4;
+    dev->ops = &memdisk_ops;
+    dev->driver_data = data;
+}
+
+static void test_block_requests_split_and_batch() {
+    static u8 disk[64 * 1024], data[20480], out[20480];
+    BlockDevice dev;
+    memdisk_init(&dev, disk, sizeof(disk));
+    fill(data, sizeof(data), 11);
+
+    CHECK(block_write(&dev, 3, data, sizeof(data)));
+    CHECK(memcmp(disk + 3 * BLOCK_SECTOR_SIZE, data, sizeof(data)) == 0);
+    CHECK(block_read(&dev, 3, out, sizeof(out)));
+    CHECK(memcmp(out, data, sizeof(out)) == 0);
+    CHECK(dev.requests == 10);  // 3 x 1536-byte segments per request, 5 per direction
+    CHECK(dev.bytes_written == sizeof(data) && dev.bytes_read == sizeof(out));
+    CHECK(block_flush(&dev));
+
+    CHECK(!block_read(&dev, dev.sectors - 1, out, 2 * BLOCK_SECTOR_SIZE));  // past the end
+    CHECK(!block_write(&dev, 0, data, 100));                                // partial sector
+    dev.read_only = true;
+    CHECK(!block_write(&dev, 0, data, BLOCK_SECTOR_SIZE));
+
+    // Segments too big to divide the request size evenly: requests still
+    // have to fit in max_segments of them
+    memdisk_init(&dev, disk, sizeof(disk));
+    dev.max_segment_size = 21845;
+    static u8 whole[sizeof(disk)];
+    CHECK(block_read(&dev, 0, whole, sizeof(whole)));
+    CHECK(memcmp(whole, disk, sizeof(whole)) == 0);
+}
+
+static void test_fs_save_and_load() {
+    static u8 disk[RAMDISK_DEFAULT_SIZE], data[3000], out[3000];
+    BlockDevice dev;
+    memdisk_init(&dev, disk, sizeof(disk));
+    fill(data, sizeof(data), 12);
+
+    CHECK(!fs_load(&dev));  // blank disk: no image
+    CHECK(fs_create_file("keep.bin", data, sizeof(data)));
+    CHECK(fs_save(&dev));
+    CHECK(fs_delete_file("keep.bin"));
+    CHECK(fs_create_file("gone.bin", data, 10));
+
+    CHECK(fs_load(&dev));
+    CHECK(fs_file_exists("keep.bin"));
+    CHECK(!fs_file_exists("gone.bin"));
+    CHECK(fs_read_file("keep.bin", out, sizeof(out)));
+    CHECK(memcmp(out, data, sizeof(out)) == 0);
+
+    // Not while a file is mapped
+    u32 size, handle;
+    CHECK(fs_map_file("keep.bin", &size, &handle) != nullptr);
+    CHECK(!fs_load(&dev));
+    fs_unmap_file(handle);
+
+    // A free still queued when the image is replaced belongs to the old
+    // image: it must not release blocks of the loaded one
+    u32 free_loaded = fs_get_free_space();
+    CHECK(fs_delete_file("keep.bin"));
+    CHECK(g_ramdisk.load(&dev));  // skips fs_load's grace period
+    settle();
+    CHECK(fs_get_free_space() == free_loaded);
+    CHECK(fs_read_file("keep.bin", out, sizeof(out)));
+
+    CHECK(fs_delete_file("keep.bin"));
+    settle();
+}
+
+// ---- network: sockets over loopback and a reflecting device ----
+
+// Sends every packet straight back, with checksums computed and checked
+static bool reflect_transmit(NetDevice* dev, NetBuf* buf) {
+    dev->tx_packets++;
+    netdev_receive(dev, buf);
+    return true;
+}
+
+static const NetDeviceOps reflect_ops = { reflect_transmit };
+
+static NetDevice* reflect_device() {
+    static NetDevice dev;
+    if (!dev.ops) {
+        memcpy(dev.name, "tst0", 5);
+        dev.ip = NET_IP(10, 0, 0, 1);
+        dev.netmask = NET_IP(255, 255, 255, 0);
+        dev.mtu = NET_MTU;
+        dev.ops = &reflect_ops;
+        netdev_register(&dev);
+    }
+    return &dev;
+}
+
+static bool no_sockets_left() {
+    char out[64];
+    return sock_format_all(out, sizeof(out)) == 0;
+}
+
+static void test_udp_loopback() {
+    u8 data[1200], out[1200];
+    fill(data, sizeof(data), 13);
+    s32 server = sock_open(SOCKET_UDP);
+    s32 client = sock_open(SOCKET_UDP);
+    CHECK(server >= 0 && client >= 0);
+    CHECK(sock_bind(server, 7000) == 0);
+    CHECK(sock_bind(client, 7000) == NET_EADDRINUSE);
+
+    CHECK(sock_recv(server, out, sizeof(out), SOCKET_NONBLOCK) == NET_EAGAIN);
+    CHECK(sock_sendto(client, data, sizeof(data), NET_LOOPBACK_IP, 7000) == (s32)sizeof(data));
+    u32 ip = 0;
+    u16 port = 0;
+    CHECK(sock_recvfrom(server, out, sizeof(out), &ip, &port, 0) == (s32)sizeof(data));
+    CHECK(memcmp(out, data, sizeof(data)) == 0);
+    CHECK(ip == NET_LOOPBACK_IP && port >= SOCKET_EPHEMERAL_FIRST);
+
+    // The reply finds the client's ephemeral port; a short buffer truncates
+    CHECK(sock_sendto(server, data, 100, ip, port) == 100);
+    CHECK(sock_recv(client, out, 10, 0) == 10);
+    CHECK(sock_recv(client, out, sizeof(out), SOCKET_NONBLOCK) == NET_EAGAIN);
+    CHECK(sock_sendto(client, data, NET_MTU, NET_LOOPBACK_IP, 7000) == NET_EMSGSIZE);
+
+    // Checksummed through a device that isn't loopback
+    u32 no_socket = net_stats()->no_socket;
+    CHECK(sock_sendto(client, data, 64, reflect_device()->ip, 7000) == 64);
+    CHECK(sock_recv(server, out, sizeof(out), 0) == 64);
+    CHECK(sock_sendto(client, data, 64, NET_LOOPBACK_IP, 7999) == 64);
+    CHECK(net_stats()->no_socket == no_socket + 1);
+
+    sock_close(client);
+    sock_close(server);
+    CHECK(no_sockets_left());
+    settle();
+}
+
+// Both ends in one thread: nothing blocks, so move data in turns
+static bool tcp_transfer(s32 from, s32 to, const u8* data, u8* out, u32 len) {
+    u32 sent = 0, received = 0;
+    for (u32 rounds = 0; received < len && rounds < 1000; rounds++) {
+        if (sent < len) {
+            s32 n = sock_send(from, data + sent, len - sent, SOCKET_NONBLOCK);
+            if (n < 0 && n != NET_EAGAIN) return false;
+            if (n > 0) sent += n;
+        }
+        s32 n = sock_recv(to, out + received, len - received, SOCKET_NONBLOCK);
+        if (n < 0 && n != NET_EAGAIN) return false;
+        if (n > 0) received += n;
+    }
+    return received == len && memcmp(out, data, len) == 0;
+}
+
+static void tcp_stream(u32 ip, u16 port) {
+    static u8 data[40000], out[40000];
+    fill(data, sizeof(data), 14);
+    s32 listener = sock_open(SOCKET_TCP);
+    s32 client = sock_open(SOCKET_TCP);
+    CHECK(sock_bind(listener, port) == 0);
+    CHECK(sock_listen(listener, 4) == 0);
+    CHECK(sock_accept(listener, SOCKET_NONBLOCK) == NET_EAGAIN);
+
+    CHECK(sock_connect(client, ip, port, 0) == 0);
+    s32 server = sock_accept(listener, 0);
+    CHECK(server >= 0);
+
+    // More than both buffers: the window has to open and close
+    CHECK(tcp_transfer(client, server, data, out, sizeof(data)));
+    CHECK(tcp_transfer(server, client, data, out, 3000));
+
+    // Close: the reader sees the end of the stream, then both sides go away
+    CHECK(sock_send(client, data, 5, 0) == 5);
+    sock_close(client);
+    CHECK(sock_recv(server, out, sizeof(out), 0) == 5);
+    CHECK(sock_recv(server, out, sizeof(out), 0) == 0);
+    sock_close(server);
+    sock_close(listener);
+    CHECK(no_sockets_left());
+}
+
+static void test_tcp_loopback_stream() {
+    tcp_stream(NET_LOOPBACK_IP, 7001);
+    settle();
+}
+
+static void test_tcp_checksummed_stream() {
+    u32 bad = net_stats()->ip_bad;
+    tcp_stream(reflect_device()->ip, 7002);
+    CHECK(net_stats()->ip_bad == bad);
+    settle();
+}
+
+static void test_tcp_refused_and_reset() {
+    s32 client = sock_open(SOCKET_TCP);
+    CHECK(sock_connect(client, NET_LOOPBACK_IP, 7003, 0) == NET_EREFUSED);
+    sock_close(client);
+
+    // Closing with unread data resets the peer
+    s32 listener = sock_open(SOCKET_TCP);
+    client = sock_open(SOCKET_TCP);
+    CHECK(sock_bind(listener, 7003) == 0 && sock_listen(listener, 1) == 0);
+    CHECK(sock_connect(client, NET_LOOPBACK_IP, 7003, 0) == 0);
+    s32 server = sock_accept(listener, 0);
+    CHECK(server >= 0);
+    CHECK(sock_send(client, "x", 1, 0) == 1);
+    sock_close(server);
+    u8 byte;
+    CHECK(sock_recv(client, &byte, 1, 0) == NET_ERESET);
+    CHECK(sock_send(client, "x", 1, 0) == NET_ERESET);
+    sock_close(client);
+    sock_close(listener);
+    CHECK(no_sockets_left());
+    settle();
+}
+
+// ---- last: runs the heap dry ----
+
+static void test_kmalloc_exhaustion_returns_null() {
+    static void* blocks[KERNEL_HEAP_SIZE / (256 * 1024) + 2];
+    u32 count = 0;
+    while (count < sizeof(blocks) / sizeof(blocks[0])) {
+        void* p = kmalloc(256 * 1024);
+        if (!p) break;
+        blocks[count++] = p;
+    }
+    CHECK(count < sizeof(blocks) / sizeof(blocks[0]));
+    CHECK(kmalloc(KERNEL_HEAP_SIZE) == nullptr);
+    for (u32 i = 0; i < count; i++) kfree(blocks[i]);
+
+    // The freed blocks are reusable
+    void* again = kmalloc(256 * 1024);
+    CHECK(again != nullptr);
+    kfree(again);
+}
+
+struct HostTest {
+    const char* name;
+    void (*run)();
+};
+
+static const HostTest tests[] = {
+    { "kmalloc small blocks are distinct", test_kmalloc_small_distinct },
+    { "kmalloc reuses a freed block", test_kmalloc_reuses_freed_block },
+    { "kmalloc bytes in use", test_kmalloc_bytes_in_use },
+    { "kmalloc magazine overflow", test_kmalloc_magazine_overflow },
+    { "kmalloc large blocks", test_kmalloc_large },
+    { "kfree ignores foreign pointers", test_kfree_ignores_foreign_pointers },
+    { "frames are zeroed and aligned", test_frames_zeroed_and_aligned },
+    { "memcpy lengths and offsets", test_memcpy_lengths_and_offsets },
+    { "memmove overlap", test_memmove_overlap },
+    { "memset and memcmp", test_memset_and_memcmp },
+    { "erms mem* variants match", test_erms_variants_match },
+    { "crc32c sse4.2 variant matches", test_crc32c_sse42_matches },
+    { "fs create/read/delete", test_fs_create_read_delete },
+    { "fs rejects bad arguments", test_fs_rejects_bad_arguments },
+    { "fs overwrite replaces contents", test_fs_overwrite_replaces_contents },
+    { "fs overwrite reuses its own blocks", test_fs_overwrite_reuses_its_own_blocks },
+    { "fs mapped file is pinned", test_fs_mapped_file_is_pinned },
+    { "fs fills up and recovers", test_fs_fills_up_and_recovers },
+    { "fs file table limit", test_fs_file_table_limit },
+    { "fs checksum serial == parallel", test_fs_checksum_serial_matches_parallel },
+    { "block requests split and batch", test_block_requests_split_and_batch },
+    { "fs save and load", test_fs_save_and_load },
+    { "udp over loopback", test_udp_loopback },
+    { "tcp stream over loopback", test_tcp_loopback_stream },
+    { "tcp stream with checksums", test_tcp_checksummed_stream },
+    { "tcp refused and reset", test_tcp_refused_and_reset },
+    { "kmalloc exhaustion returns null", test_kmalloc_exhaustion_returns_null },
+};
+
+int main(int argc, char** argv) {
+    host_set_verbose(argc > 1 && argv[1][0] == '-' && argv[1][1] == 'v');
+    if (!host_platform_initialize()) return 2;
+
+    u32 count = sizeof(tests) / sizeof(tests[0]);
+    u32 failed = 0;
+    for (u32 i = 0; i < count; i++) {
+        g_current = tests[i].name;
+        u32 before = g_failures;
+        tests[i].run();
+        bool ok = g_failures == before;
+        if (!ok) failed++;
+        printf("%s %s\n", ok ? "ok  " : "FAIL", tests[i].name);
+    }
+    printf("%u/%u passed\n", count - failed, count);
+    return failed ? 1 : 0;
+}
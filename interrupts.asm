@@ -0,0 +1,66 @@
+; Interrupt entry stubs: every vector pushes (error code, vector) and
+; funnels into isr_common, which builds an InterruptFrame for C++.
+section .text
+[bits 32]
+[extern interrupt_dispatch]
+
+KERNEL_DATA_SEG equ 0x10
+PERCPU_SEG      equ 0x30
+
+%macro ISR_NOERR 1
+isr%1:
+    push dword 0
+    push dword %1
+    jmp isr_common
+%endmacro
+
+%macro ISR_ERR 1
+isr%1:
+    push dword %1
+    jmp isr_common
+%endmacro
+
+%assign i 0
+%rep 256
+%if i == 8 || (i >= 10 && i <= 14) || i == 17 || i == 21 || i == 29 || i == 30
+    ISR_ERR %[i]
+%else
+    ISR_NOERR %[i]
+%endif
+%assign i i+1
+%endrep
+
+isr_common:
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    mov ax, KERNEL_DATA_SEG
+    mov ds, ax
+    mov es, ax
+    mov ax, PERCPU_SEG          ; same selector in every CPU's private GDT
+    mov gs, ax
+
+    cld
+    push esp                    ; InterruptFrame*
+    call interrupt_dispatch
+    add esp, 4
+
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8                  ; drop vector and error code
+    iret
+
+section .data
+global isr_stub_table
+isr_stub_table:
+%assign i 0
+%rep 256
+    dd isr%[i]
+%assign i i+1
+%endrep
@@ -0,0 +1,156 @@
+#include "interrupts.h"
+#include "apic.h"
+#include "cpu.h"
+#include "io.h"
+#include "process.h"
+
+// PIC ports
+#define PIC1_COMMAND 0x20
+#define PIC1_DATA    0x21
+#define PIC2_COMMAND 0xA0
+#define PIC2_DATA    0xA1
+#define PIC_EOI      0x20
+
+struct IdtEntry {
+    u16 offset_low;
+    u16 selector;
+    u8 zero;
+    u8 type_attr;
+    u16 offset_high;
+} __attribute__((packed));
+
+struct IdtDescriptor {
+    u16 limit;
+    u32 base;
+} __attribute__((packed));
+
+// Defined in interrupts.asm: one entry stub per vector
+extern "C" u32 isr_stub_table[256];
+
+static IdtEntry idt[256];
+static InterruptHandler handlers[256];
+
+static const char* exception_names[32] = {
+    "DIVIDE ERROR", "DEBUG", "NMI", "BREAKPOINT", "OVERFLOW", "BOUND RANGE",
+    "INVALID OPCODE", "DEVICE NOT AVAILABLE", "DOUBLE FAULT", "COPROCESSOR",
+    "INVALID TSS", "SEGMENT NOT PRESENT", "STACK FAULT", "GENERAL PROTECTION",
+    "PAGE FAULT", "RESERVED", "X87 FPU ERROR", "ALIGNMENT CHECK", "MACHINE CHECK",
+    "SIMD FPU ERROR", "VIRTUALIZATION", "CONTROL PROTECTION", "RESERVED", "RESERVED",
+    "RESERVED", "RESERVED", "RESERVED", "RESERVED", "RESERVED", "RESERVED",
+    "SECURITY", "RESERVED"
+};
+
+static void set_gate(u8 vector, u32 handler, u8 type_attr) {
+    idt[vector].offset_low = handler & 0xFFFF;
+    idt[vector].selector = KERNEL_CODE_SEG;
+    idt[vector].zero = 0;
+    idt[vector].type_attr = type_attr;
+    idt[vector].offset_high = (handler >> 16) & 0xFFFF;
+}
+
+// Write directly into VGA memory; the UI code may be what faulted
+static void panic_print(const char* s, int x, int y) {
+    volatile u16* vga = (volatile u16*)0xB8000;
+    for (int i = 0; s[i] != 0 && x + i < 80; i++) {
+        vga[y * 80 + x + i] = (u16)(u8)s[i] | (0x4F << 8);
+    }
+}
+
+static void hex32(char* buf, u32 value) {
+    static const char digits[] = "0123456789ABCDEF";
+    for (int i = 0; i < 8; i++) {
+        buf[i] = digits[(value >> (28 - i * 4)) & 0xF];
+    }
+    buf[8] = 0;
+}
+
+void unhandled_exception(InterruptFrame* frame) {
+    irq_disable();
+    char hex[9];
+    for (int x = 0; x < 80; x++) panic_print(" ", x, 24);
+    panic_print("KERNEL PANIC:", 0, 24);
+    panic_print(exception_names[frame->vector], 14, 24);
+    panic_print("EIP=", 44, 24);
+    hex32(hex, frame->eip);
+    panic_print(hex, 48, 24);
+    panic_print("ERR=", 58, 24);
+    hex32(hex, frame->error_code);
+    panic_print(hex, 62, 24);
+    while (true) cpu_halt();
+}
+
+void interrupts_initialize() {
+    for (int i = 0; i < 256; i++) {
+        set_gate(i, isr_stub_table[i], 0x8E);  // present, ring 0, 32-bit interrupt gate
+        handlers[i] = nullptr;
+    }
+    pic_remap_and_mask();
+    idt_load();
+}
+
+void idt_load() {
+    IdtDescriptor desc;
+    desc.limit = sizeof(idt) - 1;
+    desc.base = (u32)idt;
+    asm volatile ("lidt %0" : : "m"(desc));
+}
+
+void register_interrupt_handler(u8 vector, InterruptHandler handler) {
+    handlers[vector] = handler;
+}
+
+void register_user_interrupt_handler(u8 vector, InterruptHandler handler) {
+    set_gate(vector, isr_stub_table[vector], 0xEE);  // present, ring 3 may int
+    handlers[vector] = handler;
+}
+
+extern "C" void interrupt_dispatch(InterruptFrame* frame) {
+    u32 vector = frame->vector;
+
+    if (handlers[vector]) {
+        handlers[vector](frame);
+    } else if (vector < 32) {
+        if (frame_from_user(frame)) {
+            process_fault(frame, 0);  // kill the process, not the kernel
+        } else {
+            unhandled_exception(frame);
+        }
+    }
+
+    // Acknowledge the interrupt controller that delivered it
+    if (vector >= IRQ_BASE && vector < IRQ_BASE + 16) {
+        if (vector >= IRQ_BASE + 8) outb(PIC2_COMMAND, PIC_EOI);
+        outb(PIC1_COMMAND, PIC_EOI);
+    } else if (vector >= VECTOR_APIC_TIMER && vector != VECTOR_APIC_SPURIOUS &&
+               vector != VECTOR_SYSCALL) {
+        apic_eoi();
+    }
+
+    if (frame_from_user(frame)) process_return_to_user();
+}
+
+// Move the PIC off the exception vectors and mask every line;
+// drivers unmask the IRQs they own.
+void pic_remap_and_mask() {
+    outb(PIC1_COMMAND, 0x11); io_wait();  // ICW1: init, expect ICW4
+    outb(PIC2_COMMAND, 0x11); io_wait();
+    outb(PIC1_DATA, IRQ_BASE); io_wait();      // ICW2: vector offset
+    outb(PIC2_DATA, IRQ_BASE + 8); io_wait();
+    outb(PIC1_DATA, 4); io_wait();             // ICW3: slave on IRQ2
+    outb(PIC2_DATA, 2); io_wait();
+    outb(PIC1_DATA, 0x01); io_wait();          // ICW4: 8086 mode
+    outb(PIC2_DATA, 0x01); io_wait();
+
+    outb(PIC1_DATA, 0xFB);  // everything masked except the cascade line
+    outb(PIC2_DATA, 0xFF);
+}
+
+void pic_unmask_irq(u8 irq) {
+    u16 port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+}
+
+void pic_mask_irq(u8 irq) {
+    u16 port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (1 << (irq & 7)));
+}
@@ -0,0 +1,49 @@
+#ifndef INTERRUPTS_H
+#define INTERRUPTS_H
+
+#include "memory.h"
+
+// Segment selectors (must match the GDT built in smp.cpp)
+#define KERNEL_CODE_SEG 0x08
+#define KERNEL_DATA_SEG 0x10
+#define USER_CODE_SEG   0x1B  // RPL 3
+#define USER_DATA_SEG   0x23
+
+// Vector layout
+#define IRQ_BASE              0x20  // legacy PIC IRQs 0-15
+#define VECTOR_APIC_TIMER     0x40
+#define VECTOR_IPI_WAKEUP     0x41
+#define VECTOR_IPI_CALL       0x42
+#define VECTOR_SYSCALL        0x80  // int 0x80, reachable from ring 3
+#define VECTOR_APIC_SPURIOUS  0xFF
+
+// Register state pushed by the common ISR stub (interrupts.asm)
+struct InterruptFrame {
+    u32 gs, fs, es, ds;
+    u32 edi, esi, ebp, esp_dummy, ebx, edx, ecx, eax;
+    u32 vector, error_code;
+    u32 eip, cs, eflags;
+    u32 user_esp, user_ss;  // only valid when coming from ring 3
+};
+
+typedef void (*InterruptHandler)(InterruptFrame* frame);
+
+// IDT setup
+void interrupts_initialize();
+void idt_load();
+void register_interrupt_handler(u8 vector, InterruptHandler handler);
+void register_user_interrupt_handler(u8 vector, InterruptHandler handler);  // DPL 3 gate
+void unhandled_exception(InterruptFrame* frame);  // kernel panic, never returns
+
+static inline bool frame_from_user(const InterruptFrame* frame) {
+    return (frame->cs & 3) == 3;
+}
+
+// Legacy 8259 PIC
+void pic_remap_and_mask();
+void pic_unmask_irq(u8 irq);
+void pic_mask_irq(u8 irq);
+
+extern "C" void interrupt_dispatch(InterruptFrame* frame);
+
+#endif
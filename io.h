@@ -0,0 +1,51 @@
+#ifndef IO_H
+#define IO_H
+
+#include "memory.h"
+
+// Port I/O helpers shared by all drivers
+static inline void outb(u16 port, u8 value) {
+    asm volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline u8 inb(u16 port) {
+    u8 ret;
+    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outw(u16 port, u16 value) {
+    asm volatile ("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline u16 inw(u16 port) {
+    u16 ret;
+    asm volatile ("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(u16 port, u32 value) {
+    asm volatile ("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline u32 inl(u16 port) {
+    u32 ret;
+    asm volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Short delay for slow legacy devices (PIC, CMOS)
+static inline void io_wait() {
+    outb(0x80, 0);
+}
+
+// QEMU's isa-debug-exit device (-device isa-debug-exit,iobase=0xf4,iosize=0x04):
+// writing code ends the emulator with exit status (code << 1) | 1. Returns
+// when the device isn't there, as on real hardware.
+#define QEMU_DEBUG_EXIT_PORT 0xF4
+
+static inline void qemu_debug_exit(u8 code) {
+    outb(QEMU_DEBUG_EXIT_PORT, code);
+}
+
+#endif
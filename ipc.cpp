@@ -0,0 +1,179 @@
+#include "ipc.h"
+#include "process.h"
+#include "paging.h"
+#include "syscall.h"
+#include "cpu.h"
+
+// At most one receiver waits on an endpoint; senders queue in order.
+// Processes only run on the boot CPU and the kernel isn't preemptible,
+// so disabling interrupts is enough to keep the endpoints consistent.
+struct Endpoint {
+    Process* receiver;
+    Process* send_head;
+    Process* send_tail;
+};
+
+static Endpoint g_endpoints[IPC_ENDPOINTS];
+
+static bool page_range_ok(u32 addr, u32 count) {
+    return count == 0 || (count <= IPC_MAX_PAGES && !(addr & (PAGE_SIZE - 1)) &&
+                          user_range_ok(addr, count * PAGE_SIZE));
+}
+
+// Only private, writable frames can change hands
+static bool pages_owned(Process* proc, u32 addr, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        u32 pte = paging_get_pte(proc->page_directory, addr + i * PAGE_SIZE);
+        u32 need = PTE_PRESENT | PTE_USER | PTE_WRITABLE;
+        if ((pte & need) != need || (pte & PTE_SHARED)) return false;
+    }
+    return true;
+}
+
+// Move the pages of from's message into to's window. All or nothing:
+// a failed mapping (no frame for a page table) puts everything back.
+static bool move_pages(Process* from, Process* to) {
+    const IpcState& s = from->ipc;
+    const IpcState& r = to->ipc;
+    if (s.pages > r.pages) return false;
+    for (u32 i = 0; i < s.pages; i++) {
+        if (paging_get_pte(to->page_directory, r.addr + i * PAGE_SIZE) & PTE_PRESENT) return false;
+    }
+
+    for (u32 i = 0; i < s.pages; i++) {
+        u32 pte = paging_unmap(from->page_directory, s.addr + i * PAGE_SIZE);
+        if (paging_map(to->page_directory, r.addr + i * PAGE_SIZE, pte & PTE_FRAME,
+                       PTE_USER | PTE_WRITABLE)) {
+            continue;
+        }
+        paging_map(from->page_directory, s.addr + i * PAGE_SIZE, pte & PTE_FRAME, PTE_USER | PTE_WRITABLE);
+        while (i--) {
+            pte = paging_unmap(to->page_directory, r.addr + i * PAGE_SIZE);
+            paging_map(from->page_directory, s.addr + i * PAGE_SIZE, pte & PTE_FRAME, PTE_USER | PTE_WRITABLE);
+        }
+        return false;
+    }
+    return true;
+}
+
+// Deliver from's message to to, which is either running or blocked in
+// ipc_receive. Its return value (the sender's pid) goes through
+// ipc.result; the rest lands in its saved user registers.
+static bool deliver(Process* from, Process* to) {
+    if (!move_pages(from, to)) return false;
+
+    InterruptFrame* frame = process_user_frame(to);
+    frame->ebx = from->ipc.words[0];
+    frame->esi = from->ipc.words[1];
+    frame->edi = from->ipc.pages;
+    to->ipc.result = from->pid;
+    return true;
+}
+
+static Process* pop_sender(Endpoint& ep) {
+    Process* proc = ep.send_head;
+    if (proc) {
+        ep.send_head = proc->ipc.next;
+        if (!ep.send_head) ep.send_tail = nullptr;
+        proc->ipc.next = nullptr;
+    }
+    return proc;
+}
+
+static void remove_sender(Endpoint& ep, Process* proc) {
+    Process* prev = nullptr;
+    for (Process* p = ep.send_head; p; prev = p, p = p->ipc.next) {
+        if (p != proc) continue;
+        if (prev) {
+            prev->ipc.next = p->ipc.next;
+        } else {
+            ep.send_head = p->ipc.next;
+        }
+        if (ep.send_tail == p) ep.send_tail = prev;
+        p->ipc.next = nullptr;
+        return;
+    }
+}
+
+// Sleep until the other side completes our message or we're killed
+static void block(Process* self) {
+    while (!self->ipc.done && !self->killed) process_block();
+}
+
+u32 ipc_send(u32 endpoint, u32 word0, u32 word1, u32 pages_addr, u32 page_count) {
+    Process* self = process_current();
+    if (endpoint >= IPC_ENDPOINTS || !page_range_ok(pages_addr, page_count) ||
+        !pages_owned(self, pages_addr, page_count)) {
+        return SYSCALL_ERROR;
+    }
+
+    self->ipc.words[0] = word0;
+    self->ipc.words[1] = word1;
+    self->ipc.addr = pages_addr;
+    self->ipc.pages = page_count;
+    self->ipc.result = SYSCALL_ERROR;
+    self->ipc.done = false;
+
+    u32 flags = irq_save();
+    Endpoint& ep = g_endpoints[endpoint];
+    Process* receiver = ep.receiver;
+    if (receiver) {
+        u32 result = SYSCALL_ERROR;
+        if (deliver(self, receiver)) {
+            ep.receiver = nullptr;
+            receiver->ipc.done = true;
+            process_wake(receiver);
+            result = 0;
+        }
+        irq_restore(flags);
+        return result;
+    }
+
+    self->ipc.next = nullptr;
+    if (ep.send_tail) {
+        ep.send_tail->ipc.next = self;
+    } else {
+        ep.send_head = self;
+    }
+    ep.send_tail = self;
+    block(self);
+    if (!self->ipc.done) remove_sender(ep, self);
+    irq_restore(flags);
+    return self->ipc.result;
+}
+
+u32 ipc_receive(u32 endpoint, u32 dest_addr, u32 max_pages) {
+    Process* self = process_current();
+    if (endpoint >= IPC_ENDPOINTS || !page_range_ok(dest_addr, max_pages)) return SYSCALL_ERROR;
+
+    self->ipc.addr = dest_addr;
+    self->ipc.pages = max_pages;
+    self->ipc.result = SYSCALL_ERROR;
+    self->ipc.done = false;
+
+    u32 flags = irq_save();
+    Endpoint& ep = g_endpoints[endpoint];
+
+    // Take the first queued message we can accept; the rest fail
+    // their senders rather than wedging the queue
+    while (Process* sender = pop_sender(ep)) {
+        bool ok = deliver(sender, self);
+        sender->ipc.result = ok ? 0 : SYSCALL_ERROR;
+        sender->ipc.done = true;
+        process_wake(sender);
+        if (ok) {
+            irq_restore(flags);
+            return self->ipc.result;
+        }
+    }
+
+    if (ep.receiver) {
+        irq_restore(flags);
+        return SYSCALL_ERROR;
+    }
+    ep.receiver = self;
+    block(self);
+    if (!self->ipc.done) ep.receiver = nullptr;
+    irq_restore(flags);
+    return self->ipc.result;
+}
@@ -0,0 +1,27 @@
+#ifndef IPC_H
+#define IPC_H
+
+#include "memory.h"
+
+// Synchronous message passing between processes over numbered endpoints.
+// A send blocks until a receiver takes the message and a receive blocks
+// until one arrives. The two words of a message are written straight
+// into the receiver's saved user registers. Pages travel by moving their
+// page table entries from the sender to the receiver, so a send costs
+// the same whether the payload bytes are zeroes or anything else and
+// grows only by one PTE move per page; nothing is copied.
+//
+// A send gives up its pages: they vanish from the sender (touching them
+// again faults in fresh ones inside a demand-paged region) and appear,
+// writable and owned, in the receiver.
+
+#define IPC_ENDPOINTS 16
+#define IPC_MAX_PAGES 64   // per message
+
+// Syscall backends, for the current process. On success ipc_send returns
+// 0 and ipc_receive the sender's pid, with the words in ebx and esi and
+// the number of pages received in edi. Failures return SYSCALL_ERROR.
+u32 ipc_send(u32 endpoint, u32 word0, u32 word1, u32 pages_addr, u32 page_count);
+u32 ipc_receive(u32 endpoint, u32 dest_addr, u32 max_pages);
+
+#endif
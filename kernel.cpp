@@ -1,1349 +1,2221 @@
-// atomic_kernel.cpp
-// Single-file improved "ATOMIC OS" kernel UI - 32-bit freestanding
-extern "C" void main();
-#include "memory.h"
-#include "fs_ramdisk.h"
-
-// VGA constants
-static const int WIDTH = 80;
-static const int HEIGHT = 25;
-typedef unsigned short u16;
-static volatile u16* const VGA = (volatile u16*)0xB8000;
-
-// I/O ports
-#define KEYBOARD_DATA_PORT 0x60
-#define KEYBOARD_STATUS_PORT 0x64
-#define CMOS_ADDRESS 0x70
-#define CMOS_DATA    0x71
-
-// Basic types
-typedef unsigned char u8;
-typedef unsigned short u16t;
-typedef unsigned int u32;
-
-// --- Low-level I/O helpers (fixed inline asm ordering and constraints) ---
-static inline void outb(u16t port, u8 value) {
-    asm volatile ("outb %0, %1" : : "a"(value), "Nd"(port));
-}
-static inline u8 inb(u16t port) {
-    u8 ret;
-    asm volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
-    return ret;
-}
-
-// Make a VGA cell
-static inline u16 vga_entry(char c, unsigned char attr) {
-    return (u16)c | ((u16)attr << 8);
-}
-
-// Write one character safely
-static inline void putc_xy(int x, int y, char c, unsigned char attr) {
-    if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT) return;
-    VGA[y * WIDTH + x] = vga_entry(c, attr);
-}
-
-// Clear full screen
-void clear_screen(unsigned char attr) {
-    u16 cell = vga_entry(' ', attr);
-    for (int i = 0; i < WIDTH * HEIGHT; i++) VGA[i] = cell;
-}
-
-// Print string at (x,y)
-void print_string(const char* s, int x, int y, unsigned char attr = 0x0F) {
-    for (int i = 0; s[i] != 0 && x + i < WIDTH; i++) putc_xy(x + i, y, s[i], attr);
-}
-
-// Draw centered text
-void print_centered(const char* s, int y, unsigned char attr = 0x0F) {
-    int len = 0;
-    while (s[len] != 0) len++;
-    int x = (WIDTH - len) / 2;
-    print_string(s, x, y, attr);
-}
-
-// Safe strcmp (same as before)
-int strcmp(const char* s1, const char* s2) {
-    while (*s1 && (*s1 == *s2)) { s1++; s2++; }
-    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
-}
-
-// --- CMOS / RTC helpers (fixed) ---
-u8 read_cmos(u8 reg) {
-    outb(CMOS_ADDRESS, reg);
-    return inb(CMOS_DATA);
-}
-
-int is_updating_rtc() {
-    outb(CMOS_ADDRESS, 0x0A);
-    return inb(CMOS_DATA) & 0x80;
-}
-
-u8 bcd_to_bin(u8 bcd) {
-    return ((bcd >> 4) * 10) + (bcd & 0x0F);
-}
-
-struct Time {
-    u8 second;
-    u8 minute;
-    u8 hour;
-    u8 day;
-    u8 month;
-    u8 year; // two-digit year (00..99)
-};
-
-// Stable RTC read: read twice and compare (common OSDev pattern)
-Time read_rtc_time() {
-    Time t1, t2;
-    u8 reg_b;
-    do {
-        // wait while update in progress
-        while (is_updating_rtc()) {}
-
-        t1.second = read_cmos(0x00);
-        t1.minute = read_cmos(0x02);
-        t1.hour   = read_cmos(0x04);
-        t1.day    = read_cmos(0x07);
-        t1.month  = read_cmos(0x08);
-        t1.year   = read_cmos(0x09);
-
-        // read twice
-        while (is_updating_rtc()) {}
-
-        t2.second = read_cmos(0x00);
-        t2.minute = read_cmos(0x02);
-        t2.hour   = read_cmos(0x04);
-        t2.day    = read_cmos(0x07);
-        t2.month  = read_cmos(0x08);
-        t2.year   = read_cmos(0x09);
-    } while (t1.second != t2.second || t1.minute != t2.minute || t1.hour != t2.hour ||
-             t1.day != t2.day || t1.month != t2.month || t1.year != t2.year);
-
-    // Now get register B once for format info
-    outb(CMOS_ADDRESS, 0x0B);
-    reg_b = inb(CMOS_DATA);
-
-    Time result = t1;
-    // Convert from BCD if necessary
-    if (!(reg_b & 0x04)) {
-        result.second = bcd_to_bin(result.second);
-        result.minute = bcd_to_bin(result.minute);
-        result.hour   = bcd_to_bin(result.hour & 0x7F); // clear possible 12-hour bit for conversion
-        result.day    = bcd_to_bin(result.day);
-        result.month  = bcd_to_bin(result.month);
-        result.year   = bcd_to_bin(result.year);
-    } else {
-        // If reg_b & 0x04, values are already binary - ensure hour cleared of 12h bit before checking
-        result.hour = result.hour & 0x7F;
-    }
-
-    // Convert 12-hour to 24-hour format if necessary (bit 1 of reg_b == 0 => 12-hour mode)
-    if (!(reg_b & 0x02) && (t1.hour & 0x80)) {
-        // hour's PM bit was set in t1; convert using t1 because it contained the 0x80 marker
-        u8 hour12 = t1.hour & 0x7F;
-        // if BCD, hour12 was converted earlier; we used t1.hour to check 0x80 but used result.hour for numeric
-        result.hour = (hour12 % 12) + 12;
-        if (result.hour >= 24) result.hour -= 24;
-    }
-
-    return result;
-}
-
-// formatting helpers
-static inline void two_digits(char* dst, int v) {
-    dst[0] = '0' + (v / 10) % 10;
-    dst[1] = '0' + (v % 10);
-}
-
-// Format time as string "HH:MM:SS"
-void format_time(char* buffer, const Time& time) {
-    two_digits(&buffer[0], time.hour);
-    buffer[2] = ':';
-    two_digits(&buffer[3], time.minute);
-    buffer[5] = ':';
-    two_digits(&buffer[6], time.second);
-    buffer[8] = 0;
-}
-
-// Format date as string "DD/MM/20YY"
-void format_date(char* buffer, const Time& time) {
-    two_digits(&buffer[0], time.day);
-    buffer[2] = '/';
-    two_digits(&buffer[3], time.month);
-    buffer[5] = '/';
-    buffer[6] = '2';
-    buffer[7] = '0';
-    two_digits(&buffer[8], time.year);
-    buffer[10] = 0;
-}
-
-// Draw glowing horizontal line
-void draw_glow_line(int y, unsigned char attr) {
-    for (int x = 0; x < WIDTH; x++) putc_xy(x, y, 0xDB, attr);
-}
-
-void draw_atomic_border() {
-    int w = 64;
-    int h = 7;
-
-    // Top border
-    putc_xy(15, 1, '+', 0x1F);
-    for (int x = 16; x < w - 1; x++)
-        putc_xy(x, 1, '-', 0x1F);   // use '_' if you want
-    putc_xy(w - 1, 1, '+', 0x1F);
-
-    // Side borders
-    for (int y = 2; y < h ; y++) {
-        putc_xy(15, y, '|', 0x1F);
-        putc_xy(w - 1, y, '|', 0x1F);
-    }
-
-    // Bottom border
-    putc_xy(15, h  , '+', 0x1F);
-    for (int x = 16; x < w - 1; x++)
-        putc_xy(x, h , '-', 0x1F);
-    putc_xy(w - 1, h , '+', 0x1F);
-}
-
-
-// Draw static interface skeleton (draw once)
-void draw_static_interface() {
-    // Background subtle grid but tiled with the word "ATOMIC" as a pattern
-    const char *tile = "ATOMIC ";
-    int tile_len = 7; // length of tile string above
-
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            // base background (dark teal-ish)
-            unsigned char bg = 0x10;
-
-            // slight checker to add depth
-            if ((x + y) % 6 == 0) bg = 0x11;
-
-            // draw the tile-letter in a faint color occasionally to form the repeating word pattern
-            char ch = tile[(x + y) % tile_len];
-            if ((x % 8) == 0 && (y % 3) == 0) {
-                // faint character as background motif
-                putc_xy(x, y, ch, 0x12); // dark green on dark background (subtle)
-            } else {
-                putc_xy(x, y, ' ', bg);
-            }
-        }
-    }
-
-    // Bold centered ASCII wordmark for "ATOMIC OS"
-    const char* banner[] = {
-        "   ___   _____  _____  __  __  _____  _____  ",
-        "  / _ \\ |_   _||  _  ||  \\/  ||_   _|| ____| ",
-        " | |_| |  | |  | | | || |\\/| |  | |  | |     ",
-        " | | | |  | |  | |_| || |  | | _| |_ | |___  ",
-        " |_| |_|  |_|  |_____||_|  |_||_____||_____| ",
-        "                                              "
-    };
-    int banner_h = sizeof(banner) / sizeof(banner[0]);
-    int banner_y = 2; // start a little lower so header glow remains
-    for (int i = 0; i < banner_h; ++i) {
-        print_centered(banner[i], banner_y + i, 0x3E); // cyan-on-blueish glow
-    }
-
-    // === FLOATING PLATFORM (improved) ===
-    int platform_y = banner_y + banner_h + 0; // position platform under banner
-    
-    draw_atomic_border();
-    
-    // === LARGE WORDMARK (centered, stylized) ===
-    // A compact, readable "ATOMIC OS" wordmark appearing above the platform
-    print_centered("   A T O M I C   O S   ", platform_y , 0x1E);
-    print_centered("   SYSTEM READY        ", platform_y + 7, 0x1F);
-
-    // === HOLOGRAPHIC INFO DISPLAY BOX (refined) ===
-    int box_w = 52;
-    int box_x = (WIDTH - box_w) / 2;
-    int box_y = platform_y ;
-    int box_h = 6;
-
-
-
-    // Holographic interior: a subtle gradient using two attributes
-    for (int y = box_y + 1; y < box_y + box_h - 1; ++y) {
-        unsigned char attr = (y % 2 == 0) ? 0x1E : 0x1F; // alternate to simulate depth
-        for (int x = box_x + 1; x < box_x + box_w - 1; ++x) {
-            putc_xy(x, y, ' ', attr);
-        }
-    }
-
-    // Static labels inside box (left-aligned)
-    print_string("  CPU:    32-bit x86", box_x + 2, box_y + 2, 0x1E);
-    print_string("  Kernel: v0.1.0     ", box_x + 2, box_y + 3, 0x1E);
-    print_string("  Status: OPERATIONAL", box_x + 2, box_y + 4, 0x1E);
-
-    // Reserve a right-side small 'hologram' panel inside the box for icons/indicators
-    int panel_x = box_x + box_w - 12;
-    print_string("[IO] OK", panel_x, box_y + 2, 0x1E);
-    print_string("[NET] --", panel_x, box_y + 3, 0x1E);
-
-    // === TERMINAL AREA & INPUT FIELD (improved) ===
-    print_centered("TERMINAL READY - TYPE COMMANDS BELOW", box_y + box_h + 2, 0x17);
-    print_centered("TYPE 'help' FOR FURTHER INFO", box_y + box_h + 3, 0x17);
-}
-
-
-/// Update the header time and holographic time (separate function, avoids full redraw)
-void update_time_display() {
-    Time now = read_rtc_time();
-    char time_str[9], date_str[11];
-    format_time(time_str, now);
-    format_date(date_str, now);
-
-    // Right side of header
-    // Clear area first (simple background)
-    for (int x = 55; x < 79; x++) putc_xy(x, 0, ' ', 0x30);
-    print_string(date_str, 56, 0, 0x3F);
-    print_string(time_str, 70, 0, 0x3F);
-
-
-    
-}
-
-// --- Keyboard reading and mapping (safer) ---
-unsigned char read_scan_code() {
-    unsigned char status;
-    do {
-        status = inb(KEYBOARD_STATUS_PORT);
-    } while (!(status & 1)); // wait until output buffer full
-    return inb(KEYBOARD_DATA_PORT);
-}
-
-// Simple set 1 scancode -> ASCII map (index by scancode, 0..127)
-char scan_code_to_ascii(unsigned char scan_code) {
-    if (scan_code & 0x80) return 0; // key release
-    
-    static bool shift_pressed = false;
-    static bool caps_lock = false;
-    
-    
-    // Handle modifier keys
-    if (scan_code == 0x2A || scan_code == 0x36) {
-        shift_pressed = true;
-        return 0;
-    }
-    if (scan_code == 0xAA || scan_code == 0xB6) {
-        shift_pressed = false;
-        return 0;
-    }
-    if (scan_code == 0x3A) {
-        caps_lock = !caps_lock;
-        return 0;
-    }
-    
-    // Determine if we should use uppercase
-    bool uppercase = shift_pressed ^ caps_lock; // XOR: if either is true but not both
-    
-    // Keyboard map with shift support
-    static const char keyboard_map[128] = {
-        0, 27, '1','2','3','4','5','6','7','8','9','0','-','=',0,0,
-        'q','w','e','r','t','y','u','i','o','p','[',']', '\n',0,'a','s',
-        'd','f','g','h','j','k','l',';','\'','`',0,'\\','z','x','c','v',
-        'b','n','m',',','.','/',0,'*',0,' ',
-        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-        0,0,0,0,0,0,0,0,0,0,  // 58-67
-        0,0,0,0,0,0,0,0,0,0  
-    };
-    
-    static const char keyboard_map_shift[128] = {
-        0, 27, '!','@','#','$','%','^','&','*','(',')','_','+',0,0,
-        'Q','W','E','R','T','Y','U','I','O','P','{','}', '\n',0,'A','S',
-        'D','F','G','H','J','K','L',':','"','~',0,'|','Z','X','C','V',
-        'B','N','M','<','>','?',0,'*',0,' ',
-        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
-        0,0,0,0,0,0,0,0,0,0,  // 58-67
-        0,0,0,0,0,0,0,0,0,0  
-    };
-    
-    if (scan_code < sizeof(keyboard_map)) {
-        if (uppercase && scan_code < sizeof(keyboard_map_shift)) {
-            return keyboard_map_shift[scan_code];
-        } else {
-            return keyboard_map[scan_code];
-        }
-    }
-    return 0;
-}
-
-// Small safe helpers
-void copy_str(char* dst, const char* src) {
-    while (*src) { *dst++ = *src++; }
-    *dst = 0;
-}
-
-// Word wrap function - breaks long text into multiple lines
-void show_output_wrapped(const char* text, unsigned char attr = 0x17) {
-    // Clear area first
-    for (int y = 19; y <= 21; y++) {
-        for (int x = 16; x < 64; x++) {
-            putc_xy(x, y, ' ', 0x10);
-        }
-    }
-    
-    int max_length = 48;  // Maximum characters per line (64-16=48 width)
-    int current_line = 0;
-    int start_pos = 0;
-    int text_len = strlen(text);
-    
-    while (start_pos < text_len && current_line < 3) {  // Max 3 lines
-        // Find where to break the line
-        int end_pos = start_pos + max_length;
-        if (end_pos > text_len) {
-            end_pos = text_len;
-        } else {
-            // Try to break at a space if possible
-            for (int i = end_pos; i > start_pos; i--) {
-                if (text[i] == ' ' || text[i] == ',') {
-                    end_pos = i;
-                    break;
-                }
-            }
-        }
-        
-        // Extract and display this line
-        char line[50];
-        int line_len = end_pos - start_pos;
-        for (int i = 0; i < line_len; i++) {
-            line[i] = text[start_pos + i];
-        }
-        line[line_len] = 0;
-        
-        print_centered(line, 20 + current_line, attr);
-        
-        start_pos = end_pos;
-        // Skip spaces at the beginning of next line
-        while (start_pos < text_len && text[start_pos] == ' ') {
-            start_pos++;
-        }
-        current_line++;
-    }
-}
-
-// --- Enhanced Text Editor with Memory Save/Load ---
-class TextEditor {
-private:
-    char buffer[20000];
-    int cursor_pos;
-    bool ctrl_pressed;
-     char current_filename[50];
-
-     void show_file_browser(bool for_saving = false) {
-        clear_screen(0x10);
-        
-        if (for_saving) {
-            print_centered(" SAVE AS - ENTER FILENAME ", 0, 0x1F);
-        } else {
-            print_centered(" LOAD FILE - SELECT FILE ", 0, 0x1F);
-        }
-        
-        print_centered("UP/DOWN: NAVIGATE | ENTER: SELECT | ESC: CANCEL", 1, 0x17);
-        
-        // List files
-        RAMDiskFileEntry files[16];
-        int file_count = fs_get_file_list(files, 16);
-        
-        if (file_count == 0) {
-            print_centered("No files found", 5, 0x47);
-        } else {
-            for (int i = 0; i < file_count && i < 15; i++) {
-                char file_line[60];
-                copy_str(file_line, "  ");
-                copy_str(file_line + 2, files[i].filename);
-                copy_str(file_line + 2 + strlen(files[i].filename), " (");
-                char size_str[10];
-                itoa(size_str, files[i].size, 10);
-                copy_str(file_line + 2 + strlen(files[i].filename) + 2, size_str);
-                copy_str(file_line + 2 + strlen(files[i].filename) + 2 + strlen(size_str), " bytes)");
-                
-                print_string(file_line, 10, 3 + i, 0x17);
-            }
-        }
-        
-        // If saving, show filename input
-        if (for_saving) {
-            print_centered("Or enter new filename:", 18, 0x1E);
-            print_string("Filename: > ", 20, 20, 0x1F);
-            putc_xy(32, 20, '_', 0x4F); // Cursor
-        }
-        
-        // Wait for user input
-        if (for_saving) {
-            get_filename_input();
-        } else {
-            select_file_from_list(file_count);
-        }
-    }
-    
-    void get_filename_input() {
-        char new_filename[50] = {0};
-        int filename_pos = 0;
-        
-        while (true) {
-            unsigned char scan_code = read_scan_code();
-            
-            if (scan_code == 0x01) { // ESC
-                break;
-            } else if (scan_code == 0x1C) { // ENTER
-                if (filename_pos > 0) {
-                    save_file_as(new_filename);
-                }
-                break;
-            } else if (scan_code == 0x0E) { // BACKSPACE
-                if (filename_pos > 0) {
-                    filename_pos--;
-                    new_filename[filename_pos] = 0;
-                }
-            } else {
-                char ascii = scan_code_to_ascii(scan_code);
-                if (ascii != 0 && filename_pos < 49) {
-                    new_filename[filename_pos++] = ascii;
-                    new_filename[filename_pos] = 0;
-                }
-            }
-            
-            // Update display
-            for (int x = 32; x < 70; x++) {
-                putc_xy(x, 20, ' ', 0x1F);
-            }
-            print_string(new_filename, 32, 20, 0x1F);
-            putc_xy(32 + filename_pos, 20, '_', 0x4F);
-        }
-    }
-    
-    void select_file_from_list(int file_count) {
-        if (file_count == 0) {
-            // Wait for any key
-            read_scan_code();
-            return;
-        }
-        
-        int selected = 0;
-        
-        while (true) {
-            // Highlight selected file
-            for (int i = 0; i < file_count && i < 15; i++) {
-                unsigned char attr = (i == selected) ? 0x4F : 0x17;
-                
-                RAMDiskFileEntry files[16];
-                fs_get_file_list(files, 16);
-                
-                char file_line[60];
-                copy_str(file_line, "  ");
-                copy_str(file_line + 2, files[i].filename);
-                
-                // Clear line and print with highlight
-                for (int x = 10; x < 70; x++) {
-                    putc_xy(x, 3 + i, ' ', attr);
-                }
-                print_string(file_line, 10, 3 + i, attr);
-            }
-            
-            unsigned char scan_code = read_scan_code();
-            
-            if (scan_code == 0x01) { // ESC
-                break;
-            } else if (scan_code == 0x1C) { // ENTER
-                RAMDiskFileEntry files[16];
-                fs_get_file_list(files, 16);
-                load_file(files[selected].filename);
-                break;
-            } else if (scan_code == 0x48) { // UP
-                if (selected > 0) selected--;
-            } else if (scan_code == 0x50) { // DOWN
-                if (selected < file_count - 1) selected++;
-            }
-        }
-    }
-
-public:
-    TextEditor() : cursor_pos(0), ctrl_pressed(false) {
-        // Initialize buffer
-        for (int i = 0; i < 20000; i++) buffer[i] = 0;
-        current_filename[0] = 0;
-    }
-
-    // Add these methods to TextEditor class:
-   void load_file(const char* filename) {
-        u8 file_buffer[19000];
-        if (fs_read_file(filename, file_buffer, sizeof(file_buffer))) {
-            // Clear current buffer
-            for (int i = 0; i < 20000; i++) buffer[i] = 0;
-            
-            // Copy file content to editor buffer
-            int i = 0;
-            while (file_buffer[i] != 0 && i < 19999) {
-                buffer[i] = file_buffer[i];
-                i++;
-            }
-            buffer[i] = 0;
-            
-            cursor_pos = 0;
-            copy_str(current_filename, filename);
-            show_message("File loaded", 0x1E);
-        } else {
-            show_message("Load failed", 0x47);
-        }
-        refresh_display();
-    }
-
-    void save_file() {
-        if (current_filename[0] == 0) {
-            show_message("No filename - use F2 to save as", 0x47);
-            return;
-        }
-        
-        if (fs_create_file(current_filename, (const u8*)buffer, strlen(buffer))) {
-            show_message("File saved", 0x1E);
-        } else {
-            show_message("Save failed", 0x47);
-        }
-    }
-
-    void save_file_as(const char* filename) {
-        copy_str(current_filename, filename);
-        save_file();
-    }
-
-    void draw_editor() {
-        clear_screen(0x10);
-
-        // Simple editor header
-        print_centered(" ATOMIC TEXT EDITOR - TYPE TO EDIT ", 0, 0x1F);
-        print_centered("ESC: EXIT | F1: CLEAR | F2: SAVE AS | F3: SAVE | F4: LOAD | Arrow keys: NAVIGATE", 1, 0x17);
-
-        refresh_display();
-    }
-
-    void refresh_display() {
-        // Clear content area
-        for (int y = 3; y < HEIGHT - 2; y++) {
-            for (int x = 2; x < WIDTH - 2; x++) {
-                putc_xy(x, y, ' ', 0x10);
-            }
-        }
-        
-        // Display text content
-        int x = 2, y = 3;
-        for (int i = 0; buffer[i] != 0 && y < HEIGHT - 2; i++) {
-            if (buffer[i] == '\n') { 
-                x = 2; 
-                y++; 
-            } else { 
-                putc_xy(x, y, buffer[i], 0x1F); 
-                x++; 
-                if (x >= WIDTH - 2) { 
-                    x = 2; 
-                    y++; 
-                } 
-            }
-        }
-        
-        // Display cursor
-        int cur_x = 2, cur_y = 3;
-        int line_start = 0;
-        for (int i = 0; i < cursor_pos && buffer[i] != 0; i++) {
-            if (buffer[i] == '\n') { 
-                cur_x = 2; 
-                cur_y++; 
-                line_start = i + 1;
-            } else { 
-                cur_x++; 
-                if (cur_x >= WIDTH - 2) { 
-                    cur_x = 2; 
-                    cur_y++; 
-                    line_start = i + 1;
-                } 
-            }
-        }
-        putc_xy(cur_x, cur_y, '_', 0x4F);
-        
-    }
-
-    void handle_input(unsigned char scan_code) {
-        // Handle modifier keys first
-        if (scan_code == 0x1D) {  // Ctrl press
-            ctrl_pressed = true;
-            return;
-        } else if (scan_code == 0x9D) {  // Ctrl release
-            ctrl_pressed = false;
-            return;
-        }
-        
-        char ascii = scan_code_to_ascii(scan_code);
-        
-        // Special key handling
-        if (scan_code == 0x01) return;  // ESC (handled in run loop)
-        
-        // Clear screen (F1)
-        else if (scan_code == 0x3B) {  // F1 - Clear screen
-            for (int i = 0; i < 20000; i++) buffer[i] = 0;
-            cursor_pos = 0;
-            show_message("SCREEN CLEARED", 0x1E);
-            return;
-        }
-        else if (ctrl_pressed && scan_code == 0x1F) {   
-            for (int i = 0; i < 20000; i++) buffer[i] = 0;
-            cursor_pos = 0;
-            show_message("SCREEN CLEARED", 0x1E);
-            return;
-        }
-        // Arrow keys - Extended scan codes
-        else if (scan_code == 0x48) {  // Up arrow
-            move_cursor_up();
-            return;
-        }
-        else if (scan_code == 0x50) {  // Down arrow
-            move_cursor_down();
-            return;
-        }
-        else if (scan_code == 0x4B) {  // Left arrow
-            if (cursor_pos > 0) {
-                cursor_pos--;
-            }
-        }
-        else if (scan_code == 0x4D) {  // Right arrow
-            if (cursor_pos < 19999 && buffer[cursor_pos] != 0) {
-                cursor_pos++;
-            }
-        }
-
-        else if (scan_code == 0x3C) { // F2 - Save As
-            show_file_browser(true); // true = for saving
-            draw_editor(); // Redraw editor after file operation
-            return;
-        } else if (scan_code == 0x3D) { // F3 - Save
-            save_file();
-            return;
-        } else if (scan_code == 0x3E) { // F4 - Load
-            show_file_browser(false); // false = for loading
-            draw_editor(); // Redraw editor after file operation
-            return;
-        } else if (scan_code == 0x3F) { // F5 - New
-            // Clear buffer and reset filename
-            for (int i = 0; i < 20000; i++) buffer[i] = 0;
-            current_filename[0] = 0;
-            cursor_pos = 0;
-            show_message("New file created", 0x1E);
-            refresh_display();
-            return;
-        }
-        
-        // Backspace
-        else if (scan_code == 0x0E) {   
-            if (cursor_pos > 0) {
-                // Shift all characters left
-                for (int i = cursor_pos - 1; i < 19999; i++) {
-                    buffer[i] = buffer[i + 1];
-                }
-                cursor_pos--;
-                buffer[1999] = 0; // Ensure null terminator
-            }
-        } 
-        
-        // Enter
-        else if (scan_code == 0x1C) { 
-            if (cursor_pos < 19999) {
-                // Shift all characters right to make space for newline
-                for (int i = 19998; i > cursor_pos; i--) {
-                    buffer[i] = buffer[i - 1];
-                }
-                buffer[cursor_pos++] = '\n';
-                buffer[19999] = 0; // Ensure null terminator
-            }
-        } 
-        
-        // Text input
-        else if (ascii != 0 && cursor_pos < 19999) {
-            // Shift all characters right to make space for new character
-            for (int i = 19998; i > cursor_pos; i--) {
-                buffer[i] = buffer[i - 1];
-            }
-            buffer[cursor_pos++] = ascii;
-            buffer[19999] = 0; // Ensure null terminator
-        }
-        
-        refresh_display();
-    }
-
-    void move_cursor_up() {
-        if (cursor_pos == 0) return;
-        
-        // Find current line start
-        int current_line_start = find_line_start(cursor_pos);
-        if (current_line_start == 0) return; // Already at first line
-        
-        // Find previous line start
-        int prev_line_start = find_line_start(current_line_start - 1);
-        
-        // Calculate current column position
-        int current_column = cursor_pos - current_line_start;
-        
-        // Find end of previous line
-        int prev_line_end = current_line_start - 1;
-        if (prev_line_end < 0) prev_line_end = 0;
-        
-        // Calculate target position in previous line
-        int prev_line_length = prev_line_end - prev_line_start;
-        int target_pos = prev_line_start + current_column;
-        
-        // Don't go beyond previous line length
-        if (target_pos > prev_line_end) {
-            target_pos = prev_line_end;
-        }
-        
-        cursor_pos = target_pos;
-    }
-
-    
-
-    void move_cursor_down() {
-        if (buffer[cursor_pos] == 0) return; // At end of buffer
-        
-        // Find current line start
-        int current_line_start = find_line_start(cursor_pos);
-        
-        // Find next line start (after next newline)
-        int next_line_start = cursor_pos;
-        while (buffer[next_line_start] != 0 && buffer[next_line_start] != '\n') {
-            next_line_start++;
-        }
-        if (buffer[next_line_start] == '\n') {
-            next_line_start++; // Move past the newline
-        } else {
-            return; // No next line
-        }
-        
-        // Calculate current column position
-        int current_column = cursor_pos - current_line_start;
-        
-        // Find end of next line
-        int next_line_end = next_line_start;
-        while (buffer[next_line_end] != 0 && buffer[next_line_end] != '\n') {
-            next_line_end++;
-        }
-        
-        // Calculate target position in next line
-        int target_pos = next_line_start + current_column;
-        
-        // Don't go beyond next line length
-        if (target_pos > next_line_end) {
-            target_pos = next_line_end;
-        }
-        
-        cursor_pos = target_pos;
-    }
-
-    int find_line_start(int pos) {
-        int line_start = 0;
-        for (int i = 0; i < pos && buffer[i] != 0; i++) {
-            if (buffer[i] == '\n') {
-                line_start = i + 1;
-            }
-        }
-        return line_start;
-    }
-    
-    void show_message(const char* msg, unsigned char attr) {
-        // Clear message area
-        for (int x = 30; x < 50; x++) {
-            putc_xy(x, HEIGHT - 1, ' ', 0x10);
-        }
-        print_string(msg, 30, HEIGHT - 1, attr);
-    }
-
-    void run() {
-        draw_editor();
-        while (true) {
-            unsigned char scan_code = read_scan_code();
-            if (scan_code == 0x01) break; // ESC to exit
-            handle_input(scan_code);
-        }
-    }
-};
-
-
-// --- CommandLine class (improved formatting, safe buffers) ---
-class CommandLine {
-private:
-    char input_buffer[100];
-    int cursor_pos;
-    void list_files_command() {
-        RAMDiskFileEntry files[16];
-        int file_count = fs_get_file_list(files, 16);
-        
-        if (file_count == 0) {
-            show_output("No files in RAM disk", 0x47);
-        } else {
-            char output[80];
-            copy_str(output, "Files in RAM disk:");
-            show_output(output, 0x1F);
-            
-            for (int i = 0; i < file_count; i++) {
-                char file_info[60];
-                char* ptr = file_info;
-                
-                // Format: "filename.txt (123 bytes)"
-                copy_str(ptr, "  ");
-                ptr += 2;
-                copy_str(ptr, files[i].filename);
-                ptr += strlen(files[i].filename);
-                copy_str(ptr, " (");
-                ptr += 2;
-                char size_str[10];
-                itoa(size_str, files[i].size, 10);
-                copy_str(ptr, size_str);
-                ptr += strlen(size_str);
-                copy_str(ptr, " bytes)");
-                
-                show_output(file_info, 0x17);
-            }
-        }
-    }
-
-    
-    
-    void save_file_command() {
-        if (strlen(input_buffer) < 6) {
-            show_output("Usage: save filename", 0x47);
-            return;
-        }
-        
-        const char* filename = input_buffer + 5;
-        if (strlen(filename) == 0) {
-            show_output("Usage: save filename", 0x47);
-            return;
-        }
-        
-        // Save actual content instead of hardcoded text
-        const char* content = " ";
-        if (fs_create_file(filename, (const u8*)content, strlen(content))) {
-            char msg[50];
-            copy_str(msg, "Saved: ");
-            copy_str(msg + 7, filename);
-            show_output(msg, 0x1E);
-        } else {
-            char msg[50];
-            copy_str(msg, "Save failed - disk full?");
-            show_output(msg, 0x47);
-        }
-    }
-    
-    void load_file_command() {
-    if (strlen(input_buffer) < 6) {
-        show_output("Usage: load filename", 0x47);
-        return;
-    }
-    
-    const char* filename = input_buffer + 5;
-    if (strlen(filename) == 0) {
-        show_output("Usage: load filename", 0x47);
-        return;
-    }
-    
-    // Check if file exists first
-    if (!fs_file_exists(filename)) {
-        char msg[50];
-        copy_str(msg, "File not found: ");
-        copy_str(msg + 16, filename);
-        show_output(msg, 0x47);
-        return;
-    }
-    
-    // Launch editor with the file loaded
-    TextEditor editor;
-    editor.load_file(filename);  // Load file into editor
-    editor.run();               // Run editor
-    
-    // After editor returns, redraw interface
-    clear_screen(0x10);
-    draw_static_interface();
-    update_time_display();
-}
-    
-    void cat_file_command() {
-    // Debug: Show what we received
-    char debug_msg[80];
-    copy_str(debug_msg, "DEBUG input: [");
-    copy_str(debug_msg + 14, input_buffer);
-    copy_str(debug_msg + 14 + strlen(input_buffer), "]");
-    show_output(debug_msg, 0x47);
-    
-    if (strlen(input_buffer) < 5) { // "cat " is 4 chars + space
-        show_output("Usage: cat filename", 0x47);
-        return;
-    }
-    
-    const char* filename = input_buffer + 4; // Skip "cat "
-    
-    // Debug: Show the extracted filename
-    char debug_fn[50];
-    copy_str(debug_fn, "DEBUG filename: [");
-    copy_str(debug_fn + 17, filename);
-    copy_str(debug_fn + 17 + strlen(filename), "]");
-    show_output(debug_fn, 0x47);
-    
-    if (strlen(filename) == 0) {
-        show_output("Usage: cat filename", 0x47);
-        return;
-    }
-    
-    // Debug: Check if file exists first
-    if (!fs_file_exists(filename)) {
-        char msg[60];
-        copy_str(msg, "File does not exist: ");
-        copy_str(msg + 20, filename);
-        show_output(msg, 0x47);
-        
-        // Show available files
-        RAMDiskFileEntry files[16];
-        int file_count = fs_get_file_list(files, 16);
-        if (file_count > 0) {
-            show_output("Available files:", 0x17);
-            for (int i = 0; i < file_count; i++) {
-                char avail_file[40];
-                copy_str(avail_file, "  ");
-                copy_str(avail_file + 2, files[i].filename);
-                show_output(avail_file, 0x17);
-            }
-        }
-        return;
-    }
-    
-    u8 file_buffer[1000];
-    if (fs_read_file(filename, file_buffer, sizeof(file_buffer))) {
-        // Debug: Show file size
-        RAMDiskFileEntry file_info;
-        // We need to get file size - let's create a helper function
-        u32 file_size = 0;
-        // For now, just display the content
-        show_output((char*)file_buffer, 0x1E);
-    } else {
-        char msg[60];
-        copy_str(msg, "Read failed for: ");
-        copy_str(msg + 17, filename);
-        show_output(msg, 0x47);
-    }
-}
-    
-    void delete_file_command() {
-        if (strlen(input_buffer) < 4) { // "rm " is 3 chars
-            show_output("Usage: rm filename", 0x47);
-            return;
-        }
-        
-        const char* filename = input_buffer + 3;
-        if (strlen(filename) == 0) {
-            show_output("Usage: rm filename", 0x47);
-            return;
-        }
-        
-        if (fs_delete_file(filename)) {
-            char msg[50];
-            copy_str(msg, "Deleted: ");
-            copy_str(msg + 9, filename);
-            show_output(msg, 0x1E);
-        } else {
-            char msg[50];
-            copy_str(msg, "Delete failed: ");
-            copy_str(msg + 15, filename);
-            show_output(msg, 0x47);
-        }
-    }
-    
-    // String compare for first n characters
-int strncmp(const char* s1, const char* s2, int n) {
-    for (int i = 0; i < n; i++) {
-        if (s1[i] != s2[i]) {
-            return s1[i] - s2[i];
-        }
-        if (s1[i] == 0) {
-            return 0;
-        }
-    }
-    return 0;
-}
-
-    void filesystem_stats_command() {
-        u32 free_space = fs_get_free_space();
-        u32 total_space = 1024 * 1024; // 1MB RAM disk
-        u32 used_space = total_space - free_space;
-        
-        RAMDiskFileEntry files[16];
-        int file_count = fs_get_file_list(files, 16);
-        
-        char stats[120];
-        char* ptr = stats;
-        
-        copy_str(ptr, "RAM Disk: ");
-        ptr += 10;
-        char used_str[10];
-        itoa(used_str, used_space / 1024, 10);
-        copy_str(ptr, used_str);
-        ptr += strlen(used_str);
-        copy_str(ptr, "K used, ");
-        ptr += 8;
-        char free_str[10];
-        itoa(free_str, free_space / 1024, 10);
-        copy_str(ptr, free_str);
-        ptr += strlen(free_str);
-        copy_str(ptr, "K free, ");
-        ptr += 8;
-        char files_str[5];
-        itoa(files_str, file_count, 10);
-        copy_str(ptr, files_str);
-        ptr += strlen(files_str);
-        copy_str(ptr, " files");
-        
-        show_output(stats, 0x1E);
-    }
-
-public:
-    CommandLine() : cursor_pos(0) {
-        for (int i = 0; i < 100; i++) input_buffer[i] = 0;
-    }
-
-    void clear_input() {
-        for (int x = 18; x < 63; x++) putc_xy(x, 23, '_', 0x17);
-        cursor_pos = 0;
-        for (int i = 0; i < 100; i++) input_buffer[i] = 0;
-        putc_xy(17, 23, '>', 0x2F);
-    }
-
-    void display_input() {
-        for (int x = 18; x < 63; x++) putc_xy(x, 23, ' ', 0x17);
-        for (int i = 0; i < cursor_pos && i < 45; i++) putc_xy(18 + i, 23, input_buffer[i], 0x17);
-        // cursor
-        putc_xy(18 + cursor_pos, 23, '_', 0x4F);
-    }
-
-    void handle_input(unsigned char scan_code) {
-        char ascii = scan_code_to_ascii(scan_code);
-        if (scan_code == 0x01) {
-            // ESC - handled by outer loop (we return to launch editor)
-            return;
-        } else if (scan_code == 0x0E) {
-            if (cursor_pos > 0) {
-                cursor_pos--;
-                input_buffer[cursor_pos] = 0;
-            }
-        } else if (scan_code == 0x1C) {
-            execute_command();
-            clear_input();
-        } else if (ascii != 0 && cursor_pos < 99) {
-            input_buffer[cursor_pos++] = ascii;
-            input_buffer[cursor_pos] = 0;
-        }
-        display_input();
-    }
-
-    void show_output(const char* text, unsigned char attr = 0x17) {
-        // clear area
-        for (int y = 19; y <= 21; y++) for (int x = 16; x < 64; x++) putc_xy(x, y, ' ', 0x10);
-        print_centered(text, 20, attr);
-    }
-
-
-    void execute_command() {
-    if (input_buffer[0] == 0) return;
-
-    if (strcmp(input_buffer, "help") == 0) {
-        show_output_wrapped("COMMANDS: help, clear, about, status, time, date, mem, meminfo, mmap, alloc, ls, save, load, cat, rm", 0x1F);
-    } else if (strcmp(input_buffer, "clear") == 0) {
-        show_output("OUTPUT CLEARED", 0x1E);
-    } else if (strcmp(input_buffer, "about") == 0) {
-        show_output("ATOMIC OS v0.1 - 32BIT KERNEL WITH MEMORY MANAGEMENT", 0x1F);
-    } else if (strcmp(input_buffer, "status") == 0) {
-        show_output("SYSTEM STATUS: OPTIMAL", 0x1E);
-    } else if (strcmp(input_buffer, "time") == 0) {
-        Time now = read_rtc_time();
-        char t[9]; format_time(t, now);
-        char out[32] = "TIME: ";
-        copy_str(out + 6, t);
-        show_output(out, 0x1E);
-    } else if (strcmp(input_buffer, "date") == 0) {
-        Time now = read_rtc_time();
-        char d[11]; format_date(d, now);
-        char out[32] = "DATE: ";
-        copy_str(out + 6, d);
-        show_output(out, 0x1E);
-    }
-    
-     else if (strcmp(input_buffer, "ls") == 0 || strcmp(input_buffer, "dir") == 0) {
-        list_files_command();
-    } else if (strncmp(input_buffer, "save ", 5) == 0) {
-    save_file_command();
-} else if (strncmp(input_buffer, "load ", 5) == 0) {
-    load_file_command();
-} else if (strncmp(input_buffer, "cat ", 4) == 0) {
-    cat_file_command();
-} else if (strncmp(input_buffer, "rm ", 3) == 0) {
-    delete_file_command();
-}
-
-    else if (strcmp(input_buffer, "mem") == 0) {
-        u32 used = g_allocator.get_used_memory();
-        u32 total = g_allocator.get_total_memory();
-        char mem_info[50];
-        
-        char used_str[10];
-        char total_str[10];
-        
-        itoa(used_str, used / 1024, 10);
-        itoa(total_str, total / 1024, 10);
-        
-        char* ptr = mem_info;
-        copy_str(ptr, "MEM: ");
-        ptr += 5;
-        copy_str(ptr, used_str);
-        ptr += strlen(used_str);
-        copy_str(ptr, "K/");
-        ptr += 2;
-        copy_str(ptr, total_str);
-        ptr += strlen(total_str);
-        copy_str(ptr, "K USED");
-        
-        show_output(mem_info, 0x1E);
-    } else if (strcmp(input_buffer, "meminfo") == 0) {
-        u32 used = g_allocator.get_used_memory();
-        u32 total_alloc = g_allocator.get_total_memory();
-        u32 total_system = get_total_usable_memory();
-        
-        char info[80];
-        char* ptr = info;
-        
-        copy_str(ptr, "ALLOC: ");
-        ptr += 7;
-        char used_str[10];
-        itoa(used_str, used / 1024, 10);
-        copy_str(ptr, used_str);
-        ptr += strlen(used_str);
-        copy_str(ptr, "K/");
-        ptr += 2;
-        char alloc_str[10];
-        itoa(alloc_str, total_alloc / 1024, 10);
-        copy_str(ptr, alloc_str);
-        ptr += strlen(alloc_str);
-        copy_str(ptr, "K  SYSTEM: ");
-        ptr += 11;
-        char sys_str[10];
-        itoa(sys_str, total_system / (1024*1024), 10);
-        copy_str(ptr, sys_str);
-        ptr += strlen(sys_str);
-        copy_str(ptr, "MB RAM");
-        
-        show_output(info, 0x1E);
-    } 
-    
-    else if (strcmp(input_buffer, "mmap") == 0) {
-        char mmap_info[80];
-        char* ptr = mmap_info;
-        
-        copy_str(ptr, "MEMORY MAP: ");
-        ptr += 12;
-        char entries_str[10];
-        itoa(entries_str, memory_map_entries, 10);
-        copy_str(ptr, entries_str);
-        ptr += strlen(entries_str);
-        copy_str(ptr, " REGIONS DETECTED");
-        
-        show_output(mmap_info, 0x1E);
-        
-        // Show first few regions
-        int regions_to_show = (memory_map_entries < 3) ? memory_map_entries : 3;
-        for (int i = 0; i < regions_to_show; i++) {
-            char region_info[60];
-            char* rptr = region_info;
-            
-            // Type string
-            const char* type_str = "UNKNOWN";
-            switch(memory_map[i].type) {
-                case MEMORY_AVAILABLE: type_str = "AVAIL"; break;
-                case MEMORY_RESERVED: type_str = "RSRVD"; break;
-                default: type_str = "OTHER"; break;
-            }
-            
-            copy_str(rptr, type_str);
-            rptr += 5;
-            copy_str(rptr, " 0x");
-            rptr += 3;
-            
-            // Convert address to hex string (simplified)
-            u32 addr = (u32)memory_map[i].base_addr;
-            for (int j = 0; j < 8; j++) {
-                int digit = (addr >> (28 - j*4)) & 0xF;
-                *rptr++ = (digit < 10) ? '0' + digit : 'A' + digit - 10;
-            }
-            
-            copy_str(rptr, "-");
-            rptr++;
-            
-            u32 end_addr = (u32)(memory_map[i].base_addr + memory_map[i].length);
-            for (int j = 0; j < 8; j++) {
-                int digit = (end_addr >> (28 - j*4)) & 0xF;
-                *rptr++ = (digit < 10) ? '0' + digit : 'A' + digit - 10;
-            }
-            
-            *rptr = 0;
-            show_output(region_info, 0x17);
-        }
-    } else if (strcmp(input_buffer, "alloc") == 0) {
-        void* test_ptr = kmalloc(1024);
-        if (test_ptr) {
-            show_output("ALLOCATED 1KB - TEST PASSED", 0x1E);
-        } else {
-            show_output("ALLOCATION FAILED", 0x47);
-        }
-    } 
-    else {
-        show_output("UNKNOWN COMMAND - TYPE 'help'", 0x47);
-    }
-}
-};
-
-
-// --- main ---
-extern "C" void main() {
-    initialize_memory();
-    fs_initialize(); 
-    // draw whole static interface once
-    clear_screen(0x10);
-    draw_static_interface();
-    update_time_display();
-
-    CommandLine cmd;
-
-    while (true) {
-        // Refresh time in header and holographic box frequently (but not full redraw)
-        update_time_display();
-
-        cmd.clear_input();
-        cmd.show_output("SYSTEM INITIALIZED - AWAITING INPUT", 0x1E);
-
-        // listen for keyboard events for the CLI
-        while (true) {
-            unsigned char scan_code = read_scan_code();
-
-            // ESC launches editor
-            if (scan_code == 0x01) {
-                TextEditor editor;
-                editor.run();
-                // After editor returns, redraw the static UI (editor cleared screen)
-                clear_screen(0x10);
-                draw_static_interface();
-                update_time_display();
-                break;
-            }
-
-            cmd.handle_input(scan_code);
-            // keep header time fresh while typing
-            // (In real kernel you'd update based on timer interrupts to save power)
-            update_time_display();
-        }
-    }
+// atomic_kernel.cpp
+// Single-file improved "ATOMIC OS" kernel UI - 32-bit freestanding
+extern "C" void main();
+#include "memory.h"
+#include "fs_ramdisk.h"
+#include "io.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "smp.h"
+#include "crc32.h"
+#include "task_pool.h"
+#include "spinlock.h"
+#include "rcu.h"
+#include "paging.h"
+#include "process.h"
+#include "syscall.h"
+#include "exec.h"
+#include "module.h"
+#include "pipeline.h"
+#include "script.h"
+#include "bench.h"
+#include "prof.h"
+#include "serial.h"
+#include "console.h"
+#include "klog.h"
+#include "kformat.h"
+#include "trace.h"
+#include "keyrec.h"
+#include "alternatives.h"
+#include "fpu.h"
+#include "pci.h"
+#include "block.h"
+#include "virtio_blk.h"
+#include "net.h"
+#include "socket.h"
+
+// VGA constants
+static const int WIDTH = 80;
+static const int HEIGHT = 25;
+typedef unsigned short u16;
+static volatile u16* const VGA = (volatile u16*)0xB8000;
+
+// Keeps multi-cell VGA updates (strings, clears) from interleaving across CPUs
+static Spinlock g_vga_lock;
+
+// Built-in ring 3 programs (user_images.asm)
+extern "C" const u8 usertest_image[];
+extern "C" const u8 usertest_image_end[];
+
+// What user processes write to fds 1 and 2, shown once they exit
+static char process_output[160];
+static u32 process_output_len = 0;
+
+static void capture_process_output(const char* text, u32 len) {
+    for (u32 i = 0; i < len && process_output_len < sizeof(process_output) - 1; i++) {
+        process_output[process_output_len++] = text[i];
+    }
+    process_output[process_output_len] = 0;
+}
+
+// I/O ports
+#define KEYBOARD_DATA_PORT 0x60
+#define KEYBOARD_STATUS_PORT 0x64
+#define CMOS_ADDRESS 0x70
+#define CMOS_DATA    0x71
+
+// Basic types
+typedef unsigned char u8;
+typedef unsigned short u16t;
+typedef unsigned int u32;
+
+// Make a VGA cell
+static inline u16 vga_entry(char c, unsigned char attr) {
+    return (u16)c | ((u16)attr << 8);
+}
+
+// Write one character safely
+static inline void putc_xy(int x, int y, char c, unsigned char attr) {
+    if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT) return;
+    VGA[y * WIDTH + x] = vga_entry(c, attr);
+}
+
+// Clear full screen
+void clear_screen(unsigned char attr) {
+    u16 cell = vga_entry(' ', attr);
+    u32 flags = g_vga_lock.lock_irqsave();
+    for (int i = 0; i < WIDTH * HEIGHT; i++) VGA[i] = cell;
+    g_vga_lock.unlock_irqrestore(flags);
+}
+
+// Print string at (x,y)
+void print_string(const char* s, int x, int y, unsigned char attr = 0x0F) {
+    u32 flags = g_vga_lock.lock_irqsave();
+    for (int i = 0; s[i] != 0 && x + i < WIDTH; i++) putc_xy(x + i, y, s[i], attr);
+    g_vga_lock.unlock_irqrestore(flags);
+}
+
+// Draw centered text
+void print_centered(const char* s, int y, unsigned char attr = 0x0F) {
+    int len = 0;
+    while (s[len] != 0) len++;
+    int x = (WIDTH - len) / 2;
+    print_string(s, x, y, attr);
+}
+
+// Safe strcmp (same as before)
+int strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) { s1++; s2++; }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+// --- CMOS / RTC helpers (fixed) ---
+u8 read_cmos(u8 reg) {
+    outb(CMOS_ADDRESS, reg);
+    return inb(CMOS_DATA);
+}
+
+int is_updating_rtc() {
+    outb(CMOS_ADDRESS, 0x0A);
+    return inb(CMOS_DATA) & 0x80;
+}
+
+u8 bcd_to_bin(u8 bcd) {
+    return ((bcd >> 4) * 10) + (bcd & 0x0F);
+}
+
+struct Time {
+    u8 second;
+    u8 minute;
+    u8 hour;
+    u8 day;
+    u8 month;
+    u8 year; // two-digit year (00..99)
+};
+
+// Stable RTC read: read twice and compare (common OSDev pattern)
+Time read_rtc_time() {
+    Time t1, t2;
+    u8 reg_b;
+    do {
+        // wait while update in progress
+        while (is_updating_rtc()) {}
+
+        t1.second = read_cmos(0x00);
+        t1.minute = read_cmos(0x02);
+        t1.hour   = read_cmos(0x04);
+        t1.day    = read_cmos(0x07);
+        t1.month  = read_cmos(0x08);
+        t1.year   = read_cmos(0x09);
+
+        // read twice
+        while (is_updating_rtc()) {}
+
+        t2.second = read_cmos(0x00);
+        t2.minute = read_cmos(0x02);
+        t2.hour   = read_cmos(0x04);
+        t2.day    = read_cmos(0x07);
+        t2.month  = read_cmos(0x08);
+        t2.year   = read_cmos(0x09);
+    } while (t1.second != t2.second || t1.minute != t2.minute || t1.hour != t2.hour ||
+             t1.day != t2.day || t1.month != t2.month || t1.year != t2.year);
+
+    // Now get register B once for format info
+    outb(CMOS_ADDRESS, 0x0B);
+    reg_b = inb(CMOS_DATA);
+
+    Time result = t1;
+    // Convert from BCD if necessary
+    if (!(reg_b & 0x04)) {
+        result.second = bcd_to_bin(result.second);
+        result.minute = bcd_to_bin(result.minute);
+        result.hour   = bcd_to_bin(result.hour & 0x7F); // clear possible 12-hour bit for conversion
+        result.day    = bcd_to_bin(result.day);
+        result.month  = bcd_to_bin(result.month);
+        result.year   = bcd_to_bin(result.year);
+    } else {
+        // If reg_b & 0x04, values are already binary - ensure hour cleared of 12h bit before checking
+        result.hour = result.hour & 0x7F;
+    }
+
+    // Convert 12-hour to 24-hour format if necessary (bit 1 of reg_b == 0 => 12-hour mode)
+    if (!(reg_b & 0x02) && (t1.hour & 0x80)) {
+        // hour's PM bit was set in t1; convert using t1 because it contained the 0x80 marker
+        u8 hour12 = t1.hour & 0x7F;
+        // if BCD, hour12 was converted earlier; we used t1.hour to check 0x80 but used result.hour for numeric
+        result.hour = (hour12 % 12) + 12;
+        if (result.hour >= 24) result.hour -= 24;
+    }
+
+    return result;
+}
+
+// formatting helpers
+static inline void two_digits(char* dst, int v) {
+    dst[0] = '0' + (v / 10) % 10;
+    dst[1] = '0' + (v % 10);
+}
+
+// Format time as string "HH:MM:SS"
+void format_time(char* buffer, const Time& time) {
+    two_digits(&buffer[0], time.hour);
+    buffer[2] = ':';
+    two_digits(&buffer[3], time.minute);
+    buffer[5] = ':';
+    two_digits(&buffer[6], time.second);
+    buffer[8] = 0;
+}
+
+// Format date as string "DD/MM/20YY"
+void format_date(char* buffer, const Time& time) {
+    two_digits(&buffer[0], time.day);
+    buffer[2] = '/';
+    two_digits(&buffer[3], time.month);
+    buffer[5] = '/';
+    buffer[6] = '2';
+    buffer[7] = '0';
+    two_digits(&buffer[8], time.year);
+    buffer[10] = 0;
+}
+
+// Draw glowing horizontal line
+void draw_glow_line(int y, unsigned char attr) {
+    for (int x = 0; x < WIDTH; x++) putc_xy(x, y, 0xDB, attr);
+}
+
+void draw_atomic_border() {
+    int w = 64;
+    int h = 7;
+
+    // Top border
+    putc_xy(15, 1, '+', 0x1F);
+    for (int x = 16; x < w - 1; x++)
+        putc_xy(x, 1, '-', 0x1F);   // use '_' if you want
+    putc_xy(w - 1, 1, '+', 0x1F);
+
+    // Side borders
+    for (int y = 2; y < h ; y++) {
+        putc_xy(15, y, '|', 0x1F);
+        putc_xy(w - 1, y, '|', 0x1F);
+    }
+
+    // Bottom border
+    putc_xy(15, h  , '+', 0x1F);
+    for (int x = 16; x < w - 1; x++)
+        putc_xy(x, h , '-', 0x1F);
+    putc_xy(w - 1, h , '+', 0x1F);
+}
+
+
+// Draw static interface skeleton (draw once)
+void draw_static_interface() {
+    // Background subtle grid but tiled with the word "ATOMIC" as a pattern
+    const char *tile = "ATOMIC ";
+    int tile_len = 7; // length of tile string above
+
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            // base background (dark teal-ish)
+            unsigned char bg = 0x10;
+
+            // slight checker to add depth
+            if ((x + y) % 6 == 0) bg = 0x11;
+
+            // draw the tile-letter in a faint color occasionally to form the repeating word pattern
+            char ch = tile[(x + y) % tile_len];
+            if ((x % 8) == 0 && (y % 3) == 0) {
+                // faint character as background motif
+                putc_xy(x, y, ch, 0x12); // dark green on dark background (subtle)
+            } else {
+                putc_xy(x, y, ' ', bg);
+            }
+        }
+    }
+
+    // Bold centered ASCII wordmark for "ATOMIC OS"
+    const char* banner[] = {
+        "   ___   _____  _____  __  __  _____  _____  ",
+        "  / _ \\ |_   _||  _  ||  \\/  ||_   _|| ____| ",
+        " | |_| |  | |  | | | || |\\/| |  | |  | |     ",
+        " | | | |  | |  | |_| || |  | | _| |_ | |___  ",
+        " |_| |_|  |_|  |_____||_|  |_||_____||_____| ",
+        "                                              "
+    };
+    int banner_h = sizeof(banner) / sizeof(banner[0]);
+    int banner_y = 2; // start a little lower so header glow remains
+    for (int i = 0; i < banner_h; ++i) {
+        print_centered(banner[i], banner_y + i, 0x3E); // cyan-on-blueish glow
+    }
+
+    // === FLOATING PLATFORM (improved) ===
+    int platform_y = banner_y + banner_h + 0; // position platform under banner
+    
+    draw_atomic_border();
+    
+    // === LARGE WORDMARK (centered, stylized) ===
+    // A compact, readable "ATOMIC OS" wordmark appearing above the platform
+    print_centered("   A T O M I C   O S   ", platform_y , 0x1E);
+    print_centered("   SYSTEM READY        ", platform_y + 7, 0x1F);
+
+    // === HOLOGRAPHIC INFO DISPLAY BOX (refined) ===
+    int box_w = 52;
+    int box_x = (WIDTH - box_w) / 2;
+    int box_y = platform_y ;
+    int box_h = 6;
+
+
+
+    // Holographic interior: a subtle gradient using two attributes
+    for (int y = box_y + 1; y < box_y + box_h - 1; ++y) {
+        unsigned char attr = (y % 2 == 0) ? 0x1E : 0x1F; // alternate to simulate depth
+        for (int x = box_x + 1; x < box_x + box_w - 1; ++x) {
+            putc_xy(x, y, ' ', attr);
+        }
+    }
+
+    // Static labels inside box (left-aligned)
+    print_string("  CPU:    32-bit x86", box_x + 2, box_y + 2, 0x1E);
+    print_string("  Kernel: v0.1.0     ", box_x + 2, box_y + 3, 0x1E);
+    print_string("  Status: OPERATIONAL", box_x + 2, box_y + 4, 0x1E);
+
+    // Reserve a right-side small 'hologram' panel inside the box for icons/indicators
+    int panel_x = box_x + box_w - 12;
+    print_string("[IO] OK", panel_x, box_y + 2, 0x1E);
+    print_string(netdev_count() > 1 ? "[NET] UP" : netdev_count() ? "[NET] LO" : "[NET] --", panel_x, box_y + 3, 0x1E);
+
+    // === TERMINAL AREA & INPUT FIELD (improved) ===
+    print_centered("TERMINAL READY - TYPE COMMANDS BELOW", box_y + box_h + 2, 0x17);
+    print_centered("TYPE 'help' FOR FURTHER INFO", box_y + box_h + 3, 0x17);
+}
+
+
+/// Update the header time and holographic time (separate function, avoids full redraw)
+void update_time_display() {
+    Time now = read_rtc_time();
+    char time_str[9], date_str[11];
+    format_time(time_str, now);
+    format_date(date_str, now);
+
+    // Right side of header
+    // Clear area first (simple background)
+    for (int x = 55; x < 79; x++) putc_xy(x, 0, ' ', 0x30);
+    print_string(date_str, 56, 0, 0x3F);
+    print_string(time_str, 70, 0, 0x3F);
+
+
+    
+}
+
+// --- Keyboard reading and mapping (safer) ---
+unsigned char read_scan_code() {
+    unsigned char status;
+    u8 scan_code;
+    if (keyrec_replaying() && keyrec_replay_next(&scan_code)) {  // keys replay
+        trace_instant(TRACE_KEY, scan_code);
+        return scan_code;
+    }
+    do {
+        rcu_quiescent_state(); // the UI holds no RCU references while polling
+        if (console_read_scan_code(&scan_code)) {  // typed on COM1
+            trace_instant(TRACE_KEY, scan_code);
+            keyrec_key(scan_code);
+            return scan_code;
+        }
+        status = inb(KEYBOARD_STATUS_PORT);
+    } while (!(status & 1)); // wait until output buffer full
+    scan_code = inb(KEYBOARD_DATA_PORT);
+    trace_instant(TRACE_KEY, scan_code);
+    keyrec_key(scan_code);
+    return scan_code;
+}
+
+// Simple set 1 scancode -> ASCII map (index by scancode, 0..127)
+char scan_code_to_ascii(unsigned char scan_code) {
+    if (scan_code & 0x80) return 0; // key release
+    
+    static bool shift_pressed = false;
+    static bool caps_lock = false;
+    
+    
+    // Handle modifier keys
+    if (scan_code == 0x2A || scan_code == 0x36) {
+        shift_pressed = true;
+        return 0;
+    }
+    if (scan_code == 0xAA || scan_code == 0xB6) {
+        shift_pressed = false;
+        return 0;
+    }
+    if (scan_code == 0x3A) {
+        caps_lock = !caps_lock;
+        return 0;
+    }
+    
+    // Determine if we should use uppercase
+    bool uppercase = shift_pressed ^ caps_lock; // XOR: if either is true but not both
+    
+    // Keyboard map with shift support
+    static const char keyboard_map[128] = {
+        0, 27, '1','2','3','4','5','6','7','8','9','0','-','=',0,0,
+        'q','w','e','r','t','y','u','i','o','p','[',']', '\n',0,'a','s',
+        'd','f','g','h','j','k','l',';','\'','`',0,'\\','z','x','c','v',
+        'b','n','m',',','.','/',0,'*',0,' ',
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+        0,0,0,0,0,0,0,0,0,0,  // 58-67
+        0,0,0,0,0,0,0,0,0,0  
+    };
+    
+    static const char keyboard_map_shift[128] = {
+        0, 27, '!','@','#','$','%','^','&','*','(',')','_','+',0,0,
+        'Q','W','E','R','T','Y','U','I','O','P','{','}', '\n',0,'A','S',
+        'D','F','G','H','J','K','L',':','"','~',0,'|','Z','X','C','V',
+        'B','N','M','<','>','?',0,'*',0,' ',
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+        0,0,0,0,0,0,0,0,0,0,  // 58-67
+        0,0,0,0,0,0,0,0,0,0  
+    };
+    
+    if (scan_code < sizeof(keyboard_map)) {
+        if (uppercase && scan_code < sizeof(keyboard_map_shift)) {
+            return keyboard_map_shift[scan_code];
+        } else {
+            return keyboard_map[scan_code];
+        }
+    }
+    return 0;
+}
+
+// Small safe helpers
+void copy_str(char* dst, const char* src) {
+    while (*src) { *dst++ = *src++; }
+    *dst = 0;
+}
+
+// Word wrap function - breaks long text into multiple lines
+void show_output_wrapped(const char* text, unsigned char attr = 0x17) {
+    console_output(text);
+    // Clear area first
+    for (int y = 19; y <= 21; y++) {
+        for (int x = 16; x < 64; x++) {
+            putc_xy(x, y, ' ', 0x10);
+        }
+    }
+    
+    int max_length = 48;  // Maximum characters per line (64-16=48 width)
+    int current_line = 0;
+    int start_pos = 0;
+    int text_len = strlen(text);
+    
+    while (start_pos < text_len && current_line < 3) {  // Max 3 lines
+        // Find where to break the line
+        int end_pos = start_pos + max_length;
+        if (end_pos > text_len) {
+            end_pos = text_len;
+        } else {
+            // Try to break at a space if possible
+            for (int i = end_pos; i > start_pos; i--) {
+                if (text[i] == ' ' || text[i] == ',') {
+                    end_pos = i;
+                    break;
+                }
+            }
+        }
+        
+        // Extract and display this line
+        char line[50];
+        int line_len = end_pos - start_pos;
+        for (int i = 0; i < line_len; i++) {
+            line[i] = text[start_pos + i];
+        }
+        line[line_len] = 0;
+        
+        print_centered(line, 20 + current_line, attr);
+        
+        start_pos = end_pos;
+        // Skip spaces at the beginning of next line
+        while (start_pos < text_len && text[start_pos] == ' ') {
+            start_pos++;
+        }
+        current_line++;
+    }
+}
+
+// --- Enhanced Text Editor with Memory Save/Load ---
+class TextEditor {
+private:
+    char buffer[20000];
+    int cursor_pos;
+    bool ctrl_pressed;
+     char current_filename[50];
+
+     void show_file_browser(bool for_saving = false) {
+        clear_screen(0x10);
+        
+        if (for_saving) {
+            print_centered(" SAVE AS - ENTER FILENAME ", 0, 0x1F);
+        } else {
+            print_centered(" LOAD FILE - SELECT FILE ", 0, 0x1F);
+        }
+        
+        print_centered("UP/DOWN: NAVIGATE | ENTER: SELECT | ESC: CANCEL", 1, 0x17);
+        
+        // List files
+        RAMDiskFileEntry files[16];
+        int file_count = fs_get_file_list(files, 16);
+        
+        if (file_count == 0) {
+            print_centered("No files found", 5, 0x47);
+        } else {
+            for (int i = 0; i < file_count && i < 15; i++) {
+                char file_line[60];
+                ksnprintf(file_line, sizeof(file_line), "  %s (%u bytes)", files[i].filename, files[i].size);
+                print_string(file_line, 10, 3 + i, 0x17);
+            }
+        }
+        
+        // If saving, show filename input
+        if (for_saving) {
+            print_centered("Or enter new filename:", 18, 0x1E);
+            print_string("Filename: > ", 20, 20, 0x1F);
+            putc_xy(32, 20, '_', 0x4F); // Cursor
+        }
+        
+        // Wait for user input
+        if (for_saving) {
+            get_filename_input();
+        } else {
+            select_file_from_list(file_count);
+        }
+    }
+    
+    void get_filename_input() {
+        char new_filename[50] = {0};
+        int filename_pos = 0;
+        
+        while (true) {
+            unsigned char scan_code = read_scan_code();
+            
+            if (scan_code == 0x01) { // ESC
+                break;
+            } else if (scan_code == 0x1C) { // ENTER
+                if (filename_pos > 0) {
+                    save_file_as(new_filename);
+                }
+                break;
+            } else if (scan_code == 0x0E) { // BACKSPACE
+                if (filename_pos > 0) {
+                    filename_pos--;
+                    new_filename[filename_pos] = 0;
+                }
+            } else {
+                char ascii = scan_code_to_ascii(scan_code);
+                if (ascii != 0 && filename_pos < 49) {
+                    new_filename[filename_pos++] = ascii;
+                    new_filename[filename_pos] = 0;
+                }
+            }
+            
+            // Update display
+            for (int x = 32; x < 70; x++) {
+                putc_xy(x, 20, ' ', 0x1F);
+            }
+            print_string(new_filename, 32, 20, 0x1F);
+            putc_xy(32 + filename_pos, 20, '_', 0x4F);
+        }
+    }
+    
+    void select_file_from_list(int file_count) {
+        if (file_count == 0) {
+            // Wait for any key
+            read_scan_code();
+            return;
+        }
+        
+        int selected = 0;
+        
+        while (true) {
+            // Highlight selected file
+            for (int i = 0; i < file_count && i < 15; i++) {
+                unsigned char attr = (i == selected) ? 0x4F : 0x17;
+                
+                RAMDiskFileEntry files[16];
+                fs_get_file_list(files, 16);
+                
+                char file_line[60];
+                ksnprintf(file_line, sizeof(file_line), "  %s", files[i].filename);
+                
+                // Clear line and print with highlight
+                for (int x = 10; x < 70; x++) {
+                    putc_xy(x, 3 + i, ' ', attr);
+                }
+                print_string(file_line, 10, 3 + i, attr);
+            }
+            
+            unsigned char scan_code = read_scan_code();
+            
+            if (scan_code == 0x01) { // ESC
+                break;
+            } else if (scan_code == 0x1C) { // ENTER
+                RAMDiskFileEntry files[16];
+                fs_get_file_list(files, 16);
+                load_file(files[selected].filename);
+                break;
+            } else if (scan_code == 0x48) { // UP
+                if (selected > 0) selected--;
+            } else if (scan_code == 0x50) { // DOWN
+                if (selected < file_count - 1) selected++;
+            }
+        }
+    }
+
+public:
+    TextEditor() : cursor_pos(0), ctrl_pressed(false) {
+        // Initialize buffer
+        for (int i = 0; i < 20000; i++) buffer[i] = 0;
+        current_filename[0] = 0;
+    }
+
+    // Add these methods to TextEditor class:
+   void load_file(const char* filename) {
+        u8 file_buffer[19000];
+        if (fs_read_file(filename, file_buffer, sizeof(file_buffer))) {
+            // Clear current buffer
+            for (int i = 0; i < 20000; i++) buffer[i] = 0;
+            
+            // Copy file content to editor buffer
+            int i = 0;
+            while (file_buffer[i] != 0 && i < 19999) {
+                buffer[i] = file_buffer[i];
+                i++;
+            }
+            buffer[i] = 0;
+            
+            cursor_pos = 0;
+            copy_str(current_filename, filename);
+            show_message("File loaded", 0x1E);
+        } else {
+            show_message("Load failed", 0x47);
+        }
+        refresh_display();
+    }
+
+    void save_file() {
+        if (current_filename[0] == 0) {
+            show_message("No filename - use F2 to save as", 0x47);
+            return;
+        }
+        
+        if (fs_create_file(current_filename, (const u8*)buffer, strlen(buffer))) {
+            show_message("File saved", 0x1E);
+        } else {
+            show_message("Save failed", 0x47);
+        }
+    }
+
+    void save_file_as(const char* filename) {
+        copy_str(current_filename, filename);
+        save_file();
+    }
+
+    void draw_editor() {
+        clear_screen(0x10);
+
+        // Simple editor header
+        print_centered(" ATOMIC TEXT EDITOR - TYPE TO EDIT ", 0, 0x1F);
+        print_centered("ESC: EXIT | F1: CLEAR | F2: SAVE AS | F3: SAVE | F4: LOAD | Arrow keys: NAVIGATE", 1, 0x17);
+
+        refresh_display();
+    }
+
+    void refresh_display() {
+        trace_begin(TRACE_SCREEN);
+        // Clear content area
+        for (int y = 3; y < HEIGHT - 2; y++) {
+            for (int x = 2; x < WIDTH - 2; x++) {
+                putc_xy(x, y, ' ', 0x10);
+            }
+        }
+        
+        // Display text content
+        int x = 2, y = 3;
+        for (int i = 0; buffer[i] != 0 && y < HEIGHT - 2; i++) {
+            if (buffer[i] == '\n') { 
+                x = 2; 
+                y++; 
+            } else { 
+                putc_xy(x, y, buffer[i], 0x1F); 
+                x++; 
+                if (x >= WIDTH - 2) { 
+                    x = 2; 
+                    y++; 
+                } 
+            }
+        }
+        
+        // Display cursor
+        int cur_x = 2, cur_y = 3;
+        int line_start = 0;
+        for (int i = 0; i < cursor_pos && buffer[i] != 0; i++) {
+            if (buffer[i] == '\n') { 
+                cur_x = 2; 
+                cur_y++; 
+                line_start = i + 1;
+            } else { 
+                cur_x++; 
+                if (cur_x >= WIDTH - 2) { 
+                    cur_x = 2; 
+                    cur_y++; 
+                    line_start = i + 1;
+                } 
+            }
+        }
+        putc_xy(cur_x, cur_y, '_', 0x4F);
+        trace_end(TRACE_SCREEN);
+    }
+
+    void handle_input(unsigned char scan_code) {
+        // Handle modifier keys first
+        if (scan_code == 0x1D) {  // Ctrl press
+            ctrl_pressed = true;
+            return;
+        } else if (scan_code == 0x9D) {  // Ctrl release
+            ctrl_pressed = false;
+            return;
+        }
+        
+        char ascii = scan_code_to_ascii(scan_code);
+        
+        // Special key handling
+        if (scan_code == 0x01) return;  // ESC (handled in run loop)
+        
+        // Clear screen (F1)
+        else if (scan_code == 0x3B) {  // F1 - Clear screen
+            for (int i = 0; i < 20000; i++) buffer[i] = 0;
+            cursor_pos = 0;
+            show_message("SCREEN CLEARED", 0x1E);
+            return;
+        }
+        else if (ctrl_pressed && scan_code == 0x1F) {   
+            for (int i = 0; i < 20000; i++) buffer[i] = 0;
+            cursor_pos = 0;
+            show_message("SCREEN CLEARED", 0x1E);
+            return;
+        }
+        // Arrow keys - Extended scan codes
+        else if (scan_code == 0x48) {  // Up arrow
+            move_cursor_up();
+            return;
+        }
+        else if (scan_code == 0x50) {  // Down arrow
+            move_cursor_down();
+            return;
+        }
+        else if (scan_code == 0x4B) {  // Left arrow
+            if (cursor_pos > 0) {
+                cursor_pos--;
+            }
+        }
+        else if (scan_code == 0x4D) {  // Right arrow
+            if (cursor_pos < 19999 && buffer[cursor_pos] != 0) {
+                cursor_pos++;
+            }
+        }
+
+        else if (scan_code == 0x3C) { // F2 - Save As
+            show_file_browser(true); // true = for saving
+            draw_editor(); // Redraw editor after file operation
+            return;
+        } else if (scan_code == 0x3D) { // F3 - Save
+            save_file();
+            return;
+        } else if (scan_code == 0x3E) { // F4 - Load
+            show_file_browser(false); // false = for loading
+            draw_editor(); // Redraw editor after file operation
+            return;
+        } else if (scan_code == 0x3F) { // F5 - New
+            // Clear buffer and reset filename
+            for (int i = 0; i < 20000; i++) buffer[i] = 0;
+            current_filename[0] = 0;
+            cursor_pos = 0;
+            show_message("New file created", 0x1E);
+            refresh_display();
+            return;
+        }
+        
+        // Backspace
+        else if (scan_code == 0x0E) {   
+            if (cursor_pos > 0) {
+                // Shift all characters left
+                for (int i = cursor_pos - 1; i < 19999; i++) {
+                    buffer[i] = buffer[i + 1];
+                }
+                cursor_pos--;
+                buffer[1999] = 0; // Ensure null terminator
+            }
+        } 
+        
+        // Enter
+        else if (scan_code == 0x1C) { 
+            insert_char('\n');
+        } 
+        
+        // Text input
+        else if (ascii != 0) {
+            insert_char(ascii);
+        }
+        
+        refresh_display();
+    }
+
+    void insert_char(char c) {
+        if (cursor_pos >= 19999) return;
+        // Shift all characters right to make space for the new one
+        for (int i = 19998; i > cursor_pos; i--) {
+            buffer[i] = buffer[i - 1];
+        }
+        buffer[cursor_pos++] = c;
+        buffer[19999] = 0; // Ensure null terminator
+    }
+
+    // Replace the text without touching the screen (benchmarks)
+    void reset_text(const char* text, int cursor) {
+        int i = 0;
+        for (; text[i] && i < 19999; i++) buffer[i] = text[i];
+        buffer[i] = 0;
+        cursor_pos = cursor < i ? cursor : i;
+    }
+
+    void move_cursor_up() {
+        if (cursor_pos == 0) return;
+        
+        // Find current line start
+        int current_line_start = find_line_start(cursor_pos);
+        if (current_line_start == 0) return; // Already at first line
+        
+        // Find previous line start
+        int prev_line_start = find_line_start(current_line_start - 1);
+        
+        // Calculate current column position
+        int current_column = cursor_pos - current_line_start;
+        
+        // Find end of previous line
+        int prev_line_end = current_line_start - 1;
+        if (prev_line_end < 0) prev_line_end = 0;
+        
+        // Calculate target position in previous line
+        int prev_line_length = prev_line_end - prev_line_start;
+        int target_pos = prev_line_start + current_column;
+        
+        // Don't go beyond previous line length
+        if (target_pos > prev_line_end) {
+            target_pos = prev_line_end;
+        }
+        
+        cursor_pos = target_pos;
+    }
+
+    
+
+    void move_cursor_down() {
+        if (buffer[cursor_pos] == 0) return; // At end of buffer
+        
+        // Find current line start
+        int current_line_start = find_line_start(cursor_pos);
+        
+        // Find next line start (after next newline)
+        int next_line_start = cursor_pos;
+        while (buffer[next_line_start] != 0 && buffer[next_line_start] != '\n') {
+            next_line_start++;
+        }
+        if (buffer[next_line_start] == '\n') {
+            next_line_start++; // Move past the newline
+        } else {
+            return; // No next line
+        }
+        
+        // Calculate current column position
+        int current_column = cursor_pos - current_line_start;
+        
+        // Find end of next line
+        int next_line_end = next_line_start;
+        while (buffer[next_line_end] != 0 && buffer[next_line_end] != '\n') {
+            next_line_end++;
+        }
+        
+        // Calculate target position in next line
+        int target_pos = next_line_start + current_column;
+        
+        // Don't go beyond next line length
+        if (target_pos > next_line_end) {
+            target_pos = next_line_end;
+        }
+        
+        cursor_pos = target_pos;
+    }
+
+    int find_line_start(int pos) {
+        int line_start = 0;
+        for (int i = 0; i < pos && buffer[i] != 0; i++) {
+            if (buffer[i] == '\n') {
+                line_start = i + 1;
+            }
+        }
+        return line_start;
+    }
+    
+    void show_message(const char* msg, unsigned char attr) {
+        // Clear message area
+        for (int x = 30; x < 50; x++) {
+            putc_xy(x, HEIGHT - 1, ' ', 0x10);
+        }
+        print_string(msg, 30, HEIGHT - 1, attr);
+    }
+
+    void run() {
+        draw_editor();
+        while (true) {
+            unsigned char scan_code = read_scan_code();
+            if (scan_code == 0x01) break; // ESC to exit
+            handle_input(scan_code);
+        }
+    }
+};
+
+
+// --- bench cases for the UI code in this file (bench.h) ---
+#define BENCH_TEXT_LEN 1000
+static char bench_text[BENCH_TEXT_LEN + 1];  // 1000 chars in lines of 60
+
+static void bench_rtc(void*) {
+    read_rtc_time();
+}
+
+static void bench_vga_repaint(void*) {
+    clear_screen(0x10);
+}
+
+static void bench_editor_refresh(void* arg) {
+    ((TextEditor*)arg)->refresh_display();
+}
+
+static void bench_editor_at_start(void* arg) {
+    ((TextEditor*)arg)->reset_text(bench_text, 0);
+}
+
+static void bench_editor_at_end(void* arg) {
+    ((TextEditor*)arg)->reset_text(bench_text, BENCH_TEXT_LEN);
+}
+
+static void bench_editor_insert(void* arg) {
+    ((TextEditor*)arg)->insert_char('x');
+}
+
+static void bench_kernel_fpu(void*) {
+    kernel_fpu_begin();
+    kernel_fpu_end();
+}
+
+// Synchronous read from the start of a block device
+struct BenchBlock {
+    BlockDevice* dev;
+    u8* buffer;
+    u32 bytes;
+};
+
+static void bench_block_read(void* arg) {
+    BenchBlock* b = (BenchBlock*)arg;
+    block_read(b->dev, 0, b->buffer, b->bytes);
+}
+
+// "net test": an echo server thread on port 7 and the shell as client,
+// in NET_TEST_CHUNK pieces so neither side fills the other's window
+#define NET_TEST_PORT 7
+#define NET_TEST_BYTES (1024 * 1024)
+#define NET_TEST_CHUNK 4096
+
+static void net_echo_thread(void* arg) {
+    s32 conn = sock_accept((s32)(u32)arg, 0);
+    u8* buffer = (u8*)kmalloc(NET_TEST_CHUNK);
+    if (conn >= 0 && buffer) {
+        s32 n;
+        while ((n = sock_recv(conn, buffer, NET_TEST_CHUNK, 0)) > 0) {
+            if (sock_send(conn, buffer, (u32)n, 0) != n) break;
+        }
+    }
+    if (buffer) kfree(buffer);
+    if (conn >= 0) sock_close(conn);
+}
+
+// A shell command timed end to end: parse, run and draw its output
+struct BenchCommand {
+    void* shell;  // CommandLine
+    const char* line;
+};
+
+// --- CommandLine class (improved formatting, safe buffers) ---
+class CommandLine {
+private:
+    char input_buffer[100];
+    int cursor_pos;
+    u32 line_first_key;  // keyrec position when this input line started
+    void list_files_command() {
+        RAMDiskFileEntry files[16];
+        int file_count = fs_get_file_list(files, 16);
+        
+        if (file_count == 0) {
+            show_output("No files in RAM disk", 0x47);
+        } else {
+            show_output("Files in RAM disk:", 0x1F);
+            
+            for (int i = 0; i < file_count; i++) {
+                char file_info[60];
+                ksnprintf(file_info, sizeof(file_info), "  %s (%u bytes)", files[i].filename, files[i].size);
+                show_output(file_info, 0x17);
+            }
+        }
+    }
+
+    
+    
+    void save_file_command() {
+        if (strlen(input_buffer) < 6) {
+            show_output("Usage: save filename", 0x47);
+            return;
+        }
+        
+        const char* filename = input_buffer + 5;
+        if (strlen(filename) == 0) {
+            show_output("Usage: save filename", 0x47);
+            return;
+        }
+        
+        // Save actual content instead of hardcoded text
+        const char* content = " ";
+        if (fs_create_file(filename, (const u8*)content, strlen(content))) {
+            char msg[50];
+            copy_str(msg, "Saved: ");
+            copy_str(msg + 7, filename);
+            show_output(msg, 0x1E);
+        } else {
+            char msg[50];
+            copy_str(msg, "Save failed - disk full?");
+            show_output(msg, 0x47);
+        }
+    }
+    
+    void load_file_command() {
+    if (strlen(input_buffer) < 6) {
+        show_output("Usage: load filename", 0x47);
+        return;
+    }
+    
+    const char* filename = input_buffer + 5;
+    if (strlen(filename) == 0) {
+        show_output("Usage: load filename", 0x47);
+        return;
+    }
+    
+    // Check if file exists first
+    if (!fs_file_exists(filename)) {
+        char msg[50];
+        copy_str(msg, "File not found: ");
+        copy_str(msg + 16, filename);
+        show_output(msg, 0x47);
+        return;
+    }
+    
+    // Launch editor with the file loaded
+    TextEditor editor;
+    editor.load_file(filename);  // Load file into editor
+    editor.run();               // Run editor
+    
+    // After editor returns, redraw interface
+    clear_screen(0x10);
+    draw_static_interface();
+    update_time_display();
+}
+    
+    void cat_file_command() {
+    // Debug: Show what we received
+    char debug_msg[80];
+    ksnprintf(debug_msg, sizeof(debug_msg), "DEBUG input: [%s]", input_buffer);
+    show_output(debug_msg, 0x47);
+    
+    if (strlen(input_buffer) < 5) { // "cat " is 4 chars + space
+        show_output("Usage: cat filename", 0x47);
+        return;
+    }
+    
+    const char* filename = input_buffer + 4; // Skip "cat "
+    
+    // Debug: Show the extracted filename
+    char debug_fn[50];
+    ksnprintf(debug_fn, sizeof(debug_fn), "DEBUG filename: [%s]", filename);
+    show_output(debug_fn, 0x47);
+    
+    if (strlen(filename) == 0) {
+        show_output("Usage: cat filename", 0x47);
+        return;
+    }
+    
+    // Debug: Check if file exists first
+    if (!fs_file_exists(filename)) {
+        char msg[60];
+        ksnprintf(msg, sizeof(msg), "File does not exist: %s", filename);
+        show_output(msg, 0x47);
+        
+        // Show available files
+        RAMDiskFileEntry files[16];
+        int file_count = fs_get_file_list(files, 16);
+        if (file_count > 0) {
+            show_output("Available files:", 0x17);
+            for (int i = 0; i < file_count; i++) {
+                char avail_file[40];
+                ksnprintf(avail_file, sizeof(avail_file), "  %s", files[i].filename);
+                show_output(avail_file, 0x17);
+            }
+        }
+        return;
+    }
+    
+    u8 file_buffer[1000];
+    if (fs_read_file(filename, file_buffer, sizeof(file_buffer))) {
+        // Debug: Show file size
+        RAMDiskFileEntry file_info;
+        // We need to get file size - let's create a helper function
+        u32 file_size = 0;
+        // For now, just display the content
+        show_output((char*)file_buffer, 0x1E);
+    } else {
+        char msg[60];
+        ksnprintf(msg, sizeof(msg), "Read failed for: %s", filename);
+        show_output(msg, 0x47);
+    }
+}
+    
+    void delete_file_command() {
+        if (strlen(input_buffer) < 4) { // "rm " is 3 chars
+            show_output("Usage: rm filename", 0x47);
+            return;
+        }
+        
+        const char* filename = input_buffer + 3;
+        if (strlen(filename) == 0) {
+            show_output("Usage: rm filename", 0x47);
+            return;
+        }
+        
+        if (fs_delete_file(filename)) {
+            char msg[50];
+            copy_str(msg, "Deleted: ");
+            copy_str(msg + 9, filename);
+            show_output(msg, 0x1E);
+        } else {
+            char msg[50];
+            copy_str(msg, "Delete failed: ");
+            copy_str(msg + 15, filename);
+            show_output(msg, 0x47);
+        }
+    }
+    
+    // String compare for first n characters
+int strncmp(const char* s1, const char* s2, int n) {
+    for (int i = 0; i < n; i++) {
+        if (s1[i] != s2[i]) {
+            return s1[i] - s2[i];
+        }
+        if (s1[i] == 0) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+    void filesystem_stats_command() {
+        u32 free_space = fs_get_free_space();
+        u32 total_space = 1024 * 1024; // 1MB RAM disk
+        u32 used_space = total_space - free_space;
+        
+        RAMDiskFileEntry files[16];
+        int file_count = fs_get_file_list(files, 16);
+        
+        char stats[120];
+        ksnprintf(stats, sizeof(stats), "RAM Disk: %uK used, %uK free, %d files",
+                  used_space / 1024, free_space / 1024, file_count);
+        show_output(stats, 0x1E);
+    }
+
+    static void ipi_ping(void* arg) {
+        (void)arg;
+    }
+
+    void cpus_command() {
+        char out[160];
+        u32 len = ksnprintf(out, sizeof(out), "CPUS: %u ONLINE", cpu_online_count());
+
+        for (u32 i = 0; i < cpu_count(); i++) {
+            Cpu* cpu = get_cpu(i);
+
+            // Round trip of a cross-CPU call (IPI out, handler, completion flag back)
+            u64 start = rdtsc();
+            smp_call_on_cpu(i, ipi_ping, nullptr);
+            u32 cycles = (u32)(rdtsc() - start);
+
+            len += ksnprintf(out + len, sizeof(out) - len, " | CPU%u APIC%u T%u S%u",
+                             i, cpu->apic_id, (u32)cpu->ticks, task_pool_stolen(i));
+            if (i != 0) len += ksnprintf(out + len, sizeof(out) - len, " IPI %uc", cycles);
+        }
+
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // List the most contended locks: acquisitions, contended acquisitions, spin cycles
+    void locks_command() {
+        if (strcmp(input_buffer, "locks reset") == 0) {
+            lock_stats_reset();
+            show_output("LOCK COUNTERS RESET", 0x1E);
+            return;
+        }
+
+        LockStats* hottest[6];
+        int count = lock_stats_hottest(hottest, 6);
+        if (count == 0) {
+            show_output("NO LOCKS REGISTERED", 0x47);
+            return;
+        }
+
+        char out[160];
+        u32 len = ksnprintf(out, sizeof(out), "LOCKS (acq/cont/spin):");
+        for (int i = 0; i < count; i++) {
+            len += ksnprintf(out + len, sizeof(out) - len, " %s %u/%u/%uK", hottest[i]->name,
+                             hottest[i]->acquisitions, hottest[i]->contended,
+                             udiv64(hottest[i]->spin_cycles, 1000));
+        }
+
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // Checksum the RAM disk on one CPU, then split across all of them
+    void checksum_command() {
+        u64 start = rdtsc();
+        u32 serial_crc = fs_checksum(false);
+        u32 serial_cycles = (u32)(rdtsc() - start);
+
+        start = rdtsc();
+        u32 parallel_crc = fs_checksum(true);
+        u32 parallel_cycles = (u32)(rdtsc() - start);
+
+        char out[120];
+        ksnprintf(out, sizeof(out), "RAMDISK CRC32C %08X%s | 1 CPU: %uK cycles | %u CPUS: %uK cycles",
+                  parallel_crc, serial_crc != parallel_crc ? " MISMATCH!" : "",
+                  serial_cycles / 1000, cpu_online_count(), parallel_cycles / 1000);
+
+        show_output_wrapped(out, serial_crc == parallel_crc ? 0x1E : 0x47);
+    }
+
+public:
+    CommandLine() : cursor_pos(0), line_first_key(0) {
+        for (int i = 0; i < 100; i++) input_buffer[i] = 0;
+    }
+
+    void clear_input() {
+        for (int x = 18; x < 63; x++) putc_xy(x, 23, '_', 0x17);
+        cursor_pos = 0;
+        for (int i = 0; i < 100; i++) input_buffer[i] = 0;
+        putc_xy(17, 23, '>', 0x2F);
+        line_first_key = keyrec_position();
+    }
+
+    void display_input() {
+        for (int x = 18; x < 63; x++) putc_xy(x, 23, ' ', 0x17);
+        for (int i = 0; i < cursor_pos && i < 45; i++) putc_xy(18 + i, 23, input_buffer[i], 0x17);
+        // cursor
+        putc_xy(18 + cursor_pos, 23, '_', 0x4F);
+    }
+
+    void handle_input(unsigned char scan_code) {
+        char ascii = scan_code_to_ascii(scan_code);
+        if (scan_code == 0x01) {
+            // ESC - handled by outer loop (we return to launch editor)
+            return;
+        } else if (scan_code == 0x0E) {
+            if (cursor_pos > 0) {
+                cursor_pos--;
+                input_buffer[cursor_pos] = 0;
+            }
+        } else if (scan_code == 0x1C) {
+            trace_begin(TRACE_COMMAND);
+            execute_command();
+            trace_end(TRACE_COMMAND);
+            clear_input();
+        } else if (ascii != 0 && cursor_pos < 99) {
+            input_buffer[cursor_pos++] = ascii;
+            input_buffer[cursor_pos] = 0;
+        }
+        display_input();
+    }
+
+    void show_output(const char* text, unsigned char attr = 0x17) {
+        console_output(text);
+        // clear area
+        for (int y = 19; y <= 21; y++) for (int x = 16; x < 64; x++) putc_xy(x, y, ' ', 0x10);
+        print_centered(text, 20, attr);
+    }
+
+
+    // Wait for a process started by a command and show what it printed
+    void show_process_result(Process* proc, const char* prefix) {
+        ProcessExitInfo info;
+        if (process_wait(proc, &info) == PROCESS_EXIT_FAULT) {
+            char out[40];
+            ksnprintf(out, sizeof(out), "PROCESS KILLED AT %08X", info.fault_address);
+            show_output(out, 0x47);
+            return;
+        }
+
+        char out[200];
+        ksnprintf(out, sizeof(out), "%s%s", prefix, process_output);
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // Run the built-in ring 3 test program and show what it printed
+    void usertest_command() {
+        process_output_len = 0;
+        process_output[0] = 0;
+
+        Process* proc = process_spawn_flat("usertest", usertest_image,
+                                           (u32)(usertest_image_end - usertest_image));
+        if (!proc) {
+            show_output(paging_available() ? "COULD NOT CREATE PROCESS" : "NO PAGING SUPPORT", 0x47);
+            return;
+        }
+        show_process_result(proc, syscall_uses_sysenter() ? "[SYSENTER] " : "[INT 0x80] ");
+    }
+
+    // Run an ELF executable from the RAM disk
+    void exec_command() {
+        const char* filename = input_buffer + 5;  // skip "exec "
+        process_output_len = 0;
+        process_output[0] = 0;
+
+        const char* error = nullptr;
+        Process* proc = exec_spawn(filename, &error);
+        if (!proc) {
+            show_output(error, 0x47);
+            return;
+        }
+        show_process_result(proc, "");
+    }
+
+    // Bounce pages between ipcping and ipcpong and show the round trips
+    void ipctest_command() {
+        process_output_len = 0;
+        process_output[0] = 0;
+
+        const char* error = nullptr;
+        Process* server = exec_spawn("ipcpong", &error);
+        if (!server) {
+            show_output(error, 0x47);
+            return;
+        }
+        Process* client = exec_spawn("ipcping", &error);
+        if (!client) {
+            process_kill(server);
+            process_wait(server);
+            show_output(error, 0x47);
+            return;
+        }
+
+        show_process_result(client, "");
+        process_kill(server);  // normally gone already; don't leave it blocked if the client died
+        process_wait(server);
+    }
+
+    // Load a kernel module from the RAM disk
+    void insmod_command() {
+        const char* filename = input_buffer + 7;  // skip "insmod "
+        const char* error = nullptr;
+        const Module* mod = module_load(filename, &error);
+
+        char out[120];
+        if (!mod) {
+            const char* log = module_last_log();
+            ksnprintf(out, sizeof(out), "%s%s%s", error, log[0] ? ": " : "", log);
+            show_output_wrapped(out, 0x47);
+            return;
+        }
+
+        ksnprintf(out, sizeof(out), "LOADED %s (%u BYTES) %s", mod->name, mod->size, module_last_log());
+        show_output_wrapped(out, 0x1E);
+    }
+
+    void rmmod_command() {
+        const char* name = input_buffer + 6;  // skip "rmmod "
+        if (!module_unload(name)) {
+            show_output("MODULE NOT LOADED", 0x47);
+            return;
+        }
+        show_output(module_last_log()[0] ? module_last_log() : "MODULE UNLOADED", 0x1E);
+    }
+
+    void lsmod_command() {
+        if (module_count() == 0) {
+            show_output("NO MODULES LOADED", 0x1E);
+            return;
+        }
+
+        char out[144];
+        u32 len = ksnprintf(out, sizeof(out), "MODULES:");
+        for (u32 i = 0; i < MAX_MODULES; i++) {
+            const Module* mod = module_get(i);
+            if (mod) len += ksnprintf(out + len, sizeof(out) - len, " %s(%uB)", mod->name, mod->size);
+        }
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // One line per PCI function in pci.log; addresses and what drives
+    // them on screen
+    void lspci_command() {
+        u32 count = pci_device_count();
+        if (count == 0) {
+            show_output("NO PCI DEVICES", 0x1E);
+            return;
+        }
+
+        u32 size = count * 128;
+        char* report = (char*)kmalloc(size);
+        if (!report) {
+            show_output("OUT OF MEMORY", 0x47);
+            return;
+        }
+        char out[145];
+        u32 out_len = ksnprintf(out, sizeof(out), "PCI (%s):", PCI_FILE);
+        u32 len = 0;
+        for (u32 i = 0; i < count; i++) {
+            const PciDevice* dev = pci_get_device(i);
+            len += pci_format_device(dev, report + len, size - len - 1);
+            report[len++] = '\n';
+            out_len += ksnprintf(out + out_len, sizeof(out) - out_len, " %02x:%02x.%u %s", dev->bus, dev->slot,
+                                 dev->function, dev->driver ? dev->driver->name : pci_class_name(dev->class_code));
+        }
+        fs_create_file(PCI_FILE, (const u8*)report, len);
+        console_report(PCI_FILE, report, len);
+        kfree(report);
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // Block devices and their counters; "disk save" writes the RAM disk
+    // image to the first one, "disk load" replaces the RAM disk with it
+    void disk_command() {
+        const char* arg = input_buffer[4] == ' ' ? input_buffer + 5 : "";
+        BlockDevice* dev = block_get(0);
+        if (!dev) {
+            show_output("NO BLOCK DEVICES", 0x47);
+            return;
+        }
+
+        char out[145];
+        if (arg[0] == 0) {
+            u32 len = ksnprintf(out, sizeof(out), "DISKS:");
+            for (u32 i = 0; i < block_count(); i++) {
+                const BlockDevice* d = block_get(i);
+                len += ksnprintf(out + len, sizeof(out) - len, " %s %uMB q%u%s RD %uKB WR %uKB %u REQ %u ERR;",
+                                 d->name, (u32)(d->sectors >> 11), d->queue_depth, d->read_only ? " RO" : "",
+                                 (u32)(d->bytes_read >> 10), (u32)(d->bytes_written >> 10), d->requests, d->errors);
+            }
+            show_output_wrapped(out, 0x1E);
+            return;
+        }
+
+        bool save = strcmp(arg, "save") == 0;
+        if (!save && strcmp(arg, "load") != 0) {
+            show_output("USAGE: disk [save|load]", 0x47);
+            return;
+        }
+        u64 start = rdtsc();
+        bool ok = save ? fs_save(dev) : fs_load(dev);
+        u32 ms = (u32)udiv64(tsc_to_ns(rdtsc() - start), 1000000);
+        if (!ok) {
+            ksnprintf(out, sizeof(out), save ? "WRITE TO %s FAILED" : "NO RAM DISK IMAGE ON %s, OR A FILE IS MAPPED",
+                      dev->name);
+            show_output_wrapped(out, 0x47);
+            return;
+        }
+        ksnprintf(out, sizeof(out), "%s %uKB %s %s IN %u MS", save ? "SAVED" : "RESTORED",
+                  RAMDISK_DEFAULT_SIZE / 1024, save ? "TO" : "FROM", dev->name, ms);
+        show_output(out, 0x1E);
+    }
+
+    // Devices, counters and sockets; the full report is in net.log.
+    // "net test" streams NET_TEST_BYTES through a TCP echo thread.
+    void net_command() {
+        const char* arg = input_buffer[3] == ' ' ? input_buffer + 4 : "";
+        if (strcmp(arg, "test") == 0) {
+            net_test_command();
+            return;
+        }
+        if (arg[0]) {
+            show_output("USAGE: net [test]", 0x47);
+            return;
+        }
+
+        char* report = (char*)kmalloc(2048);
+        if (!report) {
+            show_output("OUT OF MEMORY", 0x47);
+            return;
+        }
+        char out[145];
+        u32 out_len = ksnprintf(out, sizeof(out), "NET:");
+        u32 len = 0;
+        for (u32 i = 0; i < netdev_count(); i++) {
+            const NetDevice* dev = netdev_get(i);
+            char ip[16];
+            net_format_ip(ip, dev->ip);
+            len += ksnprintf(report + len, 2048 - len, "%s %s mtu %u rx %u/%u tx %u/%u dropped %u/%u\n",
+                             dev->name, ip, dev->mtu, dev->rx_packets, (u32)dev->rx_bytes, dev->tx_packets,
+                             (u32)dev->tx_bytes, dev->rx_dropped, dev->tx_dropped);
+            out_len += ksnprintf(out + out_len, sizeof(out) - out_len, " %s %s RX %u TX %u;", dev->name, ip,
+                                 dev->rx_packets, dev->tx_packets);
+        }
+        const NetStats* st = net_stats();
+        len += ksnprintf(report + len, 2048 - len,
+                         "ip in %u out %u bad %u\nudp in %u out %u\ntcp in %u out %u retransmits %u resets %u\n"
+                         "no socket %u receive queue full %u polls %u\n",
+                         st->ip_in, st->ip_out, st->ip_bad, st->udp_in, st->udp_out, st->tcp_in, st->tcp_out,
+                         st->tcp_retransmits, st->tcp_resets, st->no_socket, st->rcvbuf_full, st->polls);
+        len += sock_format_all(report + len, 2048 - len);
+        fs_create_file(NET_FILE, (const u8*)report, len);
+        console_report(NET_FILE, report, len);
+        kfree(report);
+
+        ksnprintf(out + out_len, sizeof(out) - out_len, " TCP %u/%u RTX %u RST %u; UDP %u/%u; BAD %u (%s)",
+                  st->tcp_in, st->tcp_out, st->tcp_retransmits, st->tcp_resets, st->udp_in, st->udp_out,
+                  st->ip_bad, NET_FILE);
+        show_output_wrapped(out, 0x1E);
+    }
+
+    void net_test_command() {
+        char out[100];
+        s32 listener = sock_open(SOCKET_TCP);
+        s32 client = sock_open(SOCKET_TCP);
+        s32 error = listener < 0 ? listener : client < 0 ? client : sock_bind(listener, NET_TEST_PORT);
+        if (!error) error = sock_listen(listener, 1);
+        Process* server = error ? nullptr : process_spawn_kernel("echo", net_echo_thread, (void*)(u32)listener);
+        u8* buffer = (u8*)kmalloc(2 * NET_TEST_CHUNK);
+        if (!error && (!server || !buffer)) error = NET_ENOMEM;
+
+        u32 segments = net_stats()->tcp_out;
+        u64 start = rdtsc();
+        if (!error) error = sock_connect(client, NET_LOOPBACK_IP, NET_TEST_PORT, 0);
+        for (u32 done = 0; !error && done < NET_TEST_BYTES; done += NET_TEST_CHUNK) {
+            for (u32 i = 0; i < NET_TEST_CHUNK; i++) buffer[i] = (u8)(done / NET_TEST_CHUNK + i);
+            s32 n = sock_send(client, buffer, NET_TEST_CHUNK, 0);
+            if (n != NET_TEST_CHUNK) error = n < 0 ? n : NET_ERESET;
+            for (u32 got = 0; !error && got < NET_TEST_CHUNK; got += (u32)n) {
+                n = sock_recv(client, buffer + NET_TEST_CHUNK + got, NET_TEST_CHUNK - got, 0);
+                if (n <= 0) error = n < 0 ? n : NET_ERESET;
+            }
+            if (!error && memcmp(buffer, buffer + NET_TEST_CHUNK, NET_TEST_CHUNK) != 0) error = NET_EINVAL;
+        }
+        u64 ns = tsc_to_ns(rdtsc() - start);
+        segments = net_stats()->tcp_out - segments;
+
+        // Closing both ends wakes the thread wherever it waits
+        if (client >= 0) sock_close(client);
+        if (listener >= 0) sock_close(listener);
+        if (server) process_wait(server);
+        if (buffer) kfree(buffer);
+
+        if (error) {
+            ksnprintf(out, sizeof(out), "NET TEST FAILED: %s", net_error_name(error));
+            show_output(out, 0x47);
+            return;
+        }
+        u32 us = (u32)udiv64(ns, 1000);
+        u32 mb_per_s = us ? (u32)udiv64((u64)NET_TEST_BYTES * 2 * 1000000, us) >> 20 : 0;
+        ksnprintf(out, sizeof(out), "ECHOED %uKB IN %u MS: %u MB/S BOTH WAYS, %u SEGMENTS",
+                  NET_TEST_BYTES / 1024, us / 1000, mb_per_s, segments);
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // Microbenchmarks: "bench" runs every case, "bench <group>" one group.
+    // The full report goes to bench.log, it doesn't fit the output area.
+    void bench_command() {
+        const char* group = input_buffer[5] == ' ' ? input_buffer + 6 : "";
+
+        for (int i = 0; i < BENCH_TEXT_LEN; i++) bench_text[i] = (i % 60 == 59) ? '\n' : 'a' + i % 26;
+        bench_text[BENCH_TEXT_LEN] = 0;
+        TextEditor editor;
+
+        BenchCase cases[32];
+        u32 count;
+        const BenchCase* kernel_cases = bench_kernel_cases(&count);
+        for (u32 i = 0; i < count; i++) cases[i] = kernel_cases[i];
+        cases[count++] = { "vga", "vga repaint", nullptr, bench_vga_repaint, nullptr };
+        cases[count++] = { "vga", "editor refresh", bench_editor_at_start, bench_editor_refresh, &editor };
+        cases[count++] = { "rtc", "read_rtc_time", nullptr, bench_rtc, nullptr };
+        if (fpu_available()) cases[count++] = { "fpu", "kernel_fpu begin/end", nullptr, bench_kernel_fpu, nullptr };
+        cases[count++] = { "edit", "insert at start", bench_editor_at_start, bench_editor_insert, &editor };
+        cases[count++] = { "edit", "insert at end", bench_editor_at_end, bench_editor_insert, &editor };
+        BenchCommand commands[] = { { this, "ls" }, { this, "mem" }, { this, "help" } };
+        cases[count++] = { "cmd", "cmd ls", nullptr, bench_run_command, &commands[0] };
+        cases[count++] = { "cmd", "cmd mem", nullptr, bench_run_command, &commands[1] };
+        cases[count++] = { "cmd", "cmd help", nullptr, bench_run_command, &commands[2] };
+        u8* block_buffer = block_count() ? (u8*)kmalloc(64 * 1024) : nullptr;
+        BenchBlock block_reads[] = { { block_get(0), block_buffer, 4096 }, { block_get(0), block_buffer, 64 * 1024 } };
+        if (block_buffer) {
+            cases[count++] = { "blk", "disk read 4K", nullptr, bench_block_read, &block_reads[0] };
+            cases[count++] = { "blk", "disk read 64K", nullptr, bench_block_read, &block_reads[1] };
+        }
+
+        char* report = (char*)kmalloc(2048);
+        if (!report) {
+            show_output("OUT OF MEMORY", 0x47);
+            return;
+        }
+        u32 report_len = 0;
+        char shown[145];
+        shown[0] = 0;
+        u32 shown_len = 0;
+        u32 ran = 0;
+        bool touched_screen = false;
+        u64 start = rdtsc();
+
+        for (u32 i = 0; i < count; i++) {
+            if (group[0] && strcmp(group, cases[i].group) != 0) continue;
+            BenchResult result;
+            if (!bench_measure(&cases[i], BENCH_WARMUP, BENCH_ITERATIONS, &result)) continue;
+            ran++;
+            if (strcmp(cases[i].group, "vga") == 0) touched_screen = true;
+
+            char line[80];
+            u32 len = bench_format(&cases[i], &result, line, sizeof(line));
+            if (report_len + len + 1 < 2048) {
+                for (u32 j = 0; j < len; j++) report[report_len++] = line[j];
+                report[report_len++] = '\n';
+            }
+            if (shown_len + len + 3 < sizeof(shown)) {
+                shown_len += ksnprintf(shown + shown_len, sizeof(shown) - shown_len, "%s%s",
+                                       shown_len ? "; " : "", line);
+            }
+        }
+        u32 total_ms = (u32)udiv64(tsc_to_ns(rdtsc() - start), 1000000);
+        bench_release();
+        if (block_buffer) kfree(block_buffer);
+
+        if (touched_screen) {
+            clear_screen(0x10);
+            draw_static_interface();
+            update_time_display();
+        }
+        if (ran == 0) {
+            kfree(report);
+            show_output("USAGE: bench [alloc|mem|fs|net|vga|rtc|edit|cmd|blk]", 0x47);
+            return;
+        }
+        fs_create_file(BENCH_FILE, (const u8*)report, report_len);
+        console_report(BENCH_FILE, report, report_len);
+        kfree(report);
+
+        if (group[0]) {
+            show_output_wrapped(shown, 0x1E);
+            return;
+        }
+        char out[100];
+        ksnprintf(out, sizeof(out), "BENCH: %u CASES IN %u MS, MEDIAN/P99 IN %s", ran, total_ms, BENCH_FILE);
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // Sampling profiler: prof start|stop|top. top shows the hottest few
+    // functions and writes the longer report to prof.log
+    void prof_command() {
+        const char* arg = input_buffer + 5;
+        char out[145];
+
+        if (strcmp(arg, "start") == 0) {
+            const char* error = nullptr;
+            if (!prof_start(&error)) {
+                show_output(error, 0x47);
+                return;
+            }
+            show_output("PROFILING - prof top, prof stop", 0x1E);
+        } else if (strcmp(arg, "stop") == 0) {
+            if (!prof_stop()) {
+                show_output("PROFILER NOT RUNNING", 0x47);
+                return;
+            }
+            ProfSummary summary;
+            prof_top(nullptr, 0, &summary);
+            ksnprintf(out, sizeof(out), "PROFILER STOPPED AFTER %u SAMPLES", summary.samples);
+            show_output(out, 0x1E);
+        } else if (strcmp(arg, "top") == 0) {
+            ProfEntry top[5];
+            ProfSummary summary;
+            u32 count = prof_top(top, 5, &summary);
+            if (summary.samples == 0) {
+                show_output("NO SAMPLES - prof start first", 0x47);
+                return;
+            }
+
+            char* report = (char*)kmalloc(4096);
+            if (report) {
+                u32 report_len = prof_report(report, 4096);
+                fs_create_file(PROF_FILE, (const u8*)report, report_len);
+                console_report(PROF_FILE, report, report_len);
+                kfree(report);
+            }
+
+            u32 len = ksnprintf(out, sizeof(out), "%u SAMPLES:", summary.samples);
+            for (u32 i = 0; i < count; i++) {
+                char name[28];
+                prof_symbol_name(top[i].name, name, sizeof(name));
+                if (len + strlen(name) + 8 >= sizeof(out)) break;
+                len += ksnprintf(out + len, sizeof(out) - len, "%s%s %u%%", i ? ", " : " ", name,
+                                 top[i].self * 100 / summary.samples);
+            }
+            show_output_wrapped(out, 0x1E);
+        } else {
+            show_output("USAGE: prof start|stop|top", 0x47);
+        }
+    }
+
+    // Event tracing: trace start|stop|dump. dump sends Chrome trace JSON
+    // over COM1 (run QEMU with -serial file:trace.json)
+    void trace_command() {
+        const char* arg = input_buffer + 6;
+        char out[100];
+
+        if (strcmp(arg, "start") == 0) {
+            const char* error = nullptr;
+            if (!trace_start(&error)) {
+                show_output(error, 0x47);
+                return;
+            }
+            show_output("TRACING - trace dump to send it", 0x1E);
+        } else if (strcmp(arg, "stop") == 0) {
+            trace_stop();
+            show_output("TRACING STOPPED", 0x1E);
+        } else if (strcmp(arg, "dump") == 0) {
+            u32 sent, overwritten;
+            if (!trace_dump(&sent, &overwritten)) {
+                show_output("NO SERIAL PORT", 0x47);
+                return;
+            }
+            ksnprintf(out, sizeof(out), "%u EVENTS SENT TO COM1, %u OVERWRITTEN", sent, overwritten);
+            show_output_wrapped(out, 0x1E);
+        } else {
+            show_output("USAGE: trace start|stop|dump", 0x47);
+        }
+    }
+
+    // COM1 routing: console [mirror|reports|log on|off]
+    void console_route_command() {
+        const char* arg = input_buffer[7] ? input_buffer + 8 : "";
+        if (!serial_present()) {
+            show_output("NO SERIAL PORT", 0x47);
+            return;
+        }
+
+        u32 route = 0;
+        if (strncmp(arg, "mirror ", 7) == 0) {
+            route = CONSOLE_MIRROR;
+            arg += 7;
+        } else if (strncmp(arg, "reports ", 8) == 0) {
+            route = CONSOLE_REPORTS;
+            arg += 8;
+        } else if (strncmp(arg, "log ", 4) == 0) {
+            route = CONSOLE_LOG;
+            arg += 4;
+        }
+        if (route && strcmp(arg, "on") == 0) {
+            console_set_routes(console_routes() | route);
+        } else if (route && strcmp(arg, "off") == 0) {
+            console_set_routes(console_routes() & ~route);
+        } else if (arg[0]) {
+            show_output("USAGE: console [mirror|reports|log on|off]", 0x47);
+            return;
+        }
+
+        SerialStats stats;
+        serial_get_stats(&stats);
+        char out[145];
+        u32 routes = console_routes();
+        ksnprintf(out, sizeof(out), "COM1: MIRROR %s, REPORTS %s, LOG %s, TX %u RX %u BYTES, %u TX WAITS, %u RX OVERRUNS",
+                  (routes & CONSOLE_MIRROR) ? "ON" : "OFF", (routes & CONSOLE_REPORTS) ? "ON" : "OFF",
+                  (routes & CONSOLE_LOG) ? "ON" : "OFF", stats.tx_bytes, stats.rx_bytes, stats.tx_waits,
+                  stats.rx_overruns);
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // keys record, then keys stop <file>: every key read from here on,
+    // minus the ones that type the stop command. keys replay <file> [fast]
+    // runs them through the same dispatch as main(), at the recorded pace
+    // or back to back, and reports the per-key latency percentiles.
+    void keys_command() {
+        const char* arg = input_buffer + 4;
+        const char* error = nullptr;
+        char out[145];
+
+        if (strcmp(arg, " record") == 0) {
+            if (!keyrec_start(&error)) {
+                ksnprintf(out, sizeof(out), "KEYS: %s", error);
+                show_output(out, 0x47);
+                return;
+            }
+            show_output("KEYS: RECORDING, keys stop <file> TO SAVE", 0x1E);
+        } else if (strncmp(arg, " stop ", 6) == 0 && arg[6]) {
+            u32 saved;
+            if (!keyrec_stop(arg + 6, line_first_key, &saved, &error)) {
+                ksnprintf(out, sizeof(out), "KEYS: %s", error);
+                show_output(out, 0x47);
+                return;
+            }
+            ksnprintf(out, sizeof(out), "KEYS: %u KEYS SAVED TO %s", saved, arg + 6);
+            show_output(out, 0x1E);
+        } else if (strncmp(arg, " replay ", 8) == 0 && arg[8]) {
+            keys_replay(arg + 8);
+        } else {
+            show_output("USAGE: keys record|stop|replay <file> [fast]", 0x47);
+        }
+    }
+
+    void keys_replay(const char* arg) {
+        // The replayed keys retype input_buffer
+        char filename[RAMDISK_FILENAME_LEN];
+        int i = 0;
+        for (; arg[i] && arg[i] != ' ' && i < RAMDISK_FILENAME_LEN - 1; i++) filename[i] = arg[i];
+        filename[i] = 0;
+        bool realtime = strcmp(arg + i, " fast") != 0;
+
+        const char* error = nullptr;
+        char out[145];
+        if (!keyrec_replay_start(filename, realtime, &error)) {
+            ksnprintf(out, sizeof(out), "KEYS: %s", error);
+            show_output(out, 0x47);
+            return;
+        }
+
+        TextEditor editor;
+        bool in_editor = false;
+        u8 scan_code;
+        while (keyrec_replay_next(&scan_code)) {
+            u64 start = rdtsc();
+            if (!in_editor && scan_code == 0x01) {  // ESC opens the editor, as in main()
+                editor.reset_text("", 0);
+                editor.draw_editor();
+                in_editor = true;
+            } else if (in_editor && scan_code == 0x01) {
+                clear_screen(0x10);
+                draw_static_interface();
+                update_time_display();
+                clear_input();
+                in_editor = false;
+            } else if (in_editor) {
+                editor.handle_input(scan_code);
+            } else {
+                handle_input(scan_code);
+            }
+            keyrec_replay_sample(rdtsc() - start);
+        }
+        if (in_editor) {
+            clear_screen(0x10);
+            draw_static_interface();
+            update_time_display();
+        }
+
+        KeyrecLatency latency;
+        keyrec_replay_finish(&latency);
+        char report[160];
+        u32 len = ksnprintf(report, sizeof(report),
+                            "keys replay %s (%s): %u keys\n"
+                            "p50 %uns p90 %uns p99 %uns max %uns\n"
+                            "busy %u ms of %u ms\n",
+                            filename, realtime ? "recorded pace" : "fast", latency.keys,
+                            latency.p50_ns, latency.p90_ns, latency.p99_ns, latency.max_ns,
+                            latency.busy_ms, latency.total_ms);
+        fs_create_file(KEYREC_FILE, (const u8*)report, len);
+        console_report(KEYREC_FILE, report, len);
+
+        ksnprintf(out, sizeof(out), "KEYS: %u KEYS P50 %uNS P90 %uNS P99 %uNS MAX %uNS, BUSY %u OF %u MS (" KEYREC_FILE ")",
+                  latency.keys, latency.p50_ns, latency.p90_ns, latency.p99_ns, latency.max_ns,
+                  latency.busy_ms, latency.total_ms);
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // Kernel log: dmesg [err|warn|info|debug] shows messages at that level
+    // or worse. The newest ones that fit go on screen, all of them to
+    // dmesg.log (and COM1 with console reports on).
+    void dmesg_command() {
+        int max_level = KLOG_DEBUG;
+        if (input_buffer[5]) {
+            max_level = klog_parse_level(input_buffer + 6);
+            if (max_level < 0) {
+                show_output("USAGE: dmesg [err|warn|info|debug]", 0x47);
+                return;
+            }
+        }
+
+        u32 size = KLOG_RING_SIZE * (KLOG_TEXT_LEN + 32);
+        char* report = (char*)kmalloc(size);
+        if (!report) {
+            show_output("OUT OF MEMORY", 0x47);
+            return;
+        }
+
+        // Last three matching messages for the screen
+        char recent[3][KLOG_TEXT_LEN + 1];
+        u32 shown = 0;
+        u32 len = 0;
+        u32 count = 0;
+        u32 end = klog_next_seq();
+        for (u32 seq = klog_first_seq(); seq != end; seq++) {
+            KlogEntry entry;
+            if (!klog_get(seq, &entry) || entry.level > max_level) continue;
+            len += klog_format(&entry, report + len, size - len);
+            copy_str(recent[shown % 3], entry.text);
+            shown++;
+            count++;
+        }
+        fs_create_file(KLOG_FILE, (const u8*)report, len);
+        console_report(KLOG_FILE, report, len);
+        kfree(report);
+
+        if (count == 0) {
+            show_output("NO MESSAGES", 0x1E);
+            return;
+        }
+        char out[145];
+        out[0] = 0;
+        u32 out_len = 0;
+        u32 first = shown > 3 ? shown - 3 : 0;
+        for (u32 i = first; i < shown; i++) {
+            const char* text = recent[i % 3];
+            if (out_len + strlen(text) + 3 >= sizeof(out)) break;
+            out_len += ksnprintf(out + out_len, sizeof(out) - out_len, "%s%s", out_len ? "; " : "", text);
+        }
+        show_output_wrapped(out, 0x1E);
+    }
+
+    // Each command of a script goes through execute_command as if typed
+    static void run_script_line(const char* line, void* context) {
+        CommandLine* self = (CommandLine*)context;
+        int i = 0;
+        for (; line[i] && i < 99; i++) self->input_buffer[i] = line[i];
+        self->input_buffer[i] = 0;
+        trace_begin(TRACE_COMMAND);
+        self->execute_command();
+        trace_end(TRACE_COMMAND);
+    }
+
+    static void bench_run_command(void* arg) {
+        BenchCommand* command = (BenchCommand*)arg;
+        run_script_line(command->line, command->shell);
+    }
+
+    // Leave QEMU through isa-debug-exit (make perf); the serial ring is
+    // flushed first so the host sees every report
+    void exit_command() {
+        u32 code = 0;
+        for (const char* p = input_buffer + 4; *p == ' ' || (*p >= '0' && *p <= '9'); p++) {
+            if (*p != ' ') code = code * 10 + (*p - '0');
+        }
+        klogf(KLOG_INFO, "exit: code %u", code);
+        serial_flush();
+        qemu_debug_exit((u8)code);
+        show_output("EXIT: NO isa-debug-exit DEVICE (QEMU ONLY)", 0x47);
+    }
+
+    // Run a script from the RAM disk; the last command's output stays up
+    void run_command() {
+        char filename[RAMDISK_FILENAME_LEN];
+        int i = 0;
+        for (const char* p = input_buffer + 4; *p && i < RAMDISK_FILENAME_LEN - 1; p++) filename[i++] = *p;
+        filename[i] = 0;  // input_buffer gets reused by the script's commands
+
+        ScriptResult result;
+        char out[100];
+        if (!script_run(filename, run_script_line, this, &result)) {
+            if (result.line) {
+                ksnprintf(out, sizeof(out), "SCRIPT LINE %u: %s", result.line, result.error);
+            } else {
+                ksnprintf(out, sizeof(out), "SCRIPT %s", result.error);
+            }
+            show_output_wrapped(out, 0x47);
+        } else if (result.commands == 0) {
+            ksnprintf(out, sizeof(out), "SCRIPT DONE, NO COMMANDS (%u INSNS)", result.insns);
+            show_output(out, 0x1E);
+        }
+    }
+
+    void execute_command() {
+    if (input_buffer[0] == 0) return;
+
+    // cmd | cmd, < file, > file: stream commands on kernel threads
+    if (pipeline_needed(input_buffer)) {
+        char out[145];  // what fits in the output area
+        bool ok = pipeline_run(input_buffer, out, sizeof(out));
+        show_output_wrapped(out, ok ? 0x1E : 0x47);
+        return;
+    }
+
+    if (strcmp(input_buffer, "help") == 0) {
+        show_output_wrapped("COMMANDS: help, clear, about, status, time, date, mem, meminfo, mmap, alloc, ls, save, load, cat, rm. MORE: help sys, help debug", 0x1F);
+    } else if (strcmp(input_buffer, "help sys") == 0) {
+        show_output_wrapped("SYSTEM: cpus cksum locks console usertest exec run ipctest insmod rmmod lsmod lspci disk net. PIPES: cat echo grep wc head ls with | < >", 0x1F);
+    } else if (strcmp(input_buffer, "help debug") == 0) {
+        show_output_wrapped("DEBUG: dmesg [level], bench [group], prof start|stop|top, trace start|stop|dump, keys record|stop|replay, exit [code]", 0x1F);
+    } else if (strcmp(input_buffer, "clear") == 0) {
+        show_output("OUTPUT CLEARED", 0x1E);
+    } else if (strcmp(input_buffer, "about") == 0) {
+        show_output("ATOMIC OS v0.1 - 32BIT KERNEL WITH MEMORY MANAGEMENT", 0x1F);
+    } else if (strcmp(input_buffer, "status") == 0) {
+        show_output("SYSTEM STATUS: OPTIMAL", 0x1E);
+    } else if (strcmp(input_buffer, "time") == 0) {
+        Time now = read_rtc_time();
+        char t[9]; format_time(t, now);
+        char out[32] = "TIME: ";
+        copy_str(out + 6, t);
+        show_output(out, 0x1E);
+    } else if (strcmp(input_buffer, "date") == 0) {
+        Time now = read_rtc_time();
+        char d[11]; format_date(d, now);
+        char out[32] = "DATE: ";
+        copy_str(out + 6, d);
+        show_output(out, 0x1E);
+    }
+    
+     else if (strcmp(input_buffer, "ls") == 0 || strcmp(input_buffer, "dir") == 0) {
+        list_files_command();
+    } else if (strncmp(input_buffer, "save ", 5) == 0) {
+    save_file_command();
+} else if (strncmp(input_buffer, "load ", 5) == 0) {
+    load_file_command();
+} else if (strncmp(input_buffer, "exec ", 5) == 0) {
+        exec_command();
+} else if (strcmp(input_buffer, "bench") == 0 || strncmp(input_buffer, "bench ", 6) == 0) {
+        bench_command();
+} else if (strncmp(input_buffer, "prof ", 5) == 0) {
+        prof_command();
+} else if (strncmp(input_buffer, "trace ", 6) == 0) {
+        trace_command();
+} else if (strcmp(input_buffer, "keys") == 0 || strncmp(input_buffer, "keys ", 5) == 0) {
+        keys_command();
+} else if (strcmp(input_buffer, "exit") == 0 || strncmp(input_buffer, "exit ", 5) == 0) {
+        exit_command();
+} else if (strcmp(input_buffer, "dmesg") == 0 || strncmp(input_buffer, "dmesg ", 6) == 0) {
+        dmesg_command();
+} else if (strcmp(input_buffer, "console") == 0 || strncmp(input_buffer, "console ", 8) == 0) {
+        console_route_command();
+} else if (strncmp(input_buffer, "run ", 4) == 0) {
+        run_command();
+} else if (strcmp(input_buffer, "ipctest") == 0) {
+        ipctest_command();
+} else if (strncmp(input_buffer, "insmod ", 7) == 0) {
+        insmod_command();
+} else if (strncmp(input_buffer, "rmmod ", 6) == 0) {
+        rmmod_command();
+} else if (strcmp(input_buffer, "lsmod") == 0) {
+        lsmod_command();
+} else if (strcmp(input_buffer, "lspci") == 0) {
+        lspci_command();
+} else if (strcmp(input_buffer, "disk") == 0 || strncmp(input_buffer, "disk ", 5) == 0) {
+        disk_command();
+} else if (strcmp(input_buffer, "net") == 0 || strncmp(input_buffer, "net ", 4) == 0) {
+        net_command();
+} else if (strncmp(input_buffer, "cat ", 4) == 0) {
+    cat_file_command();
+} else if (strncmp(input_buffer, "rm ", 3) == 0) {
+    delete_file_command();
+}
+
+    else if (strcmp(input_buffer, "mem") == 0) {
+        // The heap only grows: freed blocks are reused, not returned to it
+        KmallocStats stats;
+        kmalloc_get_stats(&stats);
+        u32 heap = g_allocator.get_used_memory();
+        u32 total = g_allocator.get_total_memory();
+        char mem_info[64];
+        ksnprintf(mem_info, sizeof(mem_info), "MEM: %uK IN USE, HEAP %uK/%uK",
+                  stats.bytes_in_use / 1024, heap / 1024, total / 1024);
+        show_output(mem_info, 0x1E);
+    } else if (strcmp(input_buffer, "meminfo") == 0) {
+        KmallocStats stats;
+        kmalloc_get_stats(&stats);
+        u32 heap = g_allocator.get_used_memory();
+        u32 total_alloc = g_allocator.get_total_memory();
+        u32 total_system = get_total_usable_memory();
+        
+        char info[80];
+        ksnprintf(info, sizeof(info), "ALLOC: %uK LIVE, HEAP %uK/%uK, %uMB RAM",
+                  stats.bytes_in_use / 1024, heap / 1024, total_alloc / 1024, total_system / (1024 * 1024));
+        show_output(info, 0x1E);
+    } 
+    
+    else if (strcmp(input_buffer, "mmap") == 0) {
+        char mmap_info[80];
+        ksnprintf(mmap_info, sizeof(mmap_info), "MEMORY MAP: %u REGIONS DETECTED", memory_map_entries);
+        show_output(mmap_info, 0x1E);
+        
+        // Show first few regions
+        int regions_to_show = (memory_map_entries < 3) ? memory_map_entries : 3;
+        for (int i = 0; i < regions_to_show; i++) {
+            char region_info[60];
+            
+            // Type string
+            const char* type_str = "UNKNOWN";
+            switch(memory_map[i].type) {
+                case MEMORY_AVAILABLE: type_str = "AVAIL"; break;
+                case MEMORY_RESERVED: type_str = "RSRVD"; break;
+                default: type_str = "OTHER"; break;
+            }
+            
+            ksnprintf(region_info, sizeof(region_info), "%s 0x%08X-%08X", type_str,
+                      (u32)memory_map[i].base_addr,
+                      (u32)(memory_map[i].base_addr + memory_map[i].length));
+            show_output(region_info, 0x17);
+        }
+    } else if (strcmp(input_buffer, "cpus") == 0) {
+        cpus_command();
+    } else if (strcmp(input_buffer, "cksum") == 0) {
+        checksum_command();
+    } else if (strcmp(input_buffer, "locks") == 0 || strcmp(input_buffer, "locks reset") == 0) {
+        locks_command();
+    } else if (strcmp(input_buffer, "usertest") == 0) {
+        usertest_command();
+    } else if (strcmp(input_buffer, "alloc") == 0) {
+        void* test_ptr = kmalloc(1024);
+        if (test_ptr) {
+            kfree(test_ptr);
+
+            KmallocStats stats;
+            kmalloc_get_stats(&stats);
+            char out[96];
+            ksnprintf(out, sizeof(out), "ALLOCATED 1KB - TEST PASSED. CPU CACHE HITS %u REFILLS %u DRAINS %u",
+                      stats.cache_hits, stats.refills, stats.drains);
+            show_output_wrapped(out, 0x1E);
+        } else {
+            show_output("ALLOCATION FAILED", 0x47);
+        }
+    } 
+    else {
+        show_output("UNKNOWN COMMAND - TYPE 'help'", 0x47);
+    }
+}
+};
+
+
+// --- main ---
+extern "C" void main() {
+    klog_initialize();
+    cpu_features_detect();
+    alternatives_apply();
+    g_vga_lock.initialize("vga");
+    initialize_memory();
+    smp_early_initialize();
+    kmalloc_enable_cpu_caches();
+    interrupts_initialize();
+    fpu_initialize();
+    paging_initialize();
+    process_initialize();
+    syscall_initialize();
+    syscall_set_console(capture_process_output);
+    timer_initialize();
+    klog_value(KLOG_INFO, "timer: TSC kHz", tsc_khz());
+    if (serial_initialize()) {
+        klog(KLOG_INFO, "serial: COM1 at 115200 baud");
+    } else {
+        klog(KLOG_WARN, "serial: no UART on COM1");
+    }
+    console_initialize();
+    crc32_initialize();
+    smp_initialize();
+    klog_value(KLOG_INFO, "smp: CPUs online", cpu_online_count());
+    pci_initialize();
+    virtio_blk_initialize();
+    net_initialize();
+    if (!paging_available()) klog(KLOG_WARN, "paging: no PSE, user programs disabled");
+    irq_enable();
+    fs_initialize(); 
+    if (block_count() && fs_load(block_get(0))) klog(KLOG_INFO, "ramdisk: restored from disk image");
+    exec_install_initrd();
+    klog_value(KLOG_INFO, "ramdisk: KB free", fs_get_free_space() / 1024);
+    // draw whole static interface once
+    clear_screen(0x10);
+    draw_static_interface();
+    update_time_display();
+    klog(KLOG_INFO, "boot: shell ready");  // make perf reads boot time from this
+
+    CommandLine cmd;
+
+    while (true) {
+        // Refresh time in header and holographic box frequently (but not full redraw)
+        update_time_display();
+
+        cmd.clear_input();
+        cmd.show_output("SYSTEM INITIALIZED - AWAITING INPUT", 0x1E);
+
+        // listen for keyboard events for the CLI
+        while (true) {
+            unsigned char scan_code = read_scan_code();
+
+            // ESC launches editor
+            if (scan_code == 0x01) {
+                TextEditor editor;
+                editor.run();
+                // After editor returns, redraw the static UI (editor cleared screen)
+                clear_screen(0x10);
+                draw_static_interface();
+                update_time_display();
+                break;
+            }
+
+            cmd.handle_input(scan_code);
+            // keep header time fresh while typing
+            // (In real kernel you'd update based on timer interrupts to save power)
+            update_time_display();
+        }
+    }
 }
\ No newline at end of file
@@ -1,5 +1,14 @@
-section .text
-    [bits 32]
-    [extern main]
-    call main
+section .text
+    [bits 32]
+    [extern main]
+    [extern __bss_start]
+    [extern _end]
+    ; The flat binary carries no .bss; clear it before any C++ runs
+    mov edi, __bss_start
+    mov ecx, _end
+    sub ecx, edi
+    xor eax, eax
+    cld
+    rep stosb
+    call main
     jmp $
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "keyrec.h"
+#include "cpu.h"
+#include "timer.h"
+#include "rcu.h"
+#include "fs_ramdisk.h"
+
+// One buffer, header first, so a recording is saved without a copy
+static u8* g_buffer = nullptr;
+static KeyrecEntry* g_keys = nullptr;
+static u32 g_count = 0;
+static bool g_recording = false;
+static u64 g_last_tsc = 0;
+
+// Replay reads the file in place through a mapping
+static const KeyrecEntry* g_replay = nullptr;
+static u32 g_replay_count = 0;
+static u32 g_replay_handle = 0;
+static u32 g_next = 0;
+static bool g_replaying = false;
+static bool g_realtime = false;
+static u64 g_start_tsc = 0;
+static u64 g_due_tsc = 0;  // when the next key is due at the recorded pace
+static u32* g_samples = nullptr;
+static u32 g_sample_count = 0;
+
+bool keyrec_start(const char** error) {
+    if (g_recording || g_replaying) {
+        *error = "BUSY";
+        return false;
+    }
+    g_buffer = (u8*)kmalloc(sizeof(KeyrecHeader) + KEYREC_MAX_KEYS * sizeof(KeyrecEntry));
+    if (!g_buffer) {
+        *error = "OUT OF MEMORY";
+        return false;
+    }
+    g_keys = (KeyrecEntry*)(g_buffer + sizeof(KeyrecHeader));
+    g_count = 0;
+    g_last_tsc = rdtsc();
+    g_recording = true;
+    return true;
+}
+
+void keyrec_key(u8 scan_code) {
+    if (!g_recording || g_count == KEYREC_MAX_KEYS) return;
+    u64 now = rdtsc();
+    u64 us = udiv64(tsc_to_ns(now - g_last_tsc), 1000);
+    g_last_tsc = now;
+
+    KeyrecEntry* entry = &g_keys[g_count++];
+    entry->delay_us = us > 0xFFFFFFFFull ? 0xFFFFFFFF : (u32)us;
+    entry->scan_code = scan_code;
+    entry->reserved[0] = entry->reserved[1] = entry->reserved[2] = 0;
+}
+
+bool keyrec_recording() {
+    return g_recording;
+}
+
+u32 keyrec_position() {
+    return g_recording ? g_count : 0;
+}
+
+bool keyrec_stop(const char* filename, u32 keep, u32* saved, const char** error) {
+    if (!g_recording) {
+        *error = "NOT RECORDING";
+        return false;
+    }
+    g_recording = false;
+    if (keep > g_count) keep = g_count;
+
+    bool ok = true;
+    if (keep == 0) {
+        *error = "NO KEYS RECORDED";
+        ok = false;
+    } else {
+        KeyrecHeader* header = (KeyrecHeader*)g_buffer;
+        header->magic = KEYREC_MAGIC;
+        header->count = keep;
+        if (!fs_create_file(filename, g_buffer, sizeof(KeyrecHeader) + keep * sizeof(KeyrecEntry))) {
+            *error = "RAM DISK FULL";
+            ok = false;
+        }
+    }
+    *saved = ok ? keep : 0;
+    kfree(g_buffer);
+    g_buffer = nullptr;
+    g_keys = nullptr;
+    return ok;
+}
+
+bool keyrec_replay_start(const char* filename, bool realtime, const char** error) {
+    if (g_recording || g_replaying) {
+        *error = "BUSY";
+        return false;
+    }
+    u32 size;
+    const u8* data = fs_map_file(filename, &size, &g_replay_handle);
+    if (!data) {
+        *error = "FILE NOT FOUND";
+        return false;
+    }
+    const KeyrecHeader* header = (const KeyrecHeader*)data;
+    if (size < sizeof(KeyrecHeader) || header->magic != KEYREC_MAGIC || header->count == 0 ||
+        header->count > KEYREC_MAX_KEYS || size < sizeof(KeyrecHeader) + header->count * sizeof(KeyrecEntry)) {
+        fs_unmap_file(g_replay_handle);
+        *error = "NOT A KEY RECORDING";
+        return false;
+    }
+    g_samples = (u32*)kmalloc(header->count * sizeof(u32));
+    if (!g_samples) {
+        fs_unmap_file(g_replay_handle);
+        *error = "OUT OF MEMORY";
+        return false;
+    }
+
+    g_replay = (const KeyrecEntry*)(data + sizeof(KeyrecHeader));
+    g_replay_count = header->count;
+    g_next = 0;
+    g_sample_count = 0;
+    g_realtime = realtime;
+    g_start_tsc = rdtsc();
+    g_due_tsc = g_start_tsc;
+    g_replaying = true;
+    return true;
+}
+
+bool keyrec_replaying() {
+    return g_replaying;
+}
+
+bool keyrec_replay_next(u8* scan_code) {
+    if (!g_replaying || g_next == g_replay_count) return false;
+    const KeyrecEntry* entry = &g_replay[g_next++];
+
+    // The schedule is absolute: a slow key doesn't push the rest back
+    if (g_realtime) {
+        g_due_tsc += udiv64((u64)entry->delay_us * tsc_khz(), 1000);
+        while (rdtsc() < g_due_tsc) {
+            rcu_quiescent_state();  // as read_scan_code does while it polls
+            cpu_pause();
+        }
+    }
+    *scan_code = entry->scan_code;
+    return true;
+}
+
+void keyrec_replay_sample(u64 cycles) {
+    if (g_replaying && g_sample_count < g_replay_count) {
+        g_samples[g_sample_count++] = cycles > 0xFFFFFFFFull ? 0xFFFFFFFF : (u32)cycles;
+    }
+}
+
+// Shell sort: a few thousand samples in no particular order
+static void sort_samples(u32* samples, u32 count) {
+    for (u32 gap = count / 2; gap > 0; gap /= 2) {
+        for (u32 i = gap; i < count; i++) {
+            u32 v = samples[i];
+            u32 j = i;
+            while (j >= gap && samples[j - gap] > v) {
+                samples[j] = samples[j - gap];
+                j -= gap;
+            }
+            samples[j] = v;
+        }
+    }
+}
+
+static u32 percentile_ns(u32 percent) {
+    u32 i = g_sample_count * percent / 100;
+    if (i >= g_sample_count) i = g_sample_count - 1;
+    return (u32)tsc_to_ns(g_samples[i]);
+}
+
+void keyrec_replay_finish(KeyrecLatency* out) {
+    if (!g_replaying) return;
+    out->keys = g_sample_count;
+    out->total_ms = (u32)udiv64(tsc_to_ns(rdtsc() - g_start_tsc), 1000000);
+
+    u64 busy = 0;
+    for (u32 i = 0; i < g_sample_count; i++) busy += g_samples[i];
+    out->busy_ms = (u32)udiv64(tsc_to_ns(busy), 1000000);
+
+    if (g_sample_count) {
+        sort_samples(g_samples, g_sample_count);
+        out->p50_ns = percentile_ns(50);
+        out->p90_ns = percentile_ns(90);
+        out->p99_ns = percentile_ns(99);
+        out->max_ns = (u32)tsc_to_ns(g_samples[g_sample_count - 1]);
+    } else {
+        out->p50_ns = out->p90_ns = out->p99_ns = out->max_ns = 0;
+    }
+
+    kfree(g_samples);
+    g_samples = nullptr;
+    fs_unmap_file(g_replay_handle);
+    g_replay = nullptr;
+    g_replaying = false;
+}
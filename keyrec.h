@@ -0,0 +1,52 @@
+#ifndef KEYREC_H
+#define KEYREC_H
+
+#include "memory.h"
+
+// Keystroke recording and replay for repeatable UI latency runs.
+// Recording captures every scan code read_scan_code() hands out, with
+// the time since the previous one, and saves them to a RAM disk file.
+// Replay feeds a file back through read_scan_code() (so modal dialogs
+// see their keys too) either at the recorded pace or as fast as the UI
+// takes them. The driver times each key it dispatches and the report is
+// the percentiles of those per-key latencies.
+
+#define KEYREC_MAX_KEYS 4096
+#define KEYREC_MAGIC 0x3143454B  // "KEC1"
+#define KEYREC_FILE "keys.log"   // replay report
+
+struct KeyrecHeader {
+    u32 magic;
+    u32 count;
+};
+
+struct KeyrecEntry {
+    u32 delay_us;  // since the previous key (the first: since recording started)
+    u8 scan_code;
+    u8 reserved[3];
+};
+
+struct KeyrecLatency {
+    u32 keys;
+    u32 p50_ns, p90_ns, p99_ns, max_ns;
+    u32 busy_ms;   // sum of the per-key latencies
+    u32 total_ms;  // wall clock, including waits at the recorded pace
+};
+
+// Recording
+bool keyrec_start(const char** error);
+void keyrec_key(u8 scan_code);  // from read_scan_code; no-op unless recording
+bool keyrec_recording();
+u32 keyrec_position();          // keys recorded so far
+// Save the first `keep` keys (leaving out the ones that typed the stop
+// command) and end the recording
+bool keyrec_stop(const char* filename, u32 keep, u32* saved, const char** error);
+
+// Replay
+bool keyrec_replay_start(const char* filename, bool realtime, const char** error);
+bool keyrec_replaying();
+bool keyrec_replay_next(u8* scan_code);  // false once the file is used up
+void keyrec_replay_sample(u64 cycles);   // time the driver spent on one key
+void keyrec_replay_finish(KeyrecLatency* out);
+
+#endif
@@ -0,0 +1,220 @@
+#include "kformat.h"
+#include "cpu.h"
+
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+
+// Digits are produced backwards into the end of a scratch buffer
+static char* u32_digits(char* end, u32 value) {
+    while (value >= 100) {
+        const char* pair = &digit_pairs[(value % 100) * 2];
+        value /= 100;
+        *--end = pair[1];
+        *--end = pair[0];
+    }
+    if (value >= 10) {
+        *--end = digit_pairs[value * 2 + 1];
+        *--end = digit_pairs[value * 2];
+    } else {
+        *--end = '0' + value;
+    }
+    return end;
+}
+
+static char* u64_digits(char* end, u64 value) {
+    // Peel off nine digits at a time until the rest fits in 32 bits
+    while (value > 0xFFFFFFFFull) {
+        u64 high = udiv64(value, 1000000000);
+        char* start = u32_digits(end, (u32)(value - high * 1000000000));
+        while (end - start < 9) *--start = '0';
+        end = start;
+        value = high;
+    }
+    return u32_digits(end, (u32)value);
+}
+
+static char* hex_digits(char* end, u64 value, const char* digits) {
+    do {
+        *--end = digits[value & 0xF];
+        value >>= 4;
+    } while (value);
+    return end;
+}
+
+u32 kformat_u32(char* out, u32 value) {
+    char scratch[10];
+    char* start = u32_digits(scratch + sizeof(scratch), value);
+    u32 len = (u32)(scratch + sizeof(scratch) - start);
+    for (u32 i = 0; i < len; i++) out[i] = start[i];
+    return len;
+}
+
+struct FormatOut {
+    char* buf;
+    u32 size;
+    u32 len;
+
+    void put(char c) {
+        if (len + 1 < size) buf[len++] = c;
+    }
+
+    void put(const char* text, u32 count) {
+        for (u32 i = 0; i < count; i++) put(text[i]);
+    }
+
+    void pad(char c, u32 count) {
+        for (u32 i = 0; i < count; i++) put(c);
+    }
+};
+
+struct FormatSpec {
+    bool left;
+    bool zero;
+    u32 width;
+};
+
+// sign is "" or "-"; zero padding goes between it and the digits
+static void put_field(FormatOut* out, const FormatSpec& spec, const char* sign,
+                      const char* text, u32 len, bool number) {
+    u32 sign_len = sign[0] ? 1 : 0;
+    u32 fill = spec.width > len + sign_len ? spec.width - len - sign_len : 0;
+    if (spec.left) {
+        out->put(sign, sign_len);
+        out->put(text, len);
+        out->pad(' ', fill);
+    } else if (spec.zero && number) {
+        out->put(sign, sign_len);
+        out->pad('0', fill);
+        out->put(text, len);
+    } else {
+        out->pad(' ', fill);
+        out->put(sign, sign_len);
+        out->put(text, len);
+    }
+}
+
+static void put_bad(FormatOut* out, char conversion) {
+    out->put('%');
+    out->put('!');
+    out->put(conversion);
+}
+
+static bool is_integer(const FormatArg& arg) {
+    return arg.kind == FormatArg::SIGNED || arg.kind == FormatArg::UNSIGNED ||
+           arg.kind == FormatArg::CHAR || arg.kind == FormatArg::POINTER;
+}
+
+u32 kformat(char* buf, u32 size, const char* format, const FormatArg* args, u32 count) {
+    FormatOut out = { buf, size, 0 };
+    u32 next = 0;
+    char scratch[24];
+    char* end = scratch + sizeof(scratch);
+
+    for (const char* p = format; *p; p++) {
+        if (*p != '%') {
+            out.put(*p);
+            continue;
+        }
+        p++;
+        if (*p == '%') {
+            out.put('%');
+            continue;
+        }
+
+        FormatSpec spec = { false, false, 0 };
+        for (;; p++) {
+            if (*p == '-') spec.left = true;
+            else if (*p == '0') spec.zero = true;
+            else break;
+        }
+        while (*p >= '0' && *p <= '9') spec.width = spec.width * 10 + (*p++ - '0');
+        while (*p == 'l' || *p == 'h') p++;
+        char conversion = *p;
+        if (!conversion) break;
+
+        if (next >= count) {
+            put_bad(&out, conversion);
+            continue;
+        }
+        const FormatArg& arg = args[next++];
+        u64 value = arg.wide ? arg.u64v : arg.u;
+
+        switch (conversion) {
+        case 'd':
+        case 'i':
+        case 'u': {
+            if (!is_integer(arg) || arg.kind == FormatArg::POINTER) {
+                put_bad(&out, conversion);
+                break;
+            }
+            const char* sign = "";
+            if (arg.kind == FormatArg::SIGNED && arg.i < 0) {
+                sign = "-";
+                value = (u32)0 - (u32)arg.i;
+            }
+            char* start = arg.wide ? u64_digits(end, value) : u32_digits(end, (u32)value);
+            put_field(&out, spec, sign, start, (u32)(end - start), true);
+            break;
+        }
+        case 'x':
+        case 'X': {
+            if (!is_integer(arg)) {
+                put_bad(&out, conversion);
+                break;
+            }
+            char* start = hex_digits(end, value, conversion == 'x' ? hex_lower : hex_upper);
+            put_field(&out, spec, "", start, (u32)(end - start), true);
+            break;
+        }
+        case 'p': {
+            if (arg.kind != FormatArg::POINTER) {
+                put_bad(&out, conversion);
+                break;
+            }
+            char* start = hex_digits(end, value, hex_lower);
+            while (end - start < 8) *--start = '0';
+            *--start = 'x';
+            *--start = '0';
+            put_field(&out, spec, "", start, (u32)(end - start), false);
+            break;
+        }
+        case 'c': {
+            if (arg.kind != FormatArg::CHAR && arg.kind != FormatArg::SIGNED && arg.kind != FormatArg::UNSIGNED) {
+                put_bad(&out, conversion);
+                break;
+            }
+            char c = (char)arg.u;
+            put_field(&out, spec, "", &c, 1, false);
+            break;
+        }
+        case 's': {
+            if (arg.kind != FormatArg::STRING) {
+                put_bad(&out, conversion);
+                break;
+            }
+            const char* s = arg.s ? arg.s : "(null)";
+            put_field(&out, spec, "", s, strlen(s), false);
+            break;
+        }
+        default:
+            next--;  // not a conversion: leave the argument for the next one
+            put_bad(&out, conversion);
+            break;
+        }
+    }
+
+    if (size) buf[out.len] = 0;
+    return out.len;
+}
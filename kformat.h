@@ -0,0 +1,91 @@
+#ifndef KFORMAT_H
+#define KFORMAT_H
+
+#include "memory.h"
+
+// ksnprintf: bounded, single-pass string formatting for the kernel.
+//
+//   %d %i   signed decimal          %u     unsigned decimal
+//   %x %X   hex, lower/upper case   %s     string ("(null)" for nullptr)
+//   %c      character               %p     pointer as 0x%08x
+//   %%      a percent sign
+//
+// Flags and width go between % and the conversion: "-" left-aligns, "0"
+// pads numbers with zeros, a number is the minimum width ("%08x", "%-12s").
+// "l" and "ll" are accepted and ignored; arguments carry their own size,
+// so u64 values print in full with plain %u or %x.
+//
+// Arguments are captured by type, not through varargs. A type with no
+// format_arg() overload (enums, structs, floating point) fails to
+// compile. A conversion that doesn't fit its argument prints "%!"
+// followed by the conversion letter, and so does one with no argument left.
+//
+// Output always ends in NUL when size > 0 and is cut off at size - 1.
+// The return value is what was written, without the NUL, so
+//     len += ksnprintf(out + len, size - len, ...)
+// appends safely.
+
+struct FormatArg {
+    enum Kind : u8 { SIGNED, UNSIGNED, STRING, CHAR, POINTER } kind;
+    bool wide;  // 64-bit value
+    union {
+        s32 i;
+        u32 u;
+        u64 u64v;
+        const char* s;
+    };
+};
+
+// Deleted catch-all: unsupported argument types are a compile error
+template<typename T> FormatArg format_arg(T value) = delete;
+
+static inline FormatArg format_signed(s32 v) {
+    FormatArg a; a.kind = FormatArg::SIGNED; a.wide = false; a.i = v; return a;
+}
+static inline FormatArg format_unsigned(u32 v) {
+    FormatArg a; a.kind = FormatArg::UNSIGNED; a.wide = false; a.u = v; return a;
+}
+
+static inline FormatArg format_arg(signed char v) { return format_signed(v); }
+static inline FormatArg format_arg(short v) { return format_signed(v); }
+static inline FormatArg format_arg(int v) { return format_signed(v); }
+static inline FormatArg format_arg(long v) { return format_signed((s32)v); }
+static inline FormatArg format_arg(unsigned char v) { return format_unsigned(v); }
+static inline FormatArg format_arg(unsigned short v) { return format_unsigned(v); }
+static inline FormatArg format_arg(unsigned int v) { return format_unsigned(v); }
+static inline FormatArg format_arg(unsigned long v) { return format_unsigned((u32)v); }
+static inline FormatArg format_arg(bool v) { return format_unsigned(v ? 1 : 0); }
+
+static inline FormatArg format_arg(unsigned long long v) {
+    FormatArg a; a.kind = FormatArg::UNSIGNED; a.wide = true; a.u64v = v; return a;
+}
+static inline FormatArg format_arg(long long v) {
+    // Only non-negative 64-bit values come up (cycles, byte counts)
+    FormatArg a; a.kind = FormatArg::UNSIGNED; a.wide = true; a.u64v = (u64)v; return a;
+}
+
+static inline FormatArg format_arg(char v) {
+    FormatArg a; a.kind = FormatArg::CHAR; a.wide = false; a.u = (u8)v; return a;
+}
+static inline FormatArg format_arg(const char* v) {
+    FormatArg a; a.kind = FormatArg::STRING; a.wide = false; a.s = v; return a;
+}
+static inline FormatArg format_arg(char* v) { return format_arg((const char*)v); }
+
+template<typename T> FormatArg format_arg(T* v) {
+    FormatArg a; a.kind = FormatArg::POINTER; a.wide = false; a.u = (u32)(unsigned long)v; return a;
+}
+
+u32 kformat(char* out, u32 size, const char* format, const FormatArg* args, u32 count);
+
+template<typename... Args>
+u32 ksnprintf(char* out, u32 size, const char* format, Args... args) {
+    const FormatArg packed[sizeof...(Args) + 1] = { format_arg(args)... };
+    return kformat(out, size, format, packed, sizeof...(Args));
+}
+
+// Decimal digits of value into out (no NUL), returns the count; the
+// two-digits-at-a-time conversion ksnprintf uses
+u32 kformat_u32(char* out, u32 value);
+
+#endif
@@ -0,0 +1,107 @@
+#include "klog.h"
+#include "cpu.h"
+#include "smp.h"
+#include "timer.h"
+#include "console.h"
+
+struct KlogRecord {
+    u64 tsc;
+    volatile u32 seq;  // seq + 1 once published, 0 while being written
+    u8 level;
+    u8 cpu;
+    u8 len;
+    u8 reserved;
+    char text[KLOG_TEXT_LEN];
+};
+
+static KlogRecord g_ring[KLOG_RING_SIZE];
+static volatile u32 g_next_seq = 0;
+static u64 g_boot_tsc = 0;
+
+static const char* const level_names[KLOG_LEVELS] = { "err", "warn", "info", "debug" };
+
+void klog_initialize() {
+    g_boot_tsc = rdtsc();
+}
+
+void klog(u8 level, const char* text) {
+    u32 seq = __atomic_fetch_add(&g_next_seq, 1, __ATOMIC_RELAXED);
+    KlogRecord* r = &g_ring[seq & (KLOG_RING_SIZE - 1)];
+
+    // Unpublish before rewriting, so a reader of the old record notices.
+    // Only a writer a whole ring behind could share the slot with us.
+    __atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    r->tsc = rdtsc();
+    r->level = level;
+    r->cpu = cpu_percpu_ready() ? this_cpu()->index : 0;  // early boot logs before %gs is set up
+    u32 len = 0;
+    for (; text[len] && len < KLOG_TEXT_LEN; len++) r->text[len] = text[len];
+    r->len = len;
+    __atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELEASE);
+
+    if (console_routes() & CONSOLE_LOG) {
+        KlogEntry entry;
+        char line[KLOG_TEXT_LEN + 32];
+        if (klog_get(seq, &entry)) console_log(line, klog_format(&entry, line, sizeof(line)));
+    }
+}
+
+void klog_value(u8 level, const char* text, u32 value) {
+    klogf(level, "%s %u", text, value);
+}
+
+u32 klog_next_seq() {
+    return __atomic_load_n(&g_next_seq, __ATOMIC_ACQUIRE);
+}
+
+u32 klog_first_seq() {
+    u32 next = klog_next_seq();
+    return next > KLOG_RING_SIZE ? next - KLOG_RING_SIZE : 0;
+}
+
+bool klog_get(u32 seq, KlogEntry* out) {
+    const KlogRecord* r = &g_ring[seq & (KLOG_RING_SIZE - 1)];
+    if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != seq + 1) return false;
+
+    u64 tsc = r->tsc;
+    out->seq = seq;
+    out->level = r->level < KLOG_LEVELS ? r->level : (u8)KLOG_DEBUG;
+    out->cpu = r->cpu;
+    u32 len = r->len <= KLOG_TEXT_LEN ? r->len : KLOG_TEXT_LEN;
+    for (u32 i = 0; i < len; i++) out->text[i] = r->text[i];
+    out->text[len] = 0;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) != seq + 1) return false;  // overwritten while copying
+    out->ns = tsc > g_boot_tsc ? tsc_to_ns(tsc - g_boot_tsc) : 0;
+    return true;
+}
+
+const char* klog_level_name(u8 level) {
+    return level < KLOG_LEVELS ? level_names[level] : "?";
+}
+
+static int strcmp(const char* s1, const char* s2) {
+    while (*s1 && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+int klog_parse_level(const char* name) {
+    for (u32 i = 0; i < KLOG_LEVELS; i++) {
+        if (strcmp(name, level_names[i]) == 0) return (int)i;
+    }
+    return -1;
+}
+
+u32 klog_format(const KlogEntry* entry, char* out, u32 size) {
+    u64 us = udiv64(entry->ns, 1000);
+    u32 seconds = (u32)udiv64(us, 1000000);
+    u32 micros = (u32)(us - (u64)seconds * 1000000);
+    return ksnprintf(out, size, "[%5u.%06u] %-6scpu%u %s\n", seconds, micros,
+                     klog_level_name(entry->level), entry->cpu, entry->text);
+}
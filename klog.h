@@ -0,0 +1,58 @@
+#ifndef KLOG_H
+#define KLOG_H
+
+#include "memory.h"
+#include "kformat.h"
+
+// Kernel log (dmesg). A fixed ring of records, each with a level, a TSC
+// timestamp, the CPU and up to KLOG_TEXT_LEN characters. Appending takes
+// no lock and is safe from interrupt handlers and any CPU: a writer
+// claims a sequence number with one atomic add and publishes its record
+// by storing that number last. Readers copy a record and check the
+// number again, so a record overwritten meanwhile is skipped, never torn.
+// The oldest records are overwritten once the ring is full.
+
+#define KLOG_RING_SIZE 256  // records, power of two
+#define KLOG_TEXT_LEN 48
+#define KLOG_FILE "dmesg.log"
+
+enum KlogLevel : u8 {
+    KLOG_ERR,
+    KLOG_WARN,
+    KLOG_INFO,
+    KLOG_DEBUG,
+    KLOG_LEVELS
+};
+
+struct KlogEntry {
+    u64 ns;   // since klog_initialize
+    u32 seq;
+    u8 level;
+    u8 cpu;
+    char text[KLOG_TEXT_LEN + 1];
+};
+
+void klog_initialize();  // first thing at boot: the timestamps' zero
+void klog(u8 level, const char* text);
+void klog_value(u8 level, const char* text, u32 value);  // "text value"
+
+// Formatted with ksnprintf; the text is cut at KLOG_TEXT_LEN either way
+template<typename... Args>
+void klogf(u8 level, const char* format, Args... args) {
+    char text[KLOG_TEXT_LEN + 1];
+    ksnprintf(text, sizeof(text), format, args...);
+    klog(level, text);
+}
+
+// Sequence numbers still in the ring are [klog_first_seq, klog_next_seq)
+u32 klog_first_seq();
+u32 klog_next_seq();
+bool klog_get(u32 seq, KlogEntry* out);  // false if missing or overwritten
+
+const char* klog_level_name(u8 level);  // "err", "warn", ...
+int klog_parse_level(const char* name);  // -1 if unknown
+
+// "[    1.234567] warn  cpu0 text\n", returns the length
+u32 klog_format(const KlogEntry* entry, char* out, u32 size);
+
+#endif
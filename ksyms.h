@@ -0,0 +1,27 @@
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include "memory.h"
+
+// Exported kernel symbols: every global function and object, with C++
+// names in mangled form. Generated at build time by tools/ksyms.sh into
+// ksyms.asm, sorted by address and terminated by a null entry.
+struct KernelSymbol {
+    u32 address;
+    const char* name;
+};
+
+extern "C" const KernelSymbol ksym_table[];
+extern "C" const u32 ksym_count;
+
+// Every kernel function, static ones included, in the same format
+extern "C" const KernelSymbol ksym_text_table[];
+extern "C" const u32 ksym_text_count;
+
+u32 ksym_lookup(const char* name);   // address, 0 if not exported
+
+// Function containing address: the last ksym_text_table entry at or
+// below it, nullptr below the first one
+const KernelSymbol* ksym_find(u32 address);
+
+#endif
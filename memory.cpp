@@ -1,180 +1,527 @@
-#include "memory.h"
-
-// Define the global instances
-SimpleAllocator g_allocator;
-
-// Global memory map
-MemoryMapEntry memory_map[32];
-u32 memory_map_entries = 0;
-u32 total_usable_memory = 0;
-
-// SimpleAllocator implementation
-void SimpleAllocator::initialize(u32* start, u32 size) {
-    memory_start = start;
-    current_ptr = start;
-    total_memory = size;
-}
-
-void* SimpleAllocator::allocate(u32 size) {
-    size = (size + 3) & ~3;
-    
-    if ((u32)current_ptr + size > (u32)memory_start + total_memory) {
-        return nullptr;
-    }
-    
-    void* allocated = current_ptr;
-    current_ptr = (u32*)((u32)current_ptr + size);
-    return allocated;
-}
-
-u32 SimpleAllocator::get_used_memory() {
-    return (u32)current_ptr - (u32)memory_start;
-}
-
-u32 SimpleAllocator::get_total_memory() {
-    return total_memory;
-}
-
-void SimpleAllocator::reset() {
-    current_ptr = memory_start;
-}
-
-// Memory detection functions
-void detect_memory() {
-    memory_map_entries = 0;
-    total_usable_memory = 0;
-    
-    // Simulate BIOS memory detection (E820 style)
-    // In real OS, this would use int 0x15, ax=0xE820
-    
-    // 0-640KB: Conventional memory (available)
-    if (memory_map_entries < 32) {
-        memory_map[memory_map_entries].base_addr = 0x00000000;
-        memory_map[memory_map_entries].length = 0x0009F000; // 640KB - 4KB for BIOS
-        memory_map[memory_map_entries].type = MEMORY_AVAILABLE;
-        memory_map_entries++;
-        total_usable_memory += 0x0009F000;
-    }
-    
-    // 1MB-16MB: Extended memory (available for kernel)
-    if (memory_map_entries < 32) {
-        memory_map[memory_map_entries].base_addr = 0x00100000;
-        memory_map[memory_map_entries].length = 0x00F00000; // 15MB
-        memory_map[memory_map_entries].type = MEMORY_AVAILABLE;
-        memory_map_entries++;
-        total_usable_memory += 0x00F00000;
-    }
-    
-    // 16MB-128MB: More extended memory
-    if (memory_map_entries < 32) {
-        memory_map[memory_map_entries].base_addr = 0x01000000;
-        memory_map[memory_map_entries].length = 0x07000000; // 112MB
-        memory_map[memory_map_entries].type = MEMORY_AVAILABLE;
-        memory_map_entries++;
-        total_usable_memory += 0x07000000;
-    }
-    
-    // Add some reserved regions for realism
-    if (memory_map_entries < 32) {
-        memory_map[memory_map_entries].base_addr = 0x0009F000;
-        memory_map[memory_map_entries].length = 0x00001000; // BIOS area
-        memory_map[memory_map_entries].type = MEMORY_RESERVED;
-        memory_map_entries++;
-    }
-    
-    if (memory_map_entries < 32) {
-        memory_map[memory_map_entries].base_addr = 0x000F0000;
-        memory_map[memory_map_entries].length = 0x00010000; // System BIOS
-        memory_map[memory_map_entries].type = MEMORY_RESERVED;
-        memory_map_entries++;
-    }
-}
-
-u32 get_total_usable_memory() {
-    return total_usable_memory;
-}
-
-u32 get_total_memory_size() {
-    return 0x400000; // 4MB for demo
-}
-
-void print_memory_map() {
-    // This would be called from kernel to display memory map
-    // Implementation depends on your kernel's output system
-}
-
-// Memory management functions
-void initialize_memory() {
-    // Detect available memory first
-    detect_memory();
-    
-    // Use detected memory - start our allocator at 1MB with 3MB
-    u32 memory_start_addr = 0x100000;
-    u32 memory_size = 0x300000;
-    
-    g_allocator.initialize((u32*)memory_start_addr, memory_size);
-}
-
-void* kmalloc(u32 size) {
-    return g_allocator.allocate(size);
-}
-
-void kfree(void* ptr) {
-    // Simple bump allocator doesn't support free
-    // Would be implemented in a more advanced allocator
-}
-
-// Utility functions
-void itoa(char* buf, int value, int base) {
-    static char digits[] = "0123456789ABCDEF";
-    char* p = buf;
-    int n = value;
-    
-    if (base == 10 && value < 0) {
-        *p++ = '-';
-        n = -value;
-    }
-    
-    char* start = p;
-    do {
-        *p++ = digits[n % base];
-        n /= base;
-    } while (n > 0);
-    *p-- = '\0';
-    
-    // Reverse the string
-    while (start < p) {
-        char temp = *start;
-        *start = *p;
-        *p = temp;
-        start++;
-        p--;
-    }
-}
-
-int strlen(const char* str) {
-    int len = 0;
-    while (str[len] != 0) len++;
-    return len;
-}
-
-// Memory analysis functions (for advanced use)
-u32 find_largest_available_block() {
-    u32 largest = 0;
-    for (u32 i = 0; i < memory_map_entries; i++) {
-        if (memory_map[i].type == MEMORY_AVAILABLE) {
-            if (memory_map[i].length > largest) {
-                largest = memory_map[i].length;
-            }
-        }
-    }
-    return largest;
-}
-
-u32 get_memory_map_entries() {
-    return memory_map_entries;
-}
-
-const MemoryMapEntry* get_memory_map() {
-    return memory_map;
+#include "memory.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "trace.h"
+#include "klog.h"
+#include "alternatives.h"
+
+// Define the global instances
+SimpleAllocator g_allocator;
+static Spinlock g_heap_lock;  // global pool: bump allocator, depot and large list
+
+#define KMALLOC_MAGIC 0x4B4D0000u
+#define KMALLOC_LARGE 0xFFFFu
+
+// Precedes every kmalloc block
+struct KmallocHeader {
+    u32 size;  // block size including this header
+    u32 tag;   // KMALLOC_MAGIC | class index (or KMALLOC_LARGE)
+};
+
+// Free objects are linked through their first word
+struct FreeObject {
+    FreeObject* next;
+};
+
+// One CPU's stack of free objects per class. Only its owner touches it,
+// with interrupts off, so the fast path needs no lock. LIFO order hands
+// back the most recently freed (cache-hot) object first.
+struct Magazine {
+    u32 count;
+    void* objects[KMALLOC_MAGAZINE_SIZE];
+};
+
+struct CpuCache {
+    Magazine magazines[KMALLOC_CLASSES];
+    KmallocStats stats;
+} __attribute__((aligned(64)));
+
+static CpuCache g_cpu_caches[MAX_CPUS];
+static bool g_cpu_caches_enabled = false;
+
+// Page frame pool: one bit per frame, set when in use
+#define FRAME_COUNT ((FRAME_POOL_END - FRAME_POOL_START) / PAGE_SIZE)
+static Spinlock g_frame_lock;
+static u32 g_frame_bitmap[FRAME_COUNT / 32];
+static u32 g_frame_hint = 0;   // first word that may have a clear bit
+static u32 g_frames_free = 0;
+
+// Global pool, under g_heap_lock
+static FreeObject* g_depot[KMALLOC_CLASSES];
+static KmallocHeader* g_large_free = nullptr;  // linked through the word after the header
+static u32 g_global_in_use = 0;  // bytes handed out by the global paths; the CPU caches count their own
+
+// Global memory map
+MemoryMapEntry memory_map[32];
+u32 memory_map_entries = 0;
+u32 total_usable_memory = 0;
+
+// SimpleAllocator implementation
+void SimpleAllocator::initialize(u32* start, u32 size) {
+    memory_start = start;
+    current_ptr = start;
+    total_memory = size;
+}
+
+void* SimpleAllocator::allocate(u32 size) {
+    size = (size + 3) & ~3;
+    
+    if ((u32)current_ptr + size > (u32)memory_start + total_memory) {
+        return nullptr;
+    }
+    
+    void* allocated = current_ptr;
+    current_ptr = (u32*)((u32)current_ptr + size);
+    return allocated;
+}
+
+u32 SimpleAllocator::get_used_memory() {
+    return (u32)current_ptr - (u32)memory_start;
+}
+
+u32 SimpleAllocator::get_total_memory() {
+    return total_memory;
+}
+
+void SimpleAllocator::reset() {
+    current_ptr = memory_start;
+}
+
+// Memory detection functions
+void detect_memory() {
+    memory_map_entries = 0;
+    total_usable_memory = 0;
+    
+    // Simulate BIOS memory detection (E820 style)
+    // In real OS, this would use int 0x15, ax=0xE820
+    
+    // 0-640KB: Conventional memory (available)
+    if (memory_map_entries < 32) {
+        memory_map[memory_map_entries].base_addr = 0x00000000;
+        memory_map[memory_map_entries].length = 0x0009F000; // 640KB - 4KB for BIOS
+        memory_map[memory_map_entries].type = MEMORY_AVAILABLE;
+        memory_map_entries++;
+        total_usable_memory += 0x0009F000;
+    }
+    
+    // 1MB-16MB: Extended memory (available for kernel)
+    if (memory_map_entries < 32) {
+        memory_map[memory_map_entries].base_addr = 0x00100000;
+        memory_map[memory_map_entries].length = 0x00F00000; // 15MB
+        memory_map[memory_map_entries].type = MEMORY_AVAILABLE;
+        memory_map_entries++;
+        total_usable_memory += 0x00F00000;
+    }
+    
+    // 16MB-128MB: More extended memory
+    if (memory_map_entries < 32) {
+        memory_map[memory_map_entries].base_addr = 0x01000000;
+        memory_map[memory_map_entries].length = 0x07000000; // 112MB
+        memory_map[memory_map_entries].type = MEMORY_AVAILABLE;
+        memory_map_entries++;
+        total_usable_memory += 0x07000000;
+    }
+    
+    // Add some reserved regions for realism
+    if (memory_map_entries < 32) {
+        memory_map[memory_map_entries].base_addr = 0x0009F000;
+        memory_map[memory_map_entries].length = 0x00001000; // BIOS area
+        memory_map[memory_map_entries].type = MEMORY_RESERVED;
+        memory_map_entries++;
+    }
+    
+    if (memory_map_entries < 32) {
+        memory_map[memory_map_entries].base_addr = 0x000F0000;
+        memory_map[memory_map_entries].length = 0x00010000; // System BIOS
+        memory_map[memory_map_entries].type = MEMORY_RESERVED;
+        memory_map_entries++;
+    }
+}
+
+u32 get_total_usable_memory() {
+    return total_usable_memory;
+}
+
+u32 get_total_memory_size() {
+    return 0x400000; // 4MB for demo
+}
+
+void print_memory_map() {
+    // This would be called from kernel to display memory map
+    // Implementation depends on your kernel's output system
+}
+
+// Memory management functions
+void initialize_memory() {
+    // Detect available memory first
+    detect_memory();
+    
+    // Use detected memory - start our allocator at 1MB with 3MB
+    u32 memory_start_addr = KERNEL_HEAP_START;
+    u32 memory_size = KERNEL_HEAP_SIZE;
+    
+    g_heap_lock.initialize("heap");
+    g_allocator.initialize((u32*)memory_start_addr, memory_size);
+
+    g_frame_lock.initialize("frames");
+    g_frames_free = FRAME_COUNT;
+}
+
+u32 frame_alloc() {
+    u32 flags = g_frame_lock.lock_irqsave();
+    u32 phys = 0;
+    for (u32 w = g_frame_hint; w < FRAME_COUNT / 32; w++) {
+        if (g_frame_bitmap[w] == 0xFFFFFFFF) continue;
+        u32 bit = __builtin_ctz(~g_frame_bitmap[w]);
+        g_frame_bitmap[w] |= 1u << bit;
+        g_frame_hint = w;
+        g_frames_free--;
+        phys = FRAME_POOL_START + (w * 32 + bit) * PAGE_SIZE;
+        break;
+    }
+    g_frame_lock.unlock_irqrestore(flags);
+
+    if (phys) {
+        u32* page = (u32*)phys;
+        for (u32 i = 0; i < PAGE_SIZE / 4; i++) page[i] = 0;
+    }
+    return phys;
+}
+
+void frame_free(u32 phys) {
+    if (phys < FRAME_POOL_START || phys >= FRAME_POOL_END) return;
+    u32 index = (phys - FRAME_POOL_START) / PAGE_SIZE;
+
+    u32 flags = g_frame_lock.lock_irqsave();
+    if (g_frame_bitmap[index / 32] & (1u << (index % 32))) {
+        g_frame_bitmap[index / 32] &= ~(1u << (index % 32));
+        g_frames_free++;
+        if (index / 32 < g_frame_hint) g_frame_hint = index / 32;
+    }
+    g_frame_lock.unlock_irqrestore(flags);
+}
+
+u32 frame_free_count() {
+    return g_frames_free;
+}
+
+static inline u32 class_size(u32 cls) {
+    return 1u << (KMALLOC_MIN_SHIFT + cls);
+}
+
+static inline u32 size_to_class(u32 total) {
+    u32 cls = 0;
+    while (class_size(cls) < total) cls++;
+    return cls;
+}
+
+// Move up to 'count' free objects of a class into 'out'. Takes recycled
+// objects from the depot first, then carves a fresh run from the heap.
+// Caller holds g_heap_lock.
+static u32 depot_take(u32 cls, void** out, u32 count) {
+    u32 n = 0;
+    while (n < count && g_depot[cls]) {
+        FreeObject* obj = g_depot[cls];
+        g_depot[cls] = obj->next;
+        out[n++] = obj;
+    }
+    if (n == count) return n;
+
+    u32 size = class_size(cls);
+    u8* run = (u8*)g_allocator.allocate((count - n) * size);
+    if (!run) {
+        // Heap nearly exhausted: settle for a single object
+        run = (u8*)g_allocator.allocate(size);
+        if (!run) return n;
+        count = n + 1;
+    }
+    while (n < count) {
+        KmallocHeader* header = (KmallocHeader*)run;
+        header->size = size;
+        header->tag = KMALLOC_MAGIC | cls;
+        out[n++] = header;
+        run += size;
+    }
+    return n;
+}
+
+static void depot_put(u32 cls, void** objects, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        FreeObject* obj = (FreeObject*)objects[i];
+        obj->next = g_depot[cls];
+        g_depot[cls] = obj;
+    }
+}
+
+static KmallocHeader* alloc_small_global(u32 cls) {
+    void* obj = nullptr;
+    u32 flags = g_heap_lock.lock_irqsave();
+    if (depot_take(cls, &obj, 1)) g_global_in_use += 1u << (cls + KMALLOC_MIN_SHIFT);
+    g_heap_lock.unlock_irqrestore(flags);
+    return (KmallocHeader*)obj;
+}
+
+static void free_small_global(u32 cls, KmallocHeader* header) {
+    void* obj = header;
+    u32 flags = g_heap_lock.lock_irqsave();
+    depot_put(cls, &obj, 1);
+    g_global_in_use -= 1u << (cls + KMALLOC_MIN_SHIFT);
+    g_heap_lock.unlock_irqrestore(flags);
+}
+
+// First fit over freed large blocks, falling back to the bump allocator
+static KmallocHeader* alloc_large(u32 total) {
+    total = (total + 7) & ~7;
+
+    u32 flags = g_heap_lock.lock_irqsave();
+    KmallocHeader** link = &g_large_free;
+    KmallocHeader* header = nullptr;
+    while (*link) {
+        if ((*link)->size >= total) {
+            header = *link;
+            *link = *(KmallocHeader**)(header + 1);
+            break;
+        }
+        link = (KmallocHeader**)(*link + 1);
+    }
+    if (!header) {
+        header = (KmallocHeader*)g_allocator.allocate(total);
+        if (header) {
+            header->size = total;
+            header->tag = KMALLOC_MAGIC | KMALLOC_LARGE;
+        }
+    }
+    if (header) g_global_in_use += header->size;
+    g_heap_lock.unlock_irqrestore(flags);
+    return header;
+}
+
+static void free_large(KmallocHeader* header) {
+    u32 flags = g_heap_lock.lock_irqsave();
+    *(KmallocHeader**)(header + 1) = g_large_free;
+    g_large_free = header;
+    g_global_in_use -= header->size;
+    g_heap_lock.unlock_irqrestore(flags);
+}
+
+void kmalloc_enable_cpu_caches() {
+    g_cpu_caches_enabled = true;
+}
+
+void* kmalloc(u32 size) {
+    trace_instant(TRACE_ALLOC, size);
+    u32 total = size + sizeof(KmallocHeader);
+    KmallocHeader* header;
+
+    if (total > KMALLOC_MAX_CLASS_SIZE) {
+        header = alloc_large(total);
+        if (g_cpu_caches_enabled) g_cpu_caches[this_cpu()->index].stats.large++;
+        if (!header) klog_value(KLOG_WARN, "kmalloc: out of memory for bytes", size);
+        return header ? header + 1 : nullptr;
+    }
+
+    u32 cls = size_to_class(total);
+    if (!g_cpu_caches_enabled) {
+        header = alloc_small_global(cls);
+        return header ? header + 1 : nullptr;
+    }
+
+    // Fast path: pop from this CPU's magazine with interrupts off
+    u32 flags = irq_save();
+    CpuCache* cache = &g_cpu_caches[this_cpu()->index];
+    Magazine* mag = &cache->magazines[cls];
+    if (mag->count == 0) {
+        g_heap_lock.lock();
+        mag->count = depot_take(cls, mag->objects, KMALLOC_BATCH);
+        g_heap_lock.unlock();
+        cache->stats.refills++;
+        if (mag->count == 0) {
+            irq_restore(flags);
+            klog_value(KLOG_WARN, "kmalloc: out of memory for bytes", size);
+            return nullptr;
+        }
+    } else {
+        cache->stats.cache_hits++;
+    }
+    header = (KmallocHeader*)mag->objects[--mag->count];
+    cache->stats.bytes_in_use += 1u << (cls + KMALLOC_MIN_SHIFT);
+    irq_restore(flags);
+    return header + 1;
+}
+
+void kfree(void* ptr) {
+    if (!ptr) return;
+
+    KmallocHeader* header = (KmallocHeader*)ptr - 1;
+    if ((header->tag & 0xFFFF0000u) != KMALLOC_MAGIC) return;  // not ours
+
+    u32 cls = header->tag & 0xFFFF;
+    if (cls == KMALLOC_LARGE) {
+        free_large(header);
+        return;
+    }
+    if (!g_cpu_caches_enabled) {
+        free_small_global(cls, header);
+        return;
+    }
+
+    // Fast path: push onto this CPU's magazine, so the object is reused
+    // here while it is still in cache
+    u32 flags = irq_save();
+    CpuCache* cache = &g_cpu_caches[this_cpu()->index];
+    Magazine* mag = &cache->magazines[cls];
+    if (mag->count == KMALLOC_MAGAZINE_SIZE) {
+        // Return the oldest (coldest) half in one lock acquisition
+        g_heap_lock.lock();
+        depot_put(cls, mag->objects, KMALLOC_BATCH);
+        g_heap_lock.unlock();
+        for (u32 i = KMALLOC_BATCH; i < KMALLOC_MAGAZINE_SIZE; i++) {
+            mag->objects[i - KMALLOC_BATCH] = mag->objects[i];
+        }
+        mag->count -= KMALLOC_BATCH;
+        cache->stats.drains++;
+    } else {
+        cache->stats.cache_hits++;
+    }
+    mag->objects[mag->count++] = header;
+    cache->stats.bytes_in_use -= 1u << (cls + KMALLOC_MIN_SHIFT);  // may wrap: only the sum over CPUs is meaningful
+    irq_restore(flags);
+}
+
+void kmalloc_get_stats(KmallocStats* out) {
+    out->cache_hits = out->refills = out->drains = out->large = 0;
+    out->bytes_in_use = g_global_in_use;
+    for (u32 i = 0; i < MAX_CPUS; i++) {
+        out->cache_hits += g_cpu_caches[i].stats.cache_hits;
+        out->refills += g_cpu_caches[i].stats.refills;
+        out->drains += g_cpu_caches[i].stats.drains;
+        out->large += g_cpu_caches[i].stats.large;
+        out->bytes_in_use += g_cpu_caches[i].stats.bytes_in_use;
+    }
+}
+
+// Utility functions
+void itoa(char* buf, int value, int base) {
+    static char digits[] = "0123456789ABCDEF";
+    char* p = buf;
+    unsigned int n = value;  // INT_MIN has no positive int
+    
+    if (base == 10 && value < 0) {
+        *p++ = '-';
+        n = 0u - n;
+    }
+    
+    char* start = p;
+    do {
+        *p++ = digits[n % base];
+        n /= base;
+    } while (n > 0);
+    *p-- = '\0';
+    
+    // Reverse the string
+    while (start < p) {
+        char temp = *start;
+        *start = *p;
+        *p = temp;
+        start++;
+        p--;
+    }
+}
+
+int strlen(const char* str) {
+    int len = 0;
+    while (str[len] != 0) len++;
+    return len;
+}
+
+// Dwords with rep movsd, then the 0-3 byte tail. Written in asm so the
+// compiler can't turn the loops back into calls to these functions.
+extern "C" ALTERNATIVE_TARGET void* memcpy(void* dst, const void* src, u32 n) {
+    u32 d0, d1, d2;
+    asm volatile ("rep movsl\n\t"
+                  "movl %4, %%ecx\n\t"
+                  "rep movsb"
+                  : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+                  : "0"(n >> 2), "g"(n & 3), "1"(dst), "2"(src)
+                  : "memory");
+    return dst;
+}
+
+extern "C" void* memmove(void* dst, const void* src, u32 n) {
+    if ((u32)dst - (u32)src >= n) return memcpy(dst, src, n);  // no harmful overlap
+
+    // Destination overlaps the end of the source: copy backwards
+    u32 d0, d1, d2;
+    asm volatile ("std\n\t"
+                  "rep movsb\n\t"
+                  "cld"
+                  : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+                  : "0"(n), "1"((u8*)dst + n - 1), "2"((const u8*)src + n - 1)
+                  : "memory");
+    return dst;
+}
+
+extern "C" ALTERNATIVE_TARGET void* memset(void* dst, int value, u32 n) {
+    u32 pattern = (u8)value * 0x01010101u;
+    u32 d0, d1;
+    asm volatile ("rep stosl\n\t"
+                  "movl %3, %%ecx\n\t"
+                  "rep stosb"
+                  : "=&c"(d0), "=&D"(d1)
+                  : "a"(pattern), "g"(n & 3), "0"(n >> 2), "1"(dst)
+                  : "memory");
+    return dst;
+}
+
+// With ERMS, one rep movsb/stosb moves whole cache lines internally and
+// beats the dword loop plus byte tail at every size
+extern "C" void* memcpy_erms(void* dst, const void* src, u32 n) {
+    u32 d0, d1, d2;
+    asm volatile ("rep movsb"
+                  : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+                  : "0"(n), "1"(dst), "2"(src)
+                  : "memory");
+    return dst;
+}
+
+extern "C" void* memset_erms(void* dst, int value, u32 n) {
+    u32 d0, d1;
+    asm volatile ("rep stosb"
+                  : "=&c"(d0), "=&D"(d1)
+                  : "a"(value), "0"(n), "1"(dst)
+                  : "memory");
+    return dst;
+}
+
+ALTERNATIVE(memcpy, memcpy_erms, CPU_FEATURE_ERMS);
+ALTERNATIVE(memset, memset_erms, CPU_FEATURE_ERMS);
+
+extern "C" int memcmp(const void* a, const void* b, u32 n) {
+    const u8* pa = (const u8*)a;
+    const u8* pb = (const u8*)b;
+    for (u32 i = 0; i < n; i++) {
+        if (pa[i] != pb[i]) return pa[i] - pb[i];
+    }
+    return 0;
+}
+
+// Memory analysis functions (for advanced use)
+u32 find_largest_available_block() {
+    u32 largest = 0;
+    for (u32 i = 0; i < memory_map_entries; i++) {
+        if (memory_map[i].type == MEMORY_AVAILABLE) {
+            if (memory_map[i].length > largest) {
+                largest = memory_map[i].length;
+            }
+        }
+    }
+    return largest;
+}
+
+u32 get_memory_map_entries() {
+    return memory_map_entries;
+}
+
+const MemoryMapEntry* get_memory_map() {
+    return memory_map;
 }
\ No newline at end of file
@@ -1,92 +1,136 @@
-#ifndef MEMORY_H
-#define MEMORY_H
-typedef unsigned int u32;
-typedef unsigned short u16;
-typedef unsigned char u8;
-typedef unsigned long long u64;
-
-// Memory map entry structure
-struct MemoryMapEntry {
-    u64 base_addr;
-    u64 length;
-    u32 type;
-    u32 extended_attributes;
-};
-
-// Memory types
-#define MEMORY_AVAILABLE 1
-#define MEMORY_RESERVED 2
-#define MEMORY_ACPI_RECLAIM 3
-#define MEMORY_ACPI_NVS 4
-#define MEMORY_BAD 5
-
-// Basic allocator class
-class SimpleAllocator {
-private:
-    u32* memory_start;
-    u32* current_ptr;
-    u32 total_memory;
-    
-public:
-    void initialize(u32* start, u32 size);
-    void* allocate(u32 size);
-    u32 get_used_memory();
-    u32 get_total_memory();
-    void reset();
-};
-
-// Paging structures
-struct PageDirectoryEntry {
-    u32 present : 1;
-    u32 read_write : 1;
-    u32 user_supervisor : 1;
-    u32 write_through : 1;
-    u32 cache_disable : 1;
-    u32 accessed : 1;
-    u32 reserved : 1;
-    u32 page_size : 1;
-    u32 global : 1;
-    u32 available : 3;
-    u32 page_table_base : 20;
-};
-
-struct PageTableEntry {
-    u32 present : 1;
-    u32 read_write : 1;
-    u32 user_supervisor : 1;
-    u32 write_through : 1;
-    u32 cache_disable : 1;
-    u32 accessed : 1;
-    u32 dirty : 1;
-    u32 reserved : 1;
-    u32 global : 1;
-    u32 available : 3;
-    u32 page_base : 20;
-};
-
-// Global allocator instance
-extern SimpleAllocator g_allocator;
-
-// Memory detection
-extern MemoryMapEntry memory_map[32];
-extern u32 memory_map_entries;
-extern u32 total_usable_memory;
-
-// Function declarations
-void initialize_memory();
-void fs_initialize();
-void detect_memory();
-u32 get_total_usable_memory();
-u32 get_total_memory_size();
-void print_memory_map();
-void* kmalloc(u32 size);
-void kfree(void* ptr);
-void itoa(char* buf, int value, int base);
-int strlen(const char* str);
-
-// Advanced memory functions
-u32 find_largest_available_block();
-u32 get_memory_map_entries();
-const MemoryMapEntry* get_memory_map();
-
+#ifndef MEMORY_H
+#define MEMORY_H
+typedef unsigned int u32;
+typedef unsigned short u16;
+typedef unsigned char u8;
+typedef unsigned long long u64;
+typedef signed int s32;
+
+// Memory map entry structure
+struct MemoryMapEntry {
+    u64 base_addr;
+    u64 length;
+    u32 type;
+    u32 extended_attributes;
+};
+
+// Physical memory layout (identity mapped by the kernel)
+#define KERNEL_HEAP_START 0x100000   // kmalloc pool
+#define KERNEL_HEAP_SIZE  0x300000
+#define RAMDISK_BASE      0x400000   // RAMDiskFS image
+#define FRAME_POOL_START  0x800000   // 4KB frames for page tables and user pages
+#define FRAME_POOL_END    0x2000000
+#define PAGE_SIZE 4096
+
+// Memory types
+#define MEMORY_AVAILABLE 1
+#define MEMORY_RESERVED 2
+#define MEMORY_ACPI_RECLAIM 3
+#define MEMORY_ACPI_NVS 4
+#define MEMORY_BAD 5
+
+// Basic allocator class
+class SimpleAllocator {
+private:
+    u32* memory_start;
+    u32* current_ptr;
+    u32 total_memory;
+    
+public:
+    void initialize(u32* start, u32 size);
+    void* allocate(u32 size);
+    u32 get_used_memory();
+    u32 get_total_memory();
+    void reset();
+};
+
+// Paging structures
+struct PageDirectoryEntry {
+    u32 present : 1;
+    u32 read_write : 1;
+    u32 user_supervisor : 1;
+    u32 write_through : 1;
+    u32 cache_disable : 1;
+    u32 accessed : 1;
+    u32 reserved : 1;
+    u32 page_size : 1;
+    u32 global : 1;
+    u32 available : 3;
+    u32 page_table_base : 20;
+};
+
+struct PageTableEntry {
+    u32 present : 1;
+    u32 read_write : 1;
+    u32 user_supervisor : 1;
+    u32 write_through : 1;
+    u32 cache_disable : 1;
+    u32 accessed : 1;
+    u32 dirty : 1;
+    u32 reserved : 1;
+    u32 global : 1;
+    u32 available : 3;
+    u32 page_base : 20;
+};
+
+// kmalloc size classes. Blocks carry an 8-byte header recording their
+// class, so the class sizes below include it. Larger requests bypass the
+// per-CPU caches and go to a first-fit list on the global heap.
+#define KMALLOC_MIN_SHIFT 4                 // smallest class is 16 bytes
+#define KMALLOC_CLASSES 8                   // 16 .. 2048
+#define KMALLOC_MAX_CLASS_SIZE (1u << (KMALLOC_MIN_SHIFT + KMALLOC_CLASSES - 1))
+#define KMALLOC_MAGAZINE_SIZE 32            // objects cached per CPU per class
+#define KMALLOC_BATCH (KMALLOC_MAGAZINE_SIZE / 2)  // moved per refill/drain
+
+struct KmallocStats {
+    u32 cache_hits;    // served from / returned to a CPU's magazine
+    u32 refills;       // magazine empty: batch taken from the global pool
+    u32 drains;        // magazine full: batch returned to the global pool
+    u32 large;         // requests above KMALLOC_MAX_CLASS_SIZE
+    u32 bytes_in_use;  // live blocks, headers and class rounding included
+};
+
+// Global allocator instance
+extern SimpleAllocator g_allocator;
+
+// Memory detection
+extern MemoryMapEntry memory_map[32];
+extern u32 memory_map_entries;
+extern u32 total_usable_memory;
+
+// Function declarations
+void initialize_memory();
+void fs_initialize();
+void detect_memory();
+u32 get_total_usable_memory();
+u32 get_total_memory_size();
+void print_memory_map();
+void* kmalloc(u32 size);
+void kfree(void* ptr);
+void kmalloc_enable_cpu_caches();  // once this_cpu() works
+void kmalloc_get_stats(KmallocStats* out);  // summed over all CPUs
+
+// Physical page frames (zeroed on allocation; 0 when exhausted)
+u32 frame_alloc();
+void frame_free(u32 phys);
+u32 frame_free_count();
+void itoa(char* buf, int value, int base);
+int strlen(const char* str);
+
+// Block copy/fill (string instructions); the compiler may emit calls too
+extern "C" void* memcpy(void* dst, const void* src, u32 n);
+extern "C" void* memmove(void* dst, const void* src, u32 n);
+extern "C" void* memset(void* dst, int value, u32 n);
+extern "C" int memcmp(const void* a, const void* b, u32 n);
+
+// Variants patched over memcpy/memset on CPUs with fast rep movsb/stosb
+// (alternatives.h)
+extern "C" void* memcpy_erms(void* dst, const void* src, u32 n);
+extern "C" void* memset_erms(void* dst, int value, u32 n);
+
+// Advanced memory functions
+u32 find_largest_available_block();
+u32 get_memory_map_entries();
+const MemoryMapEntry* get_memory_map();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,312 @@
+#include "module.h"
+#include "ksyms.h"
+#include "elf.h"
+#include "fs_ramdisk.h"
+#include "klog.h"
+
+// The module table is only touched from the shell
+static Module g_modules[MAX_MODULES];
+static char g_last_log[64];
+
+static int strcmp(const char* s1, const char* s2) {
+    while (*s1 && *s1 == *s2) {
+        s1++;
+        s2++;
+    }
+    return *(const unsigned char*)s1 - *(const unsigned char*)s2;
+}
+
+u32 ksym_lookup(const char* name) {
+    for (u32 i = 0; i < ksym_count; i++) {
+        if (strcmp(ksym_table[i].name, name) == 0) return ksym_table[i].address;
+    }
+    return 0;
+}
+
+// Binary search; cheap enough for the profiler's timer interrupt
+const KernelSymbol* ksym_find(u32 address) {
+    u32 lo = 0, hi = ksym_text_count;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (ksym_text_table[mid].address <= address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo ? &ksym_text_table[lo - 1] : nullptr;
+}
+
+// Everything the loader needs to know about one object file
+struct ElfObject {
+    const u8* data;
+    u32 size;
+    const Elf32_Shdr* sections;
+    u32 section_count;
+    const Elf32_Sym* symbols;
+    u32 symbol_count;
+    const char* strings;       // symbol names
+    u32 strings_size;
+    u32* section_addr;         // load address of each SHF_ALLOC section, 0 otherwise
+};
+
+static bool section_in_file(const ElfObject& obj, const Elf32_Shdr& sh) {
+    return sh.sh_type == SHT_NOBITS || (sh.sh_offset <= obj.size && sh.sh_size <= obj.size - sh.sh_offset);
+}
+
+static const char* parse_sections(ElfObject& obj) {
+    const Elf32_Ehdr* eh = (const Elf32_Ehdr*)obj.data;
+    if (eh->e_shentsize != sizeof(Elf32_Shdr) || eh->e_shoff > obj.size ||
+        eh->e_shnum > (obj.size - eh->e_shoff) / sizeof(Elf32_Shdr)) {
+        return "BAD SECTION HEADERS";
+    }
+    obj.sections = (const Elf32_Shdr*)(obj.data + eh->e_shoff);
+    obj.section_count = eh->e_shnum;
+
+    obj.symbols = nullptr;
+    for (u32 i = 0; i < obj.section_count; i++) {
+        const Elf32_Shdr& sh = obj.sections[i];
+        if (!section_in_file(obj, sh)) return "BAD SECTION";
+        if (sh.sh_type != SHT_SYMTAB) continue;
+
+        if (sh.sh_entsize != sizeof(Elf32_Sym) || sh.sh_link >= obj.section_count ||
+            !section_in_file(obj, obj.sections[sh.sh_link])) {
+            return "BAD SYMBOL TABLE";
+        }
+        obj.symbols = (const Elf32_Sym*)(obj.data + sh.sh_offset);
+        obj.symbol_count = sh.sh_size / sizeof(Elf32_Sym);
+        obj.strings = (const char*)(obj.data + obj.sections[sh.sh_link].sh_offset);
+        obj.strings_size = obj.sections[sh.sh_link].sh_size;
+    }
+    return obj.symbols ? nullptr : "NO SYMBOL TABLE";
+}
+
+static const char* symbol_name(const ElfObject& obj, const Elf32_Sym& sym) {
+    if (sym.st_name >= obj.strings_size) return "";
+    // The string table ends in a NUL, so names can't run past it
+    if (obj.strings[obj.strings_size - 1] != 0) return "";
+    return obj.strings + sym.st_name;
+}
+
+// Copy the SHF_ALLOC sections into one block, each at its alignment
+static const char* place_sections(ElfObject& obj, Module* mod) {
+    u32 size = 0;
+    u32 max_align = 1;
+    for (u32 i = 0; i < obj.section_count; i++) {
+        const Elf32_Shdr& sh = obj.sections[i];
+        if (!(sh.sh_flags & SHF_ALLOC) || sh.sh_size == 0) continue;
+        u32 align = sh.sh_addralign ? sh.sh_addralign : 1;
+        if (align & (align - 1) || align > PAGE_SIZE) return "BAD SECTION ALIGNMENT";
+        if (align > max_align) max_align = align;
+        size = (size + align - 1) & ~(align - 1);
+        obj.section_addr[i] = size;  // offset for now
+        size += sh.sh_size;
+    }
+    if (size == 0) return "EMPTY MODULE";
+
+    // kmalloc only guarantees 8 bytes; over-allocate for stricter sections
+    mod->memory = (u8*)kmalloc(size + max_align);
+    if (!mod->memory) return "OUT OF MEMORY";
+    u32 base = ((u32)mod->memory + max_align - 1) & ~(max_align - 1);
+    mod->size = size;
+
+    for (u32 i = 0; i < obj.section_count; i++) {
+        const Elf32_Shdr& sh = obj.sections[i];
+        if (!(sh.sh_flags & SHF_ALLOC) || sh.sh_size == 0) continue;
+        obj.section_addr[i] += base;
+        u8* dst = (u8*)obj.section_addr[i];
+        if (sh.sh_type == SHT_NOBITS) {
+            for (u32 j = 0; j < sh.sh_size; j++) dst[j] = 0;
+        } else {
+            const u8* src = obj.data + sh.sh_offset;
+            for (u32 j = 0; j < sh.sh_size; j++) dst[j] = src[j];
+        }
+    }
+    return nullptr;
+}
+
+static const char* symbol_value(const ElfObject& obj, u32 index, u32* value) {
+    if (index >= obj.symbol_count) return "BAD SYMBOL";
+    const Elf32_Sym& sym = obj.symbols[index];
+
+    switch (sym.st_shndx) {
+    case SHN_UNDEF:
+        *value = ksym_lookup(symbol_name(obj, sym));
+        if (!*value) {
+            module_log(symbol_name(obj, sym));  // tell the shell which one
+            return "UNRESOLVED SYMBOL";
+        }
+        return nullptr;
+    case SHN_ABS:
+        *value = sym.st_value;
+        return nullptr;
+    case SHN_COMMON:
+        return "COMMON SYMBOLS (BUILD WITH -fno-common)";
+    default:
+        if (sym.st_shndx >= obj.section_count || !obj.section_addr[sym.st_shndx]) return "BAD SYMBOL";
+        *value = obj.section_addr[sym.st_shndx] + sym.st_value;
+        return nullptr;
+    }
+}
+
+static const char* apply_relocations(const ElfObject& obj) {
+    for (u32 i = 0; i < obj.section_count; i++) {
+        const Elf32_Shdr& sh = obj.sections[i];
+        if (sh.sh_type != SHT_REL) continue;
+        if (sh.sh_info >= obj.section_count) return "BAD RELOCATIONS";
+        if (!obj.section_addr[sh.sh_info]) continue;  // debug info and the like
+        if (sh.sh_entsize != sizeof(Elf32_Rel)) return "BAD RELOCATIONS";
+
+        const Elf32_Shdr& target = obj.sections[sh.sh_info];
+        const Elf32_Rel* rel = (const Elf32_Rel*)(obj.data + sh.sh_offset);
+        for (u32 j = 0; j < sh.sh_size / sizeof(Elf32_Rel); j++) {
+            if (target.sh_size < 4 || rel[j].r_offset > target.sh_size - 4) return "BAD RELOCATIONS";
+
+            u32 s;
+            const char* error = symbol_value(obj, ELF32_R_SYM(rel[j].r_info), &s);
+            if (error) return error;
+
+            u32 p = obj.section_addr[sh.sh_info] + rel[j].r_offset;
+            switch (ELF32_R_TYPE(rel[j].r_info)) {
+            case R_386_32:
+                *(u32*)p += s;        // S + A
+                break;
+            case R_386_PC32:
+                *(u32*)p += s - p;    // S + A - P
+                break;
+            default:
+                return "UNSUPPORTED RELOCATION";
+            }
+        }
+    }
+    return nullptr;
+}
+
+// Address of a symbol defined by the module itself
+static u32 find_hook(const ElfObject& obj, const char* name) {
+    for (u32 i = 0; i < obj.symbol_count; i++) {
+        const Elf32_Sym& sym = obj.symbols[i];
+        if (ELF32_ST_BIND(sym.st_info) == STB_LOCAL || sym.st_shndx == SHN_UNDEF) continue;
+        if (strcmp(symbol_name(obj, sym), name) != 0) continue;
+        u32 value;
+        return symbol_value(obj, i, &value) ? 0 : value;
+    }
+    return 0;
+}
+
+static void module_name(char* dst, const char* filename) {
+    u32 i = 0;
+    for (; filename[i] && filename[i] != '.' && i < MODULE_NAME_LEN - 1; i++) dst[i] = filename[i];
+    dst[i] = 0;
+}
+
+static Module* find_module(const char* name) {
+    for (u32 i = 0; i < MAX_MODULES; i++) {
+        if (g_modules[i].loaded && strcmp(g_modules[i].name, name) == 0) return &g_modules[i];
+    }
+    return nullptr;
+}
+
+static const char* load(const char* filename, Module* mod) {
+    u32 size, handle;
+    const u8* data = fs_map_file(filename, &size, &handle);
+    if (!data) return "FILE NOT FOUND";
+
+    const char* error = nullptr;
+    ElfObject obj;
+    obj.data = data;
+    obj.size = size;
+    obj.section_addr = nullptr;
+    if (!elf_header_ok((const Elf32_Ehdr*)data, size, ET_REL)) {
+        error = "NOT A RELOCATABLE OBJECT";
+    } else if (!(error = parse_sections(obj))) {
+        obj.section_addr = (u32*)kmalloc(obj.section_count * sizeof(u32));
+        if (!obj.section_addr) {
+            error = "OUT OF MEMORY";
+        } else {
+            for (u32 i = 0; i < obj.section_count; i++) obj.section_addr[i] = 0;
+            error = place_sections(obj, mod);
+        }
+    }
+    if (!error) error = apply_relocations(obj);
+
+    ModuleInitFn init = nullptr;
+    if (!error) {
+        init = (ModuleInitFn)find_hook(obj, "module_init");
+        mod->exit = (ModuleExitFn)find_hook(obj, "module_exit");
+        if (!init) error = "NO module_init";
+    }
+
+    if (obj.section_addr) kfree(obj.section_addr);
+    fs_unmap_file(handle);  // everything needed was copied
+
+    if (!error && init() != 0) error = "module_init FAILED";
+    return error;
+}
+
+const Module* module_load(const char* filename, const char** error) {
+    Module* mod = nullptr;
+    char name[MODULE_NAME_LEN];
+    module_name(name, filename);
+    if (find_module(name)) {
+        *error = "ALREADY LOADED";
+        return nullptr;
+    }
+    for (u32 i = 0; i < MAX_MODULES && !mod; i++) {
+        if (!g_modules[i].loaded) mod = &g_modules[i];
+    }
+    if (!mod) {
+        *error = "TOO MANY MODULES";
+        return nullptr;
+    }
+
+    mod->memory = nullptr;
+    mod->size = 0;
+    mod->exit = nullptr;
+    g_last_log[0] = 0;
+    *error = load(filename, mod);
+    if (*error) {
+        if (mod->memory) kfree(mod->memory);
+        mod->memory = nullptr;
+        return nullptr;
+    }
+
+    for (u32 i = 0; i < MODULE_NAME_LEN; i++) mod->name[i] = name[i];
+    mod->loaded = true;
+    return mod;
+}
+
+bool module_unload(const char* name) {
+    Module* mod = find_module(name);
+    if (!mod) return false;
+
+    g_last_log[0] = 0;
+    if (mod->exit) mod->exit();
+    kfree(mod->memory);
+    mod->memory = nullptr;
+    mod->loaded = false;
+    return true;
+}
+
+u32 module_count() {
+    u32 count = 0;
+    for (u32 i = 0; i < MAX_MODULES; i++) {
+        if (g_modules[i].loaded) count++;
+    }
+    return count;
+}
+
+const Module* module_get(u32 index) {
+    return index < MAX_MODULES && g_modules[index].loaded ? &g_modules[index] : nullptr;
+}
+
+void module_log(const char* text) {
+    klog(KLOG_INFO, text);
+    u32 i = 0;
+    for (; text[i] && i < sizeof(g_last_log) - 1; i++) g_last_log[i] = text[i];
+    g_last_log[i] = 0;
+}
+
+const char* module_last_log() {
+    return g_last_log;
+}
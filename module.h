@@ -0,0 +1,43 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "memory.h"
+
+// Loadable kernel modules: ELF32 relocatable objects (.o) on the RAM
+// disk. The allocated sections are copied into one kmalloc block,
+// undefined symbols resolve against the exported kernel symbol table
+// (ksyms.h) and R_386_32 / R_386_PC32 relocations are applied. Modules
+// can't see each other's symbols.
+//
+// A module defines its hooks with C linkage:
+//   extern "C" int module_init();    // nonzero fails the load
+//   extern "C" void module_exit();   // optional, runs on unload
+// Like the kernel, modules get no global constructors.
+
+#define MAX_MODULES 8
+#define MODULE_NAME_LEN 16
+
+typedef int (*ModuleInitFn)();
+typedef void (*ModuleExitFn)();
+
+struct Module {
+    char name[MODULE_NAME_LEN];   // file name without the extension
+    u8* memory;                   // kmalloc block holding the sections
+    u32 size;                     // bytes of loaded sections
+    ModuleExitFn exit;
+    bool loaded;
+};
+
+// Load and initialize a module; on failure returns nullptr and sets
+// *error to a message for the shell
+const Module* module_load(const char* filename, const char** error);
+bool module_unload(const char* name);
+
+u32 module_count();
+const Module* module_get(u32 index);    // nullptr for an empty slot
+
+// Status line for the shell, set by modules from their hooks
+void module_log(const char* text);
+const char* module_last_log();
+
+#endif
@@ -0,0 +1,255 @@
+#include "net.h"
+#include "socket.h"
+#include "cpu.h"
+#include "klog.h"
+#include "kformat.h"
+
+struct Ipv4Header {
+    u8 version_ihl;
+    u8 tos;
+    u16 total_length;
+    u16 id;
+    u16 fragment;          // flags and offset
+    u8 ttl;
+    u8 protocol;
+    u16 checksum;
+    u32 saddr;
+    u32 daddr;
+} __attribute__((packed));
+
+#define IP_DONT_FRAGMENT 0x4000
+#define IP_MORE_FRAGMENTS 0x2000
+#define IP_OFFSET_MASK 0x1FFF
+#define IP_TTL 64
+
+static NetDevice* g_devices[NET_MAX_DEVICES];
+static u32 g_device_count = 0;
+static NetDevice g_loopback;
+static NetStats g_stats;
+static u16 g_ip_id = 0;
+
+// Received packets in arrival order; interrupts off around every access
+static NetBuf* g_backlog_head = nullptr;
+static NetBuf* g_backlog_tail = nullptr;
+static u32 g_backlog_count = 0;
+static bool g_polling = false;
+
+NetBuf* netbuf_alloc(u32 headroom) {
+    NetBuf* buf = (NetBuf*)kmalloc(sizeof(NetBuf));
+    if (!buf) return nullptr;
+    buf->next = nullptr;
+    buf->dev = nullptr;
+    buf->data = buf->head + headroom;
+    buf->tail = buf->data;
+    return buf;
+}
+
+void netbuf_free(NetBuf* buf) {
+    kfree(buf);
+}
+
+// 16-bit words summed as they sit in memory: the folded result stored
+// back the same way is the checksum in network byte order
+u32 net_checksum_add(u32 sum, const void* data, u32 len) {
+    const u16* words = (const u16*)data;
+    for (; len >= 2; len -= 2) sum += *words++;
+    if (len) sum += *(const u8*)words;
+    return sum;
+}
+
+u16 net_checksum_fold(u32 sum) {
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return (u16)~sum;
+}
+
+u32 net_pseudo_sum(u32 saddr, u32 daddr, u8 protocol, u32 len) {
+    u32 s = net_htonl(saddr), d = net_htonl(daddr);
+    return (s & 0xFFFF) + (s >> 16) + (d & 0xFFFF) + (d >> 16) +
+           net_htons(protocol) + net_htons((u16)len);
+}
+
+// ---- devices ----
+
+bool netdev_register(NetDevice* dev) {
+    if (g_device_count == NET_MAX_DEVICES || !dev->ops) return false;
+    g_devices[g_device_count++] = dev;
+    return true;
+}
+
+u32 netdev_count() {
+    return g_device_count;
+}
+
+NetDevice* netdev_get(u32 index) {
+    return index < g_device_count ? g_devices[index] : nullptr;
+}
+
+static void backlog_push(NetDevice* dev, NetBuf* buf) {
+    u32 flags = irq_save();
+    if (g_backlog_count == NET_BACKLOG_MAX) {
+        dev->rx_dropped++;
+        irq_restore(flags);
+        netbuf_free(buf);
+        return;
+    }
+    buf->dev = dev;
+    buf->next = nullptr;
+    if (g_backlog_tail) g_backlog_tail->next = buf;
+    else g_backlog_head = buf;
+    g_backlog_tail = buf;
+    g_backlog_count++;
+    dev->rx_packets++;
+    dev->rx_bytes += netbuf_len(buf);
+    irq_restore(flags);
+}
+
+void netdev_receive(NetDevice* dev, NetBuf* buf) {
+    backlog_push(dev, buf);
+    sock_wake_all();
+}
+
+static NetBuf* backlog_pop() {
+    NetBuf* buf = g_backlog_head;
+    if (buf) {
+        g_backlog_head = buf->next;
+        if (!g_backlog_head) g_backlog_tail = nullptr;
+        g_backlog_count--;
+        buf->next = nullptr;
+    }
+    return buf;
+}
+
+// The packet goes straight back up: same buffer, no copy
+static bool loopback_transmit(NetDevice* dev, NetBuf* buf) {
+    dev->tx_packets++;
+    dev->tx_bytes += netbuf_len(buf);
+    backlog_push(dev, buf);
+    return true;
+}
+
+static const NetDeviceOps loopback_ops = { loopback_transmit };
+
+// ---- IP ----
+
+static bool is_local(const NetDevice* dev, u32 daddr) {
+    if ((dev->flags & NETDEV_LOOPBACK) && (daddr >> 24) == 127) return true;
+    for (u32 i = 0; i < g_device_count; i++) {
+        if (g_devices[i]->ip == daddr) return true;
+    }
+    return false;
+}
+
+// No forwarding and no reassembly: anything not whole and for us is dropped
+static void ip_input(NetBuf* buf) {
+    const Ipv4Header* ip = (const Ipv4Header*)buf->data;
+    u32 len = netbuf_len(buf);
+    u32 header_len = (ip->version_ihl & 0xF) * 4;
+    u32 total = len >= sizeof(Ipv4Header) ? net_ntohs(ip->total_length) : 0;
+    if (len < sizeof(Ipv4Header) || (ip->version_ihl >> 4) != 4 || header_len < sizeof(Ipv4Header) ||
+        total < header_len || total > len || (net_ntohs(ip->fragment) & (IP_MORE_FRAGMENTS | IP_OFFSET_MASK)) ||
+        net_checksum_fold(net_checksum_add(0, ip, header_len)) != 0 ||
+        !is_local(buf->dev, net_ntohl(ip->daddr))) {
+        g_stats.ip_bad++;
+        netbuf_free(buf);
+        return;
+    }
+    g_stats.ip_in++;
+
+    buf->saddr = net_ntohl(ip->saddr);
+    buf->daddr = net_ntohl(ip->daddr);
+    buf->protocol = ip->protocol;
+    buf->tail = buf->data + total;  // drop link-layer padding
+    netbuf_pull(buf, header_len);
+
+    if (buf->protocol == IP_PROTO_TCP) {
+        tcp_input(buf);
+    } else if (buf->protocol == IP_PROTO_UDP) {
+        udp_input(buf);
+    } else {
+        g_stats.ip_bad++;
+        netbuf_free(buf);
+    }
+}
+
+bool ip_output(NetDevice* dev, NetBuf* buf, u32 saddr, u32 daddr, u8 protocol) {
+    u32 total = netbuf_len(buf) + sizeof(Ipv4Header);
+    if (total > dev->mtu) {
+        dev->tx_dropped++;
+        netbuf_free(buf);
+        return false;
+    }
+
+    Ipv4Header* ip = (Ipv4Header*)netbuf_push(buf, sizeof(Ipv4Header));
+    ip->version_ihl = 0x45;
+    ip->tos = 0;
+    ip->total_length = net_htons((u16)total);
+    ip->id = net_htons(g_ip_id++);
+    ip->fragment = net_htons(IP_DONT_FRAGMENT);
+    ip->ttl = IP_TTL;
+    ip->protocol = protocol;
+    ip->checksum = 0;
+    ip->saddr = net_htonl(saddr);
+    ip->daddr = net_htonl(daddr);
+    ip->checksum = net_checksum_fold(net_checksum_add(0, ip, sizeof(Ipv4Header)));
+
+    g_stats.ip_out++;
+    return dev->ops->transmit(dev, buf);
+}
+
+NetDevice* net_route(u32 dst) {
+    NetDevice* fallback = nullptr;
+    for (u32 i = 0; i < g_device_count; i++) {
+        NetDevice* dev = g_devices[i];
+        if ((dev->flags & NETDEV_LOOPBACK) && (dst >> 24) == 127) return dev;
+        if (dev->netmask && (dst & dev->netmask) == (dev->ip & dev->netmask)) return dev;
+        if (!fallback && !(dev->flags & NETDEV_LOOPBACK)) fallback = dev;
+    }
+    return fallback;
+}
+
+u32 net_poll() {
+    u32 flags = irq_save();
+    if (g_polling) {
+        irq_restore(flags);
+        return 0;
+    }
+    g_polling = true;
+    g_stats.polls++;
+
+    // Owed ACKs go out once the batch is done, so a reply sent meanwhile
+    // carries them instead; they land back on the backlog over loopback
+    u32 count = 0;
+    do {
+        NetBuf* buf;
+        while ((buf = backlog_pop())) {
+            ip_input(buf);
+            count++;
+        }
+        tcp_flush_acks();
+    } while (g_backlog_head);
+    tcp_timers();
+
+    g_polling = false;
+    irq_restore(flags);
+    return count;
+}
+
+void net_initialize() {
+    NetDevice* lo = &g_loopback;
+    memcpy(lo->name, "lo", 3);
+    lo->ip = NET_LOOPBACK_IP;
+    lo->netmask = NET_IP(255, 0, 0, 0);
+    lo->mtu = NET_MTU;
+    lo->flags = NETDEV_LOOPBACK | NETDEV_NO_CSUM;
+    lo->ops = &loopback_ops;
+    netdev_register(lo);
+    klog(KLOG_INFO, "net: lo 127.0.0.1/8 up");
+}
+
+u32 net_format_ip(char* out, u32 ip) {
+    return ksnprintf(out, 16, "%u.%u.%u.%u", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+}
+
+NetStats* net_stats() {
+    return &g_stats;
+}
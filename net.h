@@ -0,0 +1,165 @@
+#ifndef NET_H
+#define NET_H
+
+#include "memory.h"
+
+// IPv4 networking: packet buffers, network devices and the IP layer.
+// UDP, TCP and the socket API on top are in socket.h.
+//
+// A packet lives in one NetBuf from the socket that writes it to the
+// socket that reads it. The payload goes in once, behind NET_HEADROOM
+// bytes of space; each layer on the way down prepends its header into
+// that space and each layer on the way up strips its header by moving
+// data forward. Nothing is copied between layers, and the loopback
+// device hands the transmitted buffer straight to the receive path.
+//
+// Received packets wait on a backlog until net_poll() runs them through
+// IP and into the sockets. Socket calls poll before they check for data
+// and before they sleep, so loopback traffic needs no thread of its own.
+// Like pipes, the stack is only used from the boot CPU; disabling
+// interrupts makes each step atomic against a driver's receive interrupt.
+//
+// Addresses and ports are in host byte order everywhere in the API.
+
+#define NETBUF_ALLOC 2040      // header + data: one 2K kmalloc class
+#define NET_HEADROOM 64        // link + IPv4 + TCP headers, options included
+#define NET_MTU 1500
+#define NET_MAX_DEVICES 4
+#define NET_NAME_LEN 8
+#define NET_BACKLOG_MAX 256    // received packets waiting for net_poll
+#define NET_FILE "net.log"
+
+#define NET_IP(a, b, c, d) (((u32)(a) << 24) | ((u32)(b) << 16) | ((u32)(c) << 8) | (u32)(d))
+#define NET_LOOPBACK_IP NET_IP(127, 0, 0, 1)
+
+#define IP_PROTO_TCP 6
+#define IP_PROTO_UDP 17
+
+struct NetDevice;
+
+struct NetBuf {
+    NetBuf* next;          // backlog or socket receive queue
+    NetDevice* dev;        // received on
+    u8* data;              // first byte of the packet
+    u8* tail;              // one past the last
+    u32 saddr, daddr;      // IPv4 addresses, set by the receive path
+    u16 sport;             // UDP: sender's port
+    u8 protocol;
+    u8 reserved;
+    u8 head[NETBUF_ALLOC - 32];
+};
+
+// An empty packet with headroom bytes free in front; nullptr when out of memory
+NetBuf* netbuf_alloc(u32 headroom);
+void netbuf_free(NetBuf* buf);
+
+static inline u32 netbuf_len(const NetBuf* buf) {
+    return (u32)(buf->tail - buf->data);
+}
+
+// Room for len more bytes at the end, returns where they go
+static inline u8* netbuf_put(NetBuf* buf, u32 len) {
+    u8* at = buf->tail;
+    buf->tail += len;
+    return at;
+}
+
+// Room for a len byte header in front, returns the new start
+static inline u8* netbuf_push(NetBuf* buf, u32 len) {
+    buf->data -= len;
+    return buf->data;
+}
+
+// Drop len bytes of header from the front; false if the packet is shorter
+static inline bool netbuf_pull(NetBuf* buf, u32 len) {
+    if (netbuf_len(buf) < len) return false;
+    buf->data += len;
+    return true;
+}
+
+// Network byte order
+static inline u16 net_htons(u16 v) {
+    return (u16)((v << 8) | (v >> 8));
+}
+
+static inline u32 net_htonl(u32 v) {
+    return __builtin_bswap32(v);
+}
+
+#define net_ntohs net_htons
+#define net_ntohl net_htonl
+
+// Internet checksum helpers: fold a running 32-bit sum of 16-bit words
+u32 net_checksum_add(u32 sum, const void* data, u32 len);
+u16 net_checksum_fold(u32 sum);
+
+// Start of a UDP or TCP checksum: the IPv4 pseudo-header for len bytes
+u32 net_pseudo_sum(u32 saddr, u32 daddr, u8 protocol, u32 len);
+
+// ---- devices ----
+
+#define NETDEV_LOOPBACK 0x1    // 127.0.0.0/8 lives here
+#define NETDEV_NO_CSUM  0x2    // packets never leave memory: skip computing and checking checksums
+
+struct NetDeviceOps {
+    // Send one IPv4 packet (data is the IP header). The driver puts its
+    // link header in the headroom and owns buf from here on, sent or not.
+    bool (*transmit)(NetDevice* dev, NetBuf* buf);
+};
+
+struct NetDevice {
+    char name[NET_NAME_LEN];
+    u32 ip, netmask;
+    u32 mtu;
+    u32 flags;             // NETDEV_*
+    const NetDeviceOps* ops;
+    void* driver_data;
+
+    u64 rx_bytes, tx_bytes;
+    u32 rx_packets, tx_packets;
+    u32 rx_dropped, tx_dropped;
+};
+
+bool netdev_register(NetDevice* dev);
+u32 netdev_count();
+NetDevice* netdev_get(u32 index);
+
+// For drivers, from any context: queue a received IPv4 packet for
+// net_poll and wake sleeping sockets. Takes ownership of buf.
+void netdev_receive(NetDevice* dev, NetBuf* buf);
+
+// ---- IP ----
+
+struct NetStats {
+    u32 ip_in, ip_out;
+    u32 ip_bad;            // short, bad checksum, fragment or not for us
+    u32 udp_in, udp_out;
+    u32 tcp_in, tcp_out;
+    u32 tcp_retransmits;
+    u32 tcp_resets;        // RSTs sent
+    u32 no_socket;         // nothing listening on the port
+    u32 rcvbuf_full;       // dropped because the socket's queue was full
+    u32 polls;
+};
+
+// Bring up the loopback device (lo, 127.0.0.1/8)
+void net_initialize();
+
+// Run queued packets through the stack, then send the ACKs that the
+// batch left owing; returns how many packets were processed
+u32 net_poll();
+
+// Device for dst: the one whose subnet holds it, else the first that
+// isn't loopback; nullptr with neither
+NetDevice* net_route(u32 dst);
+
+// Prepend the IPv4 header to a transport packet and transmit it on dev.
+// Takes ownership of buf.
+bool ip_output(NetDevice* dev, NetBuf* buf, u32 saddr, u32 daddr, u8 protocol);
+
+// "a.b.c.d" into out (16 bytes); returns the length
+u32 net_format_ip(char* out, u32 ip);
+
+NetStats* net_stats();
+
+#endif
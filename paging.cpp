@@ -0,0 +1,159 @@
+#include "paging.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "process.h"
+
+#define PDE_INDEX(addr) ((addr) >> 22)
+#define PTE_INDEX(addr) (((addr) >> 12) & 0x3FF)
+#define MMIO_START 0xC0000000  // APIC, PCI BARs: uncached
+
+static u32 g_kernel_directory[1024] __attribute__((aligned(PAGE_SIZE)));
+static bool g_paging = false;
+static u32 g_cr4_bits = 0;
+
+static void page_fault_interrupt(InterruptFrame* frame) {
+    u32 addr = read_cr2();
+
+    // Missing pages of a process's regions are filled in on first touch
+    if (!(frame->error_code & PAGE_FAULT_PRESENT) && user_range_ok(addr, 1) &&
+        process_handle_page_fault(addr)) {
+        return;
+    }
+
+    // Bad accesses by a process (or by a syscall on its behalf) only kill it
+    if (frame_from_user(frame) || (user_range_ok(addr, 1) && process_current_is_user())) {
+        process_fault(frame, addr);
+        return;
+    }
+    unhandled_exception(frame);
+}
+
+void paging_initialize() {
+    u32 eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_PSE)) return;
+
+    // Kernel pages are global so switching process directories keeps them in the TLB
+    u32 global = (edx & CPUID_EDX_PGE) ? PTE_GLOBAL : 0;
+    g_cr4_bits = CR4_PSE | ((edx & CPUID_EDX_PGE) ? CR4_PGE : 0);
+
+    // The kernel's own directory covers the user window too, so firmware
+    // tables up there stay reachable. Process directories replace that
+    // part, so it must not be global or it would outlive a CR3 switch.
+    for (u32 i = 0; i < 1024; i++) {
+        u32 base = i << 22;
+        u32 cache = base >= MMIO_START ? (PTE_PCD | PTE_PWT) : 0;
+        u32 g = (base >= USER_BASE && base < USER_END) ? 0 : global;
+        g_kernel_directory[i] = base | PTE_PRESENT | PTE_WRITABLE | PTE_LARGE | g | cache;
+    }
+
+    register_interrupt_handler(14, page_fault_interrupt);
+    g_paging = true;
+    paging_enable();
+}
+
+void paging_enable() {
+    if (!g_paging) return;
+    write_cr4(read_cr4() | g_cr4_bits);
+    write_cr3((u32)g_kernel_directory);
+    write_cr0(read_cr0() | CR0_PG | CR0_WP);
+}
+
+bool paging_available() {
+    return g_paging;
+}
+
+u32 paging_kernel_directory() {
+    return (u32)g_kernel_directory;
+}
+
+u32 paging_create_address_space() {
+    u32 directory = frame_alloc();
+    if (!directory) return 0;
+
+    // User window entries stay zero (frame_alloc clears the page)
+    u32* pd = (u32*)directory;
+    for (u32 i = 0; i < PDE_INDEX(USER_BASE); i++) pd[i] = g_kernel_directory[i];
+    for (u32 i = PDE_INDEX(USER_END); i < 1024; i++) pd[i] = g_kernel_directory[i];
+    return directory;
+}
+
+void paging_destroy_address_space(u32 directory) {
+    u32* pd = (u32*)directory;
+    for (u32 i = PDE_INDEX(USER_BASE); i < PDE_INDEX(USER_END); i++) {
+        if (!(pd[i] & PTE_PRESENT)) continue;
+
+        u32* pt = (u32*)(pd[i] & PTE_FRAME);
+        for (u32 j = 0; j < 1024; j++) {
+            if ((pt[j] & PTE_PRESENT) && !(pt[j] & PTE_SHARED)) frame_free(pt[j] & PTE_FRAME);
+        }
+        frame_free((u32)pt);
+    }
+    frame_free(directory);
+}
+
+void paging_switch(u32 directory) {
+    if (g_paging && read_cr3() != directory) write_cr3(directory);
+}
+
+bool paging_map(u32 directory, u32 virt, u32 phys, u32 flags) {
+    if (!user_range_ok(virt, PAGE_SIZE)) return false;
+
+    u32* pd = (u32*)directory;
+    u32 pdi = PDE_INDEX(virt);
+    if (!(pd[pdi] & PTE_PRESENT)) {
+        u32 table = frame_alloc();
+        if (!table) return false;
+        // Permissions are enforced per page; the directory entry allows everything
+        pd[pdi] = table | PTE_PRESENT | PTE_WRITABLE | PTE_USER;
+    }
+
+    u32* pt = (u32*)(pd[pdi] & PTE_FRAME);
+    pt[PTE_INDEX(virt)] = (phys & PTE_FRAME) | flags | PTE_PRESENT;
+    if (g_paging && read_cr3() == directory) invlpg(virt);
+    return true;
+}
+
+bool paging_map_zeroed(u32 directory, u32 virt, u32 size, u32 flags) {
+    for (u32 addr = virt & PTE_FRAME; addr < virt + size; addr += PAGE_SIZE) {
+        if (paging_translate(directory, addr)) continue;
+        u32 frame = frame_alloc();
+        if (!frame) return false;
+        if (!paging_map(directory, addr, frame, flags)) {
+            frame_free(frame);
+            return false;
+        }
+    }
+    return true;
+}
+
+u32 paging_translate(u32 directory, u32 virt) {
+    u32* pd = (u32*)directory;
+    u32 pde = pd[PDE_INDEX(virt)];
+    if (!(pde & PTE_PRESENT)) return 0;
+    if (pde & PTE_LARGE) return (pde & 0xFFC00000) | (virt & 0x3FFFFF);
+
+    u32 pte = ((u32*)(pde & PTE_FRAME))[PTE_INDEX(virt)];
+    if (!(pte & PTE_PRESENT)) return 0;
+    return (pte & PTE_FRAME) | (virt & 0xFFF);
+}
+
+u32 paging_get_pte(u32 directory, u32 virt) {
+    if (!user_range_ok(virt, PAGE_SIZE)) return 0;
+    u32 pde = ((u32*)directory)[PDE_INDEX(virt)];
+    if (!(pde & PTE_PRESENT)) return 0;
+    return ((u32*)(pde & PTE_FRAME))[PTE_INDEX(virt)];
+}
+
+// The frame is the caller's to free or remap
+u32 paging_unmap(u32 directory, u32 virt) {
+    if (!user_range_ok(virt, PAGE_SIZE)) return 0;
+    u32 pde = ((u32*)directory)[PDE_INDEX(virt)];
+    if (!(pde & PTE_PRESENT)) return 0;
+
+    u32* pte = &((u32*)(pde & PTE_FRAME))[PTE_INDEX(virt)];
+    u32 old = *pte;
+    *pte = 0;
+    if (g_paging && read_cr3() == directory) invlpg(virt);
+    return old;
+}
@@ -0,0 +1,54 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "memory.h"
+
+// Page directory / table entry flags
+#define PTE_PRESENT  0x001
+#define PTE_WRITABLE 0x002
+#define PTE_USER     0x004
+#define PTE_PWT      0x008
+#define PTE_PCD      0x010
+#define PTE_ACCESSED 0x020
+#define PTE_DIRTY    0x040
+#define PTE_LARGE    0x080  // 4MB page (PDE only)
+#define PTE_GLOBAL   0x100
+#define PTE_SHARED   0x200  // available bit: frame not owned by this address space
+#define PTE_FRAME    0xFFFFF000
+
+// Virtual layout. The kernel identity maps all of physical memory with
+// global 4MB pages; a process directory shares those mappings except in
+// the user window, where it has its own page tables.
+#define USER_BASE          0x40000000
+#define USER_END           0x80000000
+#define USER_VSYSCALL_ADDR (USER_END - PAGE_SIZE)           // syscall entry stub
+#define USER_STACK_TOP     (USER_VSYSCALL_ADDR - PAGE_SIZE)  // guard page below vsyscall
+#define USER_STACK_SIZE    0x10000                          // demand-zero, below the top
+
+// Page fault error code bits
+#define PAGE_FAULT_PRESENT 0x1   // protection violation rather than a missing page
+#define PAGE_FAULT_WRITE   0x2
+#define PAGE_FAULT_USER    0x4
+
+void paging_initialize();   // build the kernel directory and enable paging on the BSP
+void paging_enable();       // load the kernel directory on an AP
+bool paging_available();    // false on CPUs without 4MB pages; no user processes then
+
+// Address spaces, identified by the physical address of their page directory
+u32 paging_kernel_directory();
+u32 paging_create_address_space();            // 0 when out of frames
+void paging_destroy_address_space(u32 directory);
+void paging_switch(u32 directory);
+
+// User window mappings
+bool paging_map(u32 directory, u32 virt, u32 phys, u32 flags);
+bool paging_map_zeroed(u32 directory, u32 virt, u32 size, u32 flags);  // fresh frames
+u32 paging_translate(u32 directory, u32 virt);  // physical address, 0 if unmapped
+u32 paging_get_pte(u32 directory, u32 virt);    // raw user window entry, 0 if none
+u32 paging_unmap(u32 directory, u32 virt);      // clear it, return the old entry
+
+static inline bool user_range_ok(u32 addr, u32 len) {
+    return addr >= USER_BASE && addr <= USER_END && len <= USER_END - addr;
+}
+
+#endif
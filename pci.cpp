@@ -0,0 +1,294 @@
+#include "pci.h"
+#include "io.h"
+#include "apic.h"
+#include "spinlock.h"
+#include "klog.h"
+#include "kformat.h"
+
+// Device and driver tables are filled on the boot CPU during startup and
+// only read afterwards. The lock keeps each 0xCF8 address write paired
+// with its 0xCFC access.
+static Spinlock g_pci_lock;
+static PciDevice g_devices[PCI_MAX_DEVICES];
+static u32 g_device_count = 0;
+static const PciDriver* g_drivers[PCI_MAX_DRIVERS];
+static u32 g_driver_count = 0;
+static u32 g_msi_next = 0;
+static bool g_dropped = false;  // more functions than PCI_MAX_DEVICES
+
+static const char* const class_names[] = {
+    "legacy", "storage", "network", "display", "multimedia", "memory",
+    "bridge", "comm", "system", "input", "dock", "cpu", "serialbus",
+    "wireless", "io", "satellite", "crypto", "signal"
+};
+
+static inline u32 config_address(u8 bus, u8 slot, u8 function, u8 offset) {
+    return 0x80000000 | ((u32)bus << 16) | ((u32)(slot & 0x1F) << 11) |
+           ((u32)(function & 7) << 8) | (offset & 0xFC);
+}
+
+u32 pci_config_read32(u8 bus, u8 slot, u8 function, u8 offset) {
+    u32 flags = g_pci_lock.lock_irqsave();
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, function, offset));
+    u32 value = inl(PCI_CONFIG_DATA);
+    g_pci_lock.unlock_irqrestore(flags);
+    return value;
+}
+
+// Narrow accesses go to the matching byte lanes of 0xCFC, so writing a
+// 16-bit register never rewrites (and clears) its write-1-to-clear neighbour
+u16 pci_config_read16(u8 bus, u8 slot, u8 function, u8 offset) {
+    u32 flags = g_pci_lock.lock_irqsave();
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, function, offset));
+    u16 value = inw(PCI_CONFIG_DATA + (offset & 2));
+    g_pci_lock.unlock_irqrestore(flags);
+    return value;
+}
+
+u8 pci_config_read8(u8 bus, u8 slot, u8 function, u8 offset) {
+    u32 flags = g_pci_lock.lock_irqsave();
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, function, offset));
+    u8 value = inb(PCI_CONFIG_DATA + (offset & 3));
+    g_pci_lock.unlock_irqrestore(flags);
+    return value;
+}
+
+void pci_config_write32(u8 bus, u8 slot, u8 function, u8 offset, u32 value) {
+    u32 flags = g_pci_lock.lock_irqsave();
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, function, offset));
+    outl(PCI_CONFIG_DATA, value);
+    g_pci_lock.unlock_irqrestore(flags);
+}
+
+void pci_config_write16(u8 bus, u8 slot, u8 function, u8 offset, u16 value) {
+    u32 flags = g_pci_lock.lock_irqsave();
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, function, offset));
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+    g_pci_lock.unlock_irqrestore(flags);
+}
+
+static inline u32 read32(const PciDevice* dev, u8 offset) {
+    return pci_config_read32(dev->bus, dev->slot, dev->function, offset);
+}
+
+static inline u16 read16(const PciDevice* dev, u8 offset) {
+    return pci_config_read16(dev->bus, dev->slot, dev->function, offset);
+}
+
+static inline u8 read8(const PciDevice* dev, u8 offset) {
+    return pci_config_read8(dev->bus, dev->slot, dev->function, offset);
+}
+
+static inline void write32(const PciDevice* dev, u8 offset, u32 value) {
+    pci_config_write32(dev->bus, dev->slot, dev->function, offset, value);
+}
+
+static inline void write16(const PciDevice* dev, u8 offset, u16 value) {
+    pci_config_write16(dev->bus, dev->slot, dev->function, offset, value);
+}
+
+// Write all ones and read back which address bits the device decodes.
+// Decoding is off meanwhile so the half-written BAR can't claim cycles.
+static void size_bars(PciDevice* dev) {
+    u32 header = dev->header_type & 0x7F;
+    u32 count = header == 0 ? PCI_BAR_COUNT : header == 1 ? 2 : 0;
+    u16 command = read16(dev, PCI_COMMAND);
+    write16(dev, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (u32 i = 0; i < count; i++) {
+        u8 offset = PCI_BAR0 + i * 4;
+        u32 original = read32(dev, offset);
+        write32(dev, offset, 0xFFFFFFFF);
+        u32 mask = read32(dev, offset);
+        write32(dev, offset, original);
+
+        PciBar& bar = dev->bars[i];
+        if (mask == 0) continue;  // not implemented
+
+        if (original & 1) {
+            u32 bits = mask & ~3u;
+            if (!(bits >> 16)) bits |= 0xFFFF0000;  // 16-bit I/O decoders read the top half as 0
+            bar.type = PCI_BAR_IO;
+            bar.base = original & ~3u;
+            bar.size = ~bits + 1;
+            continue;
+        }
+
+        bar.type = ((original >> 1) & 3) == 2 ? PCI_BAR_MEM64 : PCI_BAR_MEM32;
+        bar.prefetchable = (original & 8) != 0;
+        bar.base = original & ~0xFu;
+        bar.size = ~(mask & ~0xFu) + 1;
+        if (bar.type == PCI_BAR_MEM64 && i + 1 < count) {
+            // Upper half: a base above 4GB is out of our reach
+            if (read32(dev, offset + 4)) bar.base = 0;
+            i++;
+        }
+    }
+    write16(dev, PCI_COMMAND, command);
+}
+
+static void find_capabilities(PciDevice* dev) {
+    if (!(read16(dev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) return;
+
+    u8 ptr = read8(dev, PCI_CAP_PTR) & 0xFC;
+    for (u32 guard = 0; ptr >= 0x40 && guard < 48; guard++) {  // guard: a looping list
+        u8 id = read8(dev, ptr);
+        if (id == PCI_CAP_ID_MSI) {
+            dev->msi_cap = ptr;
+            dev->msi_vectors = 1 << ((read16(dev, ptr + 2) >> 1) & 7);
+        } else if (id == PCI_CAP_ID_MSIX) {
+            dev->msix_cap = ptr;
+            dev->msix_table_size = (read16(dev, ptr + 2) & 0x7FF) + 1;
+        }
+        ptr = read8(dev, ptr + 1) & 0xFC;
+    }
+}
+
+static bool driver_matches(const PciDriver* driver, const PciDevice* dev) {
+    return (driver->vendor_id == PCI_ANY_ID || driver->vendor_id == dev->vendor_id) &&
+           (driver->device_id == PCI_ANY_ID || driver->device_id == dev->device_id);
+}
+
+static void try_bind(PciDevice* dev, const PciDriver* driver) {
+    if (dev->driver || !driver_matches(driver, dev)) return;
+    if (!driver->probe(dev)) return;
+    dev->driver = driver;
+    klogf(KLOG_INFO, "pci: %02x:%02x.%u bound to %s", dev->bus, dev->slot, dev->function, driver->name);
+}
+
+static void scan_bus(u8 bus, u32 depth);
+
+static void scan_function(u8 bus, u8 slot, u8 function, u32 depth) {
+    u16 vendor = pci_config_read16(bus, slot, function, PCI_VENDOR_ID);
+    if (vendor == 0xFFFF) return;
+    if (g_device_count == PCI_MAX_DEVICES) {
+        g_dropped = true;
+        return;
+    }
+
+    PciDevice* dev = &g_devices[g_device_count++];
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->function = function;
+    dev->vendor_id = vendor;
+    dev->device_id = pci_config_read16(bus, slot, function, PCI_DEVICE_ID);
+    dev->header_type = read8(dev, PCI_HEADER_TYPE);
+    dev->class_code = read8(dev, PCI_CLASS);
+    dev->subclass = read8(dev, PCI_SUBCLASS);
+    dev->prog_if = read8(dev, PCI_PROG_IF);
+    dev->revision = read8(dev, PCI_REVISION);
+    dev->irq_line = read8(dev, PCI_INTERRUPT_LINE);
+    dev->irq_pin = read8(dev, PCI_INTERRUPT_PIN);
+    size_bars(dev);
+    find_capabilities(dev);
+
+    // PCI-to-PCI bridge: the bus behind it is numbered higher
+    if ((dev->header_type & 0x7F) == 1 && dev->class_code == 0x06 && dev->subclass == 0x04) {
+        u8 secondary = read8(dev, PCI_SECONDARY_BUS);
+        if (secondary > bus && depth < 8) scan_bus(secondary, depth + 1);
+    }
+}
+
+static void scan_bus(u8 bus, u32 depth) {
+    for (u8 slot = 0; slot < 32; slot++) {
+        if (pci_config_read16(bus, slot, 0, PCI_VENDOR_ID) == 0xFFFF) continue;
+        scan_function(bus, slot, 0, depth);
+        if (!(pci_config_read8(bus, slot, 0, PCI_HEADER_TYPE) & PCI_HEADER_MULTIFUNCTION)) continue;
+        for (u8 function = 1; function < 8; function++) scan_function(bus, slot, function, depth);
+    }
+}
+
+void pci_initialize() {
+    g_pci_lock.initialize("pci");
+
+    // Mechanism #1 is there if the address register holds what we write
+    outl(PCI_CONFIG_ADDRESS, 0x80000000);
+    if (inl(PCI_CONFIG_ADDRESS) != 0x80000000) {
+        klog(KLOG_WARN, "pci: no configuration mechanism #1");
+        return;
+    }
+
+    scan_bus(0, 0);
+    klog_value(KLOG_INFO, "pci: functions found", g_device_count);
+    if (g_dropped) klog_value(KLOG_WARN, "pci: table full, kept", PCI_MAX_DEVICES);
+
+    for (u32 d = 0; d < g_driver_count; d++) {
+        for (u32 i = 0; i < g_device_count; i++) try_bind(&g_devices[i], g_drivers[d]);
+    }
+}
+
+u32 pci_device_count() {
+    return g_device_count;
+}
+
+PciDevice* pci_get_device(u32 index) {
+    return index < g_device_count ? &g_devices[index] : nullptr;
+}
+
+PciDevice* pci_find_device(u16 vendor_id, u16 device_id) {
+    for (u32 i = 0; i < g_device_count; i++) {
+        if (g_devices[i].vendor_id == vendor_id && g_devices[i].device_id == device_id) return &g_devices[i];
+    }
+    return nullptr;
+}
+
+bool pci_register_driver(const PciDriver* driver) {
+    if (g_driver_count == PCI_MAX_DRIVERS) return false;
+    g_drivers[g_driver_count++] = driver;
+    for (u32 i = 0; i < g_device_count; i++) try_bind(&g_devices[i], driver);
+    return true;
+}
+
+void pci_enable_device(PciDevice* dev) {
+    u16 command = read16(dev, PCI_COMMAND);
+    write16(dev, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+}
+
+// One vector, fixed delivery, edge triggered, to this CPU's local APIC
+u8 pci_enable_msi(PciDevice* dev, InterruptHandler handler) {
+    if (dev->msi_vector) return dev->msi_vector;
+    if (!dev->msi_cap || !apic_available() || g_msi_next == VECTOR_MSI_COUNT) return 0;
+
+    u8 vector = VECTOR_MSI_BASE + g_msi_next++;
+    register_interrupt_handler(vector, handler);
+
+    u8 cap = dev->msi_cap;
+    u16 control = read16(dev, cap + 2);
+    write32(dev, cap + 4, PCI_MSI_ADDRESS | (apic_id() << 12));
+    if (control & PCI_MSI_64BIT) {
+        write32(dev, cap + 8, 0);
+        write16(dev, cap + 12, vector);
+    } else {
+        write16(dev, cap + 8, vector);
+    }
+    write16(dev, cap + 2, (control & ~0x70) | PCI_MSI_ENABLE);  // multiple message enable = 1 vector
+    write16(dev, PCI_COMMAND, read16(dev, PCI_COMMAND) | PCI_COMMAND_INTX_DISABLE);
+
+    dev->msi_vector = vector;
+    return vector;
+}
+
+const char* pci_class_name(u8 class_code) {
+    if (class_code < sizeof(class_names) / sizeof(class_names[0])) return class_names[class_code];
+    return "other";
+}
+
+u32 pci_format_device(const PciDevice* dev, char* out, u32 size) {
+    u32 len = ksnprintf(out, size, "%02x:%02x.%u %04x:%04x %-10s", dev->bus, dev->slot, dev->function,
+                        dev->vendor_id, dev->device_id, pci_class_name(dev->class_code));
+    for (u32 i = 0; i < PCI_BAR_COUNT; i++) {
+        const PciBar& bar = dev->bars[i];
+        if (bar.type == PCI_BAR_NONE) continue;
+        const char* kind = bar.type == PCI_BAR_IO ? "io" : bar.type == PCI_BAR_MEM64 ? "mem64" : "mem";
+        if (bar.size >= 1024) {
+            len += ksnprintf(out + len, size - len, " %s %x/%uK", kind, bar.base, bar.size / 1024);
+        } else {
+            len += ksnprintf(out + len, size - len, " %s %x/%u", kind, bar.base, bar.size);
+        }
+    }
+    if (dev->irq_pin) len += ksnprintf(out + len, size - len, " irq %u", dev->irq_line);
+    if (dev->msi_cap) len += ksnprintf(out + len, size - len, " msi");
+    if (dev->msix_cap) len += ksnprintf(out + len, size - len, " msix %u", dev->msix_table_size);
+    if (dev->driver) len += ksnprintf(out + len, size - len, " [%s]", dev->driver->name);
+    return len;
+}
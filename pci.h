@@ -0,0 +1,125 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "memory.h"
+#include "interrupts.h"
+
+// PCI bus enumeration through configuration mechanism #1 (ports
+// 0xCF8/0xCFC). pci_initialize() walks bus 0 and every bus behind a
+// PCI-to-PCI bridge. For each function it records the IDs and class,
+// sizes the BARs and finds the MSI/MSI-X capabilities. Drivers register
+// a vendor/device match. A driver's probe runs for each matching
+// unclaimed device: the ones found already, at registration time, and
+// any found by a later enumeration.
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+#define PCI_MAX_DEVICES 32
+#define PCI_MAX_DRIVERS 8
+#define PCI_BAR_COUNT   6
+#define PCI_ANY_ID      0xFFFF
+#define PCI_FILE "pci.log"
+
+// Configuration space header (type 0 unless noted)
+#define PCI_VENDOR_ID      0x00
+#define PCI_DEVICE_ID      0x02
+#define PCI_COMMAND        0x04
+#define PCI_STATUS         0x06
+#define PCI_REVISION       0x08
+#define PCI_PROG_IF        0x09
+#define PCI_SUBCLASS       0x0A
+#define PCI_CLASS          0x0B
+#define PCI_HEADER_TYPE    0x0E
+#define PCI_BAR0           0x10
+#define PCI_SECONDARY_BUS  0x19  // type 1 (bridge)
+#define PCI_CAP_PTR        0x34
+#define PCI_INTERRUPT_LINE 0x3C
+#define PCI_INTERRUPT_PIN  0x3D
+
+#define PCI_COMMAND_IO            0x0001
+#define PCI_COMMAND_MEMORY        0x0002
+#define PCI_COMMAND_MASTER        0x0004
+#define PCI_COMMAND_INTX_DISABLE  0x0400
+#define PCI_STATUS_CAP_LIST       0x0010
+#define PCI_HEADER_MULTIFUNCTION  0x80
+
+#define PCI_CAP_ID_MSI  0x05
+#define PCI_CAP_ID_MSIX 0x11
+
+// MSI capability: message control bits and the message address format
+#define PCI_MSI_ENABLE    0x0001
+#define PCI_MSI_64BIT     0x0080
+#define PCI_MSI_ADDRESS   0xFEE00000  // | destination APIC ID << 12
+
+// First vector handed out by pci_enable_msi; above the APIC timer so
+// interrupt_dispatch acknowledges the local APIC
+#define VECTOR_MSI_BASE  0x50
+#define VECTOR_MSI_COUNT 16
+
+enum PciBarType : u8 {
+    PCI_BAR_NONE,
+    PCI_BAR_IO,
+    PCI_BAR_MEM32,
+    PCI_BAR_MEM64   // the next BAR holds the upper half and reads as NONE
+};
+
+struct PciBar {
+    u32 base;        // port or physical address, flag bits stripped
+    u32 size;
+    PciBarType type;
+    bool prefetchable;
+};
+
+struct PciDriver;
+
+struct PciDevice {
+    u8 bus, slot, function;
+    u8 header_type;
+    u16 vendor_id, device_id;
+    u8 class_code, subclass, prog_if, revision;
+    u8 irq_line, irq_pin;            // legacy INTx routing from the BIOS
+    u8 msi_cap;                      // config offset of the capability, 0 if none
+    u8 msi_vectors;                  // how many it can request
+    u8 msix_cap;
+    u16 msix_table_size;
+    u8 msi_vector;                   // IDT vector once enabled, 0 if not
+    PciBar bars[PCI_BAR_COUNT];
+    const PciDriver* driver;         // bound driver, nullptr if unclaimed
+    void* driver_data;
+};
+
+struct PciDriver {
+    const char* name;
+    u16 vendor_id, device_id;        // PCI_ANY_ID matches anything
+    bool (*probe)(PciDevice* dev);   // true claims the device
+};
+
+// Configuration space access; offsets are naturally aligned
+u32 pci_config_read32(u8 bus, u8 slot, u8 function, u8 offset);
+u16 pci_config_read16(u8 bus, u8 slot, u8 function, u8 offset);
+u8 pci_config_read8(u8 bus, u8 slot, u8 function, u8 offset);
+void pci_config_write32(u8 bus, u8 slot, u8 function, u8 offset, u32 value);
+void pci_config_write16(u8 bus, u8 slot, u8 function, u8 offset, u16 value);
+
+void pci_initialize();                     // enumerate; after smp_initialize
+u32 pci_device_count();
+PciDevice* pci_get_device(u32 index);
+PciDevice* pci_find_device(u16 vendor_id, u16 device_id);
+
+// Add a driver and probe the matching devices; false if the table is full
+bool pci_register_driver(const PciDriver* driver);
+
+// Turn on I/O and memory decoding and bus mastering (DMA)
+void pci_enable_device(PciDevice* dev);
+
+// Route one MSI to handler on the calling CPU and mask INTx. Returns
+// the vector, 0 without an MSI capability, a local APIC or a free vector.
+u8 pci_enable_msi(PciDevice* dev, InterruptHandler handler);
+
+const char* pci_class_name(u8 class_code);
+
+// "00:03.0 8086:100e network  io c000/64 irq 11 msi" (no newline); returns the length
+u32 pci_format_device(const PciDevice* dev, char* out, u32 size);
+
+#endif
@@ -0,0 +1,79 @@
+#include "pipe.h"
+#include "process.h"
+#include "cpu.h"
+
+// Pipes are only used by threads on the boot CPU, which the kernel never
+// preempts, so disabling interrupts is enough to make each step atomic
+
+Pipe* pipe_create() {
+    Pipe* pipe = (Pipe*)kmalloc(sizeof(Pipe));
+    if (!pipe) return nullptr;
+    pipe->head = 0;
+    pipe->tail = 0;
+    pipe->read_open = true;
+    pipe->write_open = true;
+    pipe->reader = nullptr;
+    pipe->writer = nullptr;
+    return pipe;
+}
+
+static void wake(Process*& waiter) {
+    if (waiter) {
+        process_wake(waiter);
+        waiter = nullptr;
+    }
+}
+
+u32 pipe_read(Pipe* pipe, u8* data, u32 len) {
+    u32 flags = irq_save();
+    while (pipe->head == pipe->tail && pipe->write_open) {
+        pipe->reader = process_current();
+        process_block();
+    }
+
+    u32 n = 0;
+    while (n < len && pipe->tail != pipe->head) {
+        data[n++] = pipe->buffer[pipe->tail++ & (PIPE_BUFFER_SIZE - 1)];
+    }
+    wake(pipe->writer);
+    irq_restore(flags);
+    return n;
+}
+
+bool pipe_write(Pipe* pipe, const u8* data, u32 len) {
+    u32 flags = irq_save();
+    u32 done = 0;
+    while (done < len && pipe->read_open) {
+        if (pipe->head - pipe->tail == PIPE_BUFFER_SIZE) {
+            wake(pipe->reader);
+            pipe->writer = process_current();
+            process_block();
+            continue;
+        }
+        pipe->buffer[pipe->head++ & (PIPE_BUFFER_SIZE - 1)] = data[done++];
+    }
+    wake(pipe->reader);
+    bool ok = pipe->read_open;
+    irq_restore(flags);
+    return ok;
+}
+
+static void release_if_closed(Pipe* pipe) {
+    if (!pipe->read_open && !pipe->write_open) kfree(pipe);
+}
+
+void pipe_close_read(Pipe* pipe) {
+    u32 flags = irq_save();
+    pipe->read_open = false;
+    wake(pipe->writer);
+    release_if_closed(pipe);
+    irq_restore(flags);
+}
+
+void pipe_close_write(Pipe* pipe) {
+    u32 flags = irq_save();
+    pipe->write_open = false;
+    wake(pipe->reader);
+    release_if_closed(pipe);
+    irq_restore(flags);
+}
@@ -0,0 +1,30 @@
+#ifndef PIPE_H
+#define PIPE_H
+
+#include "memory.h"
+
+// Bounded in-memory pipes between kernel threads (see pipeline.cpp).
+// A reader blocks while the pipe is empty and a writer while it's full;
+// each side wakes the other. Closing the write end gives the reader EOF
+// once the buffer drains; closing the read end fails further writes
+// (broken pipe). The pipe frees itself when both ends are closed.
+
+#define PIPE_BUFFER_SIZE 512   // power of two
+
+struct Pipe {
+    u8 buffer[PIPE_BUFFER_SIZE];
+    u32 head;                  // total bytes written
+    u32 tail;                  // total bytes read
+    bool read_open;
+    bool write_open;
+    struct Process* reader;    // blocked in pipe_read
+    struct Process* writer;    // blocked in pipe_write
+};
+
+Pipe* pipe_create();
+u32 pipe_read(Pipe* pipe, u8* data, u32 len);          // 0 at EOF
+bool pipe_write(Pipe* pipe, const u8* data, u32 len);  // false once the reader is gone
+void pipe_close_read(Pipe* pipe);
+void pipe_close_write(Pipe* pipe);
+
+#endif
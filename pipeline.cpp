@@ -0,0 +1,422 @@
+#include "pipeline.h"
+#include "pipe.h"
+#include "process.h"
+#include "fs_ramdisk.h"
+
+#define PIPELINE_LINE_LEN 128
+
+struct Stage;
+typedef void (*StreamCommandFn)(Stage* stage);
+
+struct Stage {
+    StreamCommandFn run;
+    const char* argv[PIPELINE_MAX_ARGS];
+    u32 argc;
+
+    // Input: a pipe, a mapped file ('<') or nothing
+    Pipe* in_pipe;
+    const u8* in_data;
+    u32 in_size;
+    u32 in_pos;
+
+    // Output: a pipe, or a buffer for the display or a '>' file
+    Pipe* out_pipe;
+    u8* out_buffer;
+    u32 out_capacity;
+    u32 out_length;
+    bool out_overflow;
+
+    const char* error;
+    Process* thread;
+};
+
+struct Pipeline {
+    char text[PIPELINE_LINE_LEN];   // tokenized in place
+    Stage stages[PIPELINE_MAX_STAGES];
+    u32 stage_count;
+    const char* input_file;
+    const char* output_file;
+};
+
+static int streq(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static bool contains(const char* text, u32 len, const char* pattern) {
+    u32 plen = strlen(pattern);
+    if (plen == 0) return true;
+    for (u32 i = 0; i + plen <= len; i++) {
+        u32 j = 0;
+        while (j < plen && text[i + j] == pattern[j]) j++;
+        if (j == plen) return true;
+    }
+    return false;
+}
+
+// ---- stage I/O ----
+
+static u32 stage_read(Stage* st, u8* data, u32 len) {
+    if (st->in_pipe) return pipe_read(st->in_pipe, data, len);
+    u32 n = 0;
+    while (n < len && st->in_pos < st->in_size) data[n++] = st->in_data[st->in_pos++];
+    return n;
+}
+
+// False when nobody reads any more: the stage should stop
+static bool stage_write(Stage* st, const void* data, u32 len) {
+    if (st->out_pipe) return pipe_write(st->out_pipe, (const u8*)data, len);
+    for (u32 i = 0; i < len; i++) {
+        if (st->out_length == st->out_capacity) {
+            st->out_overflow = true;  // keep draining so upstream finishes
+            break;
+        }
+        st->out_buffer[st->out_length++] = ((const u8*)data)[i];
+    }
+    return true;
+}
+
+static bool stage_print(Stage* st, const char* text) {
+    return stage_write(st, text, strlen(text));
+}
+
+static bool stage_print_num(Stage* st, u32 value) {
+    char num[12];
+    itoa(num, value, 10);
+    return stage_print(st, num);
+}
+
+// Lines of up to PIPELINE_LINE_LEN bytes; longer ones come out in pieces
+struct LineReader {
+    u8 chunk[64];
+    u32 len, pos;
+};
+
+static int read_line(Stage* st, LineReader* lr, char* line) {
+    u32 n = 0;
+    while (n < PIPELINE_LINE_LEN - 1) {
+        if (lr->pos == lr->len) {
+            lr->len = stage_read(st, lr->chunk, sizeof(lr->chunk));
+            lr->pos = 0;
+            if (lr->len == 0) break;
+        }
+        char c = lr->chunk[lr->pos++];
+        line[n++] = c;
+        if (c == '\n') break;
+    }
+    line[n] = 0;
+    return n ? (int)n : -1;
+}
+
+// ---- stream commands ----
+
+static void cmd_cat(Stage* st) {
+    if (st->argc < 2) {
+        u8 chunk[128];
+        while (u32 n = stage_read(st, chunk, sizeof(chunk))) {
+            if (!stage_write(st, chunk, n)) return;
+        }
+        return;
+    }
+
+    for (u32 i = 1; i < st->argc; i++) {
+        u32 size, handle;
+        const u8* data = fs_map_file(st->argv[i], &size, &handle);
+        if (!data) {
+            st->error = "CAT: FILE NOT FOUND";
+            return;
+        }
+        // Stream from the RAM disk in place, a pipe's worth at a time
+        bool ok = true;
+        for (u32 done = 0; ok && done < size; done += PIPE_BUFFER_SIZE) {
+            u32 n = size - done < PIPE_BUFFER_SIZE ? size - done : PIPE_BUFFER_SIZE;
+            ok = stage_write(st, data + done, n);
+        }
+        fs_unmap_file(handle);
+        if (!ok) return;
+    }
+}
+
+static void cmd_echo(Stage* st) {
+    for (u32 i = 1; i < st->argc; i++) {
+        if (i > 1) stage_print(st, " ");
+        stage_print(st, st->argv[i]);
+    }
+    stage_print(st, "\n");
+}
+
+static void cmd_grep(Stage* st) {
+    if (st->argc < 2) {
+        st->error = "USAGE: grep pattern";
+        return;
+    }
+    LineReader lr;
+    lr.len = lr.pos = 0;
+    char line[PIPELINE_LINE_LEN];
+    int n;
+    while ((n = read_line(st, &lr, line)) >= 0) {
+        if (contains(line, n, st->argv[1]) && !stage_write(st, line, n)) return;
+    }
+}
+
+static void cmd_wc(Stage* st) {
+    u32 lines = 0, words = 0, bytes = 0;
+    bool in_word = false;
+    u8 chunk[128];
+    while (u32 n = stage_read(st, chunk, sizeof(chunk))) {
+        bytes += n;
+        for (u32 i = 0; i < n; i++) {
+            bool space = chunk[i] == ' ' || chunk[i] == '\n' || chunk[i] == '\t' || chunk[i] == '\r';
+            if (chunk[i] == '\n') lines++;
+            if (!space && !in_word) words++;
+            in_word = !space;
+        }
+    }
+    stage_print_num(st, lines);
+    stage_print(st, " ");
+    stage_print_num(st, words);
+    stage_print(st, " ");
+    stage_print_num(st, bytes);
+    stage_print(st, "\n");
+}
+
+static void cmd_head(Stage* st) {
+    u32 count = 10;
+    if (st->argc > 1) {
+        count = 0;
+        for (const char* p = st->argv[1]; *p >= '0' && *p <= '9'; p++) count = count * 10 + (*p - '0');
+    }
+
+    // Returning closes our input, which stops the stages feeding us
+    LineReader lr;
+    lr.len = lr.pos = 0;
+    char line[PIPELINE_LINE_LEN];
+    int n;
+    for (u32 i = 0; i < count && (n = read_line(st, &lr, line)) >= 0; i++) {
+        if (!stage_write(st, line, n)) return;
+    }
+}
+
+static void cmd_ls(Stage* st) {
+    // Too big for a thread's stack
+    RAMDiskFileEntry* files = (RAMDiskFileEntry*)kmalloc(RAMDISK_MAX_FILES * sizeof(RAMDiskFileEntry));
+    if (!files) {
+        st->error = "OUT OF MEMORY";
+        return;
+    }
+    int count = fs_get_file_list(files, RAMDISK_MAX_FILES);
+    for (int i = 0; i < count; i++) {
+        if (!stage_print(st, files[i].filename) || !stage_print(st, " ") ||
+            !stage_print_num(st, files[i].size) || !stage_print(st, "\n")) {
+            break;
+        }
+    }
+    kfree(files);
+}
+
+struct StreamCommand {
+    const char* name;
+    StreamCommandFn run;
+};
+
+static const StreamCommand stream_commands[] = {
+    {"cat", cmd_cat},
+    {"echo", cmd_echo},
+    {"grep", cmd_grep},
+    {"wc", cmd_wc},
+    {"head", cmd_head},
+    {"ls", cmd_ls},
+};
+
+// ---- parsing and running ----
+
+bool pipeline_needed(const char* line) {
+    for (; *line; line++) {
+        if (*line == '|' || *line == '<' || *line == '>') return true;
+    }
+    return false;
+}
+
+// Split one stage's text into words, pulling out redirections
+static const char* parse_stage(Pipeline* pl, char* text, bool first, bool last) {
+    Stage* st = &pl->stages[pl->stage_count++];
+    st->argc = 0;
+    const char** redirect = nullptr;
+
+    char* p = text;
+    while (*p) {
+        while (*p == ' ') *p++ = 0;
+        if (!*p) break;
+
+        if (*p == '<' || *p == '>') {
+            if (redirect) return "MISSING FILE NAME";
+            if (*p == '<' ? !first : !last) return "REDIRECT IN THE MIDDLE OF A PIPE";
+            redirect = *p == '<' ? &pl->input_file : &pl->output_file;
+            *p++ = 0;
+            continue;
+        }
+
+        char* word = p;
+        while (*p && *p != ' ' && *p != '<' && *p != '>') p++;
+        if (redirect) {
+            *redirect = word;
+            redirect = nullptr;
+        } else if (st->argc < PIPELINE_MAX_ARGS) {
+            st->argv[st->argc++] = word;
+        } else {
+            return "TOO MANY ARGUMENTS";
+        }
+        if (*p == ' ') *p++ = 0;
+    }
+    if (redirect) return "MISSING FILE NAME";
+    if (st->argc == 0) return "EMPTY COMMAND";
+
+    st->run = nullptr;
+    for (u32 i = 0; i < sizeof(stream_commands) / sizeof(stream_commands[0]); i++) {
+        if (streq(st->argv[0], stream_commands[i].name)) st->run = stream_commands[i].run;
+    }
+    return st->run ? nullptr : "UNKNOWN COMMAND IN PIPELINE";
+}
+
+static const char* parse(Pipeline* pl, const char* line) {
+    u32 len = strlen(line);
+    if (len >= PIPELINE_LINE_LEN) return "LINE TOO LONG";
+    for (u32 i = 0; i <= len; i++) pl->text[i] = line[i];
+    pl->stage_count = 0;
+    pl->input_file = nullptr;
+    pl->output_file = nullptr;
+
+    u32 bars = 0;
+    for (u32 i = 0; i < len; i++) bars += pl->text[i] == '|';
+    if (bars >= PIPELINE_MAX_STAGES) return "TOO MANY STAGES";
+
+    char* start = pl->text;
+    for (u32 i = 0; i <= bars; i++) {
+        char* end = start;
+        while (*end && *end != '|') end++;
+        bool more = *end == '|';
+        *end = 0;
+        const char* error = parse_stage(pl, start, i == 0, i == bars);
+        if (error) return error;
+        start = end + more;
+    }
+    return nullptr;
+}
+
+static void stage_main(void* arg) {
+    Stage* st = (Stage*)arg;
+    st->run(st);
+    if (st->in_pipe) pipe_close_read(st->in_pipe);
+    if (st->out_pipe) pipe_close_write(st->out_pipe);
+}
+
+static void copy_text(char* dst, u32 size, const char* a, const char* b = "") {
+    u32 n = 0;
+    while (*a && n < size - 1) dst[n++] = *a++;
+    while (*b && n < size - 1) dst[n++] = *b++;
+    dst[n] = 0;
+}
+
+bool pipeline_run(const char* line, char* display, u32 display_size) {
+    Pipeline* pl = (Pipeline*)kmalloc(sizeof(Pipeline));
+    if (!pl) {
+        copy_text(display, display_size, "OUT OF MEMORY");
+        return false;
+    }
+    const char* error = parse(pl, line);
+    if (error) {
+        copy_text(display, display_size, error);
+        kfree(pl);
+        return false;
+    }
+
+    for (u32 i = 0; i < pl->stage_count; i++) {
+        Stage* st = &pl->stages[i];
+        st->in_pipe = nullptr;
+        st->in_data = nullptr;
+        st->in_size = 0;
+        st->in_pos = 0;
+        st->out_pipe = nullptr;
+        st->out_buffer = nullptr;
+        st->out_length = 0;
+        st->out_overflow = false;
+        st->error = nullptr;
+        st->thread = nullptr;
+    }
+
+    // Ends of the pipeline: '<' file, display or '>' file
+    Stage* first = &pl->stages[0];
+    Stage* last = &pl->stages[pl->stage_count - 1];
+    u32 in_handle = 0;
+    if (pl->input_file) {
+        first->in_data = fs_map_file(pl->input_file, &first->in_size, &in_handle);
+        if (!first->in_data) error = "INPUT FILE NOT FOUND";
+    }
+    if (pl->output_file) {
+        last->out_capacity = PIPELINE_FILE_MAX;
+        last->out_buffer = (u8*)kmalloc(PIPELINE_FILE_MAX);
+        if (!last->out_buffer) error = "OUT OF MEMORY";
+    } else {
+        last->out_capacity = display_size - 1;
+        last->out_buffer = (u8*)display;
+    }
+
+    for (u32 i = 0; !error && i + 1 < pl->stage_count; i++) {
+        Pipe* pipe = pipe_create();
+        if (!pipe) {
+            error = "OUT OF MEMORY";
+            break;
+        }
+        pl->stages[i].out_pipe = pipe;
+        pl->stages[i + 1].in_pipe = pipe;
+    }
+
+    // A stage that can't start still closes its pipe ends, so its
+    // neighbours see EOF / broken pipe instead of waiting forever
+    for (u32 i = 0; i < pl->stage_count; i++) {
+        Stage* st = &pl->stages[i];
+        if (!error) st->thread = process_spawn_kernel(st->argv[0], stage_main, st);
+        if (!st->thread) {
+            if (!error) error = "TOO MANY PROCESSES";
+            if (st->in_pipe) pipe_close_read(st->in_pipe);
+            if (st->out_pipe) pipe_close_write(st->out_pipe);
+        }
+    }
+    for (u32 i = 0; i < pl->stage_count; i++) {
+        Stage* st = &pl->stages[i];
+        if (st->thread) process_wait(st->thread);
+        if (!error && st->error) error = st->error;
+    }
+    if (in_handle) fs_unmap_file(in_handle);
+
+    if (!error && pl->output_file) {
+        if (last->out_overflow) {
+            error = "OUTPUT TOO LARGE FOR A FILE";
+        } else if (!fs_create_file(pl->output_file, last->out_buffer, last->out_length)) {
+            error = "COULD NOT WRITE OUTPUT FILE";
+        } else {
+            char num[12];
+            itoa(num, last->out_length, 10);
+            copy_text(display, display_size, "WROTE ", num);
+            u32 n = strlen(display);
+            copy_text(display + n, display_size - n, " BYTES TO ", pl->output_file);
+        }
+    } else if (!error) {
+        // One display line: newlines become separators
+        u32 n = last->out_length;
+        while (n && display[n - 1] == '\n') n--;
+        display[n] = 0;
+        for (u32 i = 0; i < n; i++) {
+            if (display[i] == '\n') display[i] = ' ';
+        }
+        if (n == 0) copy_text(display, display_size, "(NO OUTPUT)");
+    }
+    if (error) copy_text(display, display_size, error);
+
+    if (pl->output_file && last->out_buffer) kfree(last->out_buffer);
+    kfree(pl);
+    return !error;
+}
@@ -0,0 +1,24 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "memory.h"
+
+// Shell pipelines: stream commands joined by '|', with an optional
+// '< file' on the first stage and '> file' on the last. Every stage runs
+// as a kernel thread and talks to its neighbours through a bounded pipe,
+// so data streams through in constant memory. Only '>' buffers, since
+// RAM disk files are written whole (up to PIPELINE_FILE_MAX bytes).
+//
+// Stream commands: cat [file], echo text, grep pattern, wc, head [n], ls
+
+#define PIPELINE_MAX_STAGES 4
+#define PIPELINE_MAX_ARGS 4
+#define PIPELINE_FILE_MAX (64 * 1024)
+
+bool pipeline_needed(const char* line);   // has '|', '<' or '>'
+
+// Run line; the last stage's output (or a summary / error) ends up in
+// display as one line of text. Returns false on error.
+bool pipeline_run(const char* line, char* display, u32 display_size);
+
+#endif
@@ -0,0 +1,43 @@
+; Kernel stack switching and the first drop to ring 3 for process.cpp.
+section .text
+[bits 32]
+
+USER_DATA_SEG equ 0x23
+
+global switch_context
+global enter_user_mode
+
+; void switch_context(u32* save_esp, u32 new_esp)
+; Saves the callee-saved registers on the current kernel stack, parks esp
+; in *save_esp and resumes the context that was parked at new_esp.
+switch_context:
+    mov eax, [esp + 4]
+    mov edx, [esp + 8]
+    push ebp
+    push ebx
+    push esi
+    push edi
+    mov [eax], esp
+    mov esp, edx
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+; A new process's first switch_context returns here with an iret frame
+; (eip, cs, eflags, esp, ss) for its entry point on top of the stack.
+enter_user_mode:
+    mov ax, USER_DATA_SEG
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    xor eax, eax                ; don't leak kernel values into ring 3
+    xor ebx, ebx
+    xor ecx, ecx
+    xor edx, edx
+    xor esi, esi
+    xor edi, edi
+    xor ebp, ebp
+    iret
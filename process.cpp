@@ -0,0 +1,401 @@
+#include "process.h"
+#include "paging.h"
+#include "syscall.h"
+#include "spinlock.h"
+#include "smp.h"
+#include "cpu.h"
+#include "rcu.h"
+#include "fs_ramdisk.h"
+#include "klog.h"
+
+// Defined in process.asm
+extern "C" void switch_context(u32* save_esp, u32 new_esp);
+extern "C" void enter_user_mode();
+
+static Process g_processes[MAX_PROCESSES];
+static Process* g_current = nullptr;   // on the boot CPU
+static Spinlock g_sched_lock;          // process table and run queue
+static Process* run_head = nullptr;
+static Process* run_tail = nullptr;
+static u32 next_pid = 1;
+static volatile bool need_resched = false;
+
+static void copy_name(char* dst, const char* src) {
+    u32 i = 0;
+    for (; src[i] && i < PROCESS_NAME_LEN - 1; i++) dst[i] = src[i];
+    dst[i] = 0;
+}
+
+// Caller holds g_sched_lock
+static void enqueue(Process* proc) {
+    proc->state = PROCESS_READY;
+    proc->next = nullptr;
+    if (run_tail) {
+        run_tail->next = proc;
+    } else {
+        run_head = proc;
+    }
+    run_tail = proc;
+}
+
+static Process* dequeue() {
+    Process* proc = run_head;
+    if (proc) {
+        run_head = proc->next;
+        if (!run_head) run_tail = nullptr;
+        proc->next = nullptr;
+    }
+    return proc;
+}
+
+void process_initialize() {
+    g_sched_lock.initialize("sched");
+
+    Process* kernel = &g_processes[0];
+    kernel->pid = 0;
+    kernel->state = PROCESS_RUNNING;
+    copy_name(kernel->name, "kernel");
+    kernel->page_directory = paging_kernel_directory();
+    g_current = kernel;
+}
+
+// Reserve a table slot (blocked until started) with a kernel stack
+static Process* allocate_process(const char* name) {
+    Process* proc = nullptr;
+    u32 flags = g_sched_lock.lock_irqsave();
+    for (u32 i = 1; i < MAX_PROCESSES; i++) {
+        if (g_processes[i].state == PROCESS_UNUSED) {
+            proc = &g_processes[i];
+            proc->state = PROCESS_BLOCKED;  // reserved until started
+            proc->pid = next_pid++;
+            break;
+        }
+    }
+    g_sched_lock.unlock_irqrestore(flags);
+    if (!proc) return nullptr;
+
+    copy_name(proc->name, name);
+    proc->exit_code = 0;
+    proc->fault_vector = 0;
+    proc->fault_address = 0;
+    proc->page_faults = 0;
+    proc->region_count = 0;
+    proc->file_handle = 0;
+    proc->ipc.done = false;
+    proc->ipc.next = nullptr;
+    proc->killed = false;
+    proc->kernel_thread = false;
+    proc->fpu_used = false;
+    proc->waiter = nullptr;
+    proc->next = nullptr;
+    proc->page_directory = 0;
+    proc->kernel_stack = (u8*)kmalloc(PROCESS_KSTACK_SIZE);
+    if (!proc->kernel_stack) {
+        process_destroy(proc);
+        return nullptr;
+    }
+    return proc;
+}
+
+Process* process_create(const char* name) {
+    if (!paging_available() || !g_current || !syscall_vsyscall_page()) return nullptr;
+
+    Process* proc = allocate_process(name);
+    if (!proc) return nullptr;
+
+    proc->page_directory = paging_create_address_space();
+    if (!proc->page_directory ||
+        !paging_map(proc->page_directory, USER_VSYSCALL_ADDR, syscall_vsyscall_page(),
+                    PTE_USER | PTE_SHARED)) {
+        process_destroy(proc);
+        return nullptr;
+    }
+    return proc;
+}
+
+// Copy an image into fresh user pages at virt. Frames are identity
+// mapped in the kernel, so the copy goes through physical addresses.
+bool process_load_image(Process* proc, u32 virt, const u8* image, u32 size) {
+    if (!paging_map_zeroed(proc->page_directory, virt, size, PTE_USER | PTE_WRITABLE)) return false;
+
+    for (u32 done = 0; done < size; ) {
+        u32 addr = virt + done;
+        u8* dst = (u8*)paging_translate(proc->page_directory, addr);
+        u32 n = PAGE_SIZE - (addr & (PAGE_SIZE - 1));
+        if (n > size - done) n = size - done;
+        for (u32 i = 0; i < n; i++) dst[i] = image[done + i];
+        done += n;
+    }
+    return true;
+}
+
+bool process_add_region(Process* proc, u32 start, u32 end, u32 flags,
+                        const u8* file_base, u32 file_size) {
+    if ((start | end) & (PAGE_SIZE - 1) || start >= end || !user_range_ok(start, end - start) ||
+        proc->region_count == PROCESS_MAX_REGIONS) {
+        return false;
+    }
+    for (u32 i = 0; i < proc->region_count; i++) {
+        const VmRegion& r = proc->regions[i];
+        if (start < r.end && r.start < end) return false;
+    }
+
+    VmRegion& r = proc->regions[proc->region_count++];
+    r.start = start;
+    r.end = end;
+    r.flags = flags;
+    r.file_base = file_base;
+    r.file_size = file_size < end - start ? file_size : end - start;
+    return true;
+}
+
+bool process_start(Process* proc, u32 entry) {
+    if (!process_add_region(proc, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_TOP, VM_WRITE,
+                            nullptr, 0)) {
+        return false;
+    }
+
+    // First switch_context into the process "returns" to enter_user_mode,
+    // which irets to ring 3 through this frame
+    u32* sp = (u32*)(proc->kernel_stack + PROCESS_KSTACK_SIZE);
+    *--sp = USER_DATA_SEG;        // ss
+    *--sp = USER_STACK_TOP;       // esp
+    *--sp = EFLAGS_IF | 0x2;      // eflags (bit 1 is reserved, always set)
+    *--sp = USER_CODE_SEG;        // cs
+    *--sp = entry;                // eip
+    *--sp = (u32)enter_user_mode;
+    for (int i = 0; i < 4; i++) *--sp = 0;  // ebp, ebx, esi, edi
+    proc->kernel_esp = (u32)sp;
+
+    u32 flags = g_sched_lock.lock_irqsave();
+    enqueue(proc);
+    g_sched_lock.unlock_irqrestore(flags);
+    return true;
+}
+
+// Drop the address space and the pin on its backing file, in that order:
+// in-place pages point into the file until the directory is gone
+static void release_address_space(Process* proc) {
+    if (proc->page_directory && proc->page_directory != paging_kernel_directory()) {
+        paging_destroy_address_space(proc->page_directory);
+    }
+    proc->page_directory = 0;
+    proc->region_count = 0;
+    if (proc->file_handle) fs_unmap_file(proc->file_handle);
+    proc->file_handle = 0;
+}
+
+void process_destroy(Process* proc) {
+    release_address_space(proc);
+    if (proc->kernel_stack) kfree(proc->kernel_stack);
+    proc->kernel_stack = nullptr;
+
+    u32 flags = g_sched_lock.lock_irqsave();
+    proc->state = PROCESS_UNUSED;
+    g_sched_lock.unlock_irqrestore(flags);
+}
+
+Process* process_spawn_flat(const char* name, const u8* image, u32 size) {
+    Process* proc = process_create(name);
+    if (!proc) return nullptr;
+
+    if (!process_load_image(proc, USER_BASE, image, size) || !process_start(proc, USER_BASE)) {
+        process_destroy(proc);
+        return nullptr;
+    }
+    return proc;
+}
+
+// First switch_context into a kernel thread "returns" here; schedule()
+// had interrupts off
+static void kernel_thread_entry(KernelThreadFn fn, void* arg) {
+    irq_enable();
+    fn(arg);
+    process_exit(0);
+}
+
+Process* process_spawn_kernel(const char* name, KernelThreadFn fn, void* arg) {
+    if (!g_current) return nullptr;
+
+    Process* proc = allocate_process(name);
+    if (!proc) return nullptr;
+    proc->kernel_thread = true;
+    proc->page_directory = paging_kernel_directory();
+
+    // switch_context pops four registers and returns into the entry,
+    // which finds its arguments above a dummy return address
+    u32* sp = (u32*)(proc->kernel_stack + PROCESS_KSTACK_SIZE);
+    *--sp = (u32)arg;
+    *--sp = (u32)fn;
+    *--sp = 0;
+    *--sp = (u32)kernel_thread_entry;
+    for (int i = 0; i < 4; i++) *--sp = 0;  // ebp, ebx, esi, edi
+    proc->kernel_esp = (u32)sp;
+
+    u32 flags = g_sched_lock.lock_irqsave();
+    enqueue(proc);
+    g_sched_lock.unlock_irqrestore(flags);
+    return proc;
+}
+
+// Processes only ever run on the boot CPU
+Process* process_current() {
+    return this_cpu()->index == 0 ? g_current : nullptr;
+}
+
+bool process_current_is_user() {
+    Process* proc = process_current();
+    return proc && proc->pid != 0 && !proc->kernel_thread;
+}
+
+void schedule() {
+    // Whatever was running holds no RCU references across a switch
+    rcu_quiescent_state();
+
+    u32 flags = irq_save();
+    need_resched = false;
+    Process* prev = g_current;
+    Process* next;
+
+    while (true) {
+        g_sched_lock.lock();
+        next = dequeue();
+        if (next && prev->state == PROCESS_RUNNING) {
+            enqueue(prev);
+        } else if (!next && prev->state == PROCESS_RUNNING) {
+            next = prev;  // nothing else wants the CPU
+        }
+        g_sched_lock.unlock();
+        if (next) break;
+
+        // Everything is blocked: sleep until an interrupt changes that
+        irq_enable_and_halt();
+        irq_disable();
+    }
+
+    next->state = PROCESS_RUNNING;
+    next->ticks_left = PROCESS_TIME_SLICE;
+    if (next != prev) {
+        g_current = next;
+        this_cpu()->tss.esp0 = (u32)next->kernel_stack + PROCESS_KSTACK_SIZE;
+        paging_switch(next->page_directory);
+        fpu_switch(next);
+        switch_context(&prev->kernel_esp, next->kernel_esp);
+    }
+    irq_restore(flags);
+}
+
+void process_block() {
+    g_current->state = PROCESS_BLOCKED;
+    schedule();
+}
+
+void process_wake(Process* proc) {
+    u32 flags = g_sched_lock.lock_irqsave();
+    if (proc->state == PROCESS_BLOCKED) enqueue(proc);
+    g_sched_lock.unlock_irqrestore(flags);
+}
+
+s32 process_wait(Process* proc, ProcessExitInfo* info) {
+    if (!proc) return PROCESS_EXIT_FAULT;
+
+    u32 flags = irq_save();
+    while (proc->state != PROCESS_ZOMBIE) {
+        proc->waiter = g_current;
+        g_current->state = PROCESS_BLOCKED;
+        schedule();
+    }
+    irq_restore(flags);
+
+    s32 code = proc->exit_code;
+    if (info) {
+        info->exit_code = code;
+        info->fault_vector = proc->fault_vector;
+        info->fault_address = proc->fault_address;
+        info->page_faults = proc->page_faults;
+    }
+    process_destroy(proc);
+    return code;
+}
+
+void process_exit(s32 code) {
+    irq_disable();
+    Process* proc = g_current;
+    proc->exit_code = code;
+
+    // Our kernel stack stays until the waiter reaps us; the user pages go now
+    paging_switch(paging_kernel_directory());
+    release_address_space(proc);
+    fpu_release(proc);
+
+    proc->state = PROCESS_ZOMBIE;
+    if (proc->waiter) process_wake(proc->waiter);
+    schedule();
+
+    while (true) cpu_halt();  // not reached
+}
+
+void process_kill(Process* proc) {
+    u32 flags = irq_save();
+    proc->killed = true;
+    irq_restore(flags);
+    process_wake(proc);  // blocking waits check the flag when they wake
+}
+
+void process_tick() {
+    if (this_cpu()->index != 0 || !g_current || g_current->pid == 0) return;
+    if (g_current->ticks_left && --g_current->ticks_left == 0) need_resched = true;
+}
+
+void process_return_to_user() {
+    if (need_resched) schedule();
+    if (g_current->killed) process_exit(PROCESS_EXIT_KILLED);
+}
+
+bool process_handle_page_fault(u32 address) {
+    Process* proc = process_current();
+    if (!proc || proc->pid == 0) return false;
+
+    u32 page = address & ~(PAGE_SIZE - 1);
+    for (u32 i = 0; i < proc->region_count; i++) {
+        const VmRegion& r = proc->regions[i];
+        if (page < r.start || page >= r.end) continue;
+
+        u32 offset = page - r.start;
+        u32 flags = PTE_USER | ((r.flags & VM_WRITE) ? PTE_WRITABLE : 0);
+        const u8* src = r.file_base + offset;
+
+        // Read-only and fully backed: share the RAM disk's copy
+        if (!(r.flags & VM_WRITE) && offset + PAGE_SIZE <= r.file_size &&
+            ((u32)src & (PAGE_SIZE - 1)) == 0) {
+            if (!paging_map(proc->page_directory, page, (u32)src, flags | PTE_SHARED)) return false;
+            proc->page_faults++;
+            return true;
+        }
+
+        u32 frame = frame_alloc();  // zeroed
+        if (!frame) return false;
+        if (offset < r.file_size) {
+            u32 n = r.file_size - offset < PAGE_SIZE ? r.file_size - offset : PAGE_SIZE;
+            u8* dst = (u8*)frame;
+            for (u32 j = 0; j < n; j++) dst[j] = src[j];
+        }
+        if (!paging_map(proc->page_directory, page, frame, flags)) {
+            frame_free(frame);
+            return false;
+        }
+        proc->page_faults++;
+        return true;
+    }
+    return false;
+}
+
+void process_fault(InterruptFrame* frame, u32 address) {
+    Process* proc = process_current();
+    if (!proc || proc->pid == 0 || proc->kernel_thread) unhandled_exception(frame);
+
+    proc->fault_vector = frame->vector;
+    proc->fault_address = address ? address : frame->eip;
+    klog_value(KLOG_ERR, "process: killed by exception", frame->vector);
+    process_exit(PROCESS_EXIT_FAULT);
+}
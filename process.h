@@ -0,0 +1,138 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include "memory.h"
+#include "interrupts.h"
+#include "fpu.h"
+
+// User processes. Every process has its own page directory and kernel
+// stack and runs in ring 3. Kernel threads share the scheduler but run
+// a kernel function on the kernel directory and never enter ring 3.
+// They are scheduled round-robin on the boot CPU alongside the UI
+// (process 0, the kernel task); the APs keep serving the task pool. The
+// kernel is not preemptible: a process loses the CPU when its time
+// slice ends while it is in user mode, or when it blocks, yields or
+// exits inside a syscall.
+
+#define MAX_PROCESSES 16
+#define PROCESS_NAME_LEN 16
+#define PROCESS_KSTACK_SIZE 8192
+#define PROCESS_TIME_SLICE 2        // timer ticks
+#define PROCESS_EXIT_FAULT (-1)     // exit code of a process killed by an exception
+#define PROCESS_EXIT_KILLED (-2)    // ... or by process_kill
+#define PROCESS_MAX_REGIONS 8
+
+// A demand-paged range of the user window. Pages are filled on first
+// touch: from file_base while inside file_size, zeroes after that.
+// Read-only pages that lie wholly inside a page-aligned file are mapped
+// in place instead of copied.
+#define VM_WRITE 0x1
+
+struct VmRegion {
+    u32 start, end;            // page aligned
+    u32 flags;                 // VM_*
+    const u8* file_base;       // contents of [start, start + file_size)
+    u32 file_size;
+};
+
+enum ProcessState {
+    PROCESS_UNUSED,
+    PROCESS_READY,
+    PROCESS_RUNNING,
+    PROCESS_BLOCKED,
+    PROCESS_ZOMBIE
+};
+
+// A message in flight while its sender or receiver is blocked (ipc.cpp)
+struct Process;
+
+struct IpcState {
+    u32 words[2];
+    u32 addr;                  // sender: pages to move; receiver: where they go
+    u32 pages;                 // sender: page count; receiver: most it accepts
+    u32 result;                // returned to the blocked side
+    bool done;
+    Process* next;             // endpoint send queue link
+};
+
+// What process_wait reports about a reaped process
+struct ProcessExitInfo {
+    s32 exit_code;
+    u32 fault_vector;
+    u32 fault_address;
+    u32 page_faults;
+};
+
+struct Process {
+    u32 pid;
+    ProcessState state;
+    char name[PROCESS_NAME_LEN];
+
+    u32 kernel_esp;            // saved by switch_context
+    u8* kernel_stack;
+    u32 page_directory;        // physical address, loaded into CR3
+
+    u32 ticks_left;
+    s32 exit_code;
+    u32 fault_vector;          // set when killed by an exception
+    u32 fault_address;
+    u32 page_faults;           // pages filled on demand
+
+    VmRegion regions[PROCESS_MAX_REGIONS];
+    u32 region_count;
+    u32 file_handle;           // fs_map_file pin on the backing file, 0 if none
+
+    IpcState ipc;
+    bool killed;               // exit at the next return to user mode
+    bool kernel_thread;
+    bool fpu_used;             // fpu holds its state; fresh state until the first FPU use
+
+    FpuState fpu;              // saved while another process owns the registers
+
+    Process* waiter;           // blocked in process_wait on us
+    Process* next;             // run queue link
+};
+
+void process_initialize();     // adopt the boot context as the kernel task
+
+// Creation: allocate a process with an empty user address space, fill it
+// with process_load_image / process_add_region, then process_start it
+Process* process_create(const char* name);
+bool process_load_image(Process* proc, u32 virt, const u8* image, u32 size);
+bool process_add_region(Process* proc, u32 start, u32 end, u32 flags,
+                        const u8* file_base, u32 file_size);
+bool process_start(Process* proc, u32 entry);   // adds the stack region, makes it runnable
+void process_destroy(Process* proc);            // never-started or reaped processes
+
+// Convenience: flat binary linked at USER_BASE
+Process* process_spawn_flat(const char* name, const u8* image, u32 size);
+
+// Run fn(arg) as a schedulable kernel thread; it exits with code 0 when
+// fn returns. Kernel threads are never preempted: they run until they
+// block, yield or return.
+typedef void (*KernelThreadFn)(void* arg);
+Process* process_spawn_kernel(const char* name, KernelThreadFn fn, void* arg);
+
+// Scheduling
+Process* process_current();
+bool process_current_is_user();
+void schedule();                      // switch to the next runnable process, if any
+void process_wake(Process* proc);
+void process_block();                 // sleep until process_wake; irqs off, recheck the condition
+s32 process_wait(Process* proc, ProcessExitInfo* info = nullptr);  // block until it exits, reap it
+void process_exit(s32 code);          // never returns
+void process_kill(Process* proc);     // also ends blocking waits in IPC
+
+// Hooks for the interrupt paths
+void process_tick();                        // timer interrupt, every CPU
+void process_return_to_user();              // preempt here if the slice is used up, die if killed
+bool process_handle_page_fault(u32 address);            // demand paging; false if not ours
+void process_fault(InterruptFrame* frame, u32 address);  // kill the current process
+
+// Ring 3 registers, saved at the top of the kernel stack on every entry
+// from user mode (int 0x80 and sysenter build the same frame there)
+static inline InterruptFrame* process_user_frame(Process* proc) {
+    return (InterruptFrame*)(proc->kernel_stack + PROCESS_KSTACK_SIZE) - 1;
+}
+
+#endif
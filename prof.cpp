@@ -0,0 +1,240 @@
+#include "prof.h"
+#include "ksyms.h"
+#include "interrupts.h"
+#include "timer.h"
+#include "cpu.h"
+
+#ifdef PROF_CALLERS
+static const bool track_callers = true;
+#else
+static const bool track_callers = false;
+#endif
+
+// Histograms indexed like ksym_text_table, allocated on first start
+static u32* g_self = nullptr;
+static u32* g_total = nullptr;  // PROF_CALLERS only
+
+static volatile bool g_running = false;
+static bool g_handler_registered = false;
+static volatile u32 g_samples = 0;
+static volatile u32 g_user = 0;
+static volatile u32 g_other = 0;
+static u64 g_start_tsc = 0;
+static u64 g_elapsed = 0;
+
+// Index of the function containing a kernel address, -1 outside the image
+static int symbol_index(u32 address) {
+    if (address >= KERNEL_HEAP_START) return -1;  // heap: module code
+    const KernelSymbol* sym = ksym_find(address);
+    return sym ? (int)(sym - ksym_text_table) : -1;
+}
+
+#ifdef PROF_CALLERS
+// Callers from the EBP chain. The interrupted code ran on this stack, so
+// every frame lies above ours; anything else ends the walk.
+static void count_callers(const InterruptFrame* frame, int leaf) {
+    int seen[PROF_MAX_DEPTH + 1];
+    u32 seen_count = 0;
+    seen[seen_count++] = leaf;
+    if (leaf >= 0) g_total[leaf]++;
+
+    u32 low = (u32)frame;
+    u32 high = low + 0x10000;
+    u32 ebp = frame->ebp;
+    for (u32 depth = 0; depth < PROF_MAX_DEPTH; depth++) {
+        if (ebp <= low || ebp + 8 > high || (ebp & 3)) break;
+        const u32* fp = (const u32*)ebp;
+        int index = symbol_index(fp[1]);
+        bool counted = index < 0;
+        for (u32 i = 0; i < seen_count && !counted; i++) counted = seen[i] == index;
+        if (!counted) {
+            g_total[index]++;
+            seen[seen_count++] = index;
+        }
+        low = ebp;
+        ebp = fp[0];
+    }
+}
+#endif
+
+static void prof_tick(InterruptFrame* frame) {
+    if (!g_running) return;
+    g_samples++;
+    if (frame_from_user(frame)) {
+        g_user++;
+        return;
+    }
+
+    int index = symbol_index(frame->eip);
+    if (index < 0) {
+        g_other++;
+    } else {
+        g_self[index]++;
+    }
+#ifdef PROF_CALLERS
+    count_callers(frame, index);
+#endif
+}
+
+bool prof_start(const char** error) {
+    if (g_running) {
+        *error = "PROFILER ALREADY RUNNING";
+        return false;
+    }
+    if (ksym_text_count == 0) {
+        *error = "NO SYMBOL TABLE";
+        return false;
+    }
+    if (!g_self) {
+        g_self = (u32*)kmalloc(ksym_text_count * sizeof(u32));
+        if (track_callers) g_total = (u32*)kmalloc(ksym_text_count * sizeof(u32));
+    }
+    if (!g_self || (track_callers && !g_total)) {
+        *error = "OUT OF MEMORY";
+        return false;
+    }
+
+    for (u32 i = 0; i < ksym_text_count; i++) g_self[i] = 0;
+    if (g_total) {
+        for (u32 i = 0; i < ksym_text_count; i++) g_total[i] = 0;
+    }
+    g_samples = g_user = g_other = 0;
+    g_elapsed = 0;
+    g_start_tsc = rdtsc();
+
+    if (!g_handler_registered) {
+        register_interrupt_handler(IRQ_BASE + 0, prof_tick);
+        g_handler_registered = true;
+    }
+    g_running = true;
+    pit_start_periodic(PROF_HZ);
+    pic_unmask_irq(0);
+    return true;
+}
+
+bool prof_stop() {
+    if (!g_running) return false;
+    pic_mask_irq(0);
+    pit_stop_periodic();
+    g_running = false;
+    g_elapsed = rdtsc() - g_start_tsc;
+    return true;
+}
+
+bool prof_running() {
+    return g_running;
+}
+
+u32 prof_top(ProfEntry* out, u32 max, ProfSummary* summary) {
+    summary->samples = g_samples;
+    summary->user = g_user;
+    summary->other = g_other;
+    u64 elapsed = g_running ? rdtsc() - g_start_tsc : g_elapsed;
+    summary->ms = (u32)udiv64(tsc_to_ns(elapsed), 1000000);
+    if (!g_self) return 0;
+
+    // Repeated selection by (count descending, index ascending); the
+    // table is small and this only runs on request
+    u32 found = 0;
+    u32 last_count = 0xFFFFFFFF;
+    int last_index = -1;
+    while (found < max) {
+        int best = -1;
+        for (u32 i = 0; i < ksym_text_count; i++) {
+            u32 c = g_self[i];
+            if (c == 0) continue;
+            if (c > last_count || (c == last_count && (int)i <= last_index)) continue;
+            if (best < 0 || c > g_self[best]) best = (int)i;
+        }
+        if (best < 0) break;
+        out[found].name = ksym_text_table[best].name;
+        out[found].self = g_self[best];
+        out[found].total = g_total ? g_total[best] : 0;
+        found++;
+        last_count = g_self[best];
+        last_index = best;
+    }
+    return found;
+}
+
+// ---- names ----
+
+static u32 append(char* out, u32 size, u32 len, const char* text, u32 count) {
+    for (u32 i = 0; i < count && len + 1 < size; i++) out[len++] = text[i];
+    out[len] = 0;
+    return len;
+}
+
+// Enough of the Itanium C++ ABI for kernel symbols: _Z[L]<len><id> and
+// _ZN[L][K]<len><id>...E. Parameters, templates and the like are dropped.
+void prof_symbol_name(const char* mangled, char* out, u32 size) {
+    if (size == 0) return;
+    out[0] = 0;
+    const char* p = mangled;
+    if (p[0] != '_' || p[1] != 'Z') {
+        append(out, size, 0, mangled, strlen(mangled));
+        return;
+    }
+    p += 2;
+    bool nested = *p == 'N';
+    if (nested) p++;
+    while (*p == 'L' || *p == 'K') p++;
+
+    u32 len = 0;
+    bool first = true;
+    while (*p >= '0' && *p <= '9') {
+        u32 id_len = 0;
+        while (*p >= '0' && *p <= '9') id_len = id_len * 10 + (*p++ - '0');
+        if (!first) len = append(out, size, len, "::", 2);
+        len = append(out, size, len, p, id_len);
+        for (u32 i = 0; i < id_len && *p; i++) p++;
+        first = false;
+        if (!nested) break;
+    }
+    if (first) append(out, size, 0, mangled, strlen(mangled));  // nothing we understand
+}
+
+static u32 append_str(char* out, u32 size, u32 len, const char* text) {
+    return append(out, size, len, text, strlen(text));
+}
+
+static u32 append_num(char* out, u32 size, u32 len, u32 value) {
+    char num[12];
+    itoa(num, (int)value, 10);
+    return append_str(out, size, len, num);
+}
+
+u32 prof_report(char* out, u32 size) {
+    ProfEntry top[PROF_REPORT_LINES];
+    ProfSummary summary;
+    u32 count = prof_top(top, PROF_REPORT_LINES, &summary);
+
+    u32 len = 0;
+    if (size) out[0] = 0;
+    len = append_num(out, size, len, summary.samples);
+    len = append_str(out, size, len, " samples in ");
+    len = append_num(out, size, len, summary.ms);
+    len = append_str(out, size, len, " ms, user ");
+    len = append_num(out, size, len, summary.user);
+    len = append_str(out, size, len, ", other ");
+    len = append_num(out, size, len, summary.other);
+    len = append_str(out, size, len, "\nself% self total function\n");
+
+    u32 samples = summary.samples ? summary.samples : 1;
+    for (u32 i = 0; i < count; i++) {
+        u32 permille = top[i].self * 1000 / samples;
+        len = append_num(out, size, len, permille / 10);
+        len = append_str(out, size, len, ".");
+        len = append_num(out, size, len, permille % 10);
+        len = append_str(out, size, len, " ");
+        len = append_num(out, size, len, top[i].self);
+        len = append_str(out, size, len, " ");
+        len = append_num(out, size, len, top[i].total);
+        len = append_str(out, size, len, " ");
+        char name[64];
+        prof_symbol_name(top[i].name, name, sizeof(name));
+        len = append_str(out, size, len, name);
+        len = append_str(out, size, len, "\n");
+    }
+    return len;
+}
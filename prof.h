@@ -0,0 +1,46 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include "memory.h"
+
+// Statistical profiler. While running, PIT channel 0 interrupts the BSP
+// PROF_HZ times a second and the interrupted EIP is counted against the
+// function that contains it (ksym_text_table). Code that runs with
+// interrupts off is charged to wherever they come back on.
+//
+// Builds with PROF_CALLERS (make PROF_CALLERS=1, which also keeps frame
+// pointers) walk the EBP chain too and count each function once per
+// sample in which it is on the stack: "total" as opposed to "self".
+
+#define PROF_HZ 1000
+#define PROF_MAX_DEPTH 8
+#define PROF_FILE "prof.log"
+
+struct ProfEntry {
+    const char* name;  // mangled, as in ksym_text_table
+    u32 self;          // samples with EIP in the function
+    u32 total;         // samples with it anywhere on the stack (PROF_CALLERS)
+};
+
+struct ProfSummary {
+    u32 samples;
+    u32 user;   // ring 3
+    u32 other;  // outside the kernel image, e.g. module code
+    u32 ms;     // time profiled
+};
+
+bool prof_start(const char** error);  // clears the previous profile
+bool prof_stop();                     // false if it wasn't running
+bool prof_running();
+
+// Hottest functions by self samples, at most max; works while running
+u32 prof_top(ProfEntry* out, u32 max, ProfSummary* summary);
+
+// "TextEditor::refresh_display" for "_ZN10TextEditor15refresh_displayEv"
+void prof_symbol_name(const char* mangled, char* out, u32 size);
+
+// Text report of the top PROF_REPORT_LINES functions for PROF_FILE
+#define PROF_REPORT_LINES 32
+u32 prof_report(char* out, u32 size);
+
+#endif
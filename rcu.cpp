@@ -0,0 +1,99 @@
+#include "rcu.h"
+#include "cpu.h"
+#include "spinlock.h"
+
+static volatile u32 g_rcu_gp = 0;  // most recently started grace period
+
+// Deferred callbacks, oldest first
+static Spinlock g_callback_lock;
+static RcuHead* callback_head = nullptr;
+static RcuHead* callback_tail = nullptr;
+static u32 completed_callbacks = 0;
+
+// A grace period is over once every online CPU has either reported a
+// quiescent state since it started or is sitting in the idle loop.
+static bool gp_completed(u32 gp) {
+    for (u32 i = 0; i < cpu_count(); i++) {
+        Cpu* cpu = get_cpu(i);
+        if (!cpu->online || __atomic_load_n(&cpu->rcu_idle, __ATOMIC_SEQ_CST)) continue;
+        if ((s32)(__atomic_load_n(&cpu->rcu_qs_gp, __ATOMIC_SEQ_CST) - gp) < 0) return false;
+    }
+    return true;
+}
+
+static void run_ready_callbacks() {
+    if (!__atomic_load_n(&callback_head, __ATOMIC_RELAXED)) return;
+
+    u32 flags = irq_save();
+    if (!g_callback_lock.try_lock()) {
+        irq_restore(flags);
+        return;  // someone else is already processing the list
+    }
+
+    RcuHead* ready = nullptr;
+    RcuHead** ready_tail = &ready;
+    while (callback_head && gp_completed(callback_head->gp)) {
+        RcuHead* head = callback_head;
+        callback_head = head->next;
+        head->next = nullptr;
+        *ready_tail = head;
+        ready_tail = &head->next;
+    }
+    if (!callback_head) callback_tail = nullptr;
+
+    g_callback_lock.unlock();
+    irq_restore(flags);
+
+    while (ready) {
+        RcuHead* next = ready->next;
+        ready->func(ready);
+        completed_callbacks++;
+        ready = next;
+    }
+}
+
+void rcu_quiescent_state() {
+    Cpu* cpu = this_cpu();
+    if (cpu->rcu_nesting) return;
+
+    __atomic_store_n(&cpu->rcu_qs_gp, __atomic_load_n(&g_rcu_gp, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    run_ready_callbacks();
+}
+
+void rcu_enter_idle() {
+    rcu_quiescent_state();
+    __atomic_store_n(&this_cpu()->rcu_idle, 1, __ATOMIC_SEQ_CST);
+}
+
+void rcu_exit_idle() {
+    // Must be visible before we dereference any RCU-protected pointer
+    __atomic_store_n(&this_cpu()->rcu_idle, 0, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void synchronize_rcu() {
+    u32 target = __atomic_add_fetch(&g_rcu_gp, 1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&this_cpu()->rcu_qs_gp, target, __ATOMIC_SEQ_CST);
+
+    while (!gp_completed(target)) cpu_pause();
+    run_ready_callbacks();
+}
+
+void call_rcu(RcuHead* head, void (*func)(RcuHead* head)) {
+    head->func = func;
+    head->next = nullptr;
+    head->gp = __atomic_add_fetch(&g_rcu_gp, 1, __ATOMIC_SEQ_CST);
+
+    u32 flags = g_callback_lock.lock_irqsave();
+    if (callback_tail) {
+        callback_tail->next = head;
+    } else {
+        callback_head = head;
+    }
+    callback_tail = head;
+    g_callback_lock.unlock_irqrestore(flags);
+}
+
+u32 rcu_completed_callbacks() {
+    return completed_callbacks;
+}
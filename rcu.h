@@ -0,0 +1,44 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include "memory.h"
+#include "smp.h"
+
+// Read-copy-update for read-mostly kernel data.
+//
+// Readers bracket lookups with rcu_read_lock/unlock and never block or
+// halt inside. Writers publish a new version with rcu_assign_pointer and
+// free the old one with call_rcu (or wait with synchronize_rcu). A CPU
+// passes through a quiescent state at the points that can't be inside a
+// read section: the idle loop, the UI's keyboard poll and task switches.
+
+struct RcuHead {
+    RcuHead* next;
+    void (*func)(RcuHead* head);
+    u32 gp;  // grace period that must complete before func runs
+};
+
+static inline void rcu_read_lock() {
+    this_cpu()->rcu_nesting++;
+    asm volatile ("" ::: "memory");
+}
+
+static inline void rcu_read_unlock() {
+    asm volatile ("" ::: "memory");
+    this_cpu()->rcu_nesting--;
+}
+
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_CONSUME)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+void rcu_quiescent_state();
+void rcu_enter_idle();
+void rcu_exit_idle();
+
+void synchronize_rcu();
+void call_rcu(RcuHead* head, void (*func)(RcuHead* head));
+
+// Statistics for diagnostics
+u32 rcu_completed_callbacks();
+
+#endif
@@ -0,0 +1,573 @@
+#include "script.h"
+#include "fs_ramdisk.h"
+
+// ---- bytecode ----
+
+enum ScriptOpcode : u8 {
+    OP_COMMAND,      // dispatch text[dest], expanding variable references
+    OP_SET,          // var[dest] = a
+    OP_ARITH,        // var[dest] = a <kind> b
+    OP_JUMP,         // goto dest
+    OP_JUMP_UNLESS,  // if !(a <kind> b) goto dest
+};
+
+enum ArithOp : u8 { ARITH_ADD, ARITH_SUB, ARITH_MUL, ARITH_DIV, ARITH_MOD };
+enum CompareOp : u8 { CMP_EQ, CMP_NE, CMP_LT, CMP_GT, CMP_LE, CMP_GE };
+
+// Operands are a variable slot (top bit set) or a constant
+#define OPERAND_VAR 0x8000
+
+// In command text a variable reference is this byte followed by slot + 1
+#define TEXT_VAR_MARK 0x01
+
+struct ScriptInsn {
+    u8 op;
+    u8 kind;   // ArithOp or CompareOp
+    u16 dest;  // variable slot, jump target or command text offset
+    u16 a, b;
+    u16 line;  // for error messages
+};
+
+struct ScriptConst {
+    u16 text;  // offset into the string pool
+    bool numeric;
+    s32 value;
+};
+
+struct ScriptVar {
+    char name[SCRIPT_NAME_LEN];  // empty for repeat counters
+    char value[SCRIPT_VALUE_LEN];
+    bool assigned;
+};
+
+enum BlockKind : u8 { BLOCK_IF, BLOCK_ELSE, BLOCK_WHILE, BLOCK_REPEAT };
+
+struct Block {
+    BlockKind kind;
+    u16 jump;     // instruction to patch with the exit target
+    u16 start;    // loop head
+    u16 counter;  // repeat counter slot
+    u16 line;
+};
+
+struct Script {
+    ScriptInsn insns[SCRIPT_MAX_INSNS];
+    u32 insn_count;
+    ScriptConst consts[SCRIPT_MAX_CONSTS];
+    u32 const_count;
+    char pool[SCRIPT_MAX_SIZE + SCRIPT_MAX_INSNS];  // command text and constants
+    u32 pool_used;
+    ScriptVar vars[SCRIPT_MAX_VARS];
+    u32 var_count;
+
+    // Compiler state
+    Block blocks[SCRIPT_MAX_DEPTH];
+    u32 depth;
+    u32 line;
+    const char* error;
+};
+
+static bool script_active = false;
+
+static int streq(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static bool is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool parse_number(const char* text, s32* value) {
+    bool negative = *text == '-';
+    if (negative) text++;
+    if (!*text) return false;
+    u32 limit = negative ? 0x80000000u : 0x7FFFFFFFu;  // the s32 range
+    u32 v = 0;
+    for (; *text; text++) {
+        if (*text < '0' || *text > '9') return false;
+        u32 digit = *text - '0';
+        if (v > (limit - digit) / 10) return false;
+        v = v * 10 + digit;
+    }
+    *value = negative ? (s32)(0u - v) : (s32)v;
+    return true;
+}
+
+static void copy_value(char* dst, const char* src) {
+    u32 i = 0;
+    while (src[i] && i < SCRIPT_VALUE_LEN - 1) {
+        dst[i] = src[i];
+        i++;
+    }
+    dst[i] = 0;
+}
+
+// ---- compiler ----
+
+static bool fail(Script* s, const char* error) {
+    if (!s->error) s->error = error;
+    return false;
+}
+
+static ScriptInsn* emit(Script* s, u8 op) {
+    if (s->insn_count == SCRIPT_MAX_INSNS) {
+        fail(s, "SCRIPT TOO LONG");
+        return nullptr;
+    }
+    ScriptInsn* insn = &s->insns[s->insn_count++];
+    insn->op = op;
+    insn->kind = 0;
+    insn->dest = insn->a = insn->b = 0;
+    insn->line = (u16)s->line;
+    return insn;
+}
+
+static u32 pool_add(Script* s, const char* text, u32 len) {
+    if (s->pool_used + len + 1 > sizeof(s->pool)) {
+        fail(s, "SCRIPT TOO LONG");
+        return 0;
+    }
+    u32 offset = s->pool_used;
+    for (u32 i = 0; i < len; i++) s->pool[s->pool_used++] = text[i];
+    s->pool[s->pool_used++] = 0;
+    return offset;
+}
+
+// Slot of a named variable, created on first use
+static int var_slot(Script* s, const char* name, u32 len) {
+    if (len == 0 || len >= SCRIPT_NAME_LEN) return fail(s, "BAD VARIABLE NAME"), -1;
+    for (u32 i = 0; i < len; i++) {
+        if (!is_name_char(name[i])) return fail(s, "BAD VARIABLE NAME"), -1;
+    }
+    for (u32 i = 0; i < s->var_count; i++) {
+        const char* n = s->vars[i].name;
+        u32 j = 0;
+        while (j < len && n[j] == name[j]) j++;
+        if (j == len && n[j] == 0) return (int)i;
+    }
+    if (s->var_count == SCRIPT_MAX_VARS) return fail(s, "TOO MANY VARIABLES"), -1;
+
+    ScriptVar* v = &s->vars[s->var_count];
+    for (u32 j = 0; j < len; j++) v->name[j] = name[j];
+    v->name[len] = 0;
+    v->assigned = false;
+    return (int)s->var_count++;
+}
+
+static int hidden_slot(Script* s) {
+    if (s->var_count == SCRIPT_MAX_VARS) return fail(s, "TOO MANY VARIABLES"), -1;
+    s->vars[s->var_count].name[0] = 0;
+    s->vars[s->var_count].assigned = false;
+    return (int)s->var_count++;
+}
+
+static int constant(Script* s, const char* text) {
+    if (s->const_count == SCRIPT_MAX_CONSTS) return fail(s, "TOO MANY CONSTANTS"), -1;
+    ScriptConst* c = &s->consts[s->const_count];
+    c->text = (u16)pool_add(s, text, strlen(text));
+    if (s->error) return -1;
+    c->numeric = parse_number(text, &c->value);
+    return (int)s->const_count++;
+}
+
+// "$name" or a literal word
+static bool operand(Script* s, const char* token, u16* out) {
+    int index;
+    if (token[0] == '$') {
+        index = var_slot(s, token + 1, strlen(token + 1));
+        if (index < 0) return false;
+        *out = (u16)(OPERAND_VAR | index);
+        return true;
+    }
+    index = constant(s, token);
+    if (index < 0) return false;
+    *out = (u16)index;
+    return true;
+}
+
+static int find_op(const char* token, const char* const* table, u32 count) {
+    for (u32 i = 0; i < count; i++) {
+        if (streq(token, table[i])) return (int)i;
+    }
+    return -1;
+}
+
+static const char* const arith_names[] = { "+", "-", "*", "/", "%" };
+static const char* const compare_names[] = { "==", "!=", "<", ">", "<=", ">=" };
+
+// "a cmp b" into a conditional jump whose target is patched later
+static bool emit_condition(Script* s, char** tok, u32 count) {
+    if (count != 4) return fail(s, "USAGE: a cmp b");
+    int cmp = find_op(tok[2], compare_names, 6);
+    if (cmp < 0) return fail(s, "UNKNOWN COMPARISON");
+    u16 a, b;
+    if (!operand(s, tok[1], &a) || !operand(s, tok[3], &b)) return false;
+    ScriptInsn* insn = emit(s, OP_JUMP_UNLESS);
+    if (!insn) return false;
+    insn->kind = (u8)cmp;
+    insn->a = a;
+    insn->b = b;
+    return true;
+}
+
+static Block* push_block(Script* s, BlockKind kind) {
+    if (s->depth == SCRIPT_MAX_DEPTH) {
+        fail(s, "BLOCKS NESTED TOO DEEP");
+        return nullptr;
+    }
+    Block* block = &s->blocks[s->depth++];
+    block->kind = kind;
+    block->start = (u16)s->insn_count;
+    block->line = (u16)s->line;
+    return block;
+}
+
+static bool compile_command(Script* s, const char* line, u32 len) {
+    // Resolve $name references now so running the loop body is just copying
+    char text[SCRIPT_LINE_LEN * 2];
+    u32 n = 0;
+    for (u32 i = 0; i < len; i++) {
+        if (line[i] == TEXT_VAR_MARK) return fail(s, "BAD CHARACTER");
+        if (line[i] == '$' && i + 1 < len && is_name_char(line[i + 1])) {
+            u32 start = ++i;
+            while (i < len && is_name_char(line[i])) i++;
+            int slot = var_slot(s, line + start, i - start);
+            if (slot < 0) return false;
+            text[n++] = TEXT_VAR_MARK;
+            text[n++] = (char)(slot + 1);
+            i--;
+        } else {
+            text[n++] = line[i];
+        }
+    }
+
+    ScriptInsn* insn = emit(s, OP_COMMAND);
+    if (!insn) return false;
+    insn->dest = (u16)pool_add(s, text, n);
+    return !s->error;
+}
+
+static bool compile_line(Script* s, char* line, u32 len) {
+    // Split a copy into words; commands keep the original spacing
+    char words[SCRIPT_LINE_LEN];
+    char* tok[6];
+    u32 count = 0;
+    for (u32 i = 0; i <= len; i++) words[i] = i < len ? line[i] : 0;
+    for (char* p = words; *p && count < 6;) {
+        while (*p == ' ' || *p == '\t') *p++ = 0;
+        if (!*p) break;
+        tok[count++] = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+    }
+    if (count == 0 || tok[0][0] == '#') return true;
+
+    if (streq(tok[0], "set")) {
+        if (count != 3 && count != 5) return fail(s, "USAGE: set name a [op b]");
+        int slot = var_slot(s, tok[1], strlen(tok[1]));
+        if (slot < 0) return false;
+        u16 a, b = 0;
+        int op = 0;
+        if (!operand(s, tok[2], &a)) return false;
+        if (count == 5) {
+            op = find_op(tok[3], arith_names, 5);
+            if (op < 0) return fail(s, "UNKNOWN OPERATOR");
+            if (!operand(s, tok[4], &b)) return false;
+        }
+        ScriptInsn* insn = emit(s, count == 5 ? OP_ARITH : OP_SET);
+        if (!insn) return false;
+        insn->kind = (u8)op;
+        insn->dest = (u16)slot;
+        insn->a = a;
+        insn->b = b;
+        return true;
+    }
+
+    if (streq(tok[0], "if") || streq(tok[0], "while")) {
+        Block* block = push_block(s, tok[0][0] == 'i' ? BLOCK_IF : BLOCK_WHILE);
+        if (!block) return false;
+        block->jump = (u16)s->insn_count;
+        return emit_condition(s, tok, count);
+    }
+
+    if (streq(tok[0], "repeat")) {
+        if (count != 2) return fail(s, "USAGE: repeat n");
+        int counter = hidden_slot(s);
+        u16 times, zero;
+        if (counter < 0 || !operand(s, tok[1], &times)) return false;
+        int zero_index = constant(s, "0");
+        if (zero_index < 0) return false;
+        zero = (u16)zero_index;
+
+        ScriptInsn* init = emit(s, OP_SET);
+        if (!init) return false;
+        init->dest = (u16)counter;
+        init->a = times;
+
+        Block* block = push_block(s, BLOCK_REPEAT);
+        if (!block) return false;
+        block->counter = (u16)counter;
+        block->jump = (u16)s->insn_count;
+        ScriptInsn* test = emit(s, OP_JUMP_UNLESS);
+        if (!test) return false;
+        test->kind = CMP_GT;
+        test->a = (u16)(OPERAND_VAR | counter);
+        test->b = zero;
+        return true;
+    }
+
+    if (streq(tok[0], "else")) {
+        if (count != 1) return fail(s, "USAGE: else");
+        if (s->depth == 0 || s->blocks[s->depth - 1].kind != BLOCK_IF) return fail(s, "ELSE WITHOUT IF");
+        Block* block = &s->blocks[s->depth - 1];
+        ScriptInsn* skip = emit(s, OP_JUMP);
+        if (!skip) return false;
+        s->insns[block->jump].dest = (u16)s->insn_count;
+        block->jump = (u16)(s->insn_count - 1);
+        block->kind = BLOCK_ELSE;
+        return true;
+    }
+
+    if (streq(tok[0], "end")) {
+        if (count != 1) return fail(s, "USAGE: end");
+        if (s->depth == 0) return fail(s, "END WITHOUT BLOCK");
+        Block* block = &s->blocks[--s->depth];
+        if (block->kind == BLOCK_REPEAT) {
+            int one = constant(s, "1");
+            if (one < 0) return false;
+            ScriptInsn* dec = emit(s, OP_ARITH);
+            if (!dec) return false;
+            dec->kind = ARITH_SUB;
+            dec->dest = block->counter;
+            dec->a = (u16)(OPERAND_VAR | block->counter);
+            dec->b = (u16)one;
+        }
+        if (block->kind == BLOCK_WHILE || block->kind == BLOCK_REPEAT) {
+            ScriptInsn* back = emit(s, OP_JUMP);
+            if (!back) return false;
+            back->dest = block->start;
+        }
+        s->insns[block->jump].dest = (u16)s->insn_count;
+        return true;
+    }
+
+    return compile_command(s, line, len);
+}
+
+static bool compile(Script* s, const u8* source, u32 size) {
+    s->line = 0;
+    u32 pos = 0;
+    while (pos < size) {
+        s->line++;
+        u32 start = pos;
+        while (pos < size && source[pos] != '\n') pos++;
+        u32 len = pos - start;
+        if (pos < size) pos++;  // the newline
+        if (len && source[start + len - 1] == '\r') len--;
+        if (len >= SCRIPT_LINE_LEN) return fail(s, "LINE TOO LONG");
+
+        char line[SCRIPT_LINE_LEN];
+        for (u32 i = 0; i < len; i++) line[i] = (char)source[start + i];
+        line[len] = 0;
+        if (!compile_line(s, line, len)) return false;
+    }
+
+    if (s->depth) {
+        s->line = s->blocks[s->depth - 1].line;
+        return fail(s, "BLOCK WITHOUT END");
+    }
+    return true;
+}
+
+// ---- interpreter ----
+
+static const char* operand_text(Script* s, u16 operand) {
+    if (operand & OPERAND_VAR) {
+        ScriptVar* v = &s->vars[operand & ~OPERAND_VAR];
+        if (!v->assigned) {
+            fail(s, "UNSET VARIABLE");
+            return nullptr;
+        }
+        return v->value;
+    }
+    return s->pool + s->consts[operand].text;
+}
+
+static bool operand_number(Script* s, u16 operand, s32* value) {
+    if (!(operand & OPERAND_VAR)) {
+        *value = s->consts[operand].value;
+        return s->consts[operand].numeric;
+    }
+    const char* text = operand_text(s, operand);
+    return text && parse_number(text, value);
+}
+
+static bool evaluate(Script* s, const ScriptInsn* insn, bool* out) {
+    s32 a, b;
+    if (operand_number(s, insn->a, &a) && operand_number(s, insn->b, &b)) {
+        switch (insn->kind) {
+            case CMP_EQ: *out = a == b; break;
+            case CMP_NE: *out = a != b; break;
+            case CMP_LT: *out = a < b; break;
+            case CMP_GT: *out = a > b; break;
+            case CMP_LE: *out = a <= b; break;
+            default:     *out = a >= b; break;
+        }
+        return true;
+    }
+    if (s->error) return false;
+
+    // Not both numbers: only equality makes sense
+    if (insn->kind != CMP_EQ && insn->kind != CMP_NE) return fail(s, "NOT A NUMBER");
+    const char* ta = operand_text(s, insn->a);
+    const char* tb = operand_text(s, insn->b);
+    if (!ta || !tb) return false;
+    *out = streq(ta, tb) == (insn->kind == CMP_EQ);
+    return true;
+}
+
+static bool arithmetic(Script* s, const ScriptInsn* insn) {
+    s32 a, b;
+    if (!operand_number(s, insn->a, &a) || !operand_number(s, insn->b, &b)) {
+        return fail(s, "NOT A NUMBER");
+    }
+    s32 r;
+    bool overflow = false;
+    switch (insn->kind) {
+        case ARITH_ADD: overflow = __builtin_add_overflow(a, b, &r); break;
+        case ARITH_SUB: overflow = __builtin_sub_overflow(a, b, &r); break;
+        case ARITH_MUL: overflow = __builtin_mul_overflow(a, b, &r); break;
+        default:
+            if (b == 0) return fail(s, "DIVISION BY ZERO");
+            // The one quotient out of range, and idiv faults on it
+            if (b == -1 && a == (s32)0x80000000) return fail(s, "NUMBER TOO BIG");
+            r = insn->kind == ARITH_DIV ? a / b : a % b;
+            break;
+    }
+    if (overflow) return fail(s, "NUMBER TOO BIG");
+    ScriptVar* v = &s->vars[insn->dest];
+    itoa(v->value, r, 10);
+    v->assigned = true;
+    return true;
+}
+
+static bool expand(Script* s, const char* text, char* out) {
+    u32 n = 0;
+    while (*text) {
+        const char* piece = text;
+        u32 len = 1;
+        if (*text == TEXT_VAR_MARK) {
+            u32 slot = (u8)text[1] - 1u;
+            if (slot >= s->var_count) return fail(s, "BAD CHARACTER");
+            ScriptVar* v = &s->vars[slot];
+            if (!v->assigned) return fail(s, "UNSET VARIABLE");
+            piece = v->value;
+            len = strlen(piece);
+            text += 2;
+        } else {
+            text++;
+        }
+        if (n + len >= SCRIPT_LINE_LEN) return fail(s, "LINE TOO LONG");
+        for (u32 i = 0; i < len; i++) out[n++] = piece[i];
+    }
+    out[n] = 0;
+    return true;
+}
+
+static bool execute(Script* s, ScriptCommandFn dispatch, void* context, ScriptResult* result) {
+    u32 pc = 0;
+    for (u32 steps = 0; pc < s->insn_count; steps++) {
+        const ScriptInsn* insn = &s->insns[pc++];
+        s->line = insn->line;
+        if (steps == SCRIPT_MAX_STEPS) return fail(s, "STEP LIMIT REACHED");
+
+        switch (insn->op) {
+            case OP_COMMAND: {
+                char line[SCRIPT_LINE_LEN];
+                if (!expand(s, s->pool + insn->dest, line)) return false;
+                result->commands++;
+                dispatch(line, context);
+                break;
+            }
+            case OP_SET: {
+                const char* value = operand_text(s, insn->a);
+                if (!value) return false;
+                copy_value(s->vars[insn->dest].value, value);
+                s->vars[insn->dest].assigned = true;
+                break;
+            }
+            case OP_ARITH:
+                if (!arithmetic(s, insn)) return false;
+                break;
+            case OP_JUMP:
+                pc = insn->dest;
+                break;
+            case OP_JUMP_UNLESS: {
+                bool taken;
+                if (!evaluate(s, insn, &taken)) return false;
+                if (!taken) pc = insn->dest;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool script_run(const char* filename, ScriptCommandFn dispatch, void* context,
+                ScriptResult* result) {
+    result->error = nullptr;
+    result->line = 0;
+    result->commands = 0;
+    result->insns = 0;
+
+    // A script can't run another one: there is a single dispatcher
+    if (script_active) {
+        result->error = "SCRIPT ALREADY RUNNING";
+        return false;
+    }
+
+    u32 size, handle;
+    const u8* source = fs_map_file(filename, &size, &handle);
+    if (!source) {
+        result->error = "SCRIPT NOT FOUND";
+        return false;
+    }
+    if (size > SCRIPT_MAX_SIZE) {
+        fs_unmap_file(handle);
+        result->error = "SCRIPT TOO LARGE";
+        return false;
+    }
+
+    Script* s = (Script*)kmalloc(sizeof(Script));
+    if (!s) {
+        fs_unmap_file(handle);
+        result->error = "OUT OF MEMORY";
+        return false;
+    }
+    s->insn_count = 0;
+    s->const_count = 0;
+    s->pool_used = 0;
+    s->var_count = 0;
+    s->depth = 0;
+    s->error = nullptr;
+
+    // Parsed once; the file is free to change while the script runs
+    bool ok = compile(s, source, size);
+    fs_unmap_file(handle);
+    result->insns = s->insn_count;
+
+    if (ok) {
+        script_active = true;
+        ok = execute(s, dispatch, context, result);
+        script_active = false;
+    }
+    if (!ok) {
+        result->error = s->error;
+        result->line = s->line;
+    }
+    kfree(s);
+    return ok;
+}
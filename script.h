@@ -0,0 +1,43 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "memory.h"
+
+// Batch scripts: `run <file>` compiles a RAM disk file once into a
+// compact bytecode, then executes it. Every line that isn't a keyword
+// goes to the command dispatcher with $name replaced by the variable's
+// value.
+//
+//   # comment
+//   set n 3                 set name a [op b]   op: + - * / %
+//   if $n > 0 ... else ... end                  cmp: == != < > <= >=
+//   while $n > 0 ... end
+//   repeat 5 ... end
+//
+// Values are strings; arithmetic and ordering treat them as signed
+// decimal numbers when both sides are numbers.
+
+#define SCRIPT_MAX_SIZE 4096
+#define SCRIPT_LINE_LEN 100      // same as the command line
+#define SCRIPT_MAX_INSNS 256
+#define SCRIPT_MAX_CONSTS 128
+#define SCRIPT_MAX_VARS 16
+#define SCRIPT_NAME_LEN 16
+#define SCRIPT_VALUE_LEN 24
+#define SCRIPT_MAX_DEPTH 8
+#define SCRIPT_MAX_STEPS 1000000  // stops runaway loops
+
+// Called for each command line, already expanded
+typedef void (*ScriptCommandFn)(const char* line, void* context);
+
+struct ScriptResult {
+    const char* error;  // nullptr on success
+    u32 line;           // source line of the error
+    u32 commands;       // commands dispatched
+    u32 insns;          // size of the compiled program
+};
+
+bool script_run(const char* filename, ScriptCommandFn dispatch, void* context,
+                ScriptResult* result);
+
+#endif
@@ -0,0 +1,195 @@
+#include "serial.h"
+#include "io.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "spinlock.h"
+
+// Register offsets from COM1_PORT
+#define UART_DATA 0         // DLAB=0: RX/TX; DLAB=1: divisor low
+#define UART_IER  1         // DLAB=1: divisor high
+#define UART_IIR  2         // read
+#define UART_FCR  2         // write
+#define UART_LCR  3
+#define UART_MCR  4
+#define UART_LSR  5
+#define UART_MSR  6
+
+#define IER_RX 0x01         // received data / timeout
+#define IER_TX 0x02         // transmit holding register empty
+#define IER_LINE 0x04       // overrun and other line errors
+
+#define IIR_NONE      0x01
+#define IIR_ID_MASK   0x0E
+#define IIR_MODEM     0x00
+#define IIR_TX_EMPTY  0x02
+#define IIR_RX_DATA   0x04
+#define IIR_LINE      0x06
+#define IIR_RX_TIMEOUT 0x0C
+
+#define LSR_DATA_READY 0x01
+#define LSR_OVERRUN    0x02
+#define LSR_THR_EMPTY  0x20  // with the FIFO on: the whole TX FIFO is empty
+#define LSR_TX_IDLE    0x40  // ... and the shift register too
+
+#define UART_FIFO_SIZE 16
+#define SERIAL_RX_BURST 64
+
+static bool g_present = false;
+
+// TX ring: writers advance head, the interrupt (or a polling writer)
+// advances tail. Both under g_serial_lock.
+static u8 g_tx[SERIAL_TX_BUFFER];
+static u32 g_tx_head = 0;
+static u32 g_tx_tail = 0;
+static u8 g_ier = 0;
+static Spinlock g_serial_lock;
+
+static SerialReceiveFn g_receiver = nullptr;
+static SerialStats g_stats;
+
+// Top up an empty TX FIFO from the ring, and keep the THR-empty interrupt
+// on exactly while the ring has bytes left. Caller holds g_serial_lock.
+static void tx_fill() {
+    if (inb(COM1_PORT + UART_LSR) & LSR_THR_EMPTY) {
+        for (u32 i = 0; i < UART_FIFO_SIZE && g_tx_tail != g_tx_head; i++) {
+            outb(COM1_PORT + UART_DATA, g_tx[g_tx_tail & (SERIAL_TX_BUFFER - 1)]);
+            g_tx_tail++;
+            g_stats.tx_bytes++;
+        }
+    }
+    u8 ier = IER_RX | IER_LINE | (g_tx_tail != g_tx_head ? IER_TX : 0);
+    if (ier != g_ier) {
+        outb(COM1_PORT + UART_IER, ier);
+        g_ier = ier;
+    }
+}
+
+static u32 rx_drain(u8* out, u32 len, u32 max) {
+    u8 lsr;
+    while (len < max && ((lsr = inb(COM1_PORT + UART_LSR)) & LSR_DATA_READY)) {
+        if (lsr & LSR_OVERRUN) g_stats.rx_overruns++;
+        out[len++] = inb(COM1_PORT + UART_DATA);
+        g_stats.rx_bytes++;
+    }
+    return len;
+}
+
+static void serial_interrupt(InterruptFrame* frame) {
+    (void)frame;
+    u8 rx[SERIAL_RX_BURST];
+    u32 rx_len = 0;
+
+    g_serial_lock.lock();
+    for (u32 rounds = 0; rounds < 16; rounds++) {
+        u8 iir = inb(COM1_PORT + UART_IIR);
+        if (iir & IIR_NONE) break;
+        switch (iir & IIR_ID_MASK) {
+        case IIR_RX_DATA:
+        case IIR_RX_TIMEOUT:
+        case IIR_LINE:
+            rx_len = rx_drain(rx, rx_len, sizeof(rx));
+            if (rx_len == sizeof(rx)) goto done;  // the rest raises another IRQ
+            break;
+        case IIR_TX_EMPTY:
+            tx_fill();
+            break;
+        default:
+            inb(COM1_PORT + UART_MSR);
+            break;
+        }
+    }
+done:
+    g_serial_lock.unlock();
+
+    // Outside the lock: the receiver may well write an echo
+    if (rx_len && g_receiver) g_receiver(rx, rx_len);
+}
+
+bool serial_initialize() {
+    u16 divisor = 115200 / SERIAL_BAUD;
+
+    outb(COM1_PORT + UART_IER, 0x00);         // no interrupts
+    outb(COM1_PORT + UART_LCR, 0x80);         // DLAB on
+    outb(COM1_PORT + UART_DATA, divisor & 0xFF);
+    outb(COM1_PORT + UART_IER, divisor >> 8);
+    outb(COM1_PORT + UART_LCR, 0x03);         // 8N1, DLAB off
+    outb(COM1_PORT + UART_FCR, 0xC7);         // FIFO on, cleared, 14-byte threshold
+
+    // Loopback: a byte sent must come straight back, or there is no UART
+    outb(COM1_PORT + UART_MCR, 0x1E);
+    outb(COM1_PORT + UART_DATA, 0xAE);
+    g_present = inb(COM1_PORT + UART_DATA) == 0xAE;
+
+    outb(COM1_PORT + UART_MCR, 0x0F);         // normal mode, DTR/RTS/OUT1/OUT2 (IRQ line)
+    if (!g_present) return false;
+
+    g_serial_lock.initialize("serial");
+    inb(COM1_PORT + UART_LSR);                // clear anything left pending
+    inb(COM1_PORT + UART_MSR);
+    inb(COM1_PORT + UART_IIR);
+    u32 flags = g_serial_lock.lock_irqsave();
+    tx_fill();                                // RX interrupts on
+    g_serial_lock.unlock_irqrestore(flags);
+
+    register_interrupt_handler(IRQ_BASE + COM1_IRQ, serial_interrupt);
+    pic_unmask_irq(COM1_IRQ);
+    return true;
+}
+
+bool serial_present() {
+    return g_present;
+}
+
+void serial_write(const char* data, u32 len) {
+    if (!g_present) return;
+    bool waited = false;
+    while (len) {
+        u32 flags = g_serial_lock.lock_irqsave();
+        u32 space = SERIAL_TX_BUFFER - (g_tx_head - g_tx_tail);
+        u32 n = len < space ? len : space;
+        for (u32 i = 0; i < n; i++) g_tx[(g_tx_head + i) & (SERIAL_TX_BUFFER - 1)] = data[i];
+        g_tx_head += n;
+
+        if (n < len) {
+            if (!waited) g_stats.tx_waits++;
+            waited = true;
+            // Nobody can take the interrupt for us: wait for the FIFO here
+            if (!(flags & EFLAGS_IF)) {
+                while (!(inb(COM1_PORT + UART_LSR) & LSR_THR_EMPTY)) cpu_pause();
+            }
+        }
+        tx_fill();
+        g_serial_lock.unlock_irqrestore(flags);
+
+        data += n;
+        len -= n;
+        if (len && (flags & EFLAGS_IF)) cpu_pause();  // the interrupt drains the ring
+    }
+}
+
+void serial_print(const char* text) {
+    serial_write(text, strlen(text));
+}
+
+// Polls with interrupts off, so it works wherever the caller is about to
+// stop the machine
+void serial_flush() {
+    if (!g_present) return;
+    u32 flags = g_serial_lock.lock_irqsave();
+    while (g_tx_tail != g_tx_head) {
+        while (!(inb(COM1_PORT + UART_LSR) & LSR_THR_EMPTY)) cpu_pause();
+        tx_fill();
+    }
+    while (!(inb(COM1_PORT + UART_LSR) & LSR_TX_IDLE)) cpu_pause();
+    g_serial_lock.unlock_irqrestore(flags);
+}
+
+void serial_set_receiver(SerialReceiveFn fn) {
+    g_receiver = fn;
+}
+
+void serial_get_stats(SerialStats* out) {
+    u32 flags = g_serial_lock.lock_irqsave();
+    *out = g_stats;
+    g_serial_lock.unlock_irqrestore(flags);
+}
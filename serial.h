@@ -0,0 +1,34 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "memory.h"
+
+// 16550 UART on COM1, 115200 8N1 with the FIFO on. Writers copy into a
+// TX ring and return; the THR-empty interrupt (IRQ 4) refills the FIFO
+// 16 bytes at a time. Writers only wait when the ring is full. With
+// interrupts off they push the bytes out by polling. Received bytes are
+// handed to the receiver in bursts from the same interrupt.
+#define COM1_PORT 0x3F8
+#define COM1_IRQ 4
+#define SERIAL_BAUD 115200
+#define SERIAL_TX_BUFFER 8192  // power of two
+
+// Runs in interrupt context with everything the RX FIFO held
+typedef void (*SerialReceiveFn)(const u8* data, u32 len);
+
+struct SerialStats {
+    u32 tx_bytes;
+    u32 rx_bytes;
+    u32 tx_waits;     // writes that found the ring full
+    u32 rx_overruns;  // bytes the UART lost before we read them
+};
+
+bool serial_initialize();  // false when no UART answers the loopback test
+bool serial_present();
+void serial_write(const char* data, u32 len);
+void serial_print(const char* text);
+void serial_flush();  // wait until everything queued has left the UART
+void serial_set_receiver(SerialReceiveFn fn);
+void serial_get_stats(SerialStats* out);
+
+#endif
@@ -0,0 +1,373 @@
+#include "smp.h"
+#include "apic.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "paging.h"
+#include "task_pool.h"
+#include "timer.h"
+#include "klog.h"
+#include "fpu.h"
+
+// Real-mode startup code and its parameter block (ap_trampoline.asm)
+extern "C" u8 ap_trampoline_start[];
+extern "C" u8 ap_trampoline_end[];
+extern "C" u32 ap_trampoline_stack;
+extern "C" u32 ap_trampoline_cpu;
+extern "C" u32 ap_trampoline_entry;
+
+struct GdtDescriptor {
+    u16 limit;
+    u32 base;
+} __attribute__((packed));
+
+// ACPI structures
+struct AcpiRsdp {
+    char signature[8];
+    u8 checksum;
+    char oem_id[6];
+    u8 revision;
+    u32 rsdt_address;
+} __attribute__((packed));
+
+struct AcpiSdtHeader {
+    char signature[4];
+    u32 length;
+    u8 revision;
+    u8 checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    u32 oem_revision;
+    u32 creator_id;
+    u32 creator_revision;
+} __attribute__((packed));
+
+struct AcpiMadt {
+    AcpiSdtHeader header;
+    u32 lapic_address;
+    u32 flags;
+} __attribute__((packed));
+
+#define MADT_TYPE_LAPIC 0
+#define MADT_LAPIC_ENABLED 1
+
+// Intel MultiProcessor specification structures (fallback)
+struct MpFloatingPointer {
+    char signature[4];
+    u32 config_table;
+    u8 length;
+    u8 revision;
+    u8 checksum;
+    u8 features[5];
+} __attribute__((packed));
+
+struct MpConfigHeader {
+    char signature[4];
+    u16 length;
+    u8 revision;
+    u8 checksum;
+    char oem_id[8];
+    char product_id[12];
+    u32 oem_table;
+    u16 oem_table_size;
+    u16 entry_count;
+    u32 lapic_address;
+    u16 ext_length;
+    u8 ext_checksum;
+    u8 reserved;
+} __attribute__((packed));
+
+#define MP_ENTRY_PROCESSOR 0
+#define MP_CPU_ENABLED 1
+
+static Cpu g_cpus[MAX_CPUS];
+static u32 g_cpu_count = 1;
+static bool g_percpu_ready = false;  // %gs points at a Cpu
+static u32 discovered_apic_ids[MAX_CPUS];
+static u32 discovered_count = 0;
+
+static bool signature_matches(const char* a, const char* b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+static bool checksum_ok(const void* table, u32 length) {
+    const u8* p = (const u8*)table;
+    u8 sum = 0;
+    for (u32 i = 0; i < length; i++) sum += p[i];
+    return sum == 0;
+}
+
+// Scan a physical range on 16-byte boundaries for a table signature
+static const void* scan_for(const char* sig, int sig_len, u32 start, u32 length) {
+    for (u32 addr = start; addr < start + length; addr += 16) {
+        if (signature_matches((const char*)addr, sig, sig_len)) return (const void*)addr;
+    }
+    return nullptr;
+}
+
+static const void* find_in_bios_areas(const char* sig, int sig_len) {
+    // EBDA segment lives in the BIOS data area; launder the low address so
+    // the compiler doesn't treat it as a null-pointer dereference
+    volatile u16* bda_ebda = (volatile u16*)0x40E;
+    asm ("" : "+r"(bda_ebda));
+    u32 ebda = (u32)(*bda_ebda) << 4;
+    const void* found = nullptr;
+    if (ebda) found = scan_for(sig, sig_len, ebda, 1024);
+    if (!found) found = scan_for(sig, sig_len, 0x9FC00, 1024);
+    if (!found) found = scan_for(sig, sig_len, 0xE0000, 0x20000);
+    return found;
+}
+
+static void add_discovered_cpu(u32 apic) {
+    if (discovered_count < MAX_CPUS) discovered_apic_ids[discovered_count++] = apic;
+}
+
+static bool parse_acpi_madt() {
+    const AcpiRsdp* rsdp = (const AcpiRsdp*)find_in_bios_areas("RSD PTR ", 8);
+    if (!rsdp || !checksum_ok(rsdp, 20)) return false;
+
+    const AcpiSdtHeader* rsdt = (const AcpiSdtHeader*)rsdp->rsdt_address;
+    if (!signature_matches(rsdt->signature, "RSDT", 4) || !checksum_ok(rsdt, rsdt->length)) return false;
+
+    u32 entries = (rsdt->length - sizeof(AcpiSdtHeader)) / 4;
+    const u32* tables = (const u32*)(rsdt + 1);
+    for (u32 i = 0; i < entries; i++) {
+        const AcpiMadt* madt = (const AcpiMadt*)tables[i];
+        if (!signature_matches(madt->header.signature, "APIC", 4)) continue;
+        if (!checksum_ok(madt, madt->header.length)) return false;
+
+        apic_set_base(madt->lapic_address);
+        const u8* p = (const u8*)(madt + 1);
+        const u8* end = (const u8*)madt + madt->header.length;
+        while (p + 2 <= end && p[1] >= 2) {
+            // Processor Local APIC: type, length, ACPI id, APIC id, flags
+            if (p[0] == MADT_TYPE_LAPIC && (*(const u32*)(p + 4) & MADT_LAPIC_ENABLED)) {
+                add_discovered_cpu(p[3]);
+            }
+            p += p[1];
+        }
+        return discovered_count > 0;
+    }
+    return false;
+}
+
+static bool parse_mp_tables() {
+    const MpFloatingPointer* fp = (const MpFloatingPointer*)find_in_bios_areas("_MP_", 4);
+    if (!fp || !checksum_ok(fp, fp->length * 16) || fp->config_table == 0) return false;
+
+    const MpConfigHeader* cfg = (const MpConfigHeader*)fp->config_table;
+    if (!signature_matches(cfg->signature, "PCMP", 4) || !checksum_ok(cfg, cfg->length)) return false;
+
+    apic_set_base(cfg->lapic_address);
+    const u8* p = (const u8*)(cfg + 1);
+    for (u32 i = 0; i < cfg->entry_count; i++) {
+        if (p[0] == MP_ENTRY_PROCESSOR) {
+            // Processor entry: type, APIC id, version, flags (20 bytes)
+            if (p[3] & MP_CPU_ENABLED) add_discovered_cpu(p[1]);
+            p += 20;
+        } else {
+            p += 8;
+        }
+    }
+    return discovered_count > 0;
+}
+
+static void gdt_set(GdtEntry* e, u32 base, u32 limit, u8 access, u8 flags) {
+    e->limit_low = limit & 0xFFFF;
+    e->base_low = base & 0xFFFF;
+    e->base_mid = (base >> 16) & 0xFF;
+    e->access = access;
+    e->flags_limit_high = ((limit >> 16) & 0x0F) | (flags << 4);
+    e->base_high = (base >> 24) & 0xFF;
+}
+
+// Build the CPU's private GDT and switch to it; %gs then addresses the Cpu
+static void cpu_load_gdt(Cpu* cpu) {
+    gdt_set(&cpu->gdt[0], 0, 0, 0, 0);
+    gdt_set(&cpu->gdt[GDT_KERNEL_CODE], 0, 0xFFFFF, 0x9A, 0xC);
+    gdt_set(&cpu->gdt[GDT_KERNEL_DATA], 0, 0xFFFFF, 0x92, 0xC);
+    gdt_set(&cpu->gdt[GDT_USER_CODE], 0, 0xFFFFF, 0xFA, 0xC);
+    gdt_set(&cpu->gdt[GDT_USER_DATA], 0, 0xFFFFF, 0xF2, 0xC);
+    gdt_set(&cpu->gdt[GDT_TSS], (u32)&cpu->tss, sizeof(Tss) - 1, 0x89, 0x0);
+    gdt_set(&cpu->gdt[GDT_PERCPU], (u32)cpu, sizeof(Cpu) - 1, 0x92, 0x4);
+
+    cpu->tss.ss0 = GDT_KERNEL_DATA * 8;
+    cpu->tss.iomap_base = sizeof(Tss);
+
+    GdtDescriptor desc;
+    desc.limit = sizeof(cpu->gdt) - 1;
+    desc.base = (u32)cpu->gdt;
+    asm volatile (
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n\t"
+        "1:\n\t"
+        "movw %w2, %%ds\n\t"
+        "movw %w2, %%es\n\t"
+        "movw %w2, %%fs\n\t"
+        "movw %w2, %%ss\n\t"
+        "movw %w3, %%gs\n\t"
+        "ltr %w4\n\t"
+        :
+        : "m"(desc), "i"(GDT_KERNEL_CODE * 8), "r"(GDT_KERNEL_DATA * 8), "r"(GDT_PERCPU * 8),
+          "r"(GDT_TSS * 8)
+        : "memory");
+}
+
+static void ipi_call_interrupt(InterruptFrame* frame) {
+    (void)frame;
+    Cpu* cpu = this_cpu();
+    cpu->ipis_received++;
+    CpuCallFn fn = cpu->call_fn;
+    if (fn) {
+        cpu->call_fn = nullptr;
+        fn(cpu->call_arg);
+        __atomic_store_n(&cpu->call_done, 1, __ATOMIC_RELEASE);
+    }
+}
+
+void smp_early_initialize() {
+    Cpu* bsp = &g_cpus[0];
+    bsp->self = bsp;
+    bsp->index = 0;
+    bsp->online = 1;
+    cpu_load_gdt(bsp);
+    g_percpu_ready = true;
+}
+
+// First C++ code on an application processor (called from the trampoline)
+extern "C" void ap_main(u32 index) {
+    Cpu* cpu = &g_cpus[index];
+    cpu_load_gdt(cpu);
+    paging_enable();
+    idt_load();
+    fpu_initialize();
+    apic_initialize(false);
+    apic_timer_start();
+
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_RELEASE);
+    cpu_idle_loop();
+}
+
+void cpu_idle_loop() {
+    while (true) {
+        if (!task_pool_run_one()) task_pool_wait_for_work();
+    }
+}
+
+static bool start_ap(u32 index) {
+    Cpu* cpu = &g_cpus[index];
+    cpu->stack = (u8*)kmalloc(AP_STACK_SIZE);
+    if (!cpu->stack) return false;
+
+    // Fill in the trampoline's parameter block for this AP
+    u32 base = (u32)ap_trampoline_start;
+    *(volatile u32*)(AP_TRAMPOLINE_ADDR + ((u32)&ap_trampoline_stack - base)) = (u32)(cpu->stack + AP_STACK_SIZE);
+    *(volatile u32*)(AP_TRAMPOLINE_ADDR + ((u32)&ap_trampoline_cpu - base)) = index;
+    *(volatile u32*)(AP_TRAMPOLINE_ADDR + ((u32)&ap_trampoline_entry - base)) = (u32)ap_main;
+
+    // INIT-SIPI-SIPI (Intel SDM vol. 3, 8.4.4.1)
+    apic_send_init(cpu->apic_id);
+    mdelay(10);
+    for (int attempt = 0; attempt < 2 && !cpu->online; attempt++) {
+        apic_send_startup(cpu->apic_id, AP_TRAMPOLINE_ADDR >> 12);
+        udelay(200);
+    }
+
+    for (int waited = 0; waited < 100 && !__atomic_load_n(&cpu->online, __ATOMIC_ACQUIRE); waited++) {
+        mdelay(1);
+    }
+    if (!cpu->online) {
+        // Park it in wait-for-SIPI so it can't come up late on this slot
+        // once the next AP takes it. The stack stays allocated: the AP
+        // may have been running on it when the INIT landed.
+        apic_send_init(cpu->apic_id);
+        return false;
+    }
+    return true;
+}
+
+void smp_initialize() {
+    Cpu* bsp = &g_cpus[0];
+
+    if (!apic_available()) return;  // stay on the legacy single-CPU path
+
+    if (!parse_acpi_madt()) {
+        discovered_count = 0;
+        parse_mp_tables();
+    }
+
+    apic_initialize(true);
+    register_interrupt_handler(VECTOR_IPI_CALL, ipi_call_interrupt);
+    bsp->apic_id = apic_id();
+    apic_timer_start();
+
+    // Copy the real-mode trampoline below 1MB
+    u32 size = (u32)(ap_trampoline_end - ap_trampoline_start);
+    u8* dst = (u8*)AP_TRAMPOLINE_ADDR;
+    for (u32 i = 0; i < size; i++) dst[i] = ap_trampoline_start[i];
+
+    // Start APs one at a time; they share the trampoline parameter block
+    for (u32 i = 0; i < discovered_count && g_cpu_count < MAX_CPUS; i++) {
+        if (discovered_apic_ids[i] == bsp->apic_id) continue;
+
+        Cpu* cpu = &g_cpus[g_cpu_count];
+        cpu->self = cpu;
+        cpu->index = g_cpu_count;
+        cpu->apic_id = discovered_apic_ids[i];
+        cpu->online = 0;
+        if (start_ap(g_cpu_count)) {
+            g_cpu_count++;
+        } else {
+            klog_value(KLOG_WARN, "smp: AP did not start, APIC id", cpu->apic_id);
+        }
+    }
+}
+
+bool cpu_percpu_ready() {
+    return g_percpu_ready;
+}
+
+u32 cpu_count() {
+    return g_cpu_count;
+}
+
+u32 cpu_online_count() {
+    u32 online = 0;
+    for (u32 i = 0; i < g_cpu_count; i++) {
+        if (g_cpus[i].online) online++;
+    }
+    return online;
+}
+
+Cpu* get_cpu(u32 index) {
+    return index < g_cpu_count ? &g_cpus[index] : nullptr;
+}
+
+void smp_wakeup_cpu(u32 index) {
+    if (index < g_cpu_count && index != this_cpu()->index) {
+        apic_send_ipi(g_cpus[index].apic_id, VECTOR_IPI_WAKEUP);
+    }
+}
+
+// Run fn(arg) on another CPU from its IPI handler and wait for it to finish
+bool smp_call_on_cpu(u32 index, CpuCallFn fn, void* arg) {
+    if (index >= g_cpu_count || !g_cpus[index].online) return false;
+    if (index == this_cpu()->index) {
+        fn(arg);
+        return true;
+    }
+
+    Cpu* target = &g_cpus[index];
+    while (__atomic_exchange_n(&target->call_busy, 1, __ATOMIC_ACQUIRE)) cpu_pause();
+
+    target->call_arg = arg;
+    target->call_done = 0;
+    __atomic_store_n(&target->call_fn, fn, __ATOMIC_RELEASE);
+    apic_send_ipi(target->apic_id, VECTOR_IPI_CALL);
+    while (!__atomic_load_n(&target->call_done, __ATOMIC_ACQUIRE)) cpu_pause();
+
+    __atomic_store_n(&target->call_busy, 0, __ATOMIC_RELEASE);
+    return true;
+}
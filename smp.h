@@ -0,0 +1,106 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include "memory.h"
+
+#define MAX_CPUS 8
+#define AP_STACK_SIZE 16384
+#define AP_TRAMPOLINE_ADDR 0x8000  // must be page aligned and below 1MB
+
+// Per-CPU GDT layout (selector = index * 8). sysenter/sysexit derive the
+// kernel stack and user segments from GDT_KERNEL_CODE, so the user
+// code/data pair must follow the kernel pair in this order.
+#define GDT_KERNEL_CODE 1
+#define GDT_KERNEL_DATA 2
+#define GDT_USER_CODE   3
+#define GDT_USER_DATA   4
+#define GDT_TSS         5
+#define GDT_PERCPU      6  // %gs base points at the owning Cpu
+#define GDT_ENTRIES     7
+
+struct GdtEntry {
+    u16 limit_low;
+    u16 base_low;
+    u8 base_mid;
+    u8 access;
+    u8 flags_limit_high;
+    u8 base_high;
+} __attribute__((packed));
+
+// 32-bit task state segment; only esp0/ss0 are used, to find the
+// kernel stack on a ring 3 -> ring 0 transition
+struct Tss {
+    u32 prev_task;
+    u32 esp0, ss0;
+    u32 esp1, ss1;
+    u32 esp2, ss2;
+    u32 cr3, eip, eflags;
+    u32 eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    u32 es, cs, ss, ds, fs, gs;
+    u32 ldt;
+    u16 trap;
+    u16 iomap_base;  // past the limit: no I/O permission bitmap
+} __attribute__((packed));
+
+typedef void (*CpuCallFn)(void* arg);
+
+struct Process;
+
+// Per-CPU state; each CPU reaches its own copy through %gs
+struct Cpu {
+    Cpu* self;                  // must stay first: this_cpu() reads %gs:0
+    u32 index;
+    u32 apic_id;
+    volatile u32 online;
+    volatile u64 ticks;
+    volatile u32 ipis_received;
+
+    // Cross-CPU function call mailbox (see smp_call_on_cpu)
+    volatile u32 call_busy;
+    CpuCallFn volatile call_fn;
+    void* volatile call_arg;
+    volatile u32 call_done;
+
+    // RCU bookkeeping (rcu.cpp)
+    volatile u32 rcu_qs_gp;     // last grace period this CPU has passed through
+    volatile u32 rcu_idle;      // halted: counts as quiescent without reporting
+    u32 rcu_nesting;            // read-side critical section depth
+    Process* fpu_owner;         // whose FPU state is in the registers (fpu.cpp)
+
+    u8* stack;
+    Tss tss;                    // MSR_SYSENTER_ESP points at tss.esp0
+    GdtEntry gdt[GDT_ENTRIES] __attribute__((aligned(8)));
+};
+
+#ifdef HOST_BUILD
+extern Cpu g_host_cpu;  // host/host_platform.cpp
+
+static inline Cpu* this_cpu() {
+    return &g_host_cpu;
+}
+#else
+static inline Cpu* this_cpu() {
+    Cpu* cpu;
+    asm volatile ("movl %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+#endif
+
+// Boot
+void smp_early_initialize();   // BSP per-CPU GDT; call before anything uses this_cpu()
+void smp_initialize();         // discover CPUs, start local APICs and bring up the APs
+
+// Queries
+bool cpu_percpu_ready();       // this_cpu() is usable: smp_early_initialize has run
+u32 cpu_count();
+u32 cpu_online_count();
+Cpu* get_cpu(u32 index);
+
+// Cross-CPU communication
+void smp_wakeup_cpu(u32 index);
+bool smp_call_on_cpu(u32 index, CpuCallFn fn, void* arg);
+
+// Idle loop run by every AP once it is online
+void cpu_idle_loop();
+
+#endif
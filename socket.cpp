@@ -0,0 +1,979 @@
+#include "socket.h"
+#include "process.h"
+#include "cpu.h"
+#include "timer.h"
+#include "kformat.h"
+
+// Sockets are only used by threads on the boot CPU, which the kernel
+// never preempts, so disabling interrupts makes each call atomic against
+// the receive path, as with pipes
+
+struct UdpHeader {
+    u16 sport;
+    u16 dport;
+    u16 length;
+    u16 checksum;
+} __attribute__((packed));
+
+struct TcpHeader {
+    u16 sport;
+    u16 dport;
+    u32 seq;
+    u32 ack;
+    u8 offset;             // header length in words, high nibble
+    u8 flags;
+    u16 window;
+    u16 checksum;
+    u16 urgent;
+} __attribute__((packed));
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+
+#define TCP_OPTION_MSS 2
+#define TCP_DEFAULT_MSS 536
+#define TCP_FIN_WAIT_MS 10000  // a closed socket waits this long for the peer's FIN
+#define UDP_QUEUE_MAX 16       // datagrams waiting on one socket
+
+enum TcpState : u8 {
+    TCP_CLOSED,
+    TCP_LISTEN,
+    TCP_SYN_SENT,
+    TCP_SYN_RECEIVED,
+    TCP_ESTABLISHED,
+    TCP_FIN_WAIT_1,
+    TCP_FIN_WAIT_2,
+    TCP_CLOSE_WAIT,
+    TCP_CLOSING,
+    TCP_LAST_ACK
+};
+
+static const char* const tcp_state_names[] = {
+    "CLOSED", "LISTEN", "SYN_SENT", "SYN_RECEIVED", "ESTABLISHED",
+    "FIN_WAIT_1", "FIN_WAIT_2", "CLOSE_WAIT", "CLOSING", "LAST_ACK"
+};
+
+struct Socket {
+    bool used;
+    bool user_closed;      // handle given back; freed once the connection is gone
+    SocketType type;
+    TcpState state;
+    s32 parent;            // listener of a connection not accepted yet, else -1
+    u8 backlog;
+    u16 local_port, remote_port;
+    u32 local_ip, remote_ip;
+    NetDevice* dev;        // route to remote_ip
+    s32 error;             // reported by every later call
+    Process* waiter;
+
+    // UDP datagrams or TCP payload in sequence order
+    NetBuf* rx_head;
+    NetBuf* rx_tail;
+    u32 rx_bytes, rx_count;
+
+    // TCP. Written byte seq sits at send_buf[(seq - iss - 1) % SOCKET_BUFFER]
+    // until acknowledged; a queued FIN takes sequence number snd_end.
+    u8* send_buf;
+    u32 iss, snd_una, snd_nxt, snd_end, snd_wnd;
+    u32 rcv_nxt, rcv_wnd_sent;
+    u16 mss;
+    bool fin_queued;
+    bool peer_fin;
+    bool ack_owed;         // sent at the end of the net_poll batch unless data carries it
+    u8 retries;
+    u32 rto_ms;
+    u64 deadline;          // TSC; 0 when no timer is running
+};
+
+static Socket g_sockets[NET_MAX_SOCKETS];
+static u16 g_next_port = SOCKET_EPHEMERAL_FIRST;
+
+static inline bool seq_lt(u32 a, u32 b) { return (s32)(a - b) < 0; }
+static inline bool seq_le(u32 a, u32 b) { return (s32)(a - b) <= 0; }
+
+static inline s32 handle_of(const Socket* sock) {
+    return (s32)(sock - g_sockets);
+}
+
+static Socket* get_socket(s32 s) {
+    if (s < 0 || s >= NET_MAX_SOCKETS) return nullptr;
+    Socket* sock = &g_sockets[s];
+    return sock->used && !sock->user_closed ? sock : nullptr;
+}
+
+static Socket* alloc_socket(SocketType type) {
+    for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+        Socket* sock = &g_sockets[i];
+        if (sock->used) continue;
+        memset(sock, 0, sizeof(Socket));
+        sock->used = true;
+        sock->type = type;
+        sock->parent = -1;
+        return sock;
+    }
+    return nullptr;
+}
+
+static void free_socket(Socket* sock) {
+    while (sock->rx_head) {
+        NetBuf* buf = sock->rx_head;
+        sock->rx_head = buf->next;
+        netbuf_free(buf);
+    }
+    if (sock->send_buf) kfree(sock->send_buf);
+    sock->used = false;
+}
+
+static void wake(Socket* sock) {
+    if (sock->waiter) {
+        process_wake(sock->waiter);
+        sock->waiter = nullptr;
+    }
+}
+
+void sock_wake_all() {
+    u32 flags = irq_save();
+    for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+        if (g_sockets[i].used) wake(&g_sockets[i]);
+    }
+    irq_restore(flags);
+}
+
+// Interrupts are off. False when the caller can't sleep (no thread to
+// block, e.g. the host test build).
+static bool wait_on(Socket* sock) {
+    Process* self = process_current();
+    if (!self) return false;
+    sock->waiter = self;
+    process_block();
+    return true;
+}
+
+static bool port_in_use(SocketType type, u16 port) {
+    for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+        const Socket* sock = &g_sockets[i];
+        if (sock->used && sock->type == type && sock->local_port == port) return true;
+    }
+    return false;
+}
+
+static u16 ephemeral_port(SocketType type) {
+    for (u32 tries = 0; tries < 65536 - SOCKET_EPHEMERAL_FIRST; tries++) {
+        u16 port = g_next_port++;
+        if (g_next_port == 0) g_next_port = SOCKET_EPHEMERAL_FIRST;
+        if (!port_in_use(type, port)) return port;
+    }
+    return 0;
+}
+
+// Route to ip and take the device's address as ours
+static bool set_remote(Socket* sock, u32 ip, u16 port) {
+    NetDevice* dev = net_route(ip);
+    if (!dev) return false;
+    sock->dev = dev;
+    sock->remote_ip = ip;
+    sock->remote_port = port;
+    sock->local_ip = dev->ip;
+    return true;
+}
+
+static void rx_queue(Socket* sock, NetBuf* buf) {
+    buf->next = nullptr;
+    if (sock->rx_tail) sock->rx_tail->next = buf;
+    else sock->rx_head = buf;
+    sock->rx_tail = buf;
+    sock->rx_bytes += netbuf_len(buf);
+    sock->rx_count++;
+}
+
+// ---- UDP ----
+
+void udp_input(NetBuf* buf) {
+    NetStats* stats = net_stats();
+    const UdpHeader* uh = (const UdpHeader*)buf->data;
+    u32 len = netbuf_len(buf);
+    u32 udp_len = len >= sizeof(UdpHeader) ? net_ntohs(uh->length) : 0;
+    if (udp_len < sizeof(UdpHeader) || udp_len > len ||
+        (!(buf->dev->flags & NETDEV_NO_CSUM) && uh->checksum &&
+         net_checksum_fold(net_checksum_add(net_pseudo_sum(buf->saddr, buf->daddr, IP_PROTO_UDP, udp_len),
+                                            buf->data, udp_len)) != 0)) {
+        stats->ip_bad++;
+        netbuf_free(buf);
+        return;
+    }
+    stats->udp_in++;
+
+    u16 dport = net_ntohs(uh->dport);
+    u16 sport = net_ntohs(uh->sport);
+    Socket* target = nullptr;
+    for (u32 i = 0; i < NET_MAX_SOCKETS && !target; i++) {
+        Socket* sock = &g_sockets[i];
+        if (!sock->used || sock->user_closed || sock->type != SOCKET_UDP || sock->local_port != dport) continue;
+        if (sock->remote_port && (sock->remote_port != sport || sock->remote_ip != buf->saddr)) continue;
+        target = sock;
+    }
+    if (!target) {
+        stats->no_socket++;
+        netbuf_free(buf);
+        return;
+    }
+    if (target->rx_count == UDP_QUEUE_MAX || target->rx_bytes + udp_len > SOCKET_BUFFER) {
+        stats->rcvbuf_full++;
+        netbuf_free(buf);
+        return;
+    }
+
+    buf->sport = sport;
+    buf->tail = buf->data + udp_len;
+    netbuf_pull(buf, sizeof(UdpHeader));
+    rx_queue(target, buf);
+    wake(target);
+}
+
+static s32 udp_send(Socket* sock, const void* data, u32 len, u32 ip, u16 port) {
+    NetDevice* dev = net_route(ip);
+    if (!dev) return NET_EUNREACH;
+    if (len > dev->mtu - 20 - sizeof(UdpHeader)) return NET_EMSGSIZE;
+    if (!sock->local_port) {
+        sock->local_port = ephemeral_port(SOCKET_UDP);
+        if (!sock->local_port) return NET_EADDRINUSE;
+    }
+
+    NetBuf* buf = netbuf_alloc(NET_HEADROOM);
+    if (!buf) return NET_ENOMEM;
+    memcpy(netbuf_put(buf, len), data, len);
+
+    u32 udp_len = len + sizeof(UdpHeader);
+    UdpHeader* uh = (UdpHeader*)netbuf_push(buf, sizeof(UdpHeader));
+    uh->sport = net_htons(sock->local_port);
+    uh->dport = net_htons(port);
+    uh->length = net_htons((u16)udp_len);
+    uh->checksum = 0;  // none
+    if (!(dev->flags & NETDEV_NO_CSUM)) {
+        u16 sum = net_checksum_fold(net_checksum_add(net_pseudo_sum(dev->ip, ip, IP_PROTO_UDP, udp_len),
+                                                     buf->data, udp_len));
+        uh->checksum = sum ? sum : 0xFFFF;
+    }
+
+    net_stats()->udp_out++;
+    ip_output(dev, buf, dev->ip, ip, IP_PROTO_UDP);
+    return (s32)len;
+}
+
+// ---- TCP output ----
+
+static u16 receive_window(const Socket* sock) {
+    u32 window = SOCKET_BUFFER - sock->rx_bytes;
+    return (u16)(window > 0xFFFF ? 0xFFFF : window);
+}
+
+static void tcp_transmit(NetDevice* dev, NetBuf* buf, u32 saddr, u16 sport, u32 daddr, u16 dport,
+                         u32 seq, u32 ack, u8 flags, u16 window, u16 mss_option) {
+    u32 header_len = sizeof(TcpHeader);
+    if (mss_option) {
+        u8* option = netbuf_push(buf, 4);
+        option[0] = TCP_OPTION_MSS;
+        option[1] = 4;
+        option[2] = (u8)(mss_option >> 8);
+        option[3] = (u8)mss_option;
+        header_len += 4;
+    }
+
+    TcpHeader* th = (TcpHeader*)netbuf_push(buf, sizeof(TcpHeader));
+    th->sport = net_htons(sport);
+    th->dport = net_htons(dport);
+    th->seq = net_htonl(seq);
+    th->ack = (flags & TCP_ACK) ? net_htonl(ack) : 0;
+    th->offset = (u8)((header_len / 4) << 4);
+    th->flags = flags;
+    th->window = net_htons(window);
+    th->checksum = 0;
+    th->urgent = 0;
+    if (!(dev->flags & NETDEV_NO_CSUM)) {
+        u32 len = netbuf_len(buf);
+        th->checksum = net_checksum_fold(net_checksum_add(net_pseudo_sum(saddr, daddr, IP_PROTO_TCP, len),
+                                                          buf->data, len));
+    }
+
+    net_stats()->tcp_out++;
+    ip_output(dev, buf, saddr, daddr, IP_PROTO_TCP);
+}
+
+// One segment of sock's connection; len bytes of payload from the send
+// buffer starting at seq
+static bool tcp_send_segment(Socket* sock, u32 seq, u8 flags, u32 len) {
+    NetBuf* buf = netbuf_alloc(NET_HEADROOM);
+    if (!buf) return false;
+    if (len) {
+        u32 offset = (seq - sock->iss - 1) & (SOCKET_BUFFER - 1);
+        u32 first = len < SOCKET_BUFFER - offset ? len : SOCKET_BUFFER - offset;
+        u8* payload = netbuf_put(buf, len);
+        memcpy(payload, sock->send_buf + offset, first);
+        if (first < len) memcpy(payload + first, sock->send_buf, len - first);
+    }
+
+    u16 window = receive_window(sock);
+    if (flags & TCP_ACK) {
+        sock->ack_owed = false;
+        sock->rcv_wnd_sent = window;
+    }
+    tcp_transmit(sock->dev, buf, sock->local_ip, sock->local_port, sock->remote_ip, sock->remote_port,
+                 seq, sock->rcv_nxt, flags, window, (flags & TCP_SYN) ? sock->dev->mtu - 40 : 0);
+    return true;
+}
+
+// RST in answer to a segment that belongs to no connection
+static void tcp_send_reset(const NetBuf* in, const TcpHeader* th, u32 payload_len) {
+    NetDevice* dev = net_route(in->saddr);
+    NetBuf* buf = dev ? netbuf_alloc(NET_HEADROOM) : nullptr;
+    if (!buf) return;
+
+    u32 seq = 0, ack = 0;
+    u8 flags = TCP_RST;
+    if (th->flags & TCP_ACK) {
+        seq = net_ntohl(th->ack);
+    } else {
+        ack = net_ntohl(th->seq) + payload_len + ((th->flags & TCP_SYN) ? 1 : 0) + ((th->flags & TCP_FIN) ? 1 : 0);
+        flags |= TCP_ACK;
+    }
+    net_stats()->tcp_resets++;
+    tcp_transmit(dev, buf, in->daddr, net_ntohs(th->dport), in->saddr, net_ntohs(th->sport), seq, ack, flags, 0, 0);
+}
+
+static void tcp_arm_timer(Socket* sock, u32 ms) {
+    sock->deadline = rdtsc() + (u64)ms * tsc_khz();
+}
+
+static bool tcp_can_send(const Socket* sock) {
+    return sock->state == TCP_ESTABLISHED || sock->state == TCP_CLOSE_WAIT || sock->state == TCP_FIN_WAIT_1 ||
+           sock->state == TCP_CLOSING || sock->state == TCP_LAST_ACK;
+}
+
+// Everything the peer's window allows, then the FIN once the data is out
+static void tcp_output(Socket* sock) {
+    if (!tcp_can_send(sock)) return;
+
+    u32 window_end = sock->snd_una + sock->snd_wnd;
+    while (seq_lt(sock->snd_nxt, sock->snd_end) && seq_lt(sock->snd_nxt, window_end)) {
+        u32 len = sock->snd_end - sock->snd_nxt;
+        if (len > sock->mss) len = sock->mss;
+        if (len > window_end - sock->snd_nxt) len = window_end - sock->snd_nxt;
+        if (!tcp_send_segment(sock, sock->snd_nxt, TCP_ACK | TCP_PSH, len)) break;
+        sock->snd_nxt += len;
+    }
+    if (sock->fin_queued && sock->snd_nxt == sock->snd_end) {
+        if (tcp_send_segment(sock, sock->snd_nxt, TCP_FIN | TCP_ACK, 0)) sock->snd_nxt++;
+    }
+
+    // Retransmission, or a window probe when data waits on a zero window
+    u32 last = sock->snd_end + (sock->fin_queued ? 1 : 0);
+    if (seq_lt(sock->snd_una, last)) {
+        if (!sock->deadline) tcp_arm_timer(sock, sock->rto_ms);
+    } else {
+        sock->deadline = 0;
+    }
+}
+
+// Connection over. A socket nobody holds a handle to goes away now;
+// otherwise the next call reports it.
+static void tcp_finish(Socket* sock) {
+    sock->state = TCP_CLOSED;
+    sock->deadline = 0;
+    if (sock->user_closed || sock->parent >= 0) {
+        free_socket(sock);
+    } else {
+        wake(sock);
+    }
+}
+
+static void tcp_abort(Socket* sock) {
+    if (sock->state != TCP_CLOSED && sock->state != TCP_LISTEN && sock->state != TCP_SYN_SENT) {
+        net_stats()->tcp_resets++;
+        tcp_send_segment(sock, sock->snd_nxt, TCP_RST | TCP_ACK, 0);
+    }
+    tcp_finish(sock);
+}
+
+static bool tcp_start(Socket* sock) {
+    if (!sock->send_buf) sock->send_buf = (u8*)kmalloc(SOCKET_BUFFER);
+    if (!sock->send_buf) return false;
+    sock->iss = (u32)(rdtsc() >> 4);
+    sock->snd_una = sock->iss;
+    sock->snd_nxt = sock->iss + 1;
+    sock->snd_end = sock->iss + 1;
+    sock->rto_ms = TCP_RTO_INITIAL_MS;
+    sock->mss = (u16)(sock->dev->mtu - 40);
+    return true;
+}
+
+void tcp_flush_acks() {
+    for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+        Socket* sock = &g_sockets[i];
+        if (sock->used && sock->ack_owed && sock->state != TCP_CLOSED) {
+            tcp_send_segment(sock, sock->snd_nxt, TCP_ACK, 0);
+        }
+    }
+}
+
+static void tcp_timeout(Socket* sock) {
+    sock->deadline = 0;
+    if (sock->state == TCP_FIN_WAIT_2) {
+        tcp_finish(sock);
+        return;
+    }
+    if (++sock->retries > TCP_MAX_RETRIES) {
+        sock->error = NET_ETIMEDOUT;
+        tcp_abort(sock);
+        return;
+    }
+    sock->rto_ms = sock->rto_ms * 2 > TCP_RTO_MAX_MS ? TCP_RTO_MAX_MS : sock->rto_ms * 2;
+    net_stats()->tcp_retransmits++;
+
+    if (sock->state == TCP_SYN_SENT || sock->state == TCP_SYN_RECEIVED) {
+        u8 flags = sock->state == TCP_SYN_SENT ? TCP_SYN : TCP_SYN | TCP_ACK;
+        tcp_send_segment(sock, sock->iss, flags, 0);
+        tcp_arm_timer(sock, sock->rto_ms);
+        return;
+    }
+
+    // Go back to the oldest unacknowledged byte; with nothing in flight
+    // the window is closed, so push one byte past it as a probe
+    sock->snd_nxt = sock->snd_una;
+    if (sock->snd_wnd == 0 && seq_lt(sock->snd_una, sock->snd_end)) {
+        if (tcp_send_segment(sock, sock->snd_una, TCP_ACK, 1)) sock->snd_nxt = sock->snd_una + 1;
+    }
+    tcp_output(sock);
+}
+
+void tcp_timers() {
+    u64 now = rdtsc();
+    for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+        Socket* sock = &g_sockets[i];
+        if (sock->used && sock->type == SOCKET_TCP && sock->deadline && now >= sock->deadline) tcp_timeout(sock);
+    }
+}
+
+// ---- TCP input ----
+
+static Socket* tcp_lookup(u32 daddr, u16 dport, u32 saddr, u16 sport) {
+    Socket* listener = nullptr;
+    for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+        Socket* sock = &g_sockets[i];
+        if (!sock->used || sock->type != SOCKET_TCP || sock->local_port != dport) continue;
+        if (sock->state == TCP_LISTEN) {
+            if (!sock->user_closed && (!sock->local_ip || sock->local_ip == daddr)) listener = sock;
+        } else if (sock->state != TCP_CLOSED && sock->remote_port == sport && sock->remote_ip == saddr &&
+                   sock->local_ip == daddr) {
+            return sock;
+        }
+    }
+    return listener;
+}
+
+static u32 pending_connections(const Socket* listener) {
+    u32 count = 0;
+    for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+        if (g_sockets[i].used && g_sockets[i].parent == handle_of(listener)) count++;
+    }
+    return count;
+}
+
+static u16 parse_mss(const TcpHeader* th, u32 header_len) {
+    const u8* option = (const u8*)(th + 1);
+    const u8* end = (const u8*)th + header_len;
+    while (option < end && *option != 0) {
+        if (*option == 1) {
+            option++;
+            continue;
+        }
+        if (option + 1 >= end || option[1] < 2 || option + option[1] > end) break;
+        if (option[0] == TCP_OPTION_MSS && option[1] == 4) return (u16)((option[2] << 8) | option[3]);
+        option += option[1];
+    }
+    return TCP_DEFAULT_MSS;
+}
+
+static void tcp_listen_input(Socket* listener, const NetBuf* buf, const TcpHeader* th, u32 header_len) {
+    if (th->flags & TCP_RST) return;
+    if (th->flags & TCP_ACK) {
+        tcp_send_reset(buf, th, netbuf_len(buf));
+        return;
+    }
+    if (!(th->flags & TCP_SYN) || pending_connections(listener) >= listener->backlog) return;
+
+    Socket* child = alloc_socket(SOCKET_TCP);
+    if (!child) return;
+    if (!set_remote(child, buf->saddr, net_ntohs(th->sport)) || !tcp_start(child)) {
+        free_socket(child);
+        return;
+    }
+    child->local_ip = buf->daddr;
+    child->local_port = listener->local_port;
+    child->parent = handle_of(listener);
+    child->state = TCP_SYN_RECEIVED;
+    child->rcv_nxt = net_ntohl(th->seq) + 1;
+    child->snd_wnd = net_ntohs(th->window);
+    u16 peer_mss = parse_mss(th, header_len);
+    if (peer_mss < child->mss) child->mss = peer_mss;
+
+    tcp_send_segment(child, child->iss, TCP_SYN | TCP_ACK, 0);
+    tcp_arm_timer(child, child->rto_ms);
+}
+
+static void tcp_syn_sent_input(Socket* sock, const NetBuf* buf, const TcpHeader* th, u32 header_len) {
+    u32 ack = net_ntohl(th->ack);
+    if ((th->flags & TCP_ACK) && ack != sock->snd_nxt) {
+        if (!(th->flags & TCP_RST)) tcp_send_reset(buf, th, netbuf_len(buf));
+        return;
+    }
+    if (th->flags & TCP_RST) {
+        if (th->flags & TCP_ACK) {
+            sock->error = NET_EREFUSED;
+            tcp_finish(sock);
+        }
+        return;
+    }
+    if (!(th->flags & TCP_SYN) || !(th->flags & TCP_ACK)) return;  // no simultaneous open
+
+    sock->rcv_nxt = net_ntohl(th->seq) + 1;
+    sock->snd_una = ack;
+    sock->snd_wnd = net_ntohs(th->window);
+    u16 peer_mss = parse_mss(th, header_len);
+    if (peer_mss < sock->mss) sock->mss = peer_mss;
+    sock->state = TCP_ESTABLISHED;
+    sock->deadline = 0;
+    sock->retries = 0;
+    sock->ack_owed = true;
+    wake(sock);
+}
+
+// Acceptable ACK for an open connection: move snd_una, finish the
+// handshake or the close it acknowledges. False if sock is gone.
+static bool tcp_ack_input(Socket* sock, const TcpHeader* th) {
+    u32 ack = net_ntohl(th->ack);
+    if (seq_lt(sock->snd_nxt, ack)) {
+        sock->ack_owed = true;  // acknowledges something never sent
+        return true;
+    }
+    if (seq_le(sock->snd_una, ack)) sock->snd_wnd = net_ntohs(th->window);
+    if (!seq_lt(sock->snd_una, ack)) return true;
+
+    sock->snd_una = ack;
+    sock->retries = 0;
+    sock->rto_ms = TCP_RTO_INITIAL_MS;
+    sock->deadline = 0;
+    wake(sock);
+
+    if (sock->state == TCP_SYN_RECEIVED) {
+        sock->state = TCP_ESTABLISHED;
+        if (sock->parent >= 0) wake(&g_sockets[sock->parent]);
+        return true;
+    }
+    bool fin_acked = sock->fin_queued && ack == sock->snd_end + 1;
+    if (!fin_acked) return true;
+    if (sock->state == TCP_FIN_WAIT_1) {
+        sock->state = TCP_FIN_WAIT_2;
+        if (sock->user_closed) tcp_arm_timer(sock, TCP_FIN_WAIT_MS);
+    } else if (sock->state == TCP_CLOSING || sock->state == TCP_LAST_ACK) {
+        tcp_finish(sock);  // no TIME_WAIT
+        return false;
+    }
+    return true;
+}
+
+// Payload and FIN, in order only. Returns true if the socket kept buf.
+static bool tcp_data_input(Socket* sock, NetBuf* buf, const TcpHeader* th) {
+    u32 seq = net_ntohl(th->seq);
+    u32 len = netbuf_len(buf);
+    bool fin = (th->flags & TCP_FIN) != 0;
+    if (!len && !fin) return false;
+    if (seq != sock->rcv_nxt) {
+        sock->ack_owed = true;  // duplicate ACK: the sender goes back to rcv_nxt
+        return false;
+    }
+
+    bool kept = false;
+    if (len) {
+        bool open = sock->state == TCP_ESTABLISHED || sock->state == TCP_FIN_WAIT_1 || sock->state == TCP_FIN_WAIT_2;
+        u32 window = SOCKET_BUFFER - sock->rx_bytes;
+        if (!open) return false;
+        if (len > window) {
+            buf->tail = buf->data + window;  // the rest comes again once the window opens
+            len = window;
+            fin = false;
+        }
+        sock->rcv_nxt += len;
+        sock->ack_owed = true;
+        if (sock->user_closed || !len) {
+            // nobody will read it
+        } else if (sock->rx_tail &&
+                   len <= (u32)(sock->rx_tail->head + sizeof(sock->rx_tail->head) - sock->rx_tail->tail)) {
+            // Small segments share the last buffer instead of holding 2K each
+            memcpy(netbuf_put(sock->rx_tail, len), buf->data, len);
+            sock->rx_bytes += len;
+        } else {
+            rx_queue(sock, buf);
+            kept = true;
+        }
+        wake(sock);
+    }
+    if (!fin) return kept;
+
+    sock->rcv_nxt++;
+    sock->peer_fin = true;
+    sock->ack_owed = true;
+    wake(sock);
+    if (sock->state == TCP_ESTABLISHED) {
+        sock->state = TCP_CLOSE_WAIT;
+    } else if (sock->state == TCP_FIN_WAIT_1) {
+        sock->state = TCP_CLOSING;
+    } else if (sock->state == TCP_FIN_WAIT_2) {
+        tcp_send_segment(sock, sock->snd_nxt, TCP_ACK, 0);
+        tcp_finish(sock);  // no TIME_WAIT
+    }
+    return kept;
+}
+
+void tcp_input(NetBuf* buf) {
+    NetStats* stats = net_stats();
+    const TcpHeader* th = (const TcpHeader*)buf->data;
+    u32 len = netbuf_len(buf);
+    u32 header_len = len >= sizeof(TcpHeader) ? (th->offset >> 4) * 4 : 0;
+    if (header_len < sizeof(TcpHeader) || header_len > len ||
+        (!(buf->dev->flags & NETDEV_NO_CSUM) &&
+         net_checksum_fold(net_checksum_add(net_pseudo_sum(buf->saddr, buf->daddr, IP_PROTO_TCP, len),
+                                            buf->data, len)) != 0)) {
+        stats->ip_bad++;
+        netbuf_free(buf);
+        return;
+    }
+    stats->tcp_in++;
+
+    // The header stays readable in front of data after the pull
+    netbuf_pull(buf, header_len);
+    Socket* sock = tcp_lookup(buf->daddr, net_ntohs(th->dport), buf->saddr, net_ntohs(th->sport));
+    if (!sock) {
+        stats->no_socket++;
+        if (!(th->flags & TCP_RST)) tcp_send_reset(buf, th, netbuf_len(buf));
+        netbuf_free(buf);
+        return;
+    }
+
+    if (sock->state == TCP_LISTEN) {
+        tcp_listen_input(sock, buf, th, header_len);
+        netbuf_free(buf);
+        return;
+    }
+    if (sock->state == TCP_SYN_SENT) {
+        tcp_syn_sent_input(sock, buf, th, header_len);
+        netbuf_free(buf);
+        return;
+    }
+
+    if (th->flags & TCP_RST) {
+        if (net_ntohl(th->seq) == sock->rcv_nxt) {
+            sock->error = NET_ERESET;
+            tcp_finish(sock);
+        }
+        netbuf_free(buf);
+        return;
+    }
+    if ((th->flags & TCP_SYN) || !(th->flags & TCP_ACK)) {
+        if (th->flags & TCP_SYN) sock->ack_owed = true;
+        netbuf_free(buf);
+        return;
+    }
+    if (sock->state == TCP_SYN_RECEIVED && net_ntohl(th->ack) != sock->snd_nxt) {
+        tcp_send_reset(buf, th, netbuf_len(buf));
+        netbuf_free(buf);
+        return;
+    }
+
+    if (!tcp_ack_input(sock, th)) {
+        netbuf_free(buf);
+        return;
+    }
+    bool kept = tcp_data_input(sock, buf, th);
+    if (!kept) netbuf_free(buf);
+    if (sock->used && sock->state != TCP_CLOSED) tcp_output(sock);
+}
+
+// ---- API ----
+
+s32 sock_open(SocketType type) {
+    if (type != SOCKET_UDP && type != SOCKET_TCP) return NET_EINVAL;
+    u32 flags = irq_save();
+    Socket* sock = alloc_socket(type);
+    irq_restore(flags);
+    return sock ? handle_of(sock) : NET_ENOSOCKETS;
+}
+
+void sock_close(s32 s) {
+    u32 flags = irq_save();
+    Socket* sock = get_socket(s);
+    if (!sock) {
+        irq_restore(flags);
+        return;
+    }
+    sock->user_closed = true;
+    wake(sock);  // a thread sleeping on it finds the handle gone
+
+    if (sock->type == SOCKET_UDP) {
+        free_socket(sock);
+    } else if (sock->state == TCP_LISTEN) {
+        for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+            if (g_sockets[i].used && g_sockets[i].parent == s) tcp_abort(&g_sockets[i]);
+        }
+        free_socket(sock);
+    } else if (sock->rx_bytes) {
+        tcp_abort(sock);  // unread data: tell the peer it was lost
+    } else if (sock->state == TCP_ESTABLISHED || sock->state == TCP_CLOSE_WAIT) {
+        sock->state = sock->state == TCP_ESTABLISHED ? TCP_FIN_WAIT_1 : TCP_LAST_ACK;
+        sock->fin_queued = true;
+        tcp_output(sock);
+    } else if (sock->state == TCP_CLOSED || sock->state == TCP_SYN_SENT) {
+        free_socket(sock);
+    }
+    irq_restore(flags);
+    net_poll();
+}
+
+s32 sock_bind(s32 s, u16 port) {
+    u32 flags = irq_save();
+    Socket* sock = get_socket(s);
+    s32 result = 0;
+    if (!sock || sock->local_port || (sock->type == SOCKET_TCP && sock->state != TCP_CLOSED)) {
+        result = NET_EINVAL;
+    } else if (port && port_in_use(sock->type, port)) {
+        result = NET_EADDRINUSE;
+    } else {
+        sock->local_port = port ? port : ephemeral_port(sock->type);
+        if (!sock->local_port) result = NET_EADDRINUSE;
+    }
+    irq_restore(flags);
+    return result;
+}
+
+s32 sock_listen(s32 s, u32 backlog) {
+    u32 flags = irq_save();
+    Socket* sock = get_socket(s);
+    s32 result = 0;
+    if (!sock || sock->type != SOCKET_TCP || sock->state != TCP_CLOSED || !sock->local_port) {
+        result = NET_EINVAL;
+    } else {
+        sock->state = TCP_LISTEN;
+        sock->backlog = (u8)(backlog == 0 ? 1 : backlog > NET_MAX_SOCKETS ? NET_MAX_SOCKETS : backlog);
+    }
+    irq_restore(flags);
+    return result;
+}
+
+s32 sock_accept(s32 s, u32 flags) {
+    u32 irq = irq_save();
+    Socket* sock = get_socket(s);
+    s32 result = NET_EINVAL;
+    while ((sock = get_socket(s)) && sock->state == TCP_LISTEN) {
+        net_poll();
+        for (u32 i = 0; i < NET_MAX_SOCKETS; i++) {
+            Socket* child = &g_sockets[i];
+            if (child->used && child->parent == s && child->state != TCP_SYN_RECEIVED) {
+                child->parent = -1;
+                result = (s32)i;
+                break;
+            }
+        }
+        if (result >= 0) break;
+        result = NET_EAGAIN;
+        if ((flags & SOCKET_NONBLOCK) || !wait_on(sock)) break;
+        result = NET_EINVAL;  // if it was closed meanwhile
+    }
+    irq_restore(irq);
+    return result;
+}
+
+s32 sock_connect(s32 s, u32 ip, u16 port, u32 flags) {
+    u32 irq = irq_save();
+    Socket* sock = get_socket(s);
+    s32 result = 0;
+    if (!sock || !port) {
+        result = NET_EINVAL;
+    } else if (sock->type == SOCKET_UDP) {
+        if (!set_remote(sock, ip, port)) result = NET_EUNREACH;
+    } else if (sock->state == TCP_CLOSED) {
+        if (sock->error) {
+            result = NET_EINVAL;
+        } else if (!set_remote(sock, ip, port)) {
+            result = NET_EUNREACH;
+        } else if (!sock->local_port && !(sock->local_port = ephemeral_port(SOCKET_TCP))) {
+            result = NET_EADDRINUSE;
+        } else if (!tcp_start(sock)) {
+            result = NET_ENOMEM;
+        } else {
+            sock->state = TCP_SYN_SENT;
+            tcp_send_segment(sock, sock->iss, TCP_SYN, 0);
+            tcp_arm_timer(sock, sock->rto_ms);
+        }
+    } else if (sock->state != TCP_SYN_SENT) {
+        result = sock->state == TCP_LISTEN ? NET_EINVAL : 0;  // already connected
+    }
+
+    while (result == 0 && sock->type == SOCKET_TCP && sock->state == TCP_SYN_SENT) {
+        net_poll();
+        if (sock->state != TCP_SYN_SENT) break;
+        if ((flags & SOCKET_NONBLOCK) || !wait_on(sock)) result = NET_EAGAIN;
+    }
+    if (result == 0 && sock->type == SOCKET_TCP && sock->state == TCP_CLOSED) result = sock->error;
+    irq_restore(irq);
+    return result;
+}
+
+s32 sock_send(s32 s, const void* data, u32 len, u32 flags) {
+    u32 irq = irq_save();
+    Socket* sock = get_socket(s);
+    s32 result;
+    if (!sock) {
+        result = NET_EINVAL;
+    } else if (sock->type == SOCKET_UDP) {
+        result = sock->remote_port ? udp_send(sock, data, len, sock->remote_ip, sock->remote_port) : NET_ENOTCONN;
+    } else {
+        const u8* bytes = (const u8*)data;
+        u32 done = 0;
+        for (;;) {
+            net_poll();
+            if (sock->error || (sock->state != TCP_ESTABLISHED && sock->state != TCP_CLOSE_WAIT)) break;
+            u32 space = SOCKET_BUFFER - (sock->snd_end - sock->snd_una);
+            u32 n = len - done < space ? len - done : space;
+            for (u32 i = 0; i < n; ) {
+                u32 offset = (sock->snd_end - sock->iss - 1) & (SOCKET_BUFFER - 1);
+                u32 chunk = SOCKET_BUFFER - offset < n - i ? SOCKET_BUFFER - offset : n - i;
+                memcpy(sock->send_buf + offset, bytes + done + i, chunk);
+                sock->snd_end += chunk;
+                i += chunk;
+            }
+            done += n;
+            if (n) tcp_output(sock);
+            if (done == len || (flags & SOCKET_NONBLOCK) || !wait_on(sock)) break;
+        }
+        result = done ? (s32)done : sock->error ? sock->error :
+                 (sock->state != TCP_ESTABLISHED && sock->state != TCP_CLOSE_WAIT) ? NET_ENOTCONN : NET_EAGAIN;
+    }
+    irq_restore(irq);
+    net_poll();  // over loopback, this delivers what was just sent
+    return result;
+}
+
+s32 sock_sendto(s32 s, const void* data, u32 len, u32 ip, u16 port) {
+    u32 irq = irq_save();
+    Socket* sock = get_socket(s);
+    s32 result = !sock || sock->type != SOCKET_UDP || !port ? NET_EINVAL : udp_send(sock, data, len, ip, port);
+    irq_restore(irq);
+    net_poll();
+    return result;
+}
+
+// Copy queued payload out; UDP takes one datagram, dropping what
+// doesn't fit
+static u32 rx_take(Socket* sock, u8* out, u32 len) {
+    u32 n = 0;
+    while (sock->rx_head && n < len) {
+        NetBuf* buf = sock->rx_head;
+        u32 avail = netbuf_len(buf);
+        u32 chunk = avail < len - n ? avail : len - n;
+        memcpy(out + n, buf->data, chunk);
+        n += chunk;
+        if (sock->type == SOCKET_UDP || chunk == avail) {
+            sock->rx_head = buf->next;
+            if (!sock->rx_head) sock->rx_tail = nullptr;
+            sock->rx_bytes -= avail;
+            sock->rx_count--;
+            netbuf_free(buf);
+        } else {
+            buf->data += chunk;
+            sock->rx_bytes -= chunk;
+        }
+        if (sock->type == SOCKET_UDP) break;
+    }
+    return n;
+}
+
+s32 sock_recvfrom(s32 s, void* data, u32 len, u32* ip, u16* port, u32 flags) {
+    u32 irq = irq_save();
+    Socket* sock = get_socket(s);
+    s32 result = NET_EINVAL;
+    while ((sock = get_socket(s))) {
+        net_poll();
+        if (sock->rx_head) {
+            if (sock->type == SOCKET_UDP) {
+                if (ip) *ip = sock->rx_head->saddr;
+                if (port) *port = sock->rx_head->sport;
+            } else {
+                if (ip) *ip = sock->remote_ip;
+                if (port) *port = sock->remote_port;
+            }
+            result = (s32)rx_take(sock, (u8*)data, len);
+
+            // Tell the sender about a window that has opened up a lot
+            u16 window = receive_window(sock);
+            if (sock->type == SOCKET_TCP && tcp_can_send(sock) &&
+                window >= sock->rcv_wnd_sent + (SOCKET_BUFFER / 2 < 2u * sock->mss ? SOCKET_BUFFER / 2 : 2u * sock->mss)) {
+                sock->ack_owed = true;
+            }
+            break;
+        }
+        if (sock->type == SOCKET_TCP) {
+            if (sock->error) {
+                result = sock->error;
+                break;
+            }
+            if (sock->peer_fin || sock->state == TCP_CLOSED) {
+                result = 0;
+                break;
+            }
+            if (sock->state == TCP_LISTEN || sock->state == TCP_SYN_SENT) {
+                result = NET_ENOTCONN;
+                break;
+            }
+        }
+        result = NET_EAGAIN;
+        if ((flags & SOCKET_NONBLOCK) || !wait_on(sock)) break;
+        result = NET_EINVAL;  // if it was closed meanwhile
+    }
+    irq_restore(irq);
+    net_poll();
+    return result;
+}
+
+s32 sock_recv(s32 s, void* data, u32 len, u32 flags) {
+    return sock_recvfrom(s, data, len, nullptr, nullptr, flags);
+}
+
+const char* net_error_name(s32 error) {
+    static const char* const names[] = {
+        "ok", "invalid", "would block", "address in use", "out of memory", "no free sockets",
+        "unreachable", "connection refused", "connection reset", "timed out", "not connected",
+        "message too long"
+    };
+    if (error > 0 || -error >= (s32)(sizeof(names) / sizeof(names[0]))) return "unknown";
+    return names[-error];
+}
+
+u32 sock_format_all(char* out, u32 size) {
+    u32 flags = irq_save();
+    u32 len = 0;
+    for (u32 i = 0; i < NET_MAX_SOCKETS && len + 1 < size; i++) {
+        const Socket* sock = &g_sockets[i];
+        if (!sock->used) continue;
+        char local[16], remote[16];
+        net_format_ip(local, sock->local_ip);
+        net_format_ip(remote, sock->remote_ip);
+        len += ksnprintf(out + len, size - len, "%u %s %s:%u > %s:%u %s rx %u\n", i,
+                         sock->type == SOCKET_TCP ? "tcp" : "udp", local, sock->local_port, remote,
+                         sock->remote_port, sock->type == SOCKET_TCP ? tcp_state_names[sock->state] : "-",
+                         sock->rx_bytes);
+    }
+    irq_restore(flags);
+    return len;
+}
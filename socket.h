@@ -0,0 +1,77 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include "memory.h"
+#include "net.h"
+
+// UDP and TCP sockets for kernel threads. A socket is a small integer
+// handle; calls return it, a byte count or 0 on success and a negative
+// NET_E* code on failure.
+//
+// Calls that have to wait (accept, connect, recv, a send into a full
+// buffer) block the calling thread like a pipe does, unless flags has
+// SOCKET_NONBLOCK, in which case they return NET_EAGAIN. One thread per
+// socket: a second thread blocking on the same socket isn't supported.
+//
+// TCP is the core of RFC 793: three-way handshake, in-order delivery
+// with cumulative ACKs, flow control through the advertised window,
+// go-back-N retransmission on a doubling timeout and FIN/RST teardown.
+// Segments that arrive out of order are dropped and retransmitted;
+// there is no congestion control, no window scaling and no TIME_WAIT
+// (a closed connection's port is free again at once). Data is sent as
+// soon as it's written (no Nagle); ACKs are held to the end of each
+// net_poll batch so a reply can carry them.
+
+#define NET_MAX_SOCKETS 32
+#define SOCKET_BUFFER 16384        // TCP send and receive buffers, UDP receive queue; power of two
+#define SOCKET_EPHEMERAL_FIRST 49152
+#define TCP_RTO_INITIAL_MS 200
+#define TCP_RTO_MAX_MS 6400
+#define TCP_MAX_RETRIES 8
+
+#define SOCKET_NONBLOCK 0x1
+
+#define NET_EINVAL       -1   // bad handle, argument or state
+#define NET_EAGAIN       -2   // would have to wait
+#define NET_EADDRINUSE   -3
+#define NET_ENOMEM       -4
+#define NET_ENOSOCKETS   -5
+#define NET_EUNREACH     -6   // no route
+#define NET_EREFUSED     -7   // RST in answer to SYN
+#define NET_ERESET       -8   // RST on an open connection
+#define NET_ETIMEDOUT    -9
+#define NET_ENOTCONN     -10
+#define NET_EMSGSIZE     -11  // UDP payload over one packet
+
+enum SocketType : u8 {
+    SOCKET_UDP,
+    SOCKET_TCP
+};
+
+s32 sock_open(SocketType type);
+void sock_close(s32 s);                                      // TCP: FIN after the queued data
+
+s32 sock_bind(s32 s, u16 port);                              // 0 picks an ephemeral port
+s32 sock_listen(s32 s, u32 backlog);
+s32 sock_accept(s32 s, u32 flags);                           // a new socket
+s32 sock_connect(s32 s, u32 ip, u16 port, u32 flags);        // UDP: default destination
+
+s32 sock_send(s32 s, const void* data, u32 len, u32 flags);  // TCP: bytes queued
+s32 sock_recv(s32 s, void* data, u32 len, u32 flags);        // TCP: 0 at end of stream
+s32 sock_sendto(s32 s, const void* data, u32 len, u32 ip, u16 port);
+s32 sock_recvfrom(s32 s, void* data, u32 len, u32* ip, u16* port, u32 flags);
+
+const char* net_error_name(s32 error);
+
+// "tcp 127.0.0.1:49152 > 127.0.0.1:7 ESTABLISHED" per socket in use;
+// returns the length
+u32 sock_format_all(char* out, u32 size);
+
+// Called by the IP layer in net.cpp
+void udp_input(NetBuf* buf);
+void tcp_input(NetBuf* buf);
+void tcp_flush_acks();
+void tcp_timers();
+void sock_wake_all();
+
+#endif
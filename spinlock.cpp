@@ -0,0 +1,103 @@
+#include "spinlock.h"
+
+static LockStats* registered_locks[LOCK_STATS_MAX];
+static u32 registered_count = 0;
+
+void lock_stats_register(LockStats* stats, const char* name) {
+    stats->name = name;
+    stats->acquisitions = 0;
+    stats->contended = 0;
+    stats->spin_cycles = 0;
+
+    if (!name) return;
+    for (u32 i = 0; i < registered_count; i++) {
+        if (registered_locks[i] == stats) return;
+    }
+    u32 slot = __atomic_fetch_add(&registered_count, 1, __ATOMIC_RELAXED);
+    if (slot < LOCK_STATS_MAX) {
+        registered_locks[slot] = stats;
+    } else {
+        registered_count = LOCK_STATS_MAX;
+    }
+}
+
+// Insertion sort by spin cycles, then acquisitions, hottest first
+int lock_stats_hottest(LockStats** out, int max_entries) {
+    int count = 0;
+    for (u32 i = 0; i < registered_count && i < LOCK_STATS_MAX; i++) {
+        LockStats* s = registered_locks[i];
+        int pos = count < max_entries ? count : max_entries;
+        while (pos > 0 && (out[pos - 1]->spin_cycles < s->spin_cycles ||
+                           (out[pos - 1]->spin_cycles == s->spin_cycles &&
+                            out[pos - 1]->acquisitions < s->acquisitions))) {
+            if (pos < max_entries) out[pos] = out[pos - 1];
+            pos--;
+        }
+        if (pos < max_entries) {
+            out[pos] = s;
+            if (count < max_entries) count++;
+        }
+    }
+    return count;
+}
+
+void lock_stats_reset() {
+    for (u32 i = 0; i < registered_count && i < LOCK_STATS_MAX; i++) {
+        registered_locks[i]->acquisitions = 0;
+        registered_locks[i]->contended = 0;
+        registered_locks[i]->spin_cycles = 0;
+    }
+}
+
+static inline void account_spin(LockStats* stats, u64 start) {
+    if (!stats) return;
+    __atomic_add_fetch(&stats->contended, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->spin_cycles, rdtsc() - start, __ATOMIC_RELAXED);
+}
+
+void spinlock_spin(volatile u32* word, LockStats* stats) {
+    u64 start = rdtsc();
+    // Spin on a plain read so the cache line stays shared until it's released
+    do {
+        while (__atomic_load_n(word, __ATOMIC_RELAXED)) cpu_pause();
+    } while (__atomic_exchange_n(word, 1, __ATOMIC_ACQUIRE));
+    account_spin(stats, start);
+}
+
+void ticket_lock_spin(volatile u16* owner, u16 ticket, LockStats* stats) {
+    u64 start = rdtsc();
+    while (__atomic_load_n(owner, __ATOMIC_ACQUIRE) != ticket) cpu_pause();
+    account_spin(stats, start);
+}
+
+void rwlock_read_spin(volatile u32* state, LockStats* stats) {
+    u64 start = rdtsc();
+    while (true) {
+        u32 s = __atomic_load_n(state, __ATOMIC_RELAXED);
+        if (!(s & (RWLOCK_WRITER | RWLOCK_PENDING)) &&
+            __atomic_compare_exchange_n(state, &s, s + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        cpu_pause();
+    }
+    account_spin(stats, start);
+}
+
+void rwlock_write_spin(volatile u32* state, LockStats* stats) {
+    u64 start = rdtsc();
+    __atomic_or_fetch(state, RWLOCK_PENDING, __ATOMIC_RELAXED);
+    while (true) {
+        u32 s = __atomic_load_n(state, __ATOMIC_RELAXED);
+        if ((s & (RWLOCK_WRITER | RWLOCK_READERS)) == 0) {
+            // Taking the lock clears PENDING; other waiting writers set it again
+            if (__atomic_compare_exchange_n(state, &s, RWLOCK_WRITER, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (!(s & RWLOCK_PENDING)) {
+            __atomic_or_fetch(state, RWLOCK_PENDING, __ATOMIC_RELAXED);
+        }
+        cpu_pause();
+    }
+    account_spin(stats, start);
+}
@@ -0,0 +1,223 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include "memory.h"
+#include "cpu.h"
+
+// Set to 0 to compile the acquisition/spin counters out of every lock
+#define LOCK_STATS 1
+
+#define LOCK_STATS_MAX 32
+
+// Per-lock contention counters, listed by the `locks` command.
+// Only written by the lock holder, except reader counts on RW locks.
+struct LockStats {
+    const char* name;
+    u32 acquisitions;
+    u32 contended;
+    u64 spin_cycles;
+};
+
+void lock_stats_register(LockStats* stats, const char* name);
+int lock_stats_hottest(LockStats** out, int max_entries);  // sorted by spin cycles
+void lock_stats_reset();
+
+// Slow paths (spinlock.cpp)
+void spinlock_spin(volatile u32* word, LockStats* stats);
+void ticket_lock_spin(volatile u16* owner, u16 ticket, LockStats* stats);
+
+// Test-and-test-and-set spinlock. Statics are zero (unlocked) in .bss;
+// call initialize() to give the lock a name in the `locks` report.
+class Spinlock {
+private:
+    volatile u32 locked;
+#if LOCK_STATS
+    LockStats stats;
+#endif
+
+public:
+    void initialize(const char* name) {
+        locked = 0;
+#if LOCK_STATS
+        lock_stats_register(&stats, name);
+#else
+        (void)name;
+#endif
+    }
+
+    bool try_lock() {
+        return __atomic_exchange_n(&locked, 1, __ATOMIC_ACQUIRE) == 0;
+    }
+
+    void lock() {
+        if (__builtin_expect(!try_lock(), 0)) {
+#if LOCK_STATS
+            spinlock_spin(&locked, &stats);
+#else
+            spinlock_spin(&locked, nullptr);
+#endif
+        }
+#if LOCK_STATS
+        stats.acquisitions++;
+#endif
+    }
+
+    void unlock() {
+        __atomic_store_n(&locked, 0, __ATOMIC_RELEASE);
+    }
+
+    u32 lock_irqsave() {
+        u32 flags = irq_save();
+        lock();
+        return flags;
+    }
+
+    void unlock_irqrestore(u32 flags) {
+        unlock();
+        irq_restore(flags);
+    }
+
+    bool is_locked() {
+        return __atomic_load_n(&locked, __ATOMIC_RELAXED) != 0;
+    }
+};
+
+// FIFO ticket lock: waiters are served in arrival order
+class TicketLock {
+private:
+    volatile u16 next;
+    volatile u16 owner;
+#if LOCK_STATS
+    LockStats stats;
+#endif
+
+public:
+    void initialize(const char* name) {
+        next = 0;
+        owner = 0;
+#if LOCK_STATS
+        lock_stats_register(&stats, name);
+#else
+        (void)name;
+#endif
+    }
+
+    void lock() {
+        u16 ticket = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+        if (__builtin_expect(__atomic_load_n(&owner, __ATOMIC_ACQUIRE) != ticket, 0)) {
+#if LOCK_STATS
+            ticket_lock_spin(&owner, ticket, &stats);
+#else
+            ticket_lock_spin(&owner, ticket, nullptr);
+#endif
+        }
+#if LOCK_STATS
+        stats.acquisitions++;
+#endif
+    }
+
+    void unlock() {
+        __atomic_store_n(&owner, (u16)(owner + 1), __ATOMIC_RELEASE);
+    }
+
+    u32 lock_irqsave() {
+        u32 flags = irq_save();
+        lock();
+        return flags;
+    }
+
+    void unlock_irqrestore(u32 flags) {
+        unlock();
+        irq_restore(flags);
+    }
+};
+
+// Reader-writer spinlock. A waiting writer blocks new readers so
+// writers can't be starved by a steady stream of lookups.
+#define RWLOCK_WRITER  0x80000000u
+#define RWLOCK_PENDING 0x40000000u
+#define RWLOCK_READERS 0x3FFFFFFFu
+
+void rwlock_read_spin(volatile u32* state, LockStats* stats);
+void rwlock_write_spin(volatile u32* state, LockStats* stats);
+
+class RWSpinlock {
+private:
+    volatile u32 state;
+#if LOCK_STATS
+    LockStats stats;
+#endif
+
+    LockStats* stats_ptr() {
+#if LOCK_STATS
+        return &stats;
+#else
+        return nullptr;
+#endif
+    }
+
+public:
+    void initialize(const char* name) {
+        state = 0;
+#if LOCK_STATS
+        lock_stats_register(&stats, name);
+#else
+        (void)name;
+#endif
+    }
+
+    void read_lock() {
+        u32 s = __atomic_load_n(&state, __ATOMIC_RELAXED);
+        if (__builtin_expect((s & (RWLOCK_WRITER | RWLOCK_PENDING)) ||
+                             !__atomic_compare_exchange_n(&state, &s, s + 1, false,
+                                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED), 0)) {
+            rwlock_read_spin(&state, stats_ptr());
+        }
+#if LOCK_STATS
+        __atomic_add_fetch(&stats.acquisitions, 1, __ATOMIC_RELAXED);
+#endif
+    }
+
+    void read_unlock() {
+        __atomic_sub_fetch(&state, 1, __ATOMIC_RELEASE);
+    }
+
+    void write_lock() {
+        u32 expected = 0;
+        if (__builtin_expect(!__atomic_compare_exchange_n(&state, &expected, RWLOCK_WRITER, false,
+                                                          __ATOMIC_ACQUIRE, __ATOMIC_RELAXED), 0)) {
+            rwlock_write_spin(&state, stats_ptr());
+        }
+#if LOCK_STATS
+        stats.acquisitions++;
+#endif
+    }
+
+    void write_unlock() {
+        __atomic_and_fetch(&state, ~RWLOCK_WRITER, __ATOMIC_RELEASE);
+    }
+
+    u32 read_lock_irqsave() {
+        u32 flags = irq_save();
+        read_lock();
+        return flags;
+    }
+
+    void read_unlock_irqrestore(u32 flags) {
+        read_unlock();
+        irq_restore(flags);
+    }
+
+    u32 write_lock_irqsave() {
+        u32 flags = irq_save();
+        write_lock();
+        return flags;
+    }
+
+    void write_unlock_irqrestore(u32 flags) {
+        write_unlock();
+        irq_restore(flags);
+    }
+};
+
+#endif
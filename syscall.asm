@@ -0,0 +1,74 @@
+; sysenter entry point and the vsyscall stubs that syscall.cpp copies
+; into the page mapped at USER_VSYSCALL_ADDR in every process.
+section .text
+[bits 32]
+[extern sysenter_dispatch]
+
+KERNEL_DATA_SEG    equ 0x10
+USER_CODE_SEG      equ 0x1B
+USER_DATA_SEG      equ 0x23
+PERCPU_SEG         equ 0x30
+VECTOR_SYSCALL     equ 0x80
+USER_VSYSCALL_ADDR equ 0x7FFFF000   ; must match paging.h
+
+global sysenter_entry
+global vsyscall_sysenter_start
+global vsyscall_sysenter_end
+global vsyscall_int80_start
+global vsyscall_int80_end
+
+; Arrives with interrupts off, cs/ss from MSR_SYSENTER_CS and esp at this
+; CPU's tss.esp0 (MSR_SYSENTER_ESP). The stub left the user esp in ebp.
+; Build the same frame isr_common does so both paths share one dispatcher.
+sysenter_entry:
+    mov esp, [esp]              ; current process's kernel stack top
+    push dword USER_DATA_SEG    ; user_ss
+    push ebp                    ; user_esp
+    pushfd
+    or dword [esp], 0x200       ; user code always runs with IF set
+    push dword USER_CODE_SEG
+    push dword USER_VSYSCALL_ADDR + (vsyscall_sysenter_return - vsyscall_sysenter_start)
+    push dword 0                ; error code
+    push dword VECTOR_SYSCALL
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
+
+    mov ax, KERNEL_DATA_SEG
+    mov ds, ax
+    mov es, ax
+    mov ax, PERCPU_SEG
+    mov gs, ax
+
+    cld
+    push esp                    ; InterruptFrame*
+    call sysenter_dispatch
+    add esp, 4
+
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa                        ; eax = result
+    add esp, 8                  ; drop vector and error code
+    mov edx, [esp]              ; sysexit resumes at edx with esp = ecx
+    mov ecx, [esp + 12]
+    sti                         ; takes effect after sysexit
+    sysexit
+
+; Copied, not executed in place: both stubs must be position independent.
+vsyscall_sysenter_start:
+    push ebp
+    mov ebp, esp
+    sysenter
+vsyscall_sysenter_return:
+    pop ebp
+    ret
+vsyscall_sysenter_end:
+
+vsyscall_int80_start:
+    int VECTOR_SYSCALL
+    ret
+vsyscall_int80_end:
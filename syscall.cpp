@@ -0,0 +1,129 @@
+#include "syscall.h"
+#include "process.h"
+#include "ipc.h"
+#include "paging.h"
+#include "smp.h"
+#include "cpu.h"
+
+// Defined in syscall.asm
+extern "C" void sysenter_entry();
+extern "C" u8 vsyscall_sysenter_start[];
+extern "C" u8 vsyscall_sysenter_end[];
+extern "C" u8 vsyscall_int80_start[];
+extern "C" u8 vsyscall_int80_end[];
+
+typedef u32 (*SyscallFn)(u32 a, u32 b, u32 c, u32 d, u32 e);
+
+static u32 g_vsyscall_page = 0;
+static bool g_sysenter = false;
+static ConsoleWriteFn g_console = nullptr;
+
+static u32 sys_exit(u32 code, u32, u32, u32, u32) {
+    process_exit((s32)code);
+    return 0;
+}
+
+static u32 sys_write(u32 fd, u32 buf, u32 len, u32, u32) {
+    if ((fd != 1 && fd != 2) || !user_range_ok(buf, len)) return SYSCALL_ERROR;
+
+    // Copy out first: a bad user pointer faults (and kills the caller)
+    // here rather than inside the console code
+    char chunk[128];
+    for (u32 done = 0; done < len; ) {
+        u32 n = len - done < sizeof(chunk) ? len - done : sizeof(chunk);
+        for (u32 i = 0; i < n; i++) chunk[i] = ((const char*)buf)[done + i];
+        if (g_console) g_console(chunk, n);
+        done += n;
+    }
+    return len;
+}
+
+static u32 sys_getpid(u32, u32, u32, u32, u32) {
+    return process_current()->pid;
+}
+
+static u32 sys_yield(u32, u32, u32, u32, u32) {
+    schedule();
+    return 0;
+}
+
+static u32 sys_ipc_send(u32 endpoint, u32 word0, u32 word1, u32 pages, u32 count) {
+    return ipc_send(endpoint, word0, word1, pages, count);
+}
+
+static u32 sys_ipc_receive(u32 endpoint, u32 dest, u32 max_pages, u32, u32) {
+    return ipc_receive(endpoint, dest, max_pages);
+}
+
+static const SyscallFn syscall_table[SYSCALL_COUNT] = {
+    sys_exit,
+    sys_write,
+    sys_getpid,
+    sys_yield,
+    sys_ipc_send,
+    sys_ipc_receive,
+};
+
+// Shared by both entry paths; the frame is the caller's user state
+static void syscall_dispatch(InterruptFrame* frame) {
+    u32 nr = frame->eax;
+    irq_enable();  // the kernel isn't preemptible, but keep the timer and IPIs flowing
+    if (nr < SYSCALL_COUNT) {
+        frame->eax = syscall_table[nr](frame->ebx, frame->ecx, frame->edx, frame->esi, frame->edi);
+    } else {
+        frame->eax = SYSCALL_ERROR;
+    }
+    irq_disable();
+}
+
+// Called from sysenter_entry; int 0x80 goes through interrupt_dispatch,
+// which does the same return-to-user check
+extern "C" void sysenter_dispatch(InterruptFrame* frame) {
+    syscall_dispatch(frame);
+    process_return_to_user();
+}
+
+static bool cpu_has_sysenter() {
+    u32 eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_EDX_SEP)) return false;
+
+    // Pentium Pro reports SEP without implementing it (SDM vol. 2, SYSENTER)
+    u32 family = (eax >> 8) & 0xF;
+    u32 model = (eax >> 4) & 0xF;
+    u32 stepping = eax & 0xF;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+void syscall_initialize() {
+    register_user_interrupt_handler(VECTOR_SYSCALL, syscall_dispatch);
+
+    g_sysenter = cpu_has_sysenter();
+    if (g_sysenter) {
+        // sysenter loads esp from the MSR; point it at tss.esp0, which
+        // holds the current process's kernel stack top (see sysenter_entry)
+        wrmsr(MSR_SYSENTER_CS, KERNEL_CODE_SEG);
+        wrmsr(MSR_SYSENTER_ESP, (u32)&this_cpu()->tss.esp0);
+        wrmsr(MSR_SYSENTER_EIP, (u32)sysenter_entry);
+    }
+
+    // One read-only page shared by every process
+    g_vsyscall_page = frame_alloc();
+    if (!g_vsyscall_page) return;
+    const u8* start = g_sysenter ? vsyscall_sysenter_start : vsyscall_int80_start;
+    const u8* end = g_sysenter ? vsyscall_sysenter_end : vsyscall_int80_end;
+    u8* dst = (u8*)g_vsyscall_page;
+    for (u32 i = 0; start + i < end; i++) dst[i] = start[i];
+}
+
+bool syscall_uses_sysenter() {
+    return g_sysenter;
+}
+
+u32 syscall_vsyscall_page() {
+    return g_vsyscall_page;
+}
+
+void syscall_set_console(ConsoleWriteFn fn) {
+    g_console = fn;
+}
@@ -0,0 +1,28 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include "memory.h"
+#include "interrupts.h"
+
+// System call ABI: number in eax, arguments in ebx, ecx, edx, esi, edi,
+// result in eax; ecx and edx are clobbered. Programs call the stub in
+// the vsyscall page at USER_VSYSCALL_ADDR, which uses sysenter when the
+// CPU has it and int 0x80 otherwise.
+#define SYS_EXIT   0  // (code)
+#define SYS_WRITE  1  // (fd, buf, len) -> bytes written
+#define SYS_GETPID 2
+#define SYS_YIELD  3
+#define SYS_IPC_SEND    4  // (endpoint, word0, word1, pages, count) -> 0
+#define SYS_IPC_RECEIVE 5  // (endpoint, dest, max) -> sender pid; ebx, esi = words, edi = pages
+#define SYSCALL_COUNT 6
+
+#define SYSCALL_ERROR 0xFFFFFFFF
+
+typedef void (*ConsoleWriteFn)(const char* text, u32 len);
+
+void syscall_initialize();                 // BSP: int 0x80 gate, sysenter MSRs, vsyscall page
+bool syscall_uses_sysenter();
+u32 syscall_vsyscall_page();               // physical frame mapped into every process
+void syscall_set_console(ConsoleWriteFn fn);  // destination of fds 1 and 2
+
+#endif
@@ -0,0 +1,195 @@
+#include "task_pool.h"
+#include "cpu.h"
+#include "smp.h"
+#include "rcu.h"
+
+#define DEQUE_MASK (TASK_DEQUE_SIZE - 1)
+
+static WorkDeque g_deques[MAX_CPUS];
+static volatile u32 g_idle_mask = 0;  // bit per CPU halted in task_pool_wait_for_work
+static u32 g_executed[MAX_CPUS];
+static u32 g_stolen[MAX_CPUS];
+
+// --- Chase-Lev deque (fixed capacity, jobs stored by value) ---
+
+static bool deque_push(WorkDeque* q, const Job& job) {
+    s32 b = q->bottom;
+    s32 t = __atomic_load_n(&q->top, __ATOMIC_ACQUIRE);
+    if (b - t >= TASK_DEQUE_SIZE) return false;  // full
+
+    q->jobs[b & DEQUE_MASK] = job;
+    __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool deque_pop(WorkDeque* q, Job* out) {
+    s32 b = q->bottom - 1;
+    __atomic_store_n(&q->bottom, b, __ATOMIC_SEQ_CST);
+    s32 t = __atomic_load_n(&q->top, __ATOMIC_SEQ_CST);
+
+    if (t > b) {  // empty
+        __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    *out = q->jobs[b & DEQUE_MASK];
+    if (t == b) {
+        // Last job: race against thieves for it
+        bool won = __atomic_compare_exchange_n(&q->top, &t, t + 1, false,
+                                               __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&q->bottom, b + 1, __ATOMIC_RELAXED);
+        return won;
+    }
+    return true;
+}
+
+static bool deque_steal(WorkDeque* q, Job* out) {
+    s32 t = __atomic_load_n(&q->top, __ATOMIC_SEQ_CST);
+    s32 b = __atomic_load_n(&q->bottom, __ATOMIC_SEQ_CST);
+    if (t >= b) return false;
+
+    *out = q->jobs[t & DEQUE_MASK];
+    return __atomic_compare_exchange_n(&q->top, &t, t + 1, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static bool deque_empty(WorkDeque* q) {
+    return __atomic_load_n(&q->top, __ATOMIC_ACQUIRE) >= __atomic_load_n(&q->bottom, __ATOMIC_ACQUIRE);
+}
+
+// --- Scheduling ---
+
+// Kick one halted CPU so it comes looking for the job we just queued
+static void wake_idle_worker() {
+    u32 idle = __atomic_load_n(&g_idle_mask, __ATOMIC_ACQUIRE);
+    if (idle == 0) return;
+    u32 self = this_cpu()->index;
+    for (u32 i = 0; i < cpu_count(); i++) {
+        if (i != self && (idle & (1u << i))) {
+            smp_wakeup_cpu(i);
+            return;
+        }
+    }
+}
+
+static void execute(Job job);
+
+static void push_or_run(const Job& job) {
+    if (deque_push(&g_deques[this_cpu()->index], job)) {
+        wake_idle_worker();
+    } else {
+        execute(job);  // deque full: no parallelism to gain by queuing more
+    }
+}
+
+static void execute(Job job) {
+    if (job.range_fn) {
+        // Split off the upper half until the range is small enough
+        while (job.end - job.begin > job.grain) {
+            u32 mid = job.begin + (job.end - job.begin) / 2;
+            Job upper = job;
+            upper.begin = mid;
+            __atomic_add_fetch(&job.group->pending, 1, __ATOMIC_RELAXED);
+            push_or_run(upper);
+            job.end = mid;
+        }
+        job.range_fn(job.begin, job.end, job.arg);
+    } else {
+        job.fn(job.arg);
+    }
+
+    g_executed[this_cpu()->index]++;
+    __atomic_sub_fetch(&job.group->pending, 1, __ATOMIC_RELEASE);
+}
+
+bool task_pool_run_one() {
+    u32 self = this_cpu()->index;
+    Job job;
+
+    if (deque_pop(&g_deques[self], &job)) {
+        execute(job);
+        return true;
+    }
+
+    // Steal round-robin, starting with our neighbour
+    u32 n = cpu_count();
+    for (u32 k = 1; k < n; k++) {
+        u32 victim = (self + k) % n;
+        if (deque_steal(&g_deques[victim], &job)) {
+            g_stolen[self]++;
+            execute(job);
+            return true;
+        }
+    }
+    return false;
+}
+
+void task_pool_wait_for_work() {
+    u32 bit = 1u << this_cpu()->index;
+
+    // Publish that we are idle with interrupts off, then re-check for work:
+    // a wakeup IPI sent after the check stays pending until sti;hlt.
+    rcu_enter_idle();
+    irq_disable();
+    __atomic_or_fetch(&g_idle_mask, bit, __ATOMIC_SEQ_CST);
+
+    bool work = false;
+    for (u32 i = 0; i < cpu_count() && !work; i++) {
+        work = !deque_empty(&g_deques[i]);
+    }
+    if (work) {
+        irq_enable();
+    } else {
+        irq_enable_and_halt();
+    }
+    __atomic_and_fetch(&g_idle_mask, ~bit, __ATOMIC_SEQ_CST);
+    rcu_exit_idle();
+}
+
+// --- Public fork/join API ---
+
+void spawn(TaskGroup* group, TaskFn fn, void* arg) {
+    Job job;
+    job.fn = fn;
+    job.range_fn = nullptr;
+    job.arg = arg;
+    job.begin = job.end = job.grain = 0;
+    job.group = group;
+
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+    push_or_run(job);
+}
+
+// Help out (run our own and stolen jobs) until the group has drained
+void join(TaskGroup* group) {
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) != 0) {
+        if (!task_pool_run_one()) cpu_pause();
+    }
+}
+
+void parallel_for(u32 begin, u32 end, u32 grain, RangeFn fn, void* arg) {
+    if (begin >= end) return;
+
+    TaskGroup group;
+    group.pending = 1;
+
+    Job root;
+    root.fn = nullptr;
+    root.range_fn = fn;
+    root.arg = arg;
+    root.begin = begin;
+    root.end = end;
+    root.grain = grain ? grain : 1;
+    root.group = &group;
+
+    execute(root);
+    join(&group);
+}
+
+u32 task_pool_executed(u32 cpu_index) {
+    return cpu_index < MAX_CPUS ? g_executed[cpu_index] : 0;
+}
+
+u32 task_pool_stolen(u32 cpu_index) {
+    return cpu_index < MAX_CPUS ? g_stolen[cpu_index] : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include "memory.h"
+
+#define TASK_DEQUE_SIZE 128  // per CPU, power of two
+
+typedef void (*TaskFn)(void* arg);
+typedef void (*RangeFn)(u32 begin, u32 end, void* arg);
+
+// Completion counter shared by a batch of spawned jobs
+struct TaskGroup {
+    volatile u32 pending;
+};
+
+// A queued unit of work; range jobs split themselves until they reach grain size
+struct Job {
+    TaskFn fn;
+    RangeFn range_fn;
+    void* arg;
+    u32 begin;
+    u32 end;
+    u32 grain;
+    TaskGroup* group;
+};
+
+// Chase-Lev work-stealing deque: the owner pushes/pops at the bottom,
+// other CPUs steal from the top.
+struct WorkDeque {
+    volatile s32 top;
+    volatile s32 bottom;
+    Job jobs[TASK_DEQUE_SIZE];
+};
+
+// Fork/join API, callable from any CPU
+void spawn(TaskGroup* group, TaskFn fn, void* arg);
+void join(TaskGroup* group);
+void parallel_for(u32 begin, u32 end, u32 grain, RangeFn fn, void* arg);
+
+// Run one queued or stolen job; returns false if there was nothing to do
+bool task_pool_run_one();
+
+// Halt the calling CPU until new work may be available (used by cpu_idle_loop)
+void task_pool_wait_for_work();
+
+// Counters for the `cpus` command
+u32 task_pool_executed(u32 cpu_index);
+u32 task_pool_stolen(u32 cpu_index);
+
+#endif
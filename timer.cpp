@@ -0,0 +1,77 @@
+#include "timer.h"
+#include "cpu.h"
+#include "io.h"
+
+#define PIT_CH0_DATA   0x40
+#define PIT_CH2_DATA   0x42
+#define PIT_COMMAND    0x43
+#define PIT_CH2_GATE   0x61
+
+static u32 g_tsc_khz = 0;
+
+// One-shot countdown on PIT channel 2 (speaker disconnected);
+// bit 5 of port 0x61 goes high when the counter reaches zero.
+void pit_wait_us(u32 us) {
+    u32 count = (u32)udiv64((u64)PIT_FREQUENCY * us, 1000000);
+    if (count == 0) count = 1;
+    if (count > 0xFFFF) count = 0xFFFF;
+
+    u8 gate = inb(PIT_CH2_GATE) & ~0x02;
+    outb(PIT_CH2_GATE, gate & ~0x01);
+    outb(PIT_COMMAND, 0xB0);  // channel 2, lobyte/hibyte, mode 0
+    outb(PIT_CH2_DATA, count & 0xFF);
+    outb(PIT_CH2_DATA, (count >> 8) & 0xFF);
+    outb(PIT_CH2_GATE, gate | 0x01);  // rising gate edge starts the count
+
+    while (!(inb(PIT_CH2_GATE) & 0x20)) {}
+    outb(PIT_CH2_GATE, gate & ~0x01);
+}
+
+void pit_start_periodic(u32 hz) {
+    u32 divisor = PIT_FREQUENCY / hz;
+    if (divisor < 2) divisor = 2;
+    if (divisor > 0xFFFF) divisor = 0xFFFF;
+
+    outb(PIT_COMMAND, 0x34);  // channel 0, lobyte/hibyte, mode 2 (rate generator)
+    outb(PIT_CH0_DATA, divisor & 0xFF);
+    outb(PIT_CH0_DATA, (divisor >> 8) & 0xFF);
+}
+
+void pit_stop_periodic() {
+    // Mode 0 with no count written yet: the output stays low, no more IRQs
+    outb(PIT_COMMAND, 0x30);
+}
+
+void timer_initialize() {
+    // Take the best of a few 10ms samples to filter out emulator jitter
+    u64 best = (u64)-1;
+    for (int i = 0; i < 3; i++) {
+        u64 start = rdtsc();
+        pit_wait_us(10000);
+        u64 elapsed = rdtsc() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    g_tsc_khz = (u32)udiv64(best, 10);
+    if (g_tsc_khz == 0) g_tsc_khz = 1;
+}
+
+u32 tsc_khz() {
+    return g_tsc_khz;
+}
+
+void udelay(u32 us) {
+    u64 end = rdtsc() + udiv64((u64)us * g_tsc_khz, 1000);
+    while (rdtsc() < end) cpu_pause();
+}
+
+void mdelay(u32 ms) {
+    u64 end = rdtsc() + (u64)ms * g_tsc_khz;
+    while (rdtsc() < end) cpu_pause();
+}
+
+u64 tsc_to_ns(u64 cycles) {
+    // ns = cycles * 10^6 / khz, split to keep the product in range
+    u64 ms = udiv64(cycles, g_tsc_khz);
+    u64 rem = cycles - ms * g_tsc_khz;
+    return ms * 1000000 + udiv64(rem * 1000000, g_tsc_khz);
+}
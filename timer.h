@@ -0,0 +1,23 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "memory.h"
+
+#define PIT_FREQUENCY 1193182
+#define TIMER_HZ 100  // local APIC timer tick rate per CPU
+
+// Calibration (uses PIT channel 2, no interrupts needed)
+void timer_initialize();
+void pit_wait_us(u32 us);   // busy-wait, us <= 50000
+
+// PIT channel 0 as a periodic IRQ 0 source (the profiler's sampling clock)
+void pit_start_periodic(u32 hz);
+void pit_stop_periodic();
+
+// TSC based timing, valid after timer_initialize()
+u32 tsc_khz();
+void udelay(u32 us);
+void mdelay(u32 ms);
+u64 tsc_to_ns(u64 cycles);
+
+#endif
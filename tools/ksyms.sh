@@ -0,0 +1,52 @@
+#!/bin/sh
+# Turn `nm --defined-only` output for the kernel into ksyms.asm. Reads nm
+# output on stdin; empty input gives empty tables. Two tables, both
+# sorted by address and terminated by a null entry:
+#   ksym_table       exported symbols that module.cpp resolves module
+#                    references against (global T/D/R/B/W)
+#   ksym_text_table  every function, static ones included, for turning
+#                    code addresses into names (the profiler)
+# Both tables share one copy of each name.
+
+sort | awk '
+BEGIN { n = 0; t = 0; s = 0 }
+function intern(sym) {
+    if (!(sym in label)) {
+        label[sym] = s
+        str[s] = sym
+        s++
+    }
+    return label[sym]
+}
+$3 ~ /^ksym_/ { next }
+$2 ~ /^[TDRBW]$/ {
+    addr[n] = $1
+    name[n] = intern($3)
+    n++
+}
+$2 ~ /^[TtWw]$/ {
+    taddr[t] = $1
+    tname[t] = intern($3)
+    t++
+}
+END {
+    print "; Generated by tools/ksyms.sh - do not edit"
+    print "section .rodata"
+    print "global ksym_table"
+    print "global ksym_count"
+    print "global ksym_text_table"
+    print "global ksym_text_count"
+    print ""
+    print "align 4"
+    print "ksym_count:"
+    printf "    dd %d\n", n
+    print "ksym_table:"
+    for (i = 0; i < n; i++) printf "    dd 0x%s, ksym_name_%d\n", addr[i], name[i]
+    print "    dd 0, 0"
+    print "ksym_text_count:"
+    printf "    dd %d\n", t
+    print "ksym_text_table:"
+    for (i = 0; i < t; i++) printf "    dd 0x%s, ksym_name_%d\n", taddr[i], tname[i]
+    print "    dd 0, 0"
+    for (i = 0; i < s; i++) printf "ksym_name_%d: db \"%s\", 0\n", i, str[i]
+}'
@@ -0,0 +1,111 @@
+#!/bin/sh
+# make perf: boot the image headless in QEMU, type the commands in the
+# input file into the shell over COM1 once it is up, and pull the
+# benchmark report and the boot log back out of the serial stream. The
+# last command should be `exit`, which leaves QEMU through isa-debug-exit.
+#
+#   tools/perf.sh OS.bin input baseline          compare with the baseline
+#   tools/perf.sh OS.bin input baseline update   record a new baseline
+#
+# The raw serial output goes to perf.log, the metrics to perf.txt: one
+# "name<TAB>value" line each, median ns per bench case and the boot time
+# in ms (kernel entry to the shell, from the "boot: shell ready" klog
+# record). A metric fails when it is more than PERF_TOLERANCE percent and
+# more than PERF_SLACK units above its baseline.
+
+IMAGE=$1
+INPUT=$2
+BASELINE=$3
+MODE=${4:-check}
+QEMU=${QEMU:-qemu-system-i386}
+TIMEOUT=${PERF_TIMEOUT:-180}      # seconds for the whole run
+TOLERANCE=${PERF_TOLERANCE:-25}   # percent
+SLACK=${PERF_SLACK:-50}           # ns or ms: ignore jitter on tiny values
+LOG=perf.log
+RESULTS=perf.txt
+
+FIFO=$(mktemp -u /tmp/perf.XXXXXX)
+mkfifo "$FIFO" || exit 1
+trap 'rm -f "$FIFO"' EXIT
+
+timeout "$TIMEOUT" "$QEMU" -smp 4 -fda "$IMAGE" -display none -monitor none -serial stdio \
+    -device isa-debug-exit,iobase=0xf4,iosize=0x04 < "$FIFO" > "$LOG" 2>&1 &
+QEMU_PID=$!
+exec 3> "$FIFO"
+
+# Typing before the shell is up would be lost
+ticks=0
+until grep -q "AWAITING INPUT" "$LOG" 2>/dev/null; do
+    if ! kill -0 "$QEMU_PID" 2>/dev/null || [ "$ticks" -ge $((TIMEOUT * 10)) ]; then
+        echo "perf: the shell never came up, see $LOG"
+        exit 1
+    fi
+    sleep 0.1
+    ticks=$((ticks + 1))
+done
+
+grep -v '^#' "$INPUT" >&3
+wait "$QEMU_PID"
+status=$?
+exec 3>&-
+
+# exit 0 in the guest is status 1: (code << 1) | 1
+if [ "$status" -eq 124 ]; then
+    echo "perf: timed out after ${TIMEOUT}s, see $LOG"
+    exit 1
+elif [ "$status" -ne 1 ]; then
+    echo "perf: QEMU exited with status $status, see $LOG"
+    exit 1
+fi
+
+awk '
+{ sub(/\r$/, "") }
+/^--- .* ---$/ { section = $2; next }
+section == "bench.log" && /^[^:]+: [0-9]+c [0-9]+ns p99/ {
+    name = substr($0, 1, index($0, ":") - 1)
+    split(substr($0, index($0, ":") + 2), field, " ")
+    ns = field[2]
+    sub(/ns$/, "", ns)
+    printf "%s ns\t%d\n", name, ns
+}
+section == "dmesg.log" && /boot: shell ready/ {
+    stamp = $0
+    sub(/^\[ */, "", stamp)
+    sub(/\].*/, "", stamp)
+    split(stamp, part, ".")
+    printf "boot ms\t%d\n", part[1] * 1000 + int(part[2] / 1000)
+}' "$LOG" > "$RESULTS"
+
+if [ ! -s "$RESULTS" ]; then
+    echo "perf: no results in $LOG"
+    exit 1
+fi
+
+if [ "$MODE" = update ] || [ ! -f "$BASELINE" ]; then
+    cp "$RESULTS" "$BASELINE"
+    echo "perf: $(wc -l < "$RESULTS") metrics recorded in $BASELINE"
+    exit 0
+fi
+
+awk -F '\t' -v tolerance="$TOLERANCE" -v slack="$SLACK" '
+NR == FNR { base[$1] = $2; order[n++] = $1; next }
+{ now[$1] = $2 }
+END {
+    failed = 0
+    printf "%-24s %10s %10s %8s\n", "metric", "baseline", "now", "change"
+    for (i = 0; i < n; i++) {
+        key = order[i]
+        if (!(key in now)) {
+            printf "%-24s %10d %10s %8s  MISSING\n", key, base[key], "-", ""
+            failed = 1
+            continue
+        }
+        limit = base[key] * (100 + tolerance) / 100
+        if (limit < base[key] + slack) limit = base[key] + slack
+        change = base[key] ? (now[key] - base[key]) * 100 / base[key] : 0
+        verdict = now[key] > limit ? "REGRESSED" : ""
+        if (verdict != "") failed = 1
+        printf "%-24s %10d %10d %+7.1f%%  %s\n", key, base[key], now[key], change, verdict
+    }
+    exit failed
+}' "$BASELINE" "$RESULTS"
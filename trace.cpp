@@ -0,0 +1,138 @@
+#include "trace.h"
+#include "cpu.h"
+#include "smp.h"
+#include "timer.h"
+#include "serial.h"
+
+struct TraceRing {
+    u32 head;  // records ever written; the next slot is head % TRACE_RING_SIZE
+    TraceRecord records[TRACE_RING_SIZE];
+};
+
+volatile bool g_trace_enabled = false;
+
+static TraceRing* g_rings[MAX_CPUS];
+static u64 g_trace_start = 0;
+
+static const char* const event_names[TRACE_EVENT_COUNT] = {
+    "key", "command", "fs_create", "fs_read", "fs_delete", "kmalloc", "screen",
+};
+
+static const char* const event_categories[TRACE_EVENT_COUNT] = {
+    "input", "shell", "fs", "fs", "fs", "memory", "vga",
+};
+
+void trace_record(u8 event, u8 phase, u32 arg) {
+    TraceRing* ring = g_rings[this_cpu()->index];
+    if (!ring) return;
+
+    // Only this CPU writes its ring, so claiming a slot just has to be
+    // atomic against our own interrupts: xadd without a lock prefix.
+    u32 slot = 1;
+    asm volatile ("xaddl %0, %1" : "+r"(slot), "+m"(ring->head) : : "memory");
+
+    TraceRecord* r = &ring->records[slot & (TRACE_RING_SIZE - 1)];
+    r->tsc = rdtsc();
+    r->arg = arg;
+    r->event = event;
+    r->phase = phase;
+}
+
+bool trace_start(const char** error) {
+    if (g_trace_enabled) {
+        *error = "TRACING ALREADY ON";
+        return false;
+    }
+    for (u32 i = 0; i < cpu_count(); i++) {
+        if (!g_rings[i]) g_rings[i] = (TraceRing*)kmalloc(sizeof(TraceRing));
+        if (!g_rings[i]) {
+            *error = "OUT OF MEMORY";
+            return false;
+        }
+        g_rings[i]->head = 0;
+    }
+    g_trace_start = rdtsc();
+    __atomic_store_n(&g_trace_enabled, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+void trace_stop() {
+    __atomic_store_n(&g_trace_enabled, false, __ATOMIC_RELEASE);
+}
+
+// ---- Chrome trace JSON ----
+
+struct JsonLine {
+    char text[160];
+    u32 len;
+};
+
+static void put(JsonLine* line, const char* text) {
+    while (*text && line->len < sizeof(line->text) - 1) line->text[line->len++] = *text++;
+}
+
+static void put_num(JsonLine* line, u32 value, u32 min_digits = 1) {
+    char num[12];
+    itoa(num, (int)value, 10);
+    for (u32 n = strlen(num); n < min_digits; n++) put(line, "0");
+    put(line, num);
+}
+
+static void emit_record(const TraceRecord* r, u32 cpu, bool first) {
+    // Timestamps in microseconds with ns precision; APs whose TSC lags
+    // the BSP's a little are clamped to the start
+    u64 delta = r->tsc > g_trace_start ? r->tsc - g_trace_start : 0;
+    u64 ns = tsc_to_ns(delta);
+    u32 us = (u32)udiv64(ns, 1000);
+    u32 frac = (u32)(ns - (u64)us * 1000);
+
+    JsonLine line;
+    line.len = 0;
+    u8 event = r->event < TRACE_EVENT_COUNT ? r->event : (u8)TRACE_KEY;
+    char phase[2] = { (char)r->phase, 0 };
+
+    put(&line, first ? "\n" : ",\n");
+    put(&line, "{\"name\":\"");
+    put(&line, event_names[event]);
+    put(&line, "\",\"cat\":\"");
+    put(&line, event_categories[event]);
+    put(&line, "\",\"ph\":\"");
+    put(&line, phase);
+    put(&line, "\",\"ts\":");
+    put_num(&line, us);
+    put(&line, ".");
+    put_num(&line, frac, 3);
+    put(&line, ",\"pid\":1,\"tid\":");
+    put_num(&line, cpu);
+    if (r->phase == TRACE_INSTANT) put(&line, ",\"s\":\"t\"");
+    if (r->phase != TRACE_END) {
+        put(&line, ",\"args\":{\"arg\":");
+        put_num(&line, r->arg);
+        put(&line, "}");
+    }
+    put(&line, "}");
+    serial_write(line.text, line.len);
+}
+
+bool trace_dump(u32* sent, u32* overwritten) {
+    *sent = 0;
+    *overwritten = 0;
+    if (!serial_present()) return false;
+    trace_stop();
+
+    serial_print("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (u32 cpu = 0; cpu < cpu_count(); cpu++) {
+        TraceRing* ring = g_rings[cpu];
+        if (!ring) continue;
+        u32 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        u32 count = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+        *overwritten += head - count;
+
+        for (u32 i = head - count; i != head; i++) {
+            emit_record(&ring->records[i & (TRACE_RING_SIZE - 1)], cpu, *sent == 0);
+            (*sent)++;
+        }
+    }
+    serial_print("\n]}\n");
+    return true;
+}
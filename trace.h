@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "memory.h"
+
+// Static tracepoints into per-CPU ring buffers. While tracing is off a
+// tracepoint is one load and a not-taken branch. While it's on, each one
+// writes a 16-byte record with a TSC timestamp into the ring of the CPU
+// it runs on; rings overwrite their oldest records when full.
+// trace_dump() streams the rings over COM1 as Chrome trace JSON
+// (load it in chrome://tracing or Perfetto).
+
+#define TRACE_RING_SIZE 2048  // records per CPU, power of two
+
+enum TraceEventId : u8 {
+    TRACE_KEY,        // scan code read from the keyboard (arg: scan code)
+    TRACE_COMMAND,    // shell command dispatch
+    TRACE_FS_CREATE,  // RAM disk operations (arg: size)
+    TRACE_FS_READ,
+    TRACE_FS_DELETE,
+    TRACE_ALLOC,      // kmalloc (arg: size)
+    TRACE_SCREEN,     // full editor repaint
+    TRACE_EVENT_COUNT
+};
+
+#define TRACE_BEGIN   'B'
+#define TRACE_END     'E'
+#define TRACE_INSTANT 'i'
+
+struct TraceRecord {
+    u64 tsc;
+    u32 arg;
+    u8 event;
+    u8 phase;
+    u16 reserved;
+};
+
+extern volatile bool g_trace_enabled;
+
+void trace_record(u8 event, u8 phase, u32 arg);
+
+static inline void trace_point(u8 event, u8 phase, u32 arg) {
+    if (__builtin_expect(g_trace_enabled, 0)) trace_record(event, phase, arg);
+}
+
+static inline void trace_begin(u8 event, u32 arg = 0) {
+    trace_point(event, TRACE_BEGIN, arg);
+}
+
+static inline void trace_end(u8 event, u32 arg = 0) {
+    trace_point(event, TRACE_END, arg);
+}
+
+static inline void trace_instant(u8 event, u32 arg = 0) {
+    trace_point(event, TRACE_INSTANT, arg);
+}
+
+bool trace_start(const char** error);  // clears the rings
+void trace_stop();
+
+// Stops tracing and writes everything to COM1. Returns false without a
+// serial port; counts what was sent and what the rings had overwritten.
+bool trace_dump(u32* sent, u32* overwritten);
+
+#endif
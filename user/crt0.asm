@@ -0,0 +1,17 @@
+; Entry point for ELF programs: run main() and pass its result to SYS_EXIT.
+[bits 32]
+section .text
+
+VSYSCALL equ 0x7FFFF000         ; USER_VSYSCALL_ADDR
+SYS_EXIT equ 0
+
+global _start
+extern main
+
+_start:
+    call main
+    mov ebx, eax
+    mov eax, SYS_EXIT
+    mov esi, VSYSCALL
+    call esi
+    jmp $                       ; SYS_EXIT does not return
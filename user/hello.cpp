@@ -0,0 +1,13 @@
+// Sample ELF program for the `exec` command. The buffer lives in bss:
+// only the page it touches gets a frame.
+#include "ulib.h"
+
+static char scratch[64 * 1024];
+static const char greeting[] = "HELLO FROM ELF. PID ";
+
+int main() {
+    for (u32 i = 0; greeting[i]; i++) scratch[i] = greeting[i];
+    print(scratch);
+    print_num(sys_getpid());
+    return 0;
+}
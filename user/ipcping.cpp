@@ -0,0 +1,59 @@
+// IPC client for the `ipctest` command: bounces 0, 1, 16 and 64 pages
+// off ipcpong and prints the average round trip in cycles, next to the
+// cost of copying the largest payload once.
+#include "ulib.h"
+
+#define PING_ENDPOINT 1
+#define PONG_ENDPOINT 2
+#define IPC_QUIT 0xFFFFFFFF
+#define MAX_PAGES 64
+#define ROUNDS 32
+
+static u8 buffer[MAX_PAGES * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static u8 copy_target[MAX_PAGES * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static const u32 sizes[] = {0, 1, 16, MAX_PAGES};
+
+// One round trip; false if a page came back wrong
+static bool round_trip(u32 pages, u32 stamp) {
+    for (u32 i = 0; i < pages; i++) buffer[i * PAGE_SIZE] = (u8)(stamp + i);
+    if (ipc_send(PING_ENDPOINT, stamp, 0, buffer, pages) != 0) return false;
+
+    IpcMessage reply = ipc_receive(PONG_ENDPOINT, buffer, pages);
+    if (reply.sender == SYSCALL_ERROR || reply.pages != pages || reply.words[1] != 0) return false;
+    return true;
+}
+
+int main() {
+    print("IPC ROUND TRIP CYCLES");
+    for (u32 s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        u32 pages = sizes[s];
+        if (!round_trip(pages, 0)) {  // warm up: faults the pages in
+            print(" FAILED");
+            return 1;
+        }
+
+        u64 start = rdtsc();
+        for (u32 i = 1; i <= ROUNDS; i++) {
+            if (!round_trip(pages, i)) {
+                print(" FAILED");
+                return 1;
+            }
+        }
+        print(" ");
+        print_num(pages);
+        print("P:");
+        print_num((u32)((rdtsc() - start) / ROUNDS));
+    }
+    ipc_send(PING_ENDPOINT, IPC_QUIT, 0, 0, 0);
+
+    // For scale: copying the same payload once, into pages already faulted in
+    for (u32 i = 0; i < sizeof(copy_target); i += PAGE_SIZE) copy_target[i] = 0;
+    u64 start = rdtsc();
+    const u32* src = (const u32*)buffer;
+    u32* dst = (u32*)copy_target;
+    for (u32 i = 0; i < sizeof(buffer) / 4; i++) dst[i] = src[i];
+    asm volatile("" : : "r"(dst) : "memory");  // keep the copy
+    print(". COPY 64P:");
+    print_num((u32)(rdtsc() - start));
+    return 0;
+}
@@ -0,0 +1,24 @@
+// IPC server for the `ipctest` command: checks the stamp on every page
+// it receives and sends the pages straight back.
+#include "ulib.h"
+
+#define PING_ENDPOINT 1
+#define PONG_ENDPOINT 2
+#define IPC_QUIT 0xFFFFFFFF
+#define MAX_PAGES 64
+
+static u8 window[MAX_PAGES * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+
+int main() {
+    while (true) {
+        IpcMessage msg = ipc_receive(PING_ENDPOINT, window, MAX_PAGES);
+        if (msg.sender == SYSCALL_ERROR) return 1;
+        if (msg.words[0] == IPC_QUIT) return 0;
+
+        u32 bad = 0;
+        for (u32 i = 0; i < msg.pages; i++) {
+            if (window[i * PAGE_SIZE] != (u8)(msg.words[0] + i)) bad++;
+        }
+        ipc_send(PONG_ENDPOINT, msg.words[0], bad, window, msg.pages);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef USER_ULIB_H
+#define USER_ULIB_H
+
+// Minimal runtime for ELF programs: system call wrappers through the
+// vsyscall page and a few console helpers. Header only; crt0.asm
+// supplies _start.
+
+#include "syscall.h"
+#include "paging.h"
+
+static inline u32 syscall3(u32 nr, u32 a, u32 b, u32 c) {
+    asm volatile("call %P[entry]"
+                 : "+a"(nr), "+c"(b), "+d"(c)
+                 : "b"(a), [entry] "i"(USER_VSYSCALL_ADDR)
+                 : "memory");
+    return nr;
+}
+
+// Full register form, for calls that return more than eax
+struct SyscallResult {
+    u32 eax, ebx, esi, edi;
+};
+
+static inline SyscallResult syscall5(u32 nr, u32 a, u32 b, u32 c, u32 d, u32 e) {
+    asm volatile("call %P[entry]"
+                 : "+a"(nr), "+b"(a), "+c"(b), "+d"(c), "+S"(d), "+D"(e)
+                 : [entry] "i"(USER_VSYSCALL_ADDR)
+                 : "memory");
+    SyscallResult r = {nr, a, d, e};
+    return r;
+}
+
+static inline void sys_exit(s32 code) { syscall3(SYS_EXIT, (u32)code, 0, 0); }
+static inline u32 sys_write(u32 fd, const void* buf, u32 len) { return syscall3(SYS_WRITE, fd, (u32)buf, len); }
+static inline u32 sys_getpid() { return syscall3(SYS_GETPID, 0, 0, 0); }
+static inline void sys_yield() { syscall3(SYS_YIELD, 0, 0, 0); }
+
+struct IpcMessage {
+    u32 sender;     // pid, or SYSCALL_ERROR
+    u32 words[2];
+    u32 pages;      // received at the dest address
+};
+
+static inline u32 ipc_send(u32 endpoint, u32 word0, u32 word1, const void* pages, u32 count) {
+    return syscall5(SYS_IPC_SEND, endpoint, word0, word1, (u32)pages, count).eax;
+}
+
+static inline IpcMessage ipc_receive(u32 endpoint, void* dest, u32 max_pages) {
+    SyscallResult r = syscall5(SYS_IPC_RECEIVE, endpoint, (u32)dest, max_pages, 0, 0);
+    IpcMessage msg = {r.eax, {r.ebx, r.esi}, r.edi};
+    return msg;
+}
+
+static inline u64 rdtsc() {
+    u32 lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64)hi << 32) | lo;
+}
+
+static inline void print(const char* text) {
+    u32 len = 0;
+    while (text[len]) len++;
+    sys_write(1, text, len);
+}
+
+static inline void print_num(u32 value) {
+    char buf[11];
+    u32 i = sizeof(buf);
+    do {
+        buf[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    sys_write(1, buf + i, sizeof(buf) - i);
+}
+
+#endif
@@ -0,0 +1,111 @@
+; Ring 3 smoke test and syscall microbenchmark, loaded as a flat image
+; at USER_BASE by the `usertest` command. Prints a greeting, then the
+; average round trip of a null syscall through the vsyscall page (sysenter
+; when available) and through a raw int 0x80, and exits.
+[bits 32]
+[org 0x40000000]                ; USER_BASE
+
+VSYSCALL   equ 0x7FFFF000       ; USER_VSYSCALL_ADDR
+SYS_EXIT   equ 0
+SYS_WRITE  equ 1
+SYS_GETPID equ 2
+ITERATIONS equ 1000
+
+_start:
+    mov ecx, msg_hello
+    mov edx, msg_hello_len
+    call write
+
+    ; Warm up, then time the vsyscall path
+    mov eax, SYS_GETPID
+    call VSYSCALL
+    rdtsc
+    mov [start_lo], eax
+    mov esi, ITERATIONS
+.vsyscall_loop:
+    mov eax, SYS_GETPID
+    call VSYSCALL
+    dec esi
+    jnz .vsyscall_loop
+    call cycles_per_call
+    push eax
+    mov ecx, msg_vsyscall
+    mov edx, msg_vsyscall_len
+    call write
+    pop eax
+    call write_number
+
+    ; Same loop through the interrupt gate
+    mov eax, SYS_GETPID
+    int 0x80
+    rdtsc
+    mov [start_lo], eax
+    mov esi, ITERATIONS
+.int80_loop:
+    mov eax, SYS_GETPID
+    int 0x80
+    dec esi
+    jnz .int80_loop
+    call cycles_per_call
+    push eax
+    mov ecx, msg_int80
+    mov edx, msg_int80_len
+    call write
+    pop eax
+    call write_number
+
+    mov eax, SYS_EXIT
+    xor ebx, ebx
+    call VSYSCALL
+    jmp $                       ; not reached
+
+; eax = (rdtsc - start_lo) / ITERATIONS; the loops are short enough for 32 bits
+cycles_per_call:
+    rdtsc
+    sub eax, [start_lo]
+    xor edx, edx
+    mov ecx, ITERATIONS
+    div ecx
+    ret
+
+; write(1, ecx, edx)
+write:
+    push ebx
+    mov eax, SYS_WRITE
+    mov ebx, 1
+    call VSYSCALL
+    pop ebx
+    ret
+
+; Print eax in decimal followed by " CYCLES "
+write_number:
+    mov edi, number_end
+    mov ecx, 10
+.digit:
+    xor edx, edx
+    div ecx
+    add dl, '0'
+    dec edi
+    mov [edi], dl
+    test eax, eax
+    jnz .digit
+    mov ecx, edi
+    mov edx, number_end
+    sub edx, edi
+    call write
+    mov ecx, msg_cycles
+    mov edx, msg_cycles_len
+    jmp write
+
+msg_hello:    db "HELLO FROM RING 3. "
+msg_hello_len equ $ - msg_hello
+msg_vsyscall: db "VSYSCALL "
+msg_vsyscall_len equ $ - msg_vsyscall
+msg_int80:    db "INT 0x80 "
+msg_int80_len equ $ - msg_int80
+msg_cycles:   db " CYCLES. "
+msg_cycles_len equ $ - msg_cycles
+
+start_lo:     dd 0
+number:       times 10 db 0
+number_end:
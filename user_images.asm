@@ -0,0 +1,53 @@
+; Built-in ring 3 programs, assembled separately as flat binaries
+; linked at USER_BASE and embedded here for process_spawn_flat.
+section .rodata
+
+global usertest_image
+global usertest_image_end
+
+usertest_image:
+    incbin "user/usertest.bin"
+usertest_image_end:
+
+; ELF executables, modules and scripts, copied onto the RAM disk by exec_install_initrd.
+; Entries are { name, data, size }, terminated by a null name.
+global initrd_files
+
+align 4
+initrd_files:
+    dd hello_name, hello_elf, hello_elf_end - hello_elf
+    dd ipcping_name, ipcping_elf, ipcping_elf_end - ipcping_elf
+    dd ipcpong_name, ipcpong_elf, ipcpong_elf_end - ipcpong_elf
+    dd memtest_name, memtest_mod, memtest_mod_end - memtest_mod
+    dd demo_name, demo_script, demo_script_end - demo_script
+    dd 0, 0, 0
+
+hello_name:
+    db "hello", 0
+hello_elf:
+    incbin "user/hello.elf"
+hello_elf_end:
+
+ipcping_name:
+    db "ipcping", 0
+ipcping_elf:
+    incbin "user/ipcping.elf"
+ipcping_elf_end:
+
+ipcpong_name:
+    db "ipcpong", 0
+ipcpong_elf:
+    incbin "user/ipcpong.elf"
+ipcpong_elf_end:
+
+memtest_name:
+    db "memtest.o", 0
+memtest_mod:
+    incbin "modules/memtest.o"
+memtest_mod_end:
+
+demo_name:
+    db "demo", 0
+demo_script:
+    incbin "scripts/demo"
+demo_script_end:
@@ -0,0 +1,157 @@
+#include "virtio.h"
+#include "io.h"
+
+static inline u32 align_up(u32 value, u32 align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+// EVENT_IDX words past the end of each ring
+static inline volatile u16* used_event(Virtqueue* vq) {
+    return (volatile u16*)&vq->avail->ring[vq->size];
+}
+
+static inline volatile u16* avail_event(Virtqueue* vq) {
+    return (volatile u16*)&vq->used->ring[vq->size];
+}
+
+// True if the other side asked to hear about an index between old and new
+static inline bool need_event(u16 event, u16 new_idx, u16 old_idx) {
+    return (u16)(new_idx - event - 1) < (u16)(new_idx - old_idx);
+}
+
+bool virtq_initialize(Virtqueue* vq, u16 io_base, u16 index, bool event_idx) {
+    outw(io_base + VIRTIO_PCI_QUEUE_SEL, index);
+    u16 size = inw(io_base + VIRTIO_PCI_QUEUE_NUM);
+    if (!size || (size & (size - 1))) return false;
+
+    u32 used_offset = align_up(sizeof(VirtqDesc) * size + 6 + 2 * size, VIRTQ_ALIGN);
+    u32 total = used_offset + align_up(6 + sizeof(VirtqUsedElem) * size, VIRTQ_ALIGN);
+    vq->size = 0;
+    vq->memory = (u8*)kmalloc(total + VIRTQ_ALIGN);
+    vq->tokens = (void**)kmalloc(size * sizeof(void*));
+    if (!vq->memory || !vq->tokens) {
+        virtq_destroy(vq);
+        return false;
+    }
+
+    u8* rings = (u8*)align_up((u32)vq->memory, VIRTQ_ALIGN);
+    memset(rings, 0, total);
+    vq->io_base = io_base;
+    vq->index = index;
+    vq->size = size;
+    vq->desc = (VirtqDesc*)rings;
+    vq->avail = (VirtqAvail*)(rings + sizeof(VirtqDesc) * size);
+    vq->used = (VirtqUsed*)(rings + used_offset);
+    for (u16 i = 0; i < size; i++) {
+        vq->desc[i].next = i + 1;
+        vq->tokens[i] = nullptr;
+    }
+    vq->free_head = 0;
+    vq->free_count = size;
+    vq->avail_idx = 0;
+    vq->kicked_idx = 0;
+    vq->last_used = 0;
+    vq->event_idx = event_idx;
+    vq->kicks = 0;
+    vq->kicks_suppressed = 0;
+
+    // Kernel memory is identity mapped: the rings' address is physical
+    outl(io_base + VIRTIO_PCI_QUEUE_PFN, (u32)rings / VIRTQ_ALIGN);
+    return true;
+}
+
+void virtq_destroy(Virtqueue* vq) {
+    if (vq->size) {
+        outw(vq->io_base + VIRTIO_PCI_QUEUE_SEL, vq->index);
+        outl(vq->io_base + VIRTIO_PCI_QUEUE_PFN, 0);
+    }
+    if (vq->memory) kfree(vq->memory);
+    if (vq->tokens) kfree(vq->tokens);
+    vq->memory = nullptr;
+    vq->tokens = nullptr;
+    vq->size = 0;
+}
+
+bool virtq_add(Virtqueue* vq, const VirtqBuffer* buffers, u32 out, u32 in, void* token) {
+    u32 count = out + in;
+    if (count == 0 || count > vq->free_count) return false;
+
+    u16 head = vq->free_head;
+    u16 i = head;
+    for (u32 k = 0; k < count; k++) {
+        VirtqDesc* d = &vq->desc[i];
+        d->addr = (u32)buffers[k].addr;
+        d->len = buffers[k].len;
+        d->flags = (k >= out ? VIRTQ_DESC_F_WRITE : 0) | (k + 1 < count ? VIRTQ_DESC_F_NEXT : 0);
+        i = d->next;  // the free list link doubles as the chain link
+    }
+    vq->free_head = i;
+    vq->free_count -= count;
+
+    vq->tokens[head] = token;
+    vq->avail->ring[vq->avail_idx & (vq->size - 1)] = head;
+    vq->avail_idx++;
+    return true;
+}
+
+void virtq_kick(Virtqueue* vq) {
+    u16 old_idx = vq->kicked_idx;
+    u16 new_idx = vq->avail_idx;
+    if (old_idx == new_idx) return;
+
+    // Ring entries before the index (x86 keeps stores in order; this
+    // stops the compiler reordering them), then a full fence so the
+    // device's suppression state is read after it can see the index
+    __atomic_store_n(&vq->avail->idx, new_idx, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    vq->kicked_idx = new_idx;
+
+    bool notify = vq->event_idx ? need_event(*avail_event(vq), new_idx, old_idx)
+                                : !(__atomic_load_n(&vq->used->flags, __ATOMIC_RELAXED) & VIRTQ_USED_F_NO_NOTIFY);
+    if (notify) {
+        outw(vq->io_base + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+        vq->kicks++;
+    } else {
+        vq->kicks_suppressed++;
+    }
+}
+
+void* virtq_get(Virtqueue* vq, u16* head, u32* len) {
+    if (vq->last_used == __atomic_load_n(&vq->used->idx, __ATOMIC_ACQUIRE)) return nullptr;
+
+    const VirtqUsedElem& elem = vq->used->ring[vq->last_used & (vq->size - 1)];
+    u16 id = (u16)elem.id;
+    if (len) *len = elem.len;
+    if (head) *head = id;
+    vq->last_used++;
+
+    u16 last = id;
+    u16 count = 1;
+    while (vq->desc[last].flags & VIRTQ_DESC_F_NEXT) {
+        last = vq->desc[last].next;
+        count++;
+    }
+    vq->desc[last].next = vq->free_head;
+    vq->free_head = id;
+    vq->free_count += count;
+
+    void* token = vq->tokens[id];
+    vq->tokens[id] = nullptr;
+    return token;
+}
+
+// With EVENT_IDX a used_event left behind last_used already keeps the
+// device quiet; the flag is for devices without it
+void virtq_disable_interrupts(Virtqueue* vq) {
+    if (!vq->event_idx) vq->avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
+}
+
+bool virtq_enable_interrupts(Virtqueue* vq) {
+    if (vq->event_idx) {
+        *used_event(vq) = vq->last_used;
+    } else {
+        vq->avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&vq->used->idx, __ATOMIC_ACQUIRE) == vq->last_used;
+}
@@ -0,0 +1,118 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include "memory.h"
+
+// Legacy (0.9.5) virtio over PCI: the device registers sit in I/O BAR0
+// and each queue is one physically contiguous split virtqueue. The
+// descriptor table and the available ring come first. The used ring
+// starts on the next page. virtio-blk uses this now; virtio-net can use
+// it later.
+
+#define VIRTIO_PCI_VENDOR 0x1AF4
+
+// I/O BAR0 register offsets
+#define VIRTIO_PCI_HOST_FEATURES  0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN      0x08
+#define VIRTIO_PCI_QUEUE_NUM      0x0C
+#define VIRTIO_PCI_QUEUE_SEL      0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY   0x10
+#define VIRTIO_PCI_STATUS         0x12
+#define VIRTIO_PCI_ISR            0x13  // read clears; bit 0: used ring updated
+#define VIRTIO_PCI_CONFIG         0x14  // device specific (no MSI-X)
+
+// Device status
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER      0x02
+#define VIRTIO_STATUS_DRIVER_OK   0x04
+#define VIRTIO_STATUS_FAILED      0x80
+
+// Transport feature bits
+#define VIRTIO_RING_F_EVENT_IDX (1u << 29)
+
+#define VIRTQ_DESC_F_NEXT  1
+#define VIRTQ_DESC_F_WRITE 2            // device writes this buffer
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+#define VIRTQ_USED_F_NO_NOTIFY 1
+#define VIRTQ_ALIGN 4096
+
+struct VirtqDesc {
+    u64 addr;
+    u32 len;
+    u16 flags;
+    u16 next;
+};
+
+struct VirtqAvail {
+    u16 flags;
+    u16 idx;
+    u16 ring[];             // then u16 used_event (EVENT_IDX)
+};
+
+struct VirtqUsedElem {
+    u32 id;                 // head of the finished chain
+    u32 len;                // bytes the device wrote
+};
+
+struct VirtqUsed {
+    u16 flags;
+    u16 idx;
+    VirtqUsedElem ring[];   // then u16 avail_event (EVENT_IDX)
+};
+
+struct VirtqBuffer {
+    const void* addr;
+    u32 len;
+};
+
+// Not locked: the owning driver serializes access
+struct Virtqueue {
+    u16 io_base;
+    u16 index;
+    u16 size;               // entries, a power of two
+    u16 free_head;          // unused descriptors, linked through next
+    u16 free_count;
+    u16 avail_idx;          // next avail->idx to publish
+    u16 kicked_idx;         // avail->idx at the last kick
+    u16 last_used;          // next used entry to reap
+    bool event_idx;         // VIRTIO_RING_F_EVENT_IDX negotiated
+    VirtqDesc* desc;
+    VirtqAvail* avail;
+    VirtqUsed* used;
+    void** tokens;          // per chain head
+    u8* memory;             // kmalloc block holding the rings
+    u32 kicks;              // doorbell writes
+    u32 kicks_suppressed;   // batches the device didn't need to hear about
+};
+
+// Select queue index, size and allocate its rings and tell the device
+// where they are. Fails if the queue doesn't exist or memory runs out.
+bool virtq_initialize(Virtqueue* vq, u16 io_base, u16 index, bool event_idx);
+void virtq_destroy(Virtqueue* vq);
+
+// The chain of the next virtq_add starts here, so a driver can index
+// per-request state by head before adding
+static inline u16 virtq_next_head(const Virtqueue* vq) {
+    return vq->free_head;
+}
+
+// Chain out device-readable then in device-writable buffers and make it
+// available; false if there aren't enough free descriptors. Nothing is
+// visible to the device before virtq_kick.
+bool virtq_add(Virtqueue* vq, const VirtqBuffer* buffers, u32 out, u32 in, void* token);
+
+// Publish everything added since the last kick; rings the doorbell only
+// if the device asked to hear about it
+void virtq_kick(Virtqueue* vq);
+
+// Next finished chain: its token, the head and the bytes written, or
+// nullptr when nothing is pending. The descriptors go back on the free list.
+void* virtq_get(Virtqueue* vq, u16* head, u32* len);
+
+// Completion interrupts. virtq_enable_interrupts returns false when
+// entries arrived meanwhile: reap again or they may never interrupt.
+void virtq_disable_interrupts(Virtqueue* vq);
+bool virtq_enable_interrupts(Virtqueue* vq);
+
+#endif
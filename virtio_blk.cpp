@@ -0,0 +1,194 @@
+#include "virtio_blk.h"
+#include "virtio.h"
+#include "block.h"
+#include "pci.h"
+#include "io.h"
+#include "interrupts.h"
+#include "spinlock.h"
+#include "klog.h"
+#include "kformat.h"
+
+struct VirtioBlkHeader {
+    u32 type;
+    u32 reserved;
+    u64 sector;
+};
+
+struct VirtioBlk {
+    BlockDevice block;
+    PciDevice* pci;
+    u16 io_base;
+    bool flush;                 // VIRTIO_BLK_F_FLUSH negotiated
+    Spinlock lock;              // the virtqueue, against the interrupt handler
+    Virtqueue vq;
+    VirtioBlkHeader* headers;   // per chain head, device reads
+    u8* status;                 // per chain head, device writes
+    u32 interrupts;
+};
+
+static VirtioBlk g_disks[VIRTIO_BLK_MAX_DEVICES];
+static u32 g_disk_count = 0;
+
+// Caller holds the lock. Re-arms the completion interrupt on the way out
+// and loops if more finished while it did.
+static void reap(VirtioBlk* disk) {
+    do {
+        u16 head;
+        BlockRequest* req;
+        while ((req = (BlockRequest*)virtq_get(&disk->vq, &head, nullptr))) {
+            u8 s = disk->status[head];
+            u8 result = s == VIRTIO_BLK_S_OK ? BLOCK_OK : s == VIRTIO_BLK_S_UNSUPP ? BLOCK_UNSUPPORTED : BLOCK_ERROR;
+            __atomic_store_n(&req->status, result, __ATOMIC_RELEASE);
+        }
+    } while (!virtq_enable_interrupts(&disk->vq));
+}
+
+// INTx may be shared: reading ISR both says whether this disk raised it
+// and deasserts the line
+static void virtio_blk_interrupt(InterruptFrame* frame) {
+    (void)frame;
+    for (u32 i = 0; i < g_disk_count; i++) {
+        VirtioBlk* disk = &g_disks[i];
+        if (!(inb(disk->io_base + VIRTIO_PCI_ISR) & 1)) continue;
+        disk->interrupts++;
+        disk->lock.lock();
+        reap(disk);
+        disk->lock.unlock();
+    }
+}
+
+static void virtio_blk_poll(BlockDevice* dev) {
+    VirtioBlk* disk = (VirtioBlk*)dev->driver_data;
+    u32 flags = disk->lock.lock_irqsave();
+    reap(disk);
+    disk->lock.unlock_irqrestore(flags);
+}
+
+// Each request is a chain: header, data segments, status byte. The
+// whole batch is published with one kick.
+static u32 virtio_blk_submit(BlockDevice* dev, BlockRequest** requests, u32 count) {
+    VirtioBlk* disk = (VirtioBlk*)dev->driver_data;
+    u32 flags = disk->lock.lock_irqsave();
+
+    u32 taken = 0;
+    for (; taken < count; taken++) {
+        BlockRequest* req = requests[taken];
+        u32 segments = req->op == BLOCK_FLUSH ? 0 : req->segment_count;
+        if (req->op == BLOCK_FLUSH && !disk->flush) {
+            req->status = BLOCK_OK;  // nothing to flush without the feature
+            continue;
+        }
+        if (segments > dev->max_segments || (req->op != BLOCK_FLUSH && segments == 0) ||
+            (req->op == BLOCK_WRITE && dev->read_only)) {
+            req->status = BLOCK_ERROR;
+            continue;
+        }
+        if (disk->vq.free_count < segments + 2) break;
+
+        u16 head = virtq_next_head(&disk->vq);
+        VirtioBlkHeader* header = &disk->headers[head];
+        header->type = req->op == BLOCK_READ ? VIRTIO_BLK_T_IN :
+                       req->op == BLOCK_WRITE ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_FLUSH;
+        header->reserved = 0;
+        header->sector = req->op == BLOCK_FLUSH ? 0 : req->sector;
+        disk->status[head] = 0xFF;
+
+        VirtqBuffer buffers[BLOCK_MAX_SEGMENTS + 2];
+        buffers[0].addr = header;
+        buffers[0].len = sizeof(VirtioBlkHeader);
+        for (u32 s = 0; s < segments; s++) {
+            buffers[1 + s].addr = req->segments[s].buffer;
+            buffers[1 + s].len = req->segments[s].length;
+        }
+        buffers[1 + segments].addr = &disk->status[head];
+        buffers[1 + segments].len = 1;
+        u32 out = req->op == BLOCK_WRITE ? 1 + segments : 1;
+        virtq_add(&disk->vq, buffers, out, segments + 2 - out, req);
+    }
+    virtq_kick(&disk->vq);
+
+    disk->lock.unlock_irqrestore(flags);
+    return taken;
+}
+
+static const BlockOps virtio_blk_ops = { virtio_blk_submit, virtio_blk_poll };
+
+static bool virtio_blk_probe(PciDevice* pci) {
+    if (g_disk_count == VIRTIO_BLK_MAX_DEVICES || pci->bars[0].type != PCI_BAR_IO) return false;
+
+    VirtioBlk* disk = &g_disks[g_disk_count];
+    u16 io = (u16)pci->bars[0].base;
+    pci_enable_device(pci);
+
+    outb(io + VIRTIO_PCI_STATUS, 0);  // reset
+    outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    u32 features = inl(io + VIRTIO_PCI_HOST_FEATURES) &
+                   (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | VIRTIO_BLK_F_RO |
+                    VIRTIO_BLK_F_FLUSH | VIRTIO_RING_F_EVENT_IDX);
+    outl(io + VIRTIO_PCI_GUEST_FEATURES, features);
+
+    if (!virtq_initialize(&disk->vq, io, 0, features & VIRTIO_RING_F_EVENT_IDX)) {
+        outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+        return false;
+    }
+    u16 size = disk->vq.size;
+    disk->headers = (VirtioBlkHeader*)kmalloc(size * sizeof(VirtioBlkHeader));
+    disk->status = (u8*)kmalloc(size);
+    if (!disk->headers || !disk->status || size < 3) {
+        if (disk->headers) kfree(disk->headers);
+        if (disk->status) kfree(disk->status);
+        virtq_destroy(&disk->vq);
+        outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_FAILED);
+        return false;
+    }
+
+    u16 config = io + VIRTIO_PCI_CONFIG;
+    u32 seg_max = (features & VIRTIO_BLK_F_SEG_MAX) ? inl(config + VIRTIO_BLK_CONFIG_SEG_MAX) : 0;
+    u32 size_max = (features & VIRTIO_BLK_F_SIZE_MAX) ? inl(config + VIRTIO_BLK_CONFIG_SIZE_MAX) : 0;
+    u32 max_segments = BLOCK_MAX_SEGMENTS;
+    if (seg_max && seg_max < max_segments) max_segments = seg_max;
+    if (size - 2u < max_segments) max_segments = size - 2;
+
+    BlockDevice* block = &disk->block;
+    ksnprintf(block->name, BLOCK_NAME_LEN, "vd%c", (char)('a' + g_disk_count));
+    block->sectors = inl(config + VIRTIO_BLK_CONFIG_CAPACITY) |
+                     ((u64)inl(config + VIRTIO_BLK_CONFIG_CAPACITY + 4) << 32);
+    block->max_segments = max_segments;
+    block->max_segment_size = size_max >= BLOCK_SECTOR_SIZE ? size_max : BLOCK_REQUEST_BYTES;
+    block->queue_depth = size / (max_segments + 2);
+    block->read_only = (features & VIRTIO_BLK_F_RO) != 0;
+    block->ops = &virtio_blk_ops;
+    block->driver_data = disk;
+    disk->pci = pci;
+    disk->io_base = io;
+    disk->flush = (features & VIRTIO_BLK_F_FLUSH) != 0;
+    disk->lock.initialize("virtio-blk");
+    g_disk_count++;
+
+    outb(io + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    // MSI if the device has it, else its INTx line through the PIC. With
+    // neither, requests still finish: block waits poll on every tick.
+    const char* irq = "polled";
+    if (pci_enable_msi(pci, virtio_blk_interrupt)) {
+        irq = "msi";
+    } else if (pci->irq_pin && pci->irq_line < 16) {
+        register_interrupt_handler(IRQ_BASE + pci->irq_line, virtio_blk_interrupt);
+        pic_unmask_irq(pci->irq_line);
+        irq = "intx";
+    }
+
+    block_register(block);
+    klogf(KLOG_INFO, "virtio-blk: %s %uMB q%u %s%s", block->name, (u32)(block->sectors >> 11), size, irq,
+          disk->vq.event_idx ? " evidx" : "");
+    return true;
+}
+
+static const PciDriver virtio_blk_driver = {
+    "virtio-blk", VIRTIO_PCI_VENDOR, VIRTIO_BLK_DEVICE_LEGACY, virtio_blk_probe
+};
+
+void virtio_blk_initialize() {
+    pci_register_driver(&virtio_blk_driver);
+}
@@ -0,0 +1,36 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "memory.h"
+
+// virtio-blk over legacy PCI (QEMU: -device virtio-blk-pci). One split
+// virtqueue per disk. A batch of block requests goes in with at most one
+// doorbell write, and completions are reaped from the interrupt handler
+// or from the block layer's poll. Disks register as vda, vdb.
+
+#define VIRTIO_BLK_DEVICE_LEGACY 0x1001
+#define VIRTIO_BLK_MAX_DEVICES 2
+
+// Feature bits
+#define VIRTIO_BLK_F_SIZE_MAX (1u << 1)
+#define VIRTIO_BLK_F_SEG_MAX  (1u << 2)
+#define VIRTIO_BLK_F_RO       (1u << 5)
+#define VIRTIO_BLK_F_FLUSH    (1u << 9)
+
+// Device config, from VIRTIO_PCI_CONFIG
+#define VIRTIO_BLK_CONFIG_CAPACITY 0   // u64, 512-byte sectors
+#define VIRTIO_BLK_CONFIG_SIZE_MAX 8
+#define VIRTIO_BLK_CONFIG_SEG_MAX  12
+
+// Request header types and the status byte the device writes back
+#define VIRTIO_BLK_T_IN     0
+#define VIRTIO_BLK_T_OUT    1
+#define VIRTIO_BLK_T_FLUSH  4
+#define VIRTIO_BLK_S_OK     0
+#define VIRTIO_BLK_S_IOERR  1
+#define VIRTIO_BLK_S_UNSUPP 2
+
+// Register the PCI driver; after pci_initialize
+void virtio_blk_initialize();
+
+#endif